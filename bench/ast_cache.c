@@ -0,0 +1,78 @@
+/* the front end against the AST cache: a generated file lexed and parsed
+ * from scratch, then its nodes read back from the cache file
+ */
+#include "../src/astcache.h"
+#include "bench.h"
+#include <unistd.h>
+
+#define CORPUS_SIZE (4 << 20)
+#define ROUNDS 5
+
+static const char *func = "static int helper%d(int a, char *s) {\n"
+                          "  if ((a & 255) == %d && s[a + 1] != 0) {\n"
+                          "    return puts(\"helper\") + (a << 2) * %d;\n"
+                          "  }\n"
+                          "  return s[a - 1] == 'x' ? a / 3 : -1;\n"
+                          "}\n";
+
+int main() {
+  char *src = xalloc(CORPUS_SIZE + 256);
+  int len = 0;
+  for (int i = 0; len < CORPUS_SIZE; ++i) {
+    len += sprintf(src + len, func, i, i % 256, i % 9);
+  }
+  char dir[] = "/tmp/vcc_bench_cache_XXXXXX";
+  if (!mkdtemp(dir)) {
+    fatals("could not make a cache directory\n");
+  }
+
+  double best_parse = 1e30, best_load = 1e30, store = 0;
+  int count = 0;
+  size_t size = 0;
+  for (int r = 0; r < ROUNDS; ++r) {
+    double start = bench_now();
+    uint64_t hash = vcc_ast_hash(0, src, len);
+    vcc_lexer_t *lexer = vcc_lexer_new_from_mem("bench", src, len);
+    vcc_tokbuf_t *tokens = vcc_lex_all(lexer);
+    vcc_node_t **nodes = xalloc(tokens->count * sizeof(vcc_node_t *));
+    count = 0;
+    vcc_parser_init_tokens(lexer, tokens);
+    while (vcc_parser_continuable()) {
+      nodes[count++] = vcc_parse();
+    }
+    double t = bench_now() - start;
+    best_parse = t < best_parse ? t : best_parse;
+    if (r == 0) {
+      start = bench_now();
+      vcc_ast_cache_store(dir, hash, lexer->symtbl, nodes, count);
+      store = bench_now() - start;
+    }
+    vcc_parser_finish();
+    xfree(nodes);
+    vcc_tokbuf_free(tokens);
+    vcc_lexer_free(lexer);
+
+    start = bench_now();
+    hash = vcc_ast_hash(0, src, len);
+    vcc_symtbl_t *symtbl = vcc_symtbl_new();
+    vcc_cached_ast_t *ast = vcc_ast_cache_load(dir, hash, symtbl);
+    t = bench_now() - start;
+    best_load = t < best_load ? t : best_load;
+    size = ast ? ast->size : 0;
+    vcc_cached_ast_free(ast);
+    vcc_symtbl_free(symtbl);
+  }
+  fprintf(stderr, "%.1f MB, %d nodes, %.1f MB cached in %.3f s\n", len / 1e6,
+          count, size / 1e6, store);
+  fprintf(stderr, "lex and parse: %.3f s\n", best_parse);
+  fprintf(stderr, "hash and load: %.3f s, %.1fx\n", best_load,
+          best_parse / best_load);
+
+  char path[256];
+  snprintf(path, sizeof(path), "%s/%016llx.ast", dir,
+           (unsigned long long)vcc_ast_hash(0, src, len));
+  unlink(path);
+  rmdir(dir);
+  xfree(src);
+  return 0;
+}
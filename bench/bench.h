@@ -0,0 +1,45 @@
+#ifndef _BENCH_H_
+#define _BENCH_H_
+
+#include "../src/lexer.h"
+#include <time.h>
+
+/* seconds on a monotonic clock
+ */
+static inline double bench_now() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* lexes `len` bytes at `src` to the end, returns the number of tokens
+ */
+static inline long bench_lex(const char *src, int len) {
+  vcc_lexer_t *lexer = vcc_lexer_new_from_mem("bench", src, len);
+  long ntokens = 0;
+  vtoken_t *t;
+  while ((t = vcc_lex(lexer)) && t->type != TOKEN_EOF) {
+    vtoken_free(lexer, t);
+    ++ntokens;
+  }
+  vcc_lexer_free(lexer);
+  return ntokens;
+}
+
+/* runs `bench_lex` `rounds` times and prints the best throughput
+ */
+static inline void bench_report_lex(const char *name, const char *src,
+                                    int len, int rounds) {
+  double best = 1e30;
+  long ntokens = 0;
+  for (int i = 0; i < rounds; ++i) {
+    double start = bench_now();
+    ntokens = bench_lex(src, len);
+    double t = bench_now() - start;
+    best = t < best ? t : best;
+  }
+  printf("%s: %.1f MB, %ld tokens, %.3f s, %.1f MB/s, %.1f Mtokens/s\n", name,
+         len / 1e6, ntokens, best, len / best / 1e6, ntokens / best / 1e6);
+}
+
+#endif
@@ -0,0 +1,123 @@
+/* expression trees against the same expressions in a pool: bytes taken,
+ * and every expression of a generated file evaluated by walking the trees
+ * and by one pass over the pool
+ */
+#include "../src/parser.h"
+#include "bench.h"
+
+#define CORPUS_SIZE (4 << 20)
+#define MAX_DEPTH 8
+#define ROUNDS 20
+
+static const char *binary[] = {" + ", " - ", " * ", " / ", " == ", " < "};
+
+static void generate(buf_t *out, int depth) {
+  int pick = depth >= MAX_DEPTH ? 0 : rand() % 6;
+  switch (pick) {
+  case 0:
+    // names keep the constants around them from being folded
+    if (rand() % 2) {
+      out->len += sprintf(out->s + out->len, "x");
+    } else {
+      out->len += sprintf(out->s + out->len, "%d", rand() % 1000);
+    }
+    break;
+  case 1:
+    out->len += sprintf(out->s + out->len, "- (");
+    generate(out, depth + 1);
+    out->len += sprintf(out->s + out->len, ")");
+    break;
+  default:
+    out->len += sprintf(out->s + out->len, "(");
+    generate(out, depth + 1);
+    out->len += sprintf(out->s + out->len, "%s", binary[rand() % 6]);
+    generate(out, depth + 1);
+    out->len += sprintf(out->s + out->len, ")");
+    break;
+  }
+}
+
+int main() {
+  buf_t *src = buf_new(CORPUS_SIZE + (64 << 10));
+  srand(1);
+  while (src->len < CORPUS_SIZE) {
+    src->len += sprintf(src->s + src->len, "return ");
+    generate(src, 0);
+    src->len += sprintf(src->s + src->len, ";\n");
+  }
+
+  vcc_lexer_t *lexer = vcc_lexer_new_from_mem("bench", src->s, src->len);
+  vcc_tokbuf_t *tokens = vcc_lex_all(lexer);
+  vcc_parser_init_tokens(lexer, tokens);
+  int cap = 1024, n = 0;
+  vcc_expr_t **trees = xalloc(cap * sizeof(vcc_expr_t *));
+  while (vcc_parser_continuable()) {
+    vcc_node_t *node = vcc_parse();
+    if (!node) {
+      continue;
+    }
+    if (n == cap) {
+      vcc_expr_t **grown = xalloc(2 * cap * sizeof(vcc_expr_t *));
+      memcpy(grown, trees, cap * sizeof(vcc_expr_t *));
+      xfree(trees);
+      trees = grown;
+      cap *= 2;
+    }
+    trees[n++] = node->value.stmt->expr;
+  }
+
+  double start = bench_now();
+  vcc_expr_pool_t *pool = vcc_expr_pool_new();
+  uint32_t *roots = xalloc(n * sizeof(uint32_t));
+  for (int i = 0; i < n; ++i) {
+    roots[i] = vcc_expr_pool_add(pool, trees[i]);
+  }
+  double copy = bench_now() - start;
+  long nexprs = pool->count - 1;
+  // arena allocations are rounded up to 16 bytes
+  size_t tree_bytes = nexprs * ((sizeof(vcc_expr_t) + 15) & ~(size_t)15);
+  size_t pool_bytes =
+      nexprs * sizeof(vcc_xnode_t) + pool->nliterals * sizeof(int);
+  fprintf(stderr,
+          "%.1f MB, %d expressions of %ld nodes: trees %.1f MB, pool %.1f MB, "
+          "copied in %.3f s\n",
+          src->len / 1e6, n, nexprs, tree_bytes / 1e6, pool_bytes / 1e6,
+          copy);
+
+  double best_tree = 1e30, best_pool = 1e30;
+  long sum_tree = 0, sum_pool = 0;
+  int *values = xalloc(pool->count * sizeof(int));
+  for (int r = 0; r < ROUNDS; ++r) {
+    start = bench_now();
+    sum_tree = 0;
+    for (int i = 0; i < n; ++i) {
+      sum_tree += vcc_expr_eval(trees[i]);
+    }
+    double t = bench_now() - start;
+    best_tree = t < best_tree ? t : best_tree;
+
+    start = bench_now();
+    vcc_expr_pool_eval(pool, values);
+    sum_pool = 0;
+    for (int i = 0; i < n; ++i) {
+      sum_pool += values[roots[i]];
+    }
+    t = bench_now() - start;
+    best_pool = t < best_pool ? t : best_pool;
+  }
+  fprintf(stderr, "eval: trees %.4f s, %.1f Mnodes/s\n", best_tree,
+          nexprs / best_tree / 1e6);
+  fprintf(stderr, "eval: pool %.4f s, %.1f Mnodes/s, %.1fx%s\n", best_pool,
+          nexprs / best_pool / 1e6, best_tree / best_pool,
+          sum_tree == sum_pool ? "" : ", VALUES DIFFER");
+
+  xfree(values);
+  xfree(roots);
+  vcc_expr_pool_free(pool);
+  xfree(trees);
+  vcc_parser_finish();
+  vcc_tokbuf_free(tokens);
+  vcc_lexer_free(lexer);
+  buf_free(src);
+  return 0;
+}
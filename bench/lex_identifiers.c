@@ -0,0 +1,35 @@
+/* identifier lexing throughput on a corpus made of identifiers, keywords
+ * and identifiers that share a prefix with a keyword
+ */
+#include "bench.h"
+
+#define CORPUS_SIZE (16 << 20)
+#define ROUNDS 5
+
+static const char *words[] = {
+    "if",      "iffy",     "int",     "integer",  "return", "returned",
+    "do",      "double",   "doubles", "while",    "struct", "structure",
+    "static",  "unsigned", "const",   "constant", "for",    "format",
+    "sizeof",  "typedef",  "_Bool",   "NULL",     "char",   "charset",
+    "default", "void",     "else",    "elsewhere"};
+
+int main() {
+  char *src = xalloc(CORPUS_SIZE + 64);
+  int len = 0;
+  srand(1);
+  while (len < CORPUS_SIZE) {
+    if (rand() % 2) {
+      const char *w = words[rand() % (sizeof(words) / sizeof(*words))];
+      len += sprintf(src + len, "%s", w);
+    } else {
+      int n = 1 + rand() % 16;
+      for (int i = 0; i < n; ++i) {
+        src[len++] = i == 0 ? 'a' + rand() % 26 : "abcxyz_019"[rand() % 10];
+      }
+    }
+    src[len++] = rand() % 8 ? ' ' : '\n';
+  }
+  bench_report_lex("identifiers", src, len, ROUNDS);
+  xfree(src);
+  return 0;
+}
@@ -0,0 +1,28 @@
+/* lexing throughput on C-like code that mixes identifiers, numbers,
+ * operators, punctuation and whitespace
+ */
+#include "bench.h"
+
+#define CORPUS_SIZE (16 << 20)
+#define ROUNDS 5
+
+static const char *lines[] = {
+    "  if (a%d <= b && c != %d) {\n",
+    "    x[i] = (y * %d + z) / w - v % 3;\n",
+    "    p->next = q; q += %d; r -= s;\n",
+    "    flags |= mask & %d; count++; --left;\n",
+    "    return foo(a, b, %d) == bar.baz || !done;\n",
+    "  } else { total = total >= %d; limit = 0; }\n",
+};
+
+int main() {
+  char *src = xalloc(CORPUS_SIZE + 256);
+  int len = 0;
+  srand(1);
+  while (len < CORPUS_SIZE) {
+    len += sprintf(src + len, lines[rand() % 6], rand() % 1000);
+  }
+  bench_report_lex("mixed", src, len, ROUNDS);
+  xfree(src);
+  return 0;
+}
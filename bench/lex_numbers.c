@@ -0,0 +1,39 @@
+/* lexing throughput on numeric-heavy code: generated lookup tables of
+ * decimal, hex and octal integers with suffixes and of floats with and
+ * without exponents
+ */
+#include "bench.h"
+
+#define CORPUS_SIZE (16 << 20)
+#define ROUNDS 5
+
+int main() {
+  char *src = xalloc(CORPUS_SIZE + 256);
+  int len = 0;
+  srand(1);
+  while (len < CORPUS_SIZE) {
+    unsigned r = rand();
+    switch (r % 4) {
+    case 0:
+      len += sprintf(src + len, "  %u, %uu, %ldL, 0x%08x, 0%o,\n", r,
+                     r >> 3, (long)r * 7919, r * 2654435761u, r & 0777);
+      break;
+    case 1:
+      len += sprintf(src + len, "  %d.%06d, %.17e, %.8ef, %de-%d,\n",
+                     r % 1000, r % 1000000, r / 3.0, r / 7.0f, r % 977,
+                     r % 30);
+      break;
+    case 2:
+      len += sprintf(src + len, "  %ull, 0x%xULL, %d, %d, %d, %d,\n", r,
+                     r, r % 10, r % 100, r % 1000, r % 10000);
+      break;
+    default:
+      len += sprintf(src + len, "  %.3f, %.6e, .%d, %d., 1e%d,\n",
+                     r / 1e6, r * 1e-9, r % 100, r % 100, r % 300);
+      break;
+    }
+  }
+  bench_report_lex("numbers", src, len, ROUNDS);
+  xfree(src);
+  return 0;
+}
@@ -0,0 +1,57 @@
+/* lexing one large file in speculative chunks on every core against
+ * vcc_lex_all() on one, on code with a long comment every few hundred lines
+ * so some chunks guess wrong
+ */
+#include "bench.h"
+#include <unistd.h>
+
+#define CORPUS_SIZE (32 << 20)
+#define ROUNDS 5
+
+static const char *lines[] = {
+    "  if (a%d <= b && c != 0x%x) {\n",
+    "    s = \"a string\"; x[i] = (y * %d + z) / w - v %% 3;\n",
+    "    p->next = q; q += %d; r -= 1.5e%d;\n",
+    "  } else { total = total >= %d; limit = 0; } // done\n",
+};
+
+/* lexes `src` serially or in `nchunks` chunks, returns the best time
+ */
+static double report(const char *name, const char *src, int len,
+                     int nchunks) {
+  double best = 1e30;
+  int count = 0, relexed = 0;
+  for (int i = 0; i < ROUNDS; ++i) {
+    vcc_lexer_t *lexer = vcc_lexer_new_from_mem("bench", src, len);
+    double start = bench_now();
+    vcc_tokbuf_t *tokens = nchunks
+                               ? vcc_lex_all_parallel(lexer, nchunks, &relexed)
+                               : vcc_lex_all(lexer);
+    double t = bench_now() - start;
+    best = t < best ? t : best;
+    count = tokens->count;
+    vcc_tokbuf_free(tokens);
+    vcc_lexer_free(lexer);
+  }
+  printf("%s: %.1f MB, %d tokens, %d chunks relexed, %.3f s, %.1f MB/s\n",
+         name, len / 1e6, count, relexed, best, len / best / 1e6);
+  return best;
+}
+
+int main() {
+  char *src = xalloc(CORPUS_SIZE + 256);
+  int len = 0;
+  srand(1);
+  while (len < CORPUS_SIZE) {
+    if (rand() % 500 == 0) {
+      len += sprintf(src + len, "/* a comment\n * of a few\n * lines\n */\n");
+    }
+    len += sprintf(src + len, lines[rand() % 4], rand() % 1000, rand() % 9);
+  }
+  long ncores = sysconf(_SC_NPROCESSORS_ONLN);
+  double serial = report("serial", src, len, 0);
+  double parallel = report("parallel", src, len, ncores > 1 ? ncores : 2);
+  printf("speedup on %ld cores: %.2fx\n", ncores, serial / parallel);
+  xfree(src);
+  return 0;
+}
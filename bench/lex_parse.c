@@ -0,0 +1,84 @@
+/* lex+parse time when the parser pulls tokens one at a time from the lexer
+ * against lexing the whole file into a token buffer first, and against a
+ * lexer thread feeding the parser through a ring, with its speedup
+ */
+#include "../src/parser.h"
+#include "bench.h"
+
+#define CORPUS_SIZE (4 << 20)
+#define ROUNDS 5
+
+static const char *lines[] = {
+    "return %d + 2 * (3 - 4) / 5;\n",
+    "if (%d == 1 + 2 * 3) {\n}\n",
+    "return (%d) * (1 + 2) == 7 * 8 - 9;\n",
+};
+
+static long parse() {
+  long nodes = 0;
+  while (vcc_parser_continuable()) {
+    vcc_node_t *node = vcc_parse();
+    nodes += node != NULL;
+  }
+  vcc_parser_finish();
+  return nodes;
+}
+
+static long streamed(const char *src, int len) {
+  vcc_lexer_t *lexer = vcc_lexer_new_from_mem("bench", src, len);
+  vcc_parser_init(lexer);
+  long nodes = parse();
+  vcc_lexer_free(lexer);
+  return nodes;
+}
+
+static long buffered(const char *src, int len) {
+  vcc_lexer_t *lexer = vcc_lexer_new_from_mem("bench", src, len);
+  vcc_tokbuf_t *tokens = vcc_lex_all(lexer);
+  vcc_parser_init_tokens(lexer, tokens);
+  long nodes = parse();
+  vcc_tokbuf_free(tokens);
+  vcc_lexer_free(lexer);
+  return nodes;
+}
+
+static long piped(const char *src, int len) {
+  vcc_lexer_t *lexer = vcc_lexer_new_from_mem("bench", src, len);
+  vcc_lex_pipe_t *pipe = vcc_lex_pipe_start(lexer, 0);
+  vcc_parser_init_pipe(lexer, pipe);
+  long nodes = parse();
+  vcc_lex_pipe_free(pipe);
+  vcc_lexer_free(lexer);
+  return nodes;
+}
+
+static double report(const char *name, long (*run)(const char *, int),
+                     const char *src, int len) {
+  double best = 1e30;
+  long nodes = 0;
+  for (int i = 0; i < ROUNDS; ++i) {
+    double start = bench_now();
+    nodes = run(src, len);
+    double t = bench_now() - start;
+    best = t < best ? t : best;
+  }
+  fprintf(stderr, "%s: %.1f MB, %ld nodes, %.3f s, %.1f MB/s\n", name,
+          len / 1e6, nodes, best, len / best / 1e6);
+  return best;
+}
+
+int main() {
+  char *src = xalloc(CORPUS_SIZE + 256);
+  int len = 0;
+  srand(1);
+  while (len < CORPUS_SIZE) {
+    len += sprintf(src + len, lines[rand() % 3], rand() % 1000);
+  }
+  double serial = report("streamed", streamed, src, len);
+  report("buffered", buffered, src, len);
+  double overlapped = report("piped", piped, src, len);
+  fprintf(stderr, "piped speedup over streamed: %.2fx\n",
+          serial / overlapped);
+  xfree(src);
+  return 0;
+}
@@ -0,0 +1,69 @@
+/* a unit including a header of many static helpers and calling a few of
+ * them: every body parsed against bodies skimmed and parsed when called
+ */
+#include "../src/parser.h"
+#include "bench.h"
+
+#define HELPERS 20000
+#define CALLED 20
+
+static const char *helper = "static inline int helper%d(int a, int b) {\n"
+                            "  if ((a & %d) != 0 && b > %d) {\n"
+                            "    return (a << 2) + b * %d;\n"
+                            "  }\n"
+                            "  return f(a - 1, b[a + %d]) | 255;\n"
+                            "}\n";
+
+typedef struct {
+  double time;
+  size_t bytes;
+  int bodies;
+} run_t;
+
+static run_t parse(vcc_tokbuf_t *tokens, int lazy) {
+  run_t run = {0};
+  arena_t *arena = arena_new(AST_ARENA_CHUNK_SIZE);
+  double start = bench_now();
+  vcc_parser_init_tokens(NULL, tokens);
+  vcc_parser_set_arena(arena);
+  vcc_parser_lazy_bodies(lazy);
+  int n = 0;
+  while (vcc_parser_continuable()) {
+    vcc_node_t *node = vcc_parse();
+    if (!node || node->type != VCC_NODE_FUNC) {
+      continue;
+    }
+    // the unit calls every HELPERS / CALLED-th helper
+    if (n++ % (HELPERS / CALLED) == 0) {
+      run.bodies += vcc_func_body(node->value.func) != NULL;
+    }
+  }
+  vcc_parser_finish();
+  run.time = bench_now() - start;
+  run.bytes = arena->used;
+  arena_free(arena);
+  return run;
+}
+
+int main() {
+  buf_t *src = buf_new(HELPERS * 256);
+  for (int i = 0; i < HELPERS; ++i) {
+    src->len += sprintf(src->s + src->len, helper, i, i % 64, i, i % 9, i);
+  }
+  vcc_lexer_t *lexer = vcc_lexer_new_from_mem("bench", src->s, src->len);
+  vcc_tokbuf_t *tokens = vcc_lex_all(lexer);
+
+  run_t full = parse(tokens, 0);
+  run_t lazy = parse(tokens, 1);
+  fprintf(stderr, "%.1f MB, %d tokens, %d helpers, %d called\n",
+          src->len / 1e6, tokens->count, HELPERS, lazy.bodies);
+  fprintf(stderr, "full: %.3f s, %.1f MB of AST\n", full.time,
+          full.bytes / 1e6);
+  fprintf(stderr, "lazy: %.3f s, %.1f MB of AST, %.1fx faster\n", lazy.time,
+          lazy.bytes / 1e6, full.time / lazy.time);
+
+  vcc_tokbuf_free(tokens);
+  vcc_lexer_free(lexer);
+  buf_free(src);
+  return 0;
+}
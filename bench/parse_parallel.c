@@ -0,0 +1,56 @@
+/* a generated file of top-level bodies parsed serially and on more and
+ * more threads, from one token buffer
+ */
+#include "../src/parser.h"
+#include "bench.h"
+#include <unistd.h>
+
+#define CORPUS_SIZE (8 << 20)
+
+static const char *body = "if (a < %d) {\n"
+                          "return (a * 2 + %d) & 255;\n"
+                          "if ((b[a + 1] >> 8) != 0) {\n"
+                          "return f(a, %d, b[a - 1]) - 1;\n"
+                          "}\n"
+                          "}\n";
+
+int main() {
+  char *src = xalloc(CORPUS_SIZE + 256);
+  int len = 0;
+  for (int i = 0; len < CORPUS_SIZE; ++i) {
+    len += sprintf(src + len, body, i, i, i);
+  }
+  vcc_lexer_t *lexer = vcc_lexer_new_from_mem("bench", src, len);
+  vcc_tokbuf_t *tokens = vcc_lex_all(lexer);
+
+  arena_t *arena = arena_new(AST_ARENA_CHUNK_SIZE);
+  double start = bench_now();
+  vcc_parser_init_tokens(lexer, tokens);
+  vcc_parser_set_arena(arena);
+  long nodes = 0;
+  while (vcc_parser_continuable()) {
+    vcc_parse();
+    ++nodes;
+  }
+  vcc_parser_finish();
+  double serial = bench_now() - start;
+  arena_free(arena);
+  fprintf(stderr, "%.1f MB, %d tokens, %ld nodes, %ld cores\n", len / 1e6,
+          tokens->count, nodes, sysconf(_SC_NPROCESSORS_ONLN));
+  fprintf(stderr, "serial: %.3f s\n", serial);
+
+  static const int threads[] = {1, 2, 4, 8};
+  for (size_t t = 0; t < sizeof(threads) / sizeof(*threads); ++t) {
+    start = bench_now();
+    vcc_forest_t *forest = vcc_parse_all(lexer, tokens, threads[t]);
+    double time = bench_now() - start;
+    fprintf(stderr, "%d threads: %.3f s, %.2fx%s\n", threads[t], time,
+            serial / time, forest->count == nodes ? "" : ", NODES DIFFER");
+    vcc_forest_free(forest);
+  }
+
+  vcc_tokbuf_free(tokens);
+  vcc_lexer_free(lexer);
+  xfree(src);
+  return 0;
+}
@@ -0,0 +1,82 @@
+/* preprocessing many translation units that include the same large
+ * guarded header: the first one lexes it, all others find it in the
+ * include cache and skip it or replay its tokens
+ */
+#include "../src/preproc.h"
+#include "bench.h"
+#include <unistd.h>
+
+#define HEADER_DECLS 20000
+#define UNITS 200
+
+/* writes a header of `HEADER_DECLS` declarations and macros to `path`,
+ * `guarded` wraps it in an include guard
+ */
+static void write_header(const char *path, int guarded) {
+  FILE *fp = fopen(path, "w");
+  if (guarded) {
+    fprintf(fp, "#ifndef BENCH_H\n#define BENCH_H\n");
+  }
+  for (int i = 0; i < HEADER_DECLS; ++i) {
+    fprintf(fp, "#define M%d(x) ((x) * %d + M%d)\nint f%d(int a, long b);\n",
+            i, i, i ? i - 1 : 0, i);
+  }
+  if (guarded) {
+    fprintf(fp, "#endif\n");
+  }
+  fclose(fp);
+}
+
+/* preprocesses `UNITS` units that include `header` twice, returns
+ * the tokens they gave in total
+ */
+static long preprocess(const char *header, double *first) {
+  char src[256];
+  int len = snprintf(src, sizeof(src),
+                     "#include \"%s\"\n#include \"%s\"\n"
+                     "int main() { return M3(2); }\n",
+                     header, header);
+  long ntokens = 0;
+  for (int i = 0; i < UNITS; ++i) {
+    double start = bench_now();
+    vcc_lexer_t *lexer = vcc_lexer_new_from_mem("unit.c", src, len);
+    vcc_pp_t *pp = vcc_pp_new();
+    vcc_tokbuf_t *tokens = vcc_pp_run(pp, lexer);
+    ntokens += tokens->count;
+    vcc_tokbuf_free(tokens);
+    vcc_pp_free(pp);
+    vcc_lexer_free(lexer);
+    if (!i) {
+      *first = bench_now() - start;
+    }
+  }
+  return ntokens;
+}
+
+static void report(const char *name, const char *header) {
+  double first;
+  double start = bench_now();
+  long ntokens = preprocess(header, &first);
+  double t = bench_now() - start;
+  printf("%s: %d units, %ld tokens, first %.2f ms, then %.3f ms per unit\n",
+         name, UNITS, ntokens, first * 1e3,
+         (t - first) / (UNITS - 1) * 1e3);
+}
+
+int main() {
+  char guarded[] = "/tmp/vcc_bench_guarded_XXXXXX.h";
+  char plain[] = "/tmp/vcc_bench_plain_XXXXXX.h";
+  close(mkstemps(guarded, 2));
+  close(mkstemps(plain, 2));
+  write_header(guarded, 1);
+  write_header(plain, 0);
+  // without a guard the second include of each unit is replayed too
+  report("guarded header", guarded);
+  report("plain header", plain);
+  vcc_pp_stats_t stats = vcc_pp_stats();
+  printf("cache: %ld lexed, %ld replayed, %ld skipped\n", stats.lexed,
+         stats.replayed, stats.skipped);
+  unlink(guarded);
+  unlink(plain);
+  return 0;
+}
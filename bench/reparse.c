@@ -0,0 +1,54 @@
+/* an editor's keystrokes on a large file: a unit edited one char at a time
+ * against lexing and parsing the whole text again after each
+ */
+#include "../src/parser.h"
+#include "bench.h"
+
+#define CORPUS_SIZE (4 << 20)
+#define EDITS 200
+
+static const char *lines[] = {
+    "return %d + 2 * (3 - 4) / 5;\n",
+    "if (%d == 1 + 2 * 3) {\n}\n",
+    "/* return (%d) * (1 + 2) == 7 * 8 - 9; */\n",
+};
+
+int main() {
+  char *src = xalloc(CORPUS_SIZE + 256);
+  int len = 0;
+  srand(1);
+  while (len < CORPUS_SIZE) {
+    len += sprintf(src + len, lines[rand() % 3], rand() % 1000);
+  }
+
+  double start = bench_now();
+  vcc_unit_t *unit = vcc_unit_new("bench", src, len);
+  double full = bench_now() - start;
+  fprintf(stderr, "full: %.1f MB, %d tokens, %d nodes, %.3f s\n", len / 1e6,
+          unit->tokens->count, unit->count, full);
+
+  vcc_reuse_t total = {0};
+  start = bench_now();
+  for (int i = 0; i < EDITS; ++i) {
+    // type a digit over another one
+    char *at = unit->src->s + rand() % unit->src->len;
+    while (*at < '0' || *at > '9') {
+      at = at + 1 < unit->src->s + unit->src->len ? at + 1 : unit->src->s;
+    }
+    vcc_edit_t edit = {
+        .offset = at - unit->src->s, .removed = 1, .text = "7", .len = 1};
+    vcc_reuse_t reuse;
+    vcc_unit_edit(unit, &edit, &reuse);
+    total.tokens_lexed += reuse.tokens_lexed;
+    total.nodes_parsed += reuse.nodes_parsed;
+  }
+  double edits = (bench_now() - start) / EDITS;
+  fprintf(stderr,
+          "edit: %.1f tokens lexed, %.1f nodes parsed, %.6f s, %.0fx faster "
+          "than full\n",
+          (double)total.tokens_lexed / EDITS,
+          (double)total.nodes_parsed / EDITS, edits, full / edits);
+  vcc_unit_free(unit);
+  xfree(src);
+  return 0;
+}
@@ -0,0 +1,65 @@
+/* hash-consing on generated code full of the same index computations and
+ * masks: expressions built against the ones allocated, and the AST bytes
+ * and parse time with and without sharing
+ */
+#include "../src/parser.h"
+#include "bench.h"
+
+#define CORPUS_SIZE (4 << 20)
+
+static const char *lines[] = {
+    "return (buf[(i + %d) & 255] >> 8 & 255) + (buf[(i + 1) & 255] & 255);\n",
+    "return buf[i * 4 + %d] | buf[i * 4 + 1] << 8 | buf[i * 4 + 2] << 16;\n",
+    "if ((flags & %d) != 0 && (flags & 16) == 0) {\n}\n",
+    "return f(i + %d) + f(i + 1) * (n - 1);\n",
+};
+
+typedef struct {
+  double time;
+  size_t bytes;
+  vcc_share_stats_t stats;
+} run_t;
+
+static run_t parse(vcc_tokbuf_t *tokens, int share) {
+  run_t run;
+  arena_t *arena = arena_new(AST_ARENA_CHUNK_SIZE);
+  double start = bench_now();
+  vcc_parser_init_tokens(NULL, tokens);
+  vcc_parser_set_arena(arena);
+  vcc_parser_share_exprs(share);
+  while (vcc_parser_continuable()) {
+    vcc_parse();
+  }
+  run.stats = vcc_parser_share_stats();
+  vcc_parser_finish();
+  run.time = bench_now() - start;
+  run.bytes = arena->used;
+  arena_free(arena);
+  return run;
+}
+
+int main() {
+  char *src = xalloc(CORPUS_SIZE + 256);
+  int len = 0;
+  srand(1);
+  while (len < CORPUS_SIZE) {
+    len += sprintf(src + len, lines[rand() % 4], rand() % 16);
+  }
+  vcc_lexer_t *lexer = vcc_lexer_new_from_mem("bench", src, len);
+  vcc_tokbuf_t *tokens = vcc_lex_all(lexer);
+
+  run_t plain = parse(tokens, 0);
+  run_t shared = parse(tokens, 1);
+  fprintf(stderr, "%.1f MB, %ld expressions built, %ld allocated, %.1fx\n",
+          len / 1e6, shared.stats.built, shared.stats.allocated,
+          (double)shared.stats.built / shared.stats.allocated);
+  fprintf(stderr, "plain: %.1f MB of AST, %.3f s\n", plain.bytes / 1e6,
+          plain.time);
+  fprintf(stderr, "shared: %.1f MB of AST, %.3f s\n", shared.bytes / 1e6,
+          shared.time);
+
+  vcc_tokbuf_free(tokens);
+  vcc_lexer_free(lexer);
+  xfree(src);
+  return 0;
+}
@@ -1,36 +1,84 @@
 #include "src/lexer.h"
 #include "src/mem.h"
 #include "src/parser.h"
+#include "src/preproc.h"
+#include "src/trace.h"
 
-int print_token(vtoken_t *t) {
+int print_token(vcc_lexer_t *lexer, vtoken_t *t) {
   printf("(%s", token_names[t->type]);
   switch (t->type) {
   case TOKEN_INT:
-    printf(": %d)\n", t->value.i);
+    printf(": %lld)\n", (long long)t->value.i);
     break;
   case TOKEN_FLOAT:
     printf(": %f)\n", t->value.f);
     break;
   default:
-    if (t->value.s)
-      printf(": \"%s\")\n", t->value.s->s);
+    printf(": \"%.*s\")\n", t->len, vtoken_view(lexer, t));
     break;
   }
   return 0;
 }
 
+/* `-` reads the source from stdin
+ */
+int is_stdin(char *fname) { return !strcmp(fname, "-"); }
+
 void test_lexer(char *fname) {
   vtoken_t *t;
-  vcc_lexer_init(fname);
+  int type;
+  vcc_lexer_t *lexer = is_stdin(fname)
+                           ? vcc_lexer_new_stream("<stdin>", stdin, 0)
+                           : vcc_lexer_new_mmap(fname);
   do {
-    t = vcc_lex();
+    t = vcc_lex(lexer);
     if (t == NULL) {
-      return;
+      break;
+    }
+    print_token(lexer, t);
+    type = t->type;
+    vtoken_free(lexer, t);
+  } while (type != TOKEN_EOF);
+  vcc_lexer_free(lexer);
+}
+
+/* -I<dir> arguments after the file name
+ */
+static char **include_dirs;
+static int ninclude_dirs;
+
+vcc_pp_t *new_preproc() {
+  vcc_pp_t *pp = vcc_pp_new();
+  for (int i = 0; i < ninclude_dirs; ++i) {
+    if (!strncmp(include_dirs[i], "-I", 2)) {
+      vcc_pp_add_include_dir(pp, include_dirs[i] + 2);
+    }
+  }
+  return pp;
+}
+
+/* prints the tokens left after preprocessing, the spellings of keywords
+ * and punctuations come from the table, tokens may be from any file
+ */
+void test_preproc(char *fname) {
+  vcc_lexer_t *lexer = is_stdin(fname)
+                           ? vcc_lexer_new_stream("<stdin>", stdin, 0)
+                           : vcc_lexer_new_mmap(fname);
+  vcc_pp_t *pp = new_preproc();
+  vcc_tokbuf_t *tokens = vcc_pp_run(pp, lexer);
+  for (int i = 0; i < tokens->count; ++i) {
+    vtoken_t t;
+    vcc_tokbuf_get(tokens, i, &t);
+    if (vtoken_has_atom(&t) || t.type == TOKEN_INT || t.type == TOKEN_FLOAT) {
+      print_token(lexer, &t);
+    } else {
+      printf("(%s: \"%s\")\n", token_names[t.type],
+             t.type == TOKEN_EOF ? "" : token_spellings[t.type]);
     }
-    print_token(t);
-    vtoken_free(t);
-  } while (t->type != TOKEN_EOF);
-  vcc_lexer_finish();
+  }
+  vcc_tokbuf_free(tokens);
+  vcc_pp_free(pp);
+  vcc_lexer_free(lexer);
 }
 
 void node_inspect(vcc_node_t *node) {
@@ -38,7 +86,15 @@ void node_inspect(vcc_node_t *node) {
     return;
 
   printf("parsed node %s\n", node_types[node->type]);
-  if (node->type == VCC_NODE_STMT) {
+  if (node->type == VCC_NODE_FUNC) {
+    vcc_block_t *body = vcc_func_body(node->value.func);
+    printf("arity: %d, statements: %d\n", node->value.func->arity,
+           body ? body->count : 0);
+    for (vcc_node_t *stmt = body ? body->nodes : NULL; stmt;
+         stmt = stmt->next) {
+      node_inspect(stmt);
+    }
+  } else if (node->type == VCC_NODE_STMT) {
     printf("stmt type: %s\n", stmt_types[node->value.stmt->type]);
     vcc_expr_print(node->value.stmt->expr, 2);
     vcc_expr_print(node->value.stmt->condition, 2);
@@ -46,29 +102,91 @@ void node_inspect(vcc_node_t *node) {
 }
 
 void test_parser(char *fname) {
-  vcc_lexer_init(fname);
-  vcc_parser_init();
+  vcc_lexer_t *lexer = is_stdin(fname)
+                           ? vcc_lexer_new_stream("<stdin>", stdin, 0)
+                           : vcc_lexer_new(fname);
+  vcc_pp_t *pp = new_preproc();
+  vcc_tokbuf_t *tokens = vcc_pp_run(pp, lexer);
+  vcc_parser_init_tokens(lexer, tokens);
 
   while (vcc_parser_continuable()) {
     vcc_node_t *node = vcc_parse();
     node_inspect(node);
-    vcc_node_free(node);
+  }
+  vcc_parser_err_t err = vcc_parser_error();
+  if (err.code != VCC_PARSER_ERR_NONE && err.expected != TRACE_NO_TOKEN) {
+    fprintf(stderr, "parse error: expect %s, received %s\n",
+            token_names[err.expected],
+            err.received != TRACE_NO_TOKEN ? token_names[err.received]
+                                           : "nothing");
+  } else if (err.code != VCC_PARSER_ERR_NONE) {
+    fprintf(stderr, "parse error %d\n", err.code);
   }
   vcc_parser_finish();
+  vcc_tokbuf_free(tokens);
+  vcc_pp_free(pp);
+  vcc_lexer_free(lexer);
+}
+
+/* writes what was traced to the file named by VCC_TRACE_FILE
+ */
+void dump_trace() {
+  const char *fname = getenv("VCC_TRACE_FILE");
+  FILE *fp = fname ? fopen(fname, "wb") : NULL;
+  if (fp) {
+    vcc_trace_dump(fp);
+    fclose(fp);
+  }
+}
+
+/* prints a trace dumped by an earlier run
+ */
+int test_trace(char *fname) {
+  FILE *fp = fopen(fname, "rb");
+  int ok = fp && vcc_trace_decode(fp, stdout);
+  if (fp) {
+    fclose(fp);
+  }
+  if (!ok) {
+    fprintf(stderr, "%s is not a trace\n", fname);
+  }
+  return ok ? 0 : -1;
 }
 
 int main(int argc, char *argv[]) {
   if (argc < 3) {
-    printf("%s l [filename]\n%s p [filename]\n", argv[0], argv[0]);
+    printf("%s l [filename]\n%s e [filename] [-Idir]...\n"
+           "%s p [filename] [-Idir]...\n%s t [trace file]\n"
+           "VCC_TRACE=parser=token,... sets trace levels, VCC_TRACE_FILE "
+           "names where to dump them\n",
+           argv[0], argv[0], argv[0], argv[0]);
     return -1;
   }
+  if (!vcc_trace_configure(getenv("VCC_TRACE"))) {
+    fprintf(stderr,
+            "VCC_TRACE=%s is not understood, no level was set, expected "
+            "phase=level,... with a phase of %s, %s, %s, %s or all\n",
+            getenv("VCC_TRACE"), trace_phases[TRACE_LEXER],
+            trace_phases[TRACE_PREPROC], trace_phases[TRACE_PARSER],
+            trace_phases[TRACE_GENERATOR]);
+  }
+  atexit(dump_trace);
+  include_dirs = argv + 3;
+  ninclude_dirs = argc - 3;
   if (!strcmp(argv[1], "l") || !strcmp(argv[1], "lex")) {
     test_lexer(argv[2]);
     return 0;
   }
+  if (!strcmp(argv[1], "e") || !strcmp(argv[1], "preprocess")) {
+    test_preproc(argv[2]);
+    return 0;
+  }
   if (!strcmp(argv[1], "p") || !strcmp(argv[1], "parse")) {
     test_parser(argv[2]);
     return 0;
   }
+  if (!strcmp(argv[1], "t") || !strcmp(argv[1], "trace")) {
+    return test_trace(argv[2]);
+  }
   return 0;
 }
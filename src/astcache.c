@@ -0,0 +1,495 @@
+#include "astcache.h"
+#include <fcntl.h>
+#include <stddef.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define PHASE "caching"
+
+/* a cache is only read by a build whose structs have the same layout
+ */
+#define LAYOUT                                                                 \
+  ((uint64_t)sizeof(vcc_node_t) | (uint64_t)sizeof(vcc_stmt_t) << 12 |         \
+   (uint64_t)sizeof(vcc_expr_t) << 24 | (uint64_t)sizeof(vcc_func_t) << 36 |   \
+   (uint64_t)sizeof(vcc_block_t) << 48 | (uint64_t)sizeof(void *) << 60)
+
+/* hashes 8 bytes at a time, `seed` chains the hashes of several sources,
+ * such as a file and the headers it includes
+ */
+uint64_t vcc_ast_hash(uint64_t seed, const char *src, size_t len) {
+  uint64_t h = seed ^ 0x9e3779b97f4a7c15ull ^ len;
+  for (; len >= 8; src += 8, len -= 8) {
+    uint64_t w;
+    memcpy(&w, src, 8);
+    h = (h ^ w) * 0x100000001b3ull;
+    h ^= h >> 29;
+  }
+  uint64_t w = 0;
+  memcpy(&w, src, len);
+  h = (h ^ w) * 0x100000001b3ull;
+  h ^= h >> 32;
+  h *= 0xff51afd7ed558ccdull;
+  return h ^ (h >> 33);
+}
+
+static void cache_path(char *path, size_t size, const char *dir,
+                       uint64_t hash) {
+  snprintf(path, size, "%s/%016llx.ast", dir, (unsigned long long)hash);
+}
+
+/* ============ WRITING ============= */
+enum { OBJ_NODE, OBJ_STMT, OBJ_EXPR, OBJ_FUNC, OBJ_BLOCK, OBJ_KINDS };
+
+/* pointer fields are 8-aligned, so a relocation keeps the kind of what the
+ * pointer names in its low bits
+ */
+#define RELOC_KIND_MASK 7
+
+static const size_t obj_sizes[] = {
+    [OBJ_NODE] = sizeof(vcc_node_t),   [OBJ_STMT] = sizeof(vcc_stmt_t),
+    [OBJ_EXPR] = sizeof(vcc_expr_t),   [OBJ_FUNC] = sizeof(vcc_func_t),
+    [OBJ_BLOCK] = sizeof(vcc_block_t),
+};
+
+/* open-addressing map of nonzero keys, a pointer to the offset it was
+ * written at or an atom to its index in the names
+ */
+typedef struct _cache_map_t {
+  uint64_t *keys;
+  uint64_t *values;
+  size_t cap; // power of two
+  size_t count;
+} cache_map_t;
+
+static uint64_t *map_slot(cache_map_t *map, uint64_t key) {
+  size_t i = (key * 0x9e3779b97f4a7c15ull >> 20) & (map->cap - 1);
+  while (map->keys[i] && map->keys[i] != key) {
+    i = (i + 1) & (map->cap - 1);
+  }
+  return &map->keys[i];
+}
+
+static void map_put(cache_map_t *map, uint64_t key, uint64_t value);
+
+static void map_grow(cache_map_t *map) {
+  cache_map_t old = *map;
+  map->cap = old.cap ? old.cap * 2 : 1024;
+  map->count = 0;
+  map->keys = xalloc(map->cap * sizeof(uint64_t));
+  map->values = xalloc(map->cap * sizeof(uint64_t));
+  memset(map->keys, 0, map->cap * sizeof(uint64_t));
+  for (size_t i = 0; i < old.cap; ++i) {
+    if (old.keys[i]) {
+      map_put(map, old.keys[i], old.values[i]);
+    }
+  }
+  xfree(old.keys);
+  xfree(old.values);
+}
+
+static void map_put(cache_map_t *map, uint64_t key, uint64_t value) {
+  if (2 * (map->count + 1) > map->cap) {
+    map_grow(map);
+  }
+  uint64_t *slot = map_slot(map, key);
+  if (!*slot) {
+    *slot = key;
+    ++map->count;
+  }
+  map->values[slot - map->keys] = value;
+}
+
+/* the value of `key`, 0 if there is none
+ */
+static uint64_t map_get(cache_map_t *map, uint64_t key) {
+  if (!map->cap) {
+    return 0;
+  }
+  uint64_t *slot = map_slot(map, key);
+  return *slot ? map->values[slot - map->keys] : 0;
+}
+
+typedef struct _cache_obj_t {
+  const void *src; // object in memory
+  int kind;        // OBJ_*
+  uint64_t off;    // where its copy is
+} cache_obj_t;
+
+typedef struct _cache_writer_t {
+  char *data;
+  uint64_t len;
+  uint64_t cap;
+  cache_map_t written; // object to its offset
+  cache_map_t atoms;   // atom + 1 to its index in the names + 1
+  vcc_atom_t *names;
+  int nnames;
+  int names_cap;
+  uint32_t *relocs; // offsets in the file, which is under 4 GB
+  uint64_t nrelocs;
+  uint64_t relocs_cap;
+  uint32_t *atom_fields;
+  uint64_t natoms;
+  uint64_t atoms_cap;
+  cache_obj_t *stack; // objects copied with their fields left to write
+  int depth;
+  int stack_cap;
+} cache_writer_t;
+
+static void *grow(void *array, size_t count, size_t cap, size_t size) {
+  void *grown = xalloc(cap * size);
+  if (count) {
+    memcpy(grown, array, count * size);
+  }
+  xfree(array);
+  return grown;
+}
+
+/* zeroed room for `size` bytes at the end of the file, aligned for any
+ * pointer
+ */
+static uint64_t reserve(cache_writer_t *w, size_t size) {
+  uint64_t off = (w->len + 7) & ~(uint64_t)7;
+  if (off + size > w->cap) {
+    uint64_t cap = w->cap * 2 > off + size ? w->cap * 2 : off + size;
+    w->data = grow(w->data, w->len, cap, 1);
+    w->cap = cap;
+  }
+  memset(w->data + w->len, 0, off + size - w->len);
+  w->len = off + size;
+  return off;
+}
+
+static void push_reloc(cache_writer_t *w, uint64_t field, int kind) {
+  assert(!(field & RELOC_KIND_MASK));
+  if (w->nrelocs == w->relocs_cap) {
+    w->relocs_cap = w->relocs_cap ? w->relocs_cap * 2 : 1024;
+    w->relocs = grow(w->relocs, w->nrelocs, w->relocs_cap, sizeof(uint32_t));
+  }
+  w->relocs[w->nrelocs++] = field | kind;
+}
+
+/* the offset `src` is or will be written at, 0 for NULL
+ */
+static uint64_t place(cache_writer_t *w, const void *src, int kind) {
+  if (!src) {
+    return 0;
+  }
+  uint64_t off = map_get(&w->written, (uintptr_t)src);
+  if (off) {
+    return off;
+  }
+  if (kind == OBJ_FUNC) {
+    // a lazy body has to be parsed to be kept
+    vcc_func_body((vcc_func_t *)src);
+  }
+  off = reserve(w, obj_sizes[kind]);
+  memcpy(w->data + off, src, obj_sizes[kind]);
+  map_put(&w->written, (uintptr_t)src, off);
+  if (w->depth == w->stack_cap) {
+    w->stack_cap = w->stack_cap ? w->stack_cap * 2 : 256;
+    w->stack = grow(w->stack, w->depth, w->stack_cap, sizeof(cache_obj_t));
+  }
+  w->stack[w->depth++] = (cache_obj_t){src, kind, off};
+  return off;
+}
+
+/* writes the offset of `src` into the pointer at `field`
+ */
+static void link_ptr(cache_writer_t *w, uint64_t field, const void *src,
+                     int kind) {
+  uint64_t off = place(w, src, kind);
+  memcpy(w->data + field, &off, sizeof(off));
+  if (off) {
+    push_reloc(w, field, kind);
+  }
+}
+
+/* writes the index of `atom` in the names into the atom at `field`
+ */
+static void link_atom(cache_writer_t *w, uint64_t field, vcc_atom_t atom) {
+  uint64_t index = map_get(&w->atoms, (uint64_t)atom + 1);
+  if (!index) {
+    if (w->nnames == w->names_cap) {
+      w->names_cap = w->names_cap ? w->names_cap * 2 : 256;
+      w->names = grow(w->names, w->nnames, w->names_cap, sizeof(vcc_atom_t));
+    }
+    w->names[w->nnames++] = atom;
+    index = w->nnames;
+    map_put(&w->atoms, (uint64_t)atom + 1, index);
+  }
+  vcc_atom_t value = index - 1;
+  memcpy(w->data + field, &value, sizeof(value));
+  if (w->natoms == w->atoms_cap) {
+    w->atoms_cap = w->atoms_cap ? w->atoms_cap * 2 : 1024;
+    w->atom_fields =
+        grow(w->atom_fields, w->natoms, w->atoms_cap, sizeof(uint32_t));
+  }
+  w->atom_fields[w->natoms++] = field;
+}
+
+static int has_atom(const vcc_expr_t *expr) {
+  return expr->arity == 0 &&
+         (expr->opr == TOKEN_IDENTIFIER || expr->opr == TOKEN_STR ||
+          expr->opr == TOKEN_CHAR);
+}
+
+#define FIELD(obj, type, field) ((obj).off + offsetof(type, field))
+
+/* writes the pointers and atoms of an object copied by place(), which
+ * places the objects they name in turn
+ */
+static void write_fields(cache_writer_t *w, cache_obj_t obj) {
+  switch (obj.kind) {
+  case OBJ_NODE: {
+    const vcc_node_t *node = obj.src;
+    link_ptr(w, FIELD(obj, vcc_node_t, next), node->next, OBJ_NODE);
+    int kind = node->type == VCC_NODE_FUNC ? OBJ_FUNC : OBJ_STMT;
+    link_ptr(w, FIELD(obj, vcc_node_t, value), node->value.stmt, kind);
+    break;
+  }
+  case OBJ_STMT: {
+    const vcc_stmt_t *stmt = obj.src;
+    link_ptr(w, FIELD(obj, vcc_stmt_t, condition), stmt->condition, OBJ_EXPR);
+    link_ptr(w, FIELD(obj, vcc_stmt_t, body), stmt->body, OBJ_BLOCK);
+    link_ptr(w, FIELD(obj, vcc_stmt_t, else_body), stmt->else_body, OBJ_BLOCK);
+    link_ptr(w, FIELD(obj, vcc_stmt_t, expr), stmt->expr, OBJ_EXPR);
+    break;
+  }
+  case OBJ_EXPR: {
+    const vcc_expr_t *expr = obj.src;
+    link_ptr(w, FIELD(obj, vcc_expr_t, lhs), expr->lhs, OBJ_EXPR);
+    link_ptr(w, FIELD(obj, vcc_expr_t, rhs), expr->rhs, OBJ_EXPR);
+    link_ptr(w, FIELD(obj, vcc_expr_t, next), expr->next, OBJ_EXPR);
+    if (has_atom(expr)) {
+      link_atom(w, FIELD(obj, vcc_expr_t, literal), expr->literal.atom);
+    }
+    break;
+  }
+  case OBJ_FUNC: {
+    const vcc_func_t *func = obj.src;
+    link_atom(w, FIELD(obj, vcc_func_t, name), func->name);
+    link_ptr(w, FIELD(obj, vcc_func_t, body), func->body, OBJ_BLOCK);
+    // nothing is left to parse, and nowhere to parse it into
+    link_ptr(w, FIELD(obj, vcc_func_t, tokens), NULL, OBJ_NODE);
+    link_ptr(w, FIELD(obj, vcc_func_t, arena), NULL, OBJ_NODE);
+    break;
+  }
+  case OBJ_BLOCK: {
+    const vcc_block_t *block = obj.src;
+    link_ptr(w, FIELD(obj, vcc_block_t, stmt), block->stmt, OBJ_STMT);
+    link_ptr(w, FIELD(obj, vcc_block_t, nodes), block->nodes, OBJ_NODE);
+    break;
+  }
+  }
+}
+
+static uint64_t write_array(cache_writer_t *w, const void *array,
+                            size_t size) {
+  uint64_t off = reserve(w, size);
+  if (size) {
+    memcpy(w->data + off, array, size);
+  }
+  return off;
+}
+
+static void writer_free(cache_writer_t *w) {
+  xfree(w->data);
+  xfree(w->written.keys);
+  xfree(w->written.values);
+  xfree(w->atoms.keys);
+  xfree(w->atoms.values);
+  xfree(w->names);
+  xfree(w->relocs);
+  xfree(w->atom_fields);
+  xfree(w->stack);
+}
+
+/* writes `count` nodes parsed from a source keyed by `hash`, with their
+ * atoms in `symtbl`, into `dir`, lazy bodies are parsed first, returns 0
+ * if the file could not be written
+ *
+ * the file is written aside and renamed, so a reader never sees half of it
+ */
+int vcc_ast_cache_store(const char *dir, uint64_t hash, vcc_symtbl_t *symtbl,
+                        vcc_node_t **nodes, int count) {
+  cache_writer_t w = {0};
+  uint64_t header = reserve(&w, sizeof(vcc_ast_cache_header_t));
+  uint64_t roots = reserve(&w, count * sizeof(uint64_t));
+  for (int i = 0; i < count; ++i) {
+    link_ptr(&w, roots + i * sizeof(uint64_t), nodes[i], OBJ_NODE);
+    while (w.depth > 0) {
+      write_fields(&w, w.stack[--w.depth]);
+    }
+  }
+
+  uint32_t *names = xalloc((w.nnames + 1) * sizeof(uint32_t));
+  for (int i = 0; i < w.nnames; ++i) {
+    int len;
+    const char *s = vcc_symtbl_name(symtbl, w.names[i], &len);
+    uint32_t len32 = len;
+    names[i] = reserve(&w, sizeof(len32) + len + 1);
+    memcpy(w.data + names[i], &len32, sizeof(len32));
+    memcpy(w.data + names[i] + sizeof(len32), s, len);
+  }
+  vcc_ast_cache_header_t h = {
+      .magic = AST_CACHE_MAGIC,
+      .version = AST_CACHE_VERSION,
+      .count = count,
+      .layout = LAYOUT,
+      .hash = hash,
+      .roots = roots,
+      .nrelocs = w.nrelocs,
+      .natoms = w.natoms,
+      .nnames = w.nnames,
+  };
+  h.names = write_array(&w, names, w.nnames * sizeof(uint32_t));
+  h.relocs = write_array(&w, w.relocs, w.nrelocs * sizeof(uint32_t));
+  h.atoms = write_array(&w, w.atom_fields, w.natoms * sizeof(uint32_t));
+  h.size = w.len;
+  memcpy(w.data + header, &h, sizeof(h));
+  xfree(names);
+
+  char path[4096], tmp[4096 + 32];
+  cache_path(path, sizeof(path), dir, hash);
+  snprintf(tmp, sizeof(tmp), "%s.%d.tmp", path, (int)getpid());
+  // tables hold 32-bit offsets
+  FILE *fp = w.len <= UINT32_MAX ? fopen(tmp, "wb") : NULL;
+  int ok = fp && fwrite(w.data, 1, w.len, fp) == w.len;
+  ok = fp && !fclose(fp) && ok;
+  ok = ok && !rename(tmp, path);
+  if (!ok) {
+    logf("could not write %s\n", path);
+    unlink(tmp);
+  }
+  logf("cached %d nodes in %llu bytes\n", count, (unsigned long long)w.len);
+  writer_free(&w);
+  return ok;
+}
+
+/* ============ READING ============= */
+/* whether `count` items of `size` bytes at `off` are in the file and
+ * aligned for them
+ */
+static int in_file(uint64_t off, uint64_t count, size_t size, uint64_t len) {
+  return off <= len && count <= (len - off) / size && off % size == 0;
+}
+
+/* checks that the header and every table fit in the file
+ */
+static int check(const vcc_ast_cache_header_t *h, uint64_t hash, size_t len) {
+  if (len < sizeof(*h) || memcmp(h->magic, AST_CACHE_MAGIC, 8) ||
+      h->version != AST_CACHE_VERSION || h->layout != LAYOUT ||
+      h->hash != hash || h->size != len) {
+    return 0;
+  }
+  return in_file(h->roots, h->count, sizeof(uint64_t), len) &&
+         in_file(h->relocs, h->nrelocs, sizeof(uint32_t), len) &&
+         in_file(h->atoms, h->natoms, sizeof(uint32_t), len) &&
+         in_file(h->names, h->nnames, sizeof(uint32_t), len);
+}
+
+/* turns the offsets of a mapped cache into pointers and its name indices
+ * into atoms of `symtbl`, returns 0 if a pointer does not name a whole
+ * aligned object in the file or an atom is out of it
+ */
+static int relocate(char *map, size_t len, const vcc_ast_cache_header_t *h,
+                    vcc_symtbl_t *symtbl) {
+  uint32_t *relocs = (uint32_t *)(map + h->relocs);
+  for (uint64_t i = 0; i < h->nrelocs; ++i) {
+    uint64_t field = relocs[i] & ~(uint64_t)RELOC_KIND_MASK;
+    int kind = relocs[i] & RELOC_KIND_MASK;
+    uint64_t off;
+    if (kind >= OBJ_KINDS || field > len - sizeof(off)) {
+      return 0;
+    }
+    memcpy(&off, map + field, sizeof(off));
+    if (off > len || obj_sizes[kind] > len - off || off % sizeof(void *)) {
+      return 0;
+    }
+    char *ptr = map + off;
+    memcpy(map + field, &ptr, sizeof(ptr));
+  }
+
+  int ok = 1;
+  vcc_atom_t *atoms = xalloc((h->nnames + 1) * sizeof(vcc_atom_t));
+  uint32_t *names = (uint32_t *)(map + h->names);
+  for (uint64_t i = 0; ok && i < h->nnames; ++i) {
+    uint32_t n;
+    ok = names[i] <= len - sizeof(n);
+    if (ok) {
+      memcpy(&n, map + names[i], sizeof(n));
+      ok = n <= len - names[i] - sizeof(n);
+    }
+    if (ok) {
+      atoms[i] = vcc_symtbl_intern(symtbl, map + names[i] + sizeof(n), n);
+    }
+  }
+  uint32_t *fields = (uint32_t *)(map + h->atoms);
+  for (uint64_t i = 0; ok && i < h->natoms; ++i) {
+    vcc_atom_t index;
+    ok = fields[i] <= len - sizeof(index);
+    if (ok) {
+      memcpy(&index, map + fields[i], sizeof(index));
+      ok = index < h->nnames;
+    }
+    if (ok) {
+      memcpy(map + fields[i], &atoms[index], sizeof(index));
+    }
+  }
+  xfree(atoms);
+  return ok;
+}
+
+/* maps the cache file of `hash` in `dir` and makes its nodes usable with
+ * `symtbl`, NULL if there is no such file or it is not one this build can
+ * read, loading allocates nothing for each node
+ */
+vcc_cached_ast_t *vcc_ast_cache_load(const char *dir, uint64_t hash,
+                                     vcc_symtbl_t *symtbl) {
+  char path[4096];
+  cache_path(path, sizeof(path), dir, hash);
+  int fd = open(path, O_RDONLY);
+  if (fd < 0) {
+    return NULL;
+  }
+  struct stat st;
+  char *map = MAP_FAILED;
+  if (!fstat(fd, &st) && st.st_size >= (off_t)sizeof(vcc_ast_cache_header_t)) {
+    // written over privately, the file stays as it is
+    map = mmap(NULL, st.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+  }
+  close(fd);
+  if (map == MAP_FAILED) {
+    return NULL;
+  }
+  size_t len = st.st_size;
+  vcc_ast_cache_header_t h;
+  memcpy(&h, map, sizeof(h));
+  if (!check(&h, hash, len)) {
+    logf("%s is not a cache of this build\n", path);
+    munmap(map, len);
+    return NULL;
+  }
+
+  if (!relocate(map, len, &h, symtbl)) {
+    logf("%s is damaged\n", path);
+    munmap(map, len);
+    return NULL;
+  }
+
+  vcc_cached_ast_t *ast = xalloc(sizeof(vcc_cached_ast_t));
+  ast->nodes = (vcc_node_t **)(map + h.roots);
+  ast->count = h.count;
+  ast->map = map;
+  ast->size = len;
+  return ast;
+}
+
+void vcc_cached_ast_free(vcc_cached_ast_t *ast) {
+  if (!ast) {
+    return;
+  }
+  munmap(ast->map, ast->size);
+  xfree(ast);
+}
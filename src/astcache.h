@@ -0,0 +1,49 @@
+#ifndef _ASTCACHE_H_
+#define _ASTCACHE_H_
+
+#include "mem.h"
+#include "parser.h"
+#include "symtbl.h"
+
+#define AST_CACHE_MAGIC "VCCAST\0"
+#define AST_CACHE_VERSION 3
+
+/* an AST cache file is the nodes of one source, written as they are in
+ * memory with pointers turned into offsets from the start of the file, so
+ * loading it is one mapping and a pass over the pointers listed in it
+ */
+typedef struct _vcc_ast_cache_header_t {
+  char magic[8];
+  uint32_t version;
+  uint32_t count;  // top-level nodes
+  uint64_t layout; // sizes of the AST structs of the build that wrote it
+  uint64_t hash;   // key of the source
+  uint64_t size;   // bytes in the file
+  uint64_t roots;  // offset of the top-level node offsets, 0 for NULL
+  uint64_t relocs; // offset of the offsets of every pointer, each with the
+                   // kind of object it names in its low 3 bits
+  uint64_t nrelocs;
+  uint64_t atoms;  // offset of the offsets of every atom, each an index
+  uint64_t natoms; // in the names
+  uint64_t names;  // offset of the name offsets, a name is a length and
+  uint64_t nnames; // the bytes after it
+} vcc_ast_cache_header_t;
+
+/* nodes read back from a cache file, they live in its mapping and have
+ * their atoms in the symbol table they were loaded with
+ */
+typedef struct _vcc_cached_ast_t {
+  vcc_node_t **nodes; // what vcc_parse() gave, NULL included
+  int count;          //
+  void *map;          //
+  size_t size;        //
+} vcc_cached_ast_t;
+
+uint64_t vcc_ast_hash(uint64_t seed, const char *src, size_t len);
+int vcc_ast_cache_store(const char *dir, uint64_t hash, vcc_symtbl_t *symtbl,
+                        vcc_node_t **nodes, int count);
+vcc_cached_ast_t *vcc_ast_cache_load(const char *dir, uint64_t hash,
+                                     vcc_symtbl_t *symtbl);
+void vcc_cached_ast_free(vcc_cached_ast_t *ast);
+
+#endif
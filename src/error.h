@@ -4,11 +4,26 @@
 #define VCC_LEX_CPP_CMT_NO_ENDING 0
 #define VCC_LEX_NO_CHAR_IN_QUOTE 1
 
-/* error macros use by compiler, not to debug */
-#define errorf(fmt, ...)                                                       \
-  fprintf(stderr, "[error while " PHASE "]@%s:%d:%d " fmt, fname, line, col,   \
-          __VA_ARGS__)
+/* error macros use by compiler, not to debug, `lexer` is the vcc_lexer_t
+ * that read the source, line and column of `offset` are only looked up
+ * when an error is printed
+ */
+#define errorf_at(lexer, offset, fmt, ...)                                     \
+  do {                                                                         \
+    int _line, _col;                                                           \
+    if ((lexer)->quiet) {                                                      \
+      break;                                                                   \
+    }                                                                          \
+    vcc_lexer_locate((lexer), (offset), &_line, &_col);                        \
+    fprintf(stderr, "[error while " PHASE "]@%s:%d:%d " fmt, (lexer)->fname,   \
+            _line, _col, __VA_ARGS__);                                         \
+  } while (0)
 
-#define errors(str) errorf("%s\n", str)
+/* reports an error at the current position of `lexer`
+ */
+#define errorf(lexer, fmt, ...)                                                \
+  errorf_at(lexer, (lexer)->base + (lexer)->ptr, fmt, __VA_ARGS__)
+
+#define errors(lexer, str) errorf(lexer, "%s\n", str)
 
 #endif
\ No newline at end of file
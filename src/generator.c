@@ -1,49 +1,148 @@
 #include "lexer.h"
 #include "mem.h"
 #include "parser.h"
+#include <stdarg.h>
 #include <stdio.h>
 
 #define PHASE "generating"
-#define BUFFER_MAX_SIZE 8096
+#define BUFFER_INIT_SIZE 8096
+#define EXPR_STACK_INIT_CAP 64
 
 buf_t *buffer;
+static int buffer_cap;
 
-void vcc_generator_init() { buffer = buf_new(BUFFER_MAX_SIZE); }
+void vcc_generator_init() {
+  buffer = buf_new(BUFFER_INIT_SIZE);
+  buffer_cap = BUFFER_INIT_SIZE;
+}
 
-static void nasm_expr(vcc_expr_t *expr, int depth) {
-  if (!expr)
-    return;
+void vcc_generator_finish() {
+  buf_free(buffer);
+  buffer = NULL;
+}
 
-  vcc_expr_t *lhs = expr->lhs;
-  vcc_expr_t *rhs = expr->rhs;
-  if (expr->arity == 2 && lhs->arity == 0 && rhs->arity == 0) {
-    sprintf(buffer->s, "mov r8, %d\nmov r9, %d\n", lhs->literal.number,
-            rhs->literal.number);
+/* appends to the code generated so far, the buffer doubles when it is
+ * full, so one expression may generate any amount of code
+ */
+static void emit(const char *fmt, ...) {
+  for (;;) {
+    va_list args;
+    va_start(args, fmt);
+    int n = vsnprintf(buffer->s + buffer->len, buffer_cap - buffer->len + 1,
+                      fmt, args);
+    va_end(args);
+    if (n <= buffer_cap - buffer->len) {
+      buffer->len += n;
+      return;
+    }
+    char *s = xalloc(2 * buffer_cap + 1);
+    memcpy(s, buffer->s, buffer->len);
+    xfree(buffer->s);
+    buffer->s = s;
+    buffer_cap *= 2;
+  }
+}
+
+static int is_constant(vcc_expr_t *expr) {
+  return expr && expr->arity == 0 && expr->opr == TOKEN_INT;
+}
+
+/* the instruction of a binary operator on r8 and r9, into r8
+ */
+static void nasm_binary(int opr) {
+  switch (opr) {
+  case TOKEN_ADD:
+    emit("add r8, r9\n");
+    break;
+  case TOKEN_SUB:
+    emit("sub r8, r9\n");
+    break;
+  case TOKEN_ASTERISK:
+    emit("mul r8, r9\n");
+    break;
+  case TOKEN_DIV:
+    emit("div r8, r9\n");
+    break;
+  }
+}
 
-    switch (expr->opr) {
-    case TOKEN_ADD:
-      sprintf(buffer->s, "add r8, r9\n");
-      break;
-    case TOKEN_SUB:
-      sprintf(buffer->s, "sub r8, r9\n");
-      break;
-    case TOKEN_ASTERISK:
-      sprintf(buffer->s, "mul r8, r9\n");
-      break;
-    case TOKEN_DIV:
-      sprintf(buffer->s, "div r8, r9\n");
-      break;
+/* code for one node, false if its operands need code of their own first,
+ * names, strings and characters are not generated yet
+ */
+static int nasm_leaf(vcc_expr_t *expr) {
+  // constant operands were folded by the parser
+  if (expr->arity == 0) {
+    if (expr->opr == TOKEN_INT) {
+      emit("push %lld\n", (long long)expr->literal.number);
     }
+    return 1;
+  }
 
-    sprintf(buffer->s, "push r8\n");
-    return;
+  vcc_expr_t *lhs = expr->lhs;
+  vcc_expr_t *rhs = expr->rhs;
+  if (expr->arity == 2 && is_constant(lhs) && is_constant(rhs)) {
+    emit("mov r8, %lld\nmov r9, %lld\n", (long long)lhs->literal.number,
+         (long long)rhs->literal.number);
+    nasm_binary(expr->opr);
+    emit("push r8\n");
+    return 1;
   }
+  return 0;
+}
+
+typedef struct _nasm_item_t {
+  vcc_expr_t *expr;
+  int operands_done; // so only the operator is left
+} nasm_item_t;
 
-  nasm_expr(lhs, depth + 1);
-  nasm_expr(rhs, depth + 1);
+/* walks the tree at `expr` with a stack of its own, the left operand of a
+ * node, then its right, then the node on the values they pushed, so an
+ * expression of any depth takes no more of the C stack than a leaf
+ */
+static void nasm_expr(vcc_expr_t *expr) {
+  nasm_item_t init[EXPR_STACK_INIT_CAP];
+  nasm_item_t *stack = init;
+  int count = 0;
+  int cap = EXPR_STACK_INIT_CAP;
+  stack[count++] = (nasm_item_t){expr, 0};
+  while (count) {
+    nasm_item_t it = stack[--count];
+    if (!it.expr) {
+      continue;
+    }
+    if (it.operands_done) {
+      if (it.expr->arity == 2) {
+        emit("pop r9\npop r8\n");
+        nasm_binary(it.expr->opr);
+        emit("push r8\n");
+      }
+      continue;
+    }
+    if (nasm_leaf(it.expr)) {
+      continue;
+    }
+    if (count + 3 > cap) {
+      nasm_item_t *grown = xalloc(2 * cap * sizeof(nasm_item_t));
+      memcpy(grown, stack, count * sizeof(nasm_item_t));
+      if (stack != init) {
+        xfree(stack);
+      }
+      stack = grown;
+      cap *= 2;
+    }
+    stack[count++] = (nasm_item_t){it.expr, 1};
+    stack[count++] = (nasm_item_t){it.expr->rhs, 0};
+    stack[count++] = (nasm_item_t){it.expr->lhs, 0};
+  }
+  if (stack != init) {
+    xfree(stack);
+  }
 }
 
-static char *vcc_generate_stmt_return(vcc_stmt_t *stmt) { return buffer->s; }
+static char *vcc_generate_stmt_return(vcc_stmt_t *stmt) {
+  nasm_expr(stmt->expr);
+  return buffer->s;
+}
 
 static char *vcc_generate_stmt(vcc_stmt_t *stmt) {
   switch (stmt->type) {
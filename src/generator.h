@@ -3,6 +3,8 @@
 
 #include "parser.h"
 
+void vcc_generator_init();
+void vcc_generator_finish();
 char *vcc_generate(vcc_node_t *node);
 
 #endif
\ No newline at end of file
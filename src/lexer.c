@@ -1,34 +1,22 @@
 #include "lexer.h"
 #include "mem.h"
+#include <sched.h>
+#include <unistd.h>
 
 /* for error emitting
  */
 #define PHASE "lexing"
 
-/* internal variables
+/* all lexing state lives in the vcc_lexer_t handed to every function below,
+ * so any number of lexers can run at the same time on different threads
  */
 
-static buf_t *filebuf;  // code buffer
-static int filebufptr;  // pointer to file buffer
-static char fname[256]; // name of lexing file
-
-static int line;               // current line
-static int col;                // current column
-static int c;                  // current char
-static char buf[BUF_MAX_SIZE]; // buffer to save temp stream
-static int buflen;             // len of buf for scanning
-
-static int lastlex; // return value of the last lex call
-
-// TODO: save internal variables to an object
-// static vcc_lexer_t *lexer;
-
 /* static funtion declarations
  */
-static void reset_buf();
-static char peek(int);
-static int discard_until(char);
-static char next(int);
+static char peek(vcc_lexer_t *L, int);
+static int discard_until(vcc_lexer_t *L, char);
+static char next(vcc_lexer_t *L, int);
+static int refill(vcc_lexer_t *L, int keep);
 
 #define TOKEN(tok) [TOKEN_##tok] = #tok,
 const char *token_names[] = {
@@ -56,6 +44,7 @@ const char *token_names[] = {
     TOKEN(XOR)    // ^
     TOKEN(OR)     // |
     TOKEN(AND)    // &
+    TOKEN(TILDE)  // ~
     TOKEN(LSHIFT) // <<
     TOKEN(RSHIFT) // >>
     /* math operators
@@ -93,580 +82,1692 @@ const char *token_names[] = {
     TOKEN(MOD_ASSIGN)    // %=
     TOKEN(POINTER)       // ->
 
-    TOKEN(KWORD_BREAK)    //
-    TOKEN(KWORD_CASE)     //
-    TOKEN(KWORD_CONST)    //
-    TOKEN(KWORD_CONTINUE) //
-    TOKEN(KWORD_DEFAULT)  //
-    TOKEN(KWORD_DO)       //
-    TOKEN(KWORD_ELSE)     //
-    TOKEN(KWORD_ENUM)     //
-    TOKEN(KWORD_FOR)      //
-    TOKEN(KWORD_GOTO)     //
-    TOKEN(KWORD_IF)       //
-    TOKEN(KWORD_NULL)     //
-    TOKEN(KWORD_RETURN)   //
-    TOKEN(KWORD_SIZEOF)   //
-    TOKEN(KWORD_STATIC)   //
-    TOKEN(KWORD_STRUCT)   //
-    TOKEN(KWORD_SWITCH)   //
-    TOKEN(KWORD_TYPEDEF)  //
-    TOKEN(KWORD_UNION)    //
-    TOKEN(KWORD_WHILE)    //
+    TOKEN(HASH)      // #
+    TOKEN(HASH_HASH) // ##
+    TOKEN(NEWLINE)   //
+    TOKEN(ELLIPSIS)  // ...
+
+    TOKEN(KWORD_AUTO)          //
+    TOKEN(KWORD_BREAK)         //
+    TOKEN(KWORD_CASE)          //
+    TOKEN(KWORD_CHAR)          //
+    TOKEN(KWORD_CONST)         //
+    TOKEN(KWORD_CONTINUE)      //
+    TOKEN(KWORD_DEFAULT)       //
+    TOKEN(KWORD_DO)            //
+    TOKEN(KWORD_DOUBLE)        //
+    TOKEN(KWORD_ELSE)          //
+    TOKEN(KWORD_ENUM)          //
+    TOKEN(KWORD_EXTERN)        //
+    TOKEN(KWORD_FLOAT)         //
+    TOKEN(KWORD_FOR)           //
+    TOKEN(KWORD_GOTO)          //
+    TOKEN(KWORD_IF)            //
+    TOKEN(KWORD_INLINE)        //
+    TOKEN(KWORD_INT)           //
+    TOKEN(KWORD_LONG)          //
+    TOKEN(KWORD_NULL)          //
+    TOKEN(KWORD_REGISTER)      //
+    TOKEN(KWORD_RESTRICT)      //
+    TOKEN(KWORD_RETURN)        //
+    TOKEN(KWORD_SHORT)         //
+    TOKEN(KWORD_SIGNED)        //
+    TOKEN(KWORD_SIZEOF)        //
+    TOKEN(KWORD_STATIC)        //
+    TOKEN(KWORD_STRUCT)        //
+    TOKEN(KWORD_SWITCH)        //
+    TOKEN(KWORD_TYPEDEF)       //
+    TOKEN(KWORD_UNION)         //
+    TOKEN(KWORD_UNSIGNED)      //
+    TOKEN(KWORD_VOID)          //
+    TOKEN(KWORD_VOLATILE)      //
+    TOKEN(KWORD_WHILE)         //
+    TOKEN(KWORD_ALIGNAS)       //
+    TOKEN(KWORD_ALIGNOF)       //
+    TOKEN(KWORD_ATOMIC)        //
+    TOKEN(KWORD_BOOL)          //
+    TOKEN(KWORD_COMPLEX)       //
+    TOKEN(KWORD_GENERIC)       //
+    TOKEN(KWORD_IMAGINARY)     //
+    TOKEN(KWORD_NORETURN)      //
+    TOKEN(KWORD_STATIC_ASSERT) //
+    TOKEN(KWORD_THREAD_LOCAL)  //
 };
 #undef TOKEN
 
-/* resets temp buffer
+/* how punctuations and keywords are written, for tokens made up by the
+ * preprocessor
  */
-static void reset_buf() { bzero(buf, BUF_MAX_SIZE); }
+#define TOKEN(tok, s) [TOKEN_##tok] = s,
+const char *token_spellings[NUMBER_OF_TOKENS] = {
+    TOKEN(COLON, ":")                            //
+    TOKEN(LPAREN, "(")                           //
+    TOKEN(RPAREN, ")")                           //
+    TOKEN(LBRACE, "{")                           //
+    TOKEN(RBRACE, "}")                           //
+    TOKEN(LBRACKET, "[")                         //
+    TOKEN(RBRACKET, "]")                         //
+    TOKEN(COMMA, ",")                            //
+    TOKEN(DOT, ".")                              //
+    TOKEN(QUESTION, "?")                         //
+    TOKEN(SEMICOLON, ";")                        //
+    TOKEN(XOR, "^")                              //
+    TOKEN(OR, "|")                               //
+    TOKEN(AND, "&")                              //
+    TOKEN(TILDE, "~")                            //
+    TOKEN(LSHIFT, "<<")                          //
+    TOKEN(RSHIFT, ">>")                          //
+    TOKEN(ADD, "+")                              //
+    TOKEN(SUB, "-")                              //
+    TOKEN(ASTERISK, "*")                         //
+    TOKEN(DIV, "/")                              //
+    TOKEN(MOD, "%")                              //
+    TOKEN(EQ, "==")                              //
+    TOKEN(NOT_EQ, "!=")                          //
+    TOKEN(LT, "<")                               //
+    TOKEN(GT, ">")                               //
+    TOKEN(LTEQ, "<=")                            //
+    TOKEN(GTEQ, ">=")                            //
+    TOKEN(INC, "++")                             //
+    TOKEN(DEC, "--")                             //
+    TOKEN(NOT, "!")                              //
+    TOKEN(AND_AND, "&&")                         //
+    TOKEN(OR_OR, "||")                           //
+    TOKEN(ASSIGN, "=")                           //
+    TOKEN(ADD_ASSIGN, "+=")                      //
+    TOKEN(SUB_ASSIGN, "-=")                      //
+    TOKEN(OR_ASSIGN, "|=")                       //
+    TOKEN(AND_ASSIGN, "&=")                      //
+    TOKEN(XOR_ASSIGN, "^=")                      //
+    TOKEN(LSHIFT_ASSIGN, "<<=")                  //
+    TOKEN(RSHIFT_ASSIGN, ">>=")                  //
+    TOKEN(MUL_ASSIGN, "*=")                      //
+    TOKEN(DIV_ASSIGN, "/=")                      //
+    TOKEN(MOD_ASSIGN, "%=")                      //
+    TOKEN(POINTER, "->")                         //
+    TOKEN(HASH, "#")                             //
+    TOKEN(HASH_HASH, "##")                       //
+    TOKEN(NEWLINE, "\n")                         //
+    TOKEN(ELLIPSIS, "...")                       //
+    TOKEN(KWORD_AUTO, "auto")                    //
+    TOKEN(KWORD_BREAK, "break")                  //
+    TOKEN(KWORD_CASE, "case")                    //
+    TOKEN(KWORD_CHAR, "char")                    //
+    TOKEN(KWORD_CONST, "const")                  //
+    TOKEN(KWORD_CONTINUE, "continue")            //
+    TOKEN(KWORD_DEFAULT, "default")              //
+    TOKEN(KWORD_DO, "do")                        //
+    TOKEN(KWORD_DOUBLE, "double")                //
+    TOKEN(KWORD_ELSE, "else")                    //
+    TOKEN(KWORD_ENUM, "enum")                    //
+    TOKEN(KWORD_EXTERN, "extern")                //
+    TOKEN(KWORD_FLOAT, "float")                  //
+    TOKEN(KWORD_FOR, "for")                      //
+    TOKEN(KWORD_GOTO, "goto")                    //
+    TOKEN(KWORD_IF, "if")                        //
+    TOKEN(KWORD_INLINE, "inline")                //
+    TOKEN(KWORD_INT, "int")                      //
+    TOKEN(KWORD_LONG, "long")                    //
+    TOKEN(KWORD_NULL, "NULL")                    //
+    TOKEN(KWORD_REGISTER, "register")            //
+    TOKEN(KWORD_RESTRICT, "restrict")            //
+    TOKEN(KWORD_RETURN, "return")                //
+    TOKEN(KWORD_SHORT, "short")                  //
+    TOKEN(KWORD_SIGNED, "signed")                //
+    TOKEN(KWORD_SIZEOF, "sizeof")                //
+    TOKEN(KWORD_STATIC, "static")                //
+    TOKEN(KWORD_STRUCT, "struct")                //
+    TOKEN(KWORD_SWITCH, "switch")                //
+    TOKEN(KWORD_TYPEDEF, "typedef")              //
+    TOKEN(KWORD_UNION, "union")                  //
+    TOKEN(KWORD_UNSIGNED, "unsigned")            //
+    TOKEN(KWORD_VOID, "void")                    //
+    TOKEN(KWORD_VOLATILE, "volatile")            //
+    TOKEN(KWORD_WHILE, "while")                  //
+    TOKEN(KWORD_ALIGNAS, "_Alignas")             //
+    TOKEN(KWORD_ALIGNOF, "_Alignof")             //
+    TOKEN(KWORD_ATOMIC, "_Atomic")               //
+    TOKEN(KWORD_BOOL, "_Bool")                   //
+    TOKEN(KWORD_COMPLEX, "_Complex")             //
+    TOKEN(KWORD_GENERIC, "_Generic")             //
+    TOKEN(KWORD_IMAGINARY, "_Imaginary")         //
+    TOKEN(KWORD_NORETURN, "_Noreturn")           //
+    TOKEN(KWORD_STATIC_ASSERT, "_Static_assert") //
+    TOKEN(KWORD_THREAD_LOCAL, "_Thread_local")   //
+};
+#undef TOKEN
 
-/* creates new token from filebuf
+/* creates new token whose text is the slice [start, start + len) of the
+ * source, nothing is copied, tokens come from the lexer arena and are
+ * recycled through the free list, so no token ever costs a malloc of its own
  */
-static vtoken_t *vtoken_new(int type, int start, int len) {
-  vtoken_t *tok = xalloc(sizeof(vtoken_t));
-  tok->type = type;
-  tok->value.s = buf_new_from_mem(filebuf->s + start, len);
+static vtoken_t *vtoken_new(vcc_lexer_t *L, int type, int start, int len) {
+  vtoken_t *tok = L->free_tokens;
+  if (tok) {
+    L->free_tokens = *(vtoken_t **)tok;
+  } else {
+    tok = arena_alloc(L->tokens, sizeof(vtoken_t));
+  }
+  *tok = (vtoken_t){.type = type, .offset = L->base + start, .len = len};
   return tok;
 }
 
-/* creates new token from buf
+/* creates new token carrying the interned atom of its text
  */
-static vtoken_t *vtoken_new_from_buf(int type) {
-  vtoken_t *tok = xalloc(sizeof(vtoken_t));
-  tok->type = type;
-  switch (type) {
-  case TOKEN_INT:
-    tok->value.i = atoi(buf);
-    break;
-  case TOKEN_FLOAT:
-    tok->value.f = atof(buf);
-    break;
-  default:
-    tok->value.s = buf_new_from_mem(buf, buflen);
-    break;
-  }
+static vtoken_t *vtoken_new_text(vcc_lexer_t *L, int type, int start,
+                                 int len) {
+  vtoken_t *tok = vtoken_new(L, type, start, len);
+  tok->value.atom = vcc_symtbl_intern(L->symtbl, L->src + start, len);
+  return tok;
+}
 
+/* creates a fixed-spelling token of `len` chars at the current position and
+ * moves past it
+ */
+static vtoken_t *vtoken_new_punct(vcc_lexer_t *L, int type, int len) {
+  vtoken_t *tok = vtoken_new(L, type, L->ptr, len);
+  next(L, len);
   return tok;
 }
 
-void vtoken_free(vtoken_t *token) {
+/* gives a token back to its lexer for reuse, the memory itself is only
+ * released with the lexer
+ */
+void vtoken_free(vcc_lexer_t *L, vtoken_t *token) {
   if (!token) {
     return;
   }
-  if (token->type != TOKEN_FLOAT && token->type != TOKEN_INT)
-    buf_free(token->value.s);
+  *(vtoken_t **)token = L->free_tokens;
+  L->free_tokens = token;
 }
 
-/* looks for next char in buf without increasing filebufptr
+/* checks if the token carries an atom instead of pointing at the source
  */
-static char peek(int n) {
-  int ptr = filebufptr + n;
-  assert(ptr < filebuf->len);
-  char p = filebuf->s[ptr];
-  return p;
+int vtoken_has_atom(vtoken_t *token) {
+  return token->type == TOKEN_IDENTIFIER || token->type == TOKEN_STR ||
+         token->type == TOKEN_CHAR;
 }
 
-/* discards all char until reaches `ch`
+/* returns the text of a token, `token->len` bytes long: the interned
+ * spelling for identifiers, strings and chars, else a view into the lexer
+ * source that is not NUL-terminated and lives as long as the lexer, or for
+ * a stream only until the next vcc_lex() call
  */
-static int discard_until(char ch) {
-  while (next(1)) {
-    if (c == ch || c == EOF) {
-      return 0;
+const char *vtoken_view(vcc_lexer_t *L, vtoken_t *token) {
+  if (vtoken_has_atom(token)) {
+    return vcc_symtbl_name(L->symtbl, token->value.atom, NULL);
+  }
+  return L->src + (token->offset - L->base);
+}
+
+/* returns an owned copy of the text of a token
+ */
+buf_t *vtoken_text(vcc_lexer_t *L, vtoken_t *token) {
+  return buf_new_from_mem((char *)vtoken_view(L, token), token->len);
+}
+
+/* gets the char at `ptr`, or BUF_EOF past the end of the source
+ */
+static inline char at(vcc_lexer_t *L, int ptr) {
+  return ptr < L->len ? L->src[ptr] : BUF_EOF;
+}
+
+/* looks for next char in buf without increasing ptr
+ */
+static char peek(vcc_lexer_t *L, int n) { return at(L, L->ptr + n); }
+
+/* jumps forward to `ptr`
+ */
+static void skip_to(vcc_lexer_t *L, int ptr) {
+  if (ptr <= L->ptr) {
+    return;
+  }
+  L->ptr = ptr;
+  L->c = at(L, ptr);
+}
+
+/* reads as much input as fits after the window contents
+ */
+static int read_input(vcc_lexer_t *L) {
+  size_t want = L->cap - L->len;
+  size_t n = fread(L->window + L->len, 1, want, L->stream);
+  if (n < want) {
+    if (ferror(L->stream)) {
+      L->error = LEX_ERR_IO;
+      errors(L, "Could not read input");
     }
+    L->eof = 1;
   }
-  return -1;
+  L->len += n;
+  return n;
 }
 
-/* gets next char
+/* slides the window of a stream: the bytes from `keep` on move to the front
+ * and more input is read behind them, the window only grows when a single
+ * token fills it, so memory is bounded by the longest token and not by the
+ * input, returns the number of bytes read
  */
-static char next(int n) {
-  assert(filebufptr + n <= filebuf->len);
-  filebufptr += n;
-  c = filebuf->s[filebufptr];
-  ++col;
-  if (c == '\n') {
-    ++line;
-    col = 1;
+static int refill(vcc_lexer_t *L, int keep) {
+  if (L->eof) {
+    return 0;
+  }
+  // the dropped bytes leave the line index, only their lines are counted
+  int lines = L->scan->count(L->window, L->window + keep, '\n');
+  if (lines) {
+    int nl = keep - 1;
+    while (L->window[nl] != '\n') {
+      --nl;
+    }
+    L->lines.first += lines;
+    L->lines.first_start = L->base + nl + 1;
+  }
+  L->lines.count = 0;
+  int left = L->len - keep;
+  if (left == L->cap) {
+    char *grown = xalloc(L->cap * 2);
+    memcpy(grown, L->window, left);
+    xfree(L->window);
+    L->window = grown;
+    L->cap *= 2;
+  } else if (keep) {
+    memmove(L->window, L->window + keep, left);
   }
-  return c;
+  L->src = L->window;
+  L->base += keep;
+  L->ptr -= keep;
+  L->len = left;
+  int n = read_input(L);
+  L->c = at(L, L->ptr);
+  return n;
 }
 
-/* checks if current char is digits
+/* refills the window keeping the token that starts at `*start`, which is
+ * moved along with it
  */
-static int is_digit(char chr) { return (chr >= '0' && chr <= '9'); }
+static int refill_from(vcc_lexer_t *L, int *start) {
+  uint32_t base = L->base;
+  int n = refill(L, *start);
+  *start -= L->base - base;
+  return n;
+}
+
+/* discards all char until reaches `ch`
+ */
+static int discard_until(vcc_lexer_t *L, char ch) {
+  const char *p = L->scan->find2(L->src + L->ptr + 1, L->src + L->len, ch, ch);
+  while (p == L->src + L->len && !L->eof) {
+    skip_to(L, L->len);
+    refill(L, L->ptr);
+    p = L->scan->find2(L->src + L->ptr, L->src + L->len, ch, ch);
+  }
+  skip_to(L, p - L->src);
+  return p < L->src + L->len ? 0 : -1;
+}
 
-/* checks if current char is alpha
+/* gets next char
  */
-static int is_alpha(char chr) {
-  return ((chr >= 'a' && chr <= 'z') || (chr >= 'A' && chr <= 'Z') ||
-          (chr == '_'));
+static char next(vcc_lexer_t *L, int n) {
+  assert(L->ptr + n <= L->len);
+  L->ptr += n;
+  L->c = at(L, L->ptr);
+  return L->c;
 }
 
-/* checks if current char is space
+/* character classes, the lexer dispatches on the class of the first char
+ * of a token
  */
-static int is_space(char chr) { return ((chr == ' ') || (chr == '\n')); }
+enum {
+  CC_OTHER = 0, // not allowed outside of strings and comments
+  CC_EOF,       // BUF_EOF
+  CC_SPACE,     // whitespace
+  CC_ALPHA,     // starts an identifier
+  CC_DIGIT,     // starts a number
+  CC_OP,        // starts an operator or a punctuation
+  CC_DOT,       // member access or the start of a float
+  CC_SLASH,     // division or the start of a comment
+  CC_QUOTE,     // '
+  CC_DQUOTE,    // "
+  CC_HASH,      // #
+};
+
+static const uint8_t char_class[256] = {
+    [BUF_EOF] = CC_EOF,
+    [' '] = CC_SPACE,
+    ['\t'... '\r'] = CC_SPACE,
+    ['a'... 'z'] = CC_ALPHA,
+    ['A'... 'Z'] = CC_ALPHA,
+    ['_'] = CC_ALPHA,
+    ['0'... '9'] = CC_DIGIT,
+    ['.'] = CC_DOT,
+    ['-'] = CC_OP,
+    ['/'] = CC_SLASH,
+    ['\''] = CC_QUOTE,
+    ['"'] = CC_DQUOTE,
+    ['#'] = CC_HASH,
+    [':'] = CC_OP,
+    ['('] = CC_OP,
+    [')'] = CC_OP,
+    ['{'] = CC_OP,
+    ['}'] = CC_OP,
+    ['['] = CC_OP,
+    [']'] = CC_OP,
+    [','] = CC_OP,
+    ['?'] = CC_OP,
+    [';'] = CC_OP,
+    ['^'] = CC_OP,
+    ['|'] = CC_OP,
+    ['&'] = CC_OP,
+    ['~'] = CC_OP,
+    ['+'] = CC_OP,
+    ['*'] = CC_OP,
+    ['%'] = CC_OP,
+    ['='] = CC_OP,
+    ['!'] = CC_OP,
+    ['<'] = CC_OP,
+    ['>'] = CC_OP,
+};
+
+#define is_digit(chr) (char_class[(uint8_t)(chr)] == CC_DIGIT)
+#define is_alpha(chr) (char_class[(uint8_t)(chr)] == CC_ALPHA)
+#define is_space(chr) (char_class[(uint8_t)(chr)] == CC_SPACE)
+#define is_id(chr) (is_alpha(chr) || is_digit(chr))
 
-/* checks if current char is legit for the rest of an identifier
+/* operators are lexed by a transition table: the first char gives a token
+ * from op_start, then every following char that has an edge from the
+ * current token moves to a longer operator
  */
-static int is_id(char chr) { return (is_digit(chr) || is_alpha(chr)); }
+static const uint8_t op_start[128] = {
+    [':'] = TOKEN_COLON,    ['('] = TOKEN_LPAREN,    [')'] = TOKEN_RPAREN,
+    ['{'] = TOKEN_LBRACE,   ['}'] = TOKEN_RBRACE,    ['['] = TOKEN_LBRACKET,
+    [']'] = TOKEN_RBRACKET, [','] = TOKEN_COMMA,     ['.'] = TOKEN_DOT,
+    ['?'] = TOKEN_QUESTION, [';'] = TOKEN_SEMICOLON, ['^'] = TOKEN_XOR,
+    ['|'] = TOKEN_OR,       ['&'] = TOKEN_AND,       ['~'] = TOKEN_TILDE,
+    ['+'] = TOKEN_ADD,      ['-'] = TOKEN_SUB,       ['*'] = TOKEN_ASTERISK,
+    ['/'] = TOKEN_DIV,      ['%'] = TOKEN_MOD,       ['='] = TOKEN_ASSIGN,
+    ['!'] = TOKEN_NOT,      ['<'] = TOKEN_LT,        ['>'] = TOKEN_GT,
+    ['#'] = TOKEN_HASH,
+};
+
+static const uint8_t op_trans[NUMBER_OF_TOKENS][128] = {
+    [TOKEN_XOR] = {['='] = TOKEN_XOR_ASSIGN},
+    [TOKEN_OR] = {['='] = TOKEN_OR_ASSIGN, ['|'] = TOKEN_OR_OR},
+    [TOKEN_AND] = {['='] = TOKEN_AND_ASSIGN, ['&'] = TOKEN_AND_AND},
+    [TOKEN_ADD] = {['='] = TOKEN_ADD_ASSIGN, ['+'] = TOKEN_INC},
+    [TOKEN_SUB] = {['='] = TOKEN_SUB_ASSIGN, ['-'] = TOKEN_DEC,
+                   ['>'] = TOKEN_POINTER},
+    [TOKEN_ASTERISK] = {['='] = TOKEN_MUL_ASSIGN},
+    [TOKEN_DIV] = {['='] = TOKEN_DIV_ASSIGN},
+    [TOKEN_MOD] = {['='] = TOKEN_MOD_ASSIGN},
+    [TOKEN_ASSIGN] = {['='] = TOKEN_EQ},
+    [TOKEN_NOT] = {['='] = TOKEN_NOT_EQ},
+    [TOKEN_LT] = {['='] = TOKEN_LTEQ, ['<'] = TOKEN_LSHIFT},
+    [TOKEN_LSHIFT] = {['='] = TOKEN_LSHIFT_ASSIGN},
+    [TOKEN_GT] = {['='] = TOKEN_GTEQ, ['>'] = TOKEN_RSHIFT},
+    [TOKEN_RSHIFT] = {['='] = TOKEN_RSHIFT_ASSIGN},
+    [TOKEN_HASH] = {['#'] = TOKEN_HASH_HASH},
+};
 
 /* =================== SCANNERS ==================== */
-static vtoken_t *scan_char() {
+static vtoken_t *scan_char(vcc_lexer_t *L) {
   // set token type
-  next(1); // skip first delimiter;
-  if (c == '\'') {
-    errors("Empty between character delimiter\n");
+  next(L, 1); // skip first delimiter;
+  if (L->c == '\'') {
+    errors(L, "Empty between character delimiter\n");
     return NULL;
   }
-  if (c == '\\' && peek(2) == '\'') {
-    vtoken_t *t = vtoken_new(TOKEN_CHAR, filebufptr, 2);
-    next(3);
+  if (L->c == '\\' && peek(L, 2) == '\'') {
+    vtoken_t *t = vtoken_new_text(L, TOKEN_CHAR, L->ptr, 2);
+    next(L, 3);
     return t;
-  } else if (peek(1) == '\'') { // a normal char
-    vtoken_t *t = vtoken_new(TOKEN_CHAR, filebufptr, 1);
-    next(2);
+  } else if (peek(L, 1) == '\'') { // a normal char
+    vtoken_t *t = vtoken_new_text(L, TOKEN_CHAR, L->ptr, 1);
+    next(L, 2);
     return t;
   } else {
-    lastlex = 1;
-    errors("Wrong or unsupported character, or use `\"` if it is a string");
+    L->error = 1;
+    errors(L, "Wrong or unsupported character, or use `\"` if it is a string");
     return NULL;
   }
   return NULL;
 }
 
-static vtoken_t *scan_number() {
-  reset_buf();
-  buflen = 0;
-  int dotcount = 0;
-  int tt = TOKEN_INT; // token type
-  while (1) {
-    if (c == '.') {
-      if (dotcount == 0) {
-        tt = TOKEN_FLOAT;
-        buf[buflen++] = c;
-        next(1);
-        continue;
-      } else {
-        errors("wrong float format\n");
-        return NULL;
-      }
+/* value + 1 of every digit up to base 16, 0 for chars that are no digit
+ */
+static const uint8_t digit_values[256] = {
+    ['0'] = 1,  ['1'] = 2,  ['2'] = 3,  ['3'] = 4,  ['4'] = 5,  ['5'] = 6,
+    ['6'] = 7,  ['7'] = 8,  ['8'] = 9,  ['9'] = 10, ['a'] = 11, ['b'] = 12,
+    ['c'] = 13, ['d'] = 14, ['e'] = 15, ['f'] = 16, ['A'] = 11, ['B'] = 12,
+    ['C'] = 13, ['D'] = 14, ['E'] = 15, ['F'] = 16,
+};
+
+#define digit_value(chr) (digit_values[(uint8_t)(chr)] - 1)
+
+/* powers of ten that are exact in double and float
+ */
+static const double pow10_exact[] = {
+    1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,  1e8,  1e9,  1e10, 1e11,
+    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22,
+};
+static const float pow10f_exact[] = {1e0f, 1e1f, 1e2f, 1e3f, 1e4f, 1e5f,
+                                     1e6f, 1e7f, 1e8f, 1e9f, 1e10f};
+
+/* converts the `len` bytes of a float literal at `p`, without its suffix,
+ * with the C library, which always rounds correctly
+ */
+static double float_slow(const char *p, int len, int flags) {
+  char small[64];
+  char *s = len < (int)sizeof(small) ? small : xalloc(len + 1);
+  memcpy(s, p, len);
+  s[len] = '\0';
+  double value = flags & VCC_LIT_FLOAT ? strtof(s, NULL) : strtod(s, NULL);
+  if (s != small) {
+    xfree(s);
+  }
+  return value;
+}
+
+/* scans an integer or floating literal of any base with its suffix in one
+ * pass over the source, the value is accumulated on the way: integers are
+ * exact up to 64 bits, a float is mant * 10^exp10, which is rounded
+ * correctly by a single operation when both are exact (Clinger's fast
+ * path), only the other floats go through strtod()
+ */
+static vtoken_t *scan_number(vcc_lexer_t *L) {
+  const char *s = L->src;
+  int start = L->ptr, p = start;
+  int base = 10, type = TOKEN_INT, flags = 0;
+  uint64_t mant = 0;
+  int exp10 = 0;   // decimal exponent of the digits in mant
+  int dropped = 0; // digits that did not fit in mant
+  int inexact = 0; // some dropped digit was not 0
+  const char *error = NULL;
+
+  if (s[p] == '0' && p + 1 < L->len && (s[p + 1] | 0x20) == 'x') {
+    base = 16;
+    p += 2;
+  } else if (s[p] == '0' && p + 1 < L->len && (s[p + 1] | 0x20) == 'b') {
+    base = 2;
+    p += 2;
+  }
+  int digits = p;
+  int radix = base == 10 ? 10 : base; // 10 covers octal digits too
+  while (p < L->len) {
+    int d = digit_value(s[p]);
+    if (d < 0 || d >= radix) {
+      break;
     }
-    if (is_digit(c)) {
-      buf[buflen++] = c;
-      next(1);
-      continue;
+    uint64_t m;
+    if (__builtin_mul_overflow(mant, radix, &m) ||
+        __builtin_add_overflow(m, d, &m)) {
+      ++dropped;
+      inexact |= d;
     } else {
-      break;
+      mant = m;
+    }
+    ++p;
+  }
+  int ndigits = p - digits;
+
+  if (base == 16 && p < L->len && (s[p] == '.' || (s[p] | 0x20) == 'p')) {
+    // hex floats are rare, strtod() reads them
+    type = TOKEN_FLOAT;
+    if (s[p] == '.') {
+      ++p;
+      while (p < L->len && digit_value(s[p]) >= 0) {
+        ++p;
+      }
+    }
+    if (p == L->len || (s[p] | 0x20) != 'p') {
+      error = "hex float has no exponent";
+    }
+    inexact = 1;
+  } else if (base == 10 && p < L->len &&
+             (s[p] == '.' || (s[p] | 0x20) == 'e')) {
+    type = TOKEN_FLOAT;
+    exp10 = dropped;
+    if (s[p] == '.') {
+      ++p;
+      while (p < L->len && is_digit(s[p])) {
+        uint64_t m;
+        int d = s[p] - '0';
+        if (__builtin_mul_overflow(mant, 10, &m) ||
+            __builtin_add_overflow(m, d, &m)) {
+          inexact |= d;
+        } else {
+          mant = m;
+          --exp10;
+        }
+        ++p;
+      }
+    }
+  }
+  if (type == TOKEN_FLOAT && !error && p < L->len &&
+      (s[p] | 0x20) == (base == 16 ? 'p' : 'e')) {
+    ++p;
+    int sign = 1, exp = 0;
+    if (p < L->len && (s[p] == '+' || s[p] == '-')) {
+      sign = s[p] == '-' ? -1 : 1;
+      ++p;
+    }
+    if (p == L->len || !is_digit(s[p])) {
+      error = "exponent has no digits";
+    }
+    while (p < L->len && is_digit(s[p])) {
+      if (exp < 100000) {
+        exp = exp * 10 + s[p] - '0';
+      }
+      ++p;
+    }
+    exp10 += sign * exp;
+  }
+  int text_len = p - start;
+
+  // suffixes
+  if (type == TOKEN_FLOAT) {
+    if (p < L->len && (s[p] | 0x20) == 'f') {
+      flags = VCC_LIT_FLOAT;
+      ++p;
+    } else if (p < L->len && (s[p] | 0x20) == 'l') {
+      flags = VCC_LIT_LONG;
+      ++p;
+    }
+  } else {
+    if (p < L->len && (s[p] | 0x20) == 'u') {
+      flags |= VCC_LIT_UNSIGNED;
+      ++p;
+    }
+    if (p < L->len && (s[p] | 0x20) == 'l') {
+      // ll must not mix cases
+      int ll = p + 1 < L->len && s[p + 1] == s[p];
+      flags |= ll ? VCC_LIT_LONG_LONG : VCC_LIT_LONG;
+      p += ll ? 2 : 1;
+    }
+    if (!(flags & VCC_LIT_UNSIGNED) && p < L->len && (s[p] | 0x20) == 'u') {
+      flags |= VCC_LIT_UNSIGNED;
+      ++p;
     }
   }
-  // number postfix etc.
-  if (tt == TOKEN_FLOAT && buflen < 2) {
-    errors("wrong float\n");
+  if (!error && p < L->len && (is_id(s[p]) || s[p] == '.')) {
+    error = is_digit(s[p]) ? "invalid digit in number" : "invalid number suffix";
+  } else if (!error && base != 10 && ndigits == 0) {
+    error = "number has no digits";
+  } else if (!error && type == TOKEN_INT && dropped) {
+    error = "integer literal is too large";
+  }
+  if (error) {
+    L->error = 1;
+    errorf_at(L, L->base + p, "%s\n", error);
     return NULL;
   }
-  logf("parsed number: %s\n", buf);
-  vtoken_t *tok = vtoken_new_from_buf(tt);
-  return tok;
-}
 
-static vtoken_t *scan_number_neg() {
-  logs("Scanning number, negative case\n");
-  vtoken_t *num = scan_number();
-  switch (num->type) {
-  //
-  case TOKEN_FLOAT:
-    num->value.f = 0 - num->value.f;
-    break;
-  case TOKEN_INT:
-    num->value.i = 0 - num->value.i;
+  vtoken_t *tok = vtoken_new(L, type, start, p - start);
+  tok->flags = flags;
+  if (type == TOKEN_INT) {
+    if (s[start] == '0' && ndigits > 1 && base == 10) { // octal
+      mant = 0;
+      for (int i = digits; i < digits + ndigits; ++i) {
+        int d = s[i] - '0';
+        if (d >= 8 || __builtin_mul_overflow(mant, 8, &mant) ||
+            __builtin_add_overflow(mant, d, &mant)) {
+          L->error = 1;
+          errorf_at(L, L->base + i, "%s\n",
+                    d >= 8 ? "invalid digit in octal number"
+                           : "integer literal is too large");
+          vtoken_free(L, tok);
+          return NULL;
+        }
+      }
+    }
+    tok->value.i = mant;
+  } else if (!inexact && flags & VCC_LIT_FLOAT && mant <= 1 << 24 &&
+             exp10 >= -10 && exp10 <= 10) {
+    tok->value.f = exp10 < 0 ? (float)mant / pow10f_exact[-exp10]
+                             : (float)mant * pow10f_exact[exp10];
+  } else if (!inexact && !(flags & VCC_LIT_FLOAT) && mant <= 1ull << 53 &&
+             exp10 >= -22 && exp10 <= 22) {
+    tok->value.f = exp10 < 0 ? (double)mant / pow10_exact[-exp10]
+                             : (double)mant * pow10_exact[exp10];
+  } else {
+    tok->value.f = float_slow(s + start, text_len, flags);
   }
-  return num;
+  next(L, p - start);
+  return tok;
 }
 
-static vtoken_t *scan_string() {
-  int len = -1;
-  int start = filebufptr + 1;
+static vtoken_t *scan_string(vcc_lexer_t *L) {
+  int quote = L->ptr; // the first string delimiter
   while (1) {
-    next(1); // skip the first string delimiter
-    ++len;
-    if (c == BUF_EOF) {
-      errors("String has no ending delimiter\n");
+    const char *end = L->src + L->len;
+    const char *p = L->scan->find2(L->src + L->ptr + 1, end, '"', '\\');
+    if (p == end && !L->eof) { // the string goes on in the next window
+      skip_to(L, L->len - 1);
+      refill_from(L, &quote);
+      continue;
+    }
+    if (p == end) {
+      skip_to(L, L->len);
+      errors(L, "String has no ending delimiter\n");
       return NULL;
     }
-    if (c == '\\' && peek(1) == '"') {
-      next(2);
-      len += 2;
+    skip_to(L, p - L->src);
+    if (L->c == '\\') { // escaped chars never end it
+      if (L->ptr + 1 == L->len) {
+        refill_from(L, &quote);
+      }
+      if (peek(L, 1) != BUF_EOF) {
+        next(L, 1);
+      }
       continue;
     }
-    if (c == '"') {
-      next(1); // skip the second string delimiter, done
-      return vtoken_new(TOKEN_STR, start, len);
-    }
+    // skip the second string delimiter, done
+    int start = quote + 1;
+    vtoken_t *t = vtoken_new_text(L, TOKEN_STR, start, L->ptr - start);
+    next(L, 1);
+    return t;
   }
   return NULL;
 }
 
 /* scan and deal with nested C-style comments
  */
-static int scan_comment() {
+static int scan_comment(vcc_lexer_t *L) {
   /* maintain a stack that counts the number of comments in total
    */
   int stack = 1;
+  next(L, 1); // skip current comment open symbol
   while (stack) {
-    next(1); // skip current comment open symbol
-    if (c == BUF_EOF) {
-      errors("Comment has no ending\n");
+    const char *end = L->src + L->len;
+    const char *p = L->scan->find2(L->src + L->ptr + 1, end, '/', '*');
+    if (p == end && !L->eof) { // the comment goes on in the next window
+      skip_to(L, L->len - 1);
+      refill(L, L->ptr);
+      continue;
+    }
+    if (p == end) {
+      skip_to(L, L->len);
+      errors(L, "Comment has no ending\n");
       return -1;
     }
-    if (c == '/' && peek(1) == '*') {
+    skip_to(L, p - L->src);
+    if (L->ptr + 1 == L->len) { // the other half may be in the next window
+      refill(L, L->ptr);
+    }
+    if (L->c == '/' && peek(L, 1) == '*') {
       ++stack;
-      next(1);
+      next(L, 1);
       continue;
     }
-    if (c == '*' && peek(1) == '/') {
+    if (L->c == '*' && peek(L, 1) == '/') {
       --stack;
-      next(1);
+      next(L, 1);
       continue;
     }
   }
-  logf("C comment ended on line %d\n", line);
-  next(1);
+  logf("C comment ended at %u\n", L->base + L->ptr);
+  next(L, 1);
   return 0;
 }
 
-/* tests buf to check if it's a keyword
+/* keyword perfect hash, generated by tools/gen_keywords.py: every keyword
+ * has its own slot, so an identifier is a keyword only if it is equal to
+ * the keyword in its slot
  */
-#define match(kw, tok_type)                                                    \
-  if (!strncmp(buf, kw, strlen(kw)))                                           \
-  return tok_type
+#define KW_HASH_SIZE 128
+#define KW_HASH(id, len)                                                       \
+  (((len) * 1 + (id)[0] * 6 + (id)[1] * 17 + (id)[(len)-1] * 1) &              \
+   (KW_HASH_SIZE - 1))
 
-static int identifier_type() {
-  switch (buf[0]) {
-  case 'b':
-    match("break", TOKEN_KWORD_BREAK);
-    break;
-  case 'c':
-    match("case", TOKEN_KWORD_CASE);
-    match("const", TOKEN_KWORD_CONST);
-    match("continue", TOKEN_KWORD_CONTINUE);
-    break;
-  case 'd':
-    match("default", TOKEN_KWORD_DEFAULT);
-    match("do", TOKEN_KWORD_DO);
-    break;
-  case 'e':
-    match("enum", TOKEN_KWORD_ENUM);
-    match("else", TOKEN_KWORD_ELSE);
-    break;
-  case 'f':
-    match("for", TOKEN_KWORD_FOR);
-    break;
-  case 'g':
-    match("goto", TOKEN_KWORD_GOTO);
-    break;
-  case 'i':
-    match("if", TOKEN_KWORD_IF);
-    break;
-  case 'N':
-    match("NULL", TOKEN_KWORD_NULL);
-    break;
-  case 'r':
-    match("return", TOKEN_KWORD_RETURN);
-    break;
-  case 's':
-    match("sizeof", TOKEN_KWORD_SIZEOF);
-    match("static", TOKEN_KWORD_STATIC);
-    match("struct", TOKEN_KWORD_STRUCT);
-    match("switch", TOKEN_KWORD_SWITCH);
-    break;
-  case 't':
-    match("typedef", TOKEN_KWORD_TYPEDEF);
-    break;
-  case 'u':
-    match("union", TOKEN_KWORD_UNION);
-    break;
-  case 'w':
-    match("while", TOKEN_KWORD_WHILE);
-    break;
-  default:
-    break;
-  }
+static const struct {
+  char s[15];
+  uint8_t len;
+  uint8_t type;
+} kw_slots[KW_HASH_SIZE] = {
+    [6] = {"_Alignas", 8, TOKEN_KWORD_ALIGNAS},
+    [7] = {"switch", 6, TOKEN_KWORD_SWITCH},
+    [8] = {"default", 7, TOKEN_KWORD_DEFAULT},
+    [9] = {"float", 5, TOKEN_KWORD_FLOAT},
+    [11] = {"void", 4, TOKEN_KWORD_VOID},
+    [13] = {"_Bool", 5, TOKEN_KWORD_BOOL},
+    [16] = {"volatile", 8, TOKEN_KWORD_VOLATILE},
+    [19] = {"short", 5, TOKEN_KWORD_SHORT},
+    [21] = {"signed", 6, TOKEN_KWORD_SIGNED},
+    [22] = {"_Imaginary", 10, TOKEN_KWORD_IMAGINARY},
+    [23] = {"sizeof", 6, TOKEN_KWORD_SIZEOF},
+    [28] = {"while", 5, TOKEN_KWORD_WHILE},
+    [29] = {"enum", 4, TOKEN_KWORD_ENUM},
+    [30] = {"continue", 8, TOKEN_KWORD_CONTINUE},
+    [34] = {"double", 6, TOKEN_KWORD_DOUBLE},
+    [36] = {"if", 2, TOKEN_KWORD_IF},
+    [40] = {"do", 2, TOKEN_KWORD_DO},
+    [42] = {"const", 5, TOKEN_KWORD_CONST},
+    [44] = {"case", 4, TOKEN_KWORD_CASE},
+    [45] = {"_Complex", 8, TOKEN_KWORD_COMPLEX},
+    [46] = {"typedef", 7, TOKEN_KWORD_TYPEDEF},
+    [47] = {"inline", 6, TOKEN_KWORD_INLINE},
+    [48] = {"char", 4, TOKEN_KWORD_CHAR},
+    [56] = {"for", 3, TOKEN_KWORD_FOR},
+    [59] = {"int", 3, TOKEN_KWORD_INT},
+    [60] = {"goto", 4, TOKEN_KWORD_GOTO},
+    [63] = {"_Static_assert", 14, TOKEN_KWORD_STATIC_ASSERT},
+    [71] = {"_Thread_local", 13, TOKEN_KWORD_THREAD_LOCAL},
+    [73] = {"NULL", 4, TOKEN_KWORD_NULL},
+    [74] = {"extern", 6, TOKEN_KWORD_EXTERN},
+    [78] = {"break", 5, TOKEN_KWORD_BREAK},
+    [79] = {"static", 6, TOKEN_KWORD_STATIC},
+    [82] = {"long", 4, TOKEN_KWORD_LONG},
+    [85] = {"return", 6, TOKEN_KWORD_RETURN},
+    [91] = {"register", 8, TOKEN_KWORD_REGISTER},
+    [92] = {"_Generic", 8, TOKEN_KWORD_GENERIC},
+    [93] = {"restrict", 8, TOKEN_KWORD_RESTRICT},
+    [95] = {"_Noreturn", 9, TOKEN_KWORD_NORETURN},
+    [96] = {"struct", 6, TOKEN_KWORD_STRUCT},
+    [115] = {"else", 4, TOKEN_KWORD_ELSE},
+    [117] = {"_Atomic", 7, TOKEN_KWORD_ATOMIC},
+    [120] = {"unsigned", 8, TOKEN_KWORD_UNSIGNED},
+    [121] = {"_Alignof", 8, TOKEN_KWORD_ALIGNOF},
+    [126] = {"auto", 4, TOKEN_KWORD_AUTO},
+    [127] = {"union", 5, TOKEN_KWORD_UNION},
+};
 
+#define KW_MIN_LEN 2
+#define KW_MAX_LEN 14
+
+/* tests the identifier at `id` to check if it's a keyword
+ */
+static int identifier_type(const char *id, int len) {
+  if (len < KW_MIN_LEN || len > KW_MAX_LEN) {
+    return TOKEN_IDENTIFIER;
+  }
+  int slot = KW_HASH(id, len);
+  if (kw_slots[slot].len == len && !memcmp(id, kw_slots[slot].s, len)) {
+    return kw_slots[slot].type;
+  }
   return TOKEN_IDENTIFIER;
 }
 
-#undef match
-
-static vtoken_t *scan_identifier() {
+static vtoken_t *scan_identifier(vcc_lexer_t *L) {
   logs("scanning identifier\n");
-  // init buffer state
-  reset_buf();
-  buflen = 0;
+  int start = L->ptr;
+  int end = start + 1;
   while (1) {
-    if (buflen == 0 && is_alpha(c)) {
-      buf[buflen++] = c;
-      next(1);
-    } else if (buflen > 0 && is_id(c)) {
-      buf[buflen++] = c;
-      next(1);
-    } else {
+    while (end < L->len && is_id(L->src[end])) {
+      ++end;
+    }
+    if (end < L->len || L->eof) {
       break;
     }
+    end -= start; // the identifier goes on in the next window
+    refill_from(L, &start);
+    end += start;
   }
+  int len = end - start;
+  next(L, len);
   // check if the idetifier is actually a keyword
-  vtoken_t *t = vtoken_new_from_buf(identifier_type());
-  return t;
+  int type = identifier_type(L->src + start, len);
+  if (type != TOKEN_IDENTIFIER) {
+    return vtoken_new(L, type, start, len);
+  }
+  return vtoken_new_text(L, TOKEN_IDENTIFIER, start, len);
+}
+
+/* allocates a lexer over `len` bytes at `src`, shared by all input modes
+ */
+static vcc_lexer_t *lexer_new(const char *fname, const char *src, int len) {
+  vcc_lexer_t *L = xalloc(sizeof(vcc_lexer_t));
+  strncpy(L->fname, fname, sizeof(L->fname) - 1);
+  L->src = src;
+  L->len = len;
+  L->lines.first = 1;
+  L->ptr = 0;
+  L->c = at(L, L->ptr);
+  L->error = 0;
+  L->eof = 1;
+  L->tokens = arena_new(TOKEN_ARENA_CHUNK_SIZE);
+  L->scan = vcc_scan_best();
+  L->symtbl = vcc_symtbl_new();
+  L->own_symtbl = 1;
+  return L;
 }
 
-int vcc_lexer_init(const char *_fname) {
-  FILE *fp = fopen(_fname, "rb");
+/* reads the whole file into a private buffer
+ */
+vcc_lexer_t *vcc_lexer_new(const char *fname) {
+  FILE *fp = fopen(fname, "rb");
   if (!fp) {
     fatalf("Could not open `%s` to read\n", fname);
   }
-  logf("Opened `%s` at %p\n", _fname, (void *)fp);
+  logf("Opened `%s` at %p\n", fname, (void *)fp);
   // copy file data to buffer
-  filebuf = buf_new_from_file(fp);
-  // init variables
-  strncpy(fname, _fname, 255);
-  line = 1;
-  col = 1;
-  filebufptr = 0;
-  assert(filebuf->len > 0);
-  c = filebuf->s[filebufptr];
-  buflen = 0;
-  lastlex = 0;
-  return 0;
+  buf_t *filebuf = buf_new_from_file(fp);
+  fclose(fp);
+  vcc_lexer_t *L = lexer_new(fname, filebuf->s, filebuf->len);
+  L->input = VCC_LEXER_INPUT_BUF;
+  L->filebuf = filebuf;
+  return L;
+}
+
+/* maps the file read-only, tokens then point straight into the mapping
+ */
+vcc_lexer_t *vcc_lexer_new_mmap(const char *fname) {
+  size_t len;
+  void *map = file_map(fname, &len);
+  if (!map) {
+    fatalf("Could not map `%s` to read\n", fname);
+  }
+  logf("Mapped `%s` at %p\n", fname, map);
+  vcc_lexer_t *L = lexer_new(fname, map, len);
+  L->input = VCC_LEXER_INPUT_MMAP;
+  return L;
 }
 
+/* lexes memory owned by the caller, which must outlive the lexer
+ */
+vcc_lexer_t *vcc_lexer_new_from_mem(const char *fname, const char *src,
+                                    int len) {
+  vcc_lexer_t *L = lexer_new(fname, src, len);
+  L->input = VCC_LEXER_INPUT_MEM;
+  return L;
+}
+
+/* lexes `fp` through a window of `window` bytes, or of
+ * VCC_LEXER_WINDOW_SIZE if it is 0, so it works on pipes and stdin and never
+ * holds the whole input, `fp` stays open and owned by the caller, numbers
+ * and operators must be shorter than the lookahead
+ */
+vcc_lexer_t *vcc_lexer_new_stream(const char *fname, FILE *fp, int window) {
+  if (window <= 0) {
+    window = VCC_LEXER_WINDOW_SIZE;
+  }
+  vcc_lexer_t *L = lexer_new(fname, NULL, 0);
+  L->input = VCC_LEXER_INPUT_STREAM;
+  L->stream = fp;
+  L->window = xalloc(window);
+  L->cap = window;
+  L->lookahead =
+      window / 2 < VCC_LEXER_LOOKAHEAD ? window / 2 : VCC_LEXER_LOOKAHEAD;
+  L->eof = 0;
+  L->src = L->window;
+  read_input(L);
+  L->c = at(L, L->ptr);
+  return L;
+}
+
+/* makes the lexer intern into `symtbl`, e.g. vcc_symtbl_global(), so its
+ * atoms agree with other lexers using the same table, must be called
+ * before the first token
+ */
+void vcc_lexer_set_symtbl(vcc_lexer_t *L, vcc_symtbl_t *symtbl) {
+  if (L->own_symtbl) {
+    vcc_symtbl_free(L->symtbl);
+  }
+  L->symtbl = symtbl;
+  L->own_symtbl = 0;
+}
+
+/* makes # lines tokens for the preprocessor instead of skipping them: a
+ * directive is TOKEN_HASH, its tokens and TOKEN_NEWLINE, must be called
+ * before the first token
+ */
+void vcc_lexer_keep_directives(vcc_lexer_t *L) { L->directives = 1; }
+
 /* free resources
  */
-int vcc_lexer_finish() {
+void vcc_lexer_free(vcc_lexer_t *L) {
+  if (!L) {
+    return;
+  }
   logs("lexing done, freeing resources\n");
-  buf_free(filebuf);
-  return 0;
+  switch (L->input) {
+  case VCC_LEXER_INPUT_BUF:
+    buf_free(L->filebuf);
+    break;
+  case VCC_LEXER_INPUT_MMAP:
+    file_unmap((void *)L->src, L->len);
+    break;
+  case VCC_LEXER_INPUT_STREAM:
+    xfree(L->window);
+    break;
+  }
+  arena_free(L->tokens);
+  xfree(L->lines.starts);
+  if (L->own_symtbl) {
+    vcc_symtbl_free(L->symtbl);
+  }
+  xfree(L);
+}
+
+/* lexes the longest operator starting at the current char
+ */
+static vtoken_t *scan_operator(vcc_lexer_t *L) {
+  int type = op_start[L->c & 0x7f];
+  int len = 1;
+  while (1) {
+    uint8_t ch = peek(L, len);
+    if (ch >= 128 || !op_trans[type][ch]) {
+      break;
+    }
+    type = op_trans[type][ch];
+    ++len;
+  }
+  return vtoken_new_punct(L, type, len);
 }
 
-static vtoken_t *next_token() {
+static vtoken_t *next_token(vcc_lexer_t *L) {
 _lex_loop:
   // logs("lexing the next token\n");
   // skip lexing if the last lex failed
-  if (lastlex != 0) {
+  if (L->error != 0) {
     logs("Last lex() failed, skipping\n");
     return NULL;
   }
-  // ignore white spaces
-  if (c != BUF_EOF) {
-    if (is_space(c)) {
-      // it's safe to continue here since we filter new line in next(1)
-      next(1);
-      goto _lex_loop;
+  // a token never starts so close to the end of a window that it is cut
+  if (!L->eof && L->len - L->ptr < L->lookahead) {
+    refill(L, L->ptr);
+  }
+  switch (char_class[(uint8_t)L->c]) {
+  case CC_SPACE: // ignore white spaces, most runs are a single char
+    if (L->in_directive) { // only here a newline means something
+      if (L->c == '\n') {
+        L->in_directive = 0;
+        return vtoken_new_punct(L, TOKEN_NEWLINE, 1);
+      }
+      next(L, 1);
+    } else if (is_space(peek(L, 1))) {
+      skip_to(L,
+              L->scan->skip_space(L->src + L->ptr, L->src + L->len) - L->src);
+    } else {
+      next(L, 1);
     }
-    // logf("line %d col %d | c = '%c'\n", line, col, c);
-    switch (c) {
-    case '#': // currently treat preprocessing statements as comments
-      logf("Preprocessor procedure on line %d\n", line);
-      discard_until('\n');
-      goto _lex_loop;
+    goto _lex_loop;
+
+  case CC_ALPHA: // identifiers and keywords don't start with digit
+    return scan_identifier(L);
 
-    case '\'':
-      logf("Scanning char on line %d\n", line);
-      return scan_char();
+  case CC_DIGIT:
+    return scan_number(L);
 
-    case '"':
-      logf("Scanning string on line %d\n", line);
-      return scan_string();
+  case CC_OP:
+    return scan_operator(L);
 
-    case '/':
-      if (peek(1) == '/') {
-        logf("C++ comment on line %d\n", line);
-        discard_until('\n');
+  case CC_DOT:
+    if (is_digit(peek(L, 1))) {
+      return scan_number(L);
+    }
+    if (peek(L, 1) == '.' && peek(L, 2) == '.') {
+      return vtoken_new_punct(L, TOKEN_ELLIPSIS, 3);
+    }
+    return scan_operator(L);
+
+  case CC_SLASH:
+    if (peek(L, 1) == '/') {
+      logf("C++ comment at %u\n", L->base + L->ptr);
+      discard_until(L, '\n');
+      goto _lex_loop; // skip to the next real token
+    }
+    if (peek(L, 1) == '*') {
+      logf("C comment at %u\n", L->base + L->ptr);
+      L->error = scan_comment(L);
+      if (L->error == 0) {
         goto _lex_loop; // skip to the next real token
       }
-      if (peek(1) == '*') {
-        logf("C comment on line %d\n", line);
-        lastlex = scan_comment();
-        if (lastlex == 0) {
-          goto _lex_loop; // skip to the next real token
-        }
-        // return error
-        return NULL;
-      }
-      if (peek(1) == '=') {
-        next(2);
-        return vtoken_new(TOKEN_DIV_ASSIGN, -1, 0);
+      // return error
+      return NULL;
+    }
+    return scan_operator(L);
+
+  case CC_QUOTE:
+    logf("Scanning char at %u\n", L->base + L->ptr);
+    return scan_char(L);
+
+  case CC_DQUOTE:
+    logf("Scanning string at %u\n", L->base + L->ptr);
+    return scan_string(L);
+
+  case CC_HASH:
+    logf("Preprocessor procedure at %u\n", L->base + L->ptr);
+    if (!L->directives) { // no preprocessor, # lines are comments
+      discard_until(L, '\n');
+      goto _lex_loop;
+    }
+    if (L->in_directive) { // # and ## of macro bodies
+      return scan_operator(L);
+    }
+    L->in_directive = 1;
+    return vtoken_new_punct(L, TOKEN_HASH, 1);
+
+  case CC_EOF:
+    if (L->in_directive) { // a directive on the last line
+      L->in_directive = 0;
+      return vtoken_new(L, TOKEN_NEWLINE, L->ptr, 0);
+    }
+    /* add the final token: the EOF
+     */
+    logs("Reached EOF\n");
+    return vtoken_new(L, TOKEN_EOF, L->ptr, 0);
+
+  default:
+    if (L->c == '\\' && (peek(L, 1) == '\n' ||
+                         (peek(L, 1) == '\r' && peek(L, 2) == '\n'))) {
+      next(L, peek(L, 1) == '\n' ? 2 : 3); // line continues
+      goto _lex_loop;
+    }
+    errors(L, "Unknown or unimplemented token!");
+    return NULL;
+  }
+  return NULL;
+}
+
+/* records where the lines of the window start, one vectorized search per
+ * line
+ */
+static void build_lines(vcc_lexer_t *L) {
+  vcc_lines_t *lines = &L->lines;
+  const char *end = L->src + L->len;
+  lines->count = 0;
+  const char *p = L->src;
+  uint32_t start = lines->first_start;
+  while (1) {
+    if (lines->count == lines->cap) {
+      int cap = lines->cap ? lines->cap * 2 : 256;
+      uint32_t *starts = xalloc(cap * sizeof(uint32_t));
+      if (lines->starts) {
+        memcpy(starts, lines->starts, lines->count * sizeof(uint32_t));
+        xfree(lines->starts);
       }
-      next(1);
-      return vtoken_new(TOKEN_DIV, -1, 0);
+      lines->starts = starts;
+      lines->cap = cap;
+    }
+    lines->starts[lines->count++] = start;
+    p = L->scan->find2(p, end, '\n', '\n');
+    if (p == end) {
+      break;
+    }
+    ++p;
+    start = L->base + (p - L->src);
+  }
+}
 
-    case ';':
-      next(1);
-      return vtoken_new(TOKEN_SEMICOLON, -1, 0);
+/* maps an input offset to its 1-based line and column, the line index is
+ * only built on the first call, so lexing itself never counts lines,
+ * offsets a stream has already dropped are reported at the oldest line left
+ */
+void vcc_lexer_locate(vcc_lexer_t *L, uint32_t offset, int *line, int *col) {
+  if (!L->lines.count) {
+    build_lines(L);
+  }
+  const uint32_t *starts = L->lines.starts;
+  int lo = 0, hi = L->lines.count - 1;
+  if (offset < starts[0]) {
+    offset = starts[0];
+  }
+  while (lo < hi) { // the last line starting at or before offset
+    int mid = (lo + hi + 1) / 2;
+    if (starts[mid] <= offset) {
+      lo = mid;
+    } else {
+      hi = mid - 1;
+    }
+  }
+  *line = L->lines.first + lo;
+  *col = offset - starts[lo] + 1;
+}
 
-    case '(':
-      next(1);
-      return vtoken_new(TOKEN_LPAREN, -1, 0);
+/* this function is called by parser to
+ * get the tokens from stream
+ */
+vtoken_t *vcc_lex(vcc_lexer_t *L) { return next_token(L); }
 
-    case ')':
-      next(1);
-      return vtoken_new(TOKEN_RPAREN, -1, 0);
+/* =================== TOKEN BUFFER ==================== */
+#define TOKBUF_INIT_CAP 1024
 
-    case '[':
-      next(1);
-      return vtoken_new(TOKEN_LBRACKET, -1, 0);
+vcc_tokbuf_t *vcc_tokbuf_new() {
+  vcc_tokbuf_t *tokens = xalloc(sizeof(vcc_tokbuf_t));
+  tokens->cap = TOKBUF_INIT_CAP;
+  tokens->types = xalloc(tokens->cap * sizeof(uint8_t));
+  tokens->offsets = xalloc(tokens->cap * sizeof(uint32_t));
+  tokens->lens = xalloc(tokens->cap * sizeof(uint32_t));
+  tokens->payloads = xalloc(tokens->cap * sizeof(uint32_t));
+  tokens->literals_cap = TOKBUF_INIT_CAP;
+  tokens->literals = xalloc(tokens->literals_cap * sizeof(vtoken_value_t));
+  tokens->literal_flags = xalloc(tokens->literals_cap * sizeof(uint8_t));
+  return tokens;
+}
 
-    case ']':
-      next(1);
-      return vtoken_new(TOKEN_RBRACKET, -1, 0);
+void vcc_tokbuf_free(vcc_tokbuf_t *tokens) {
+  if (!tokens) {
+    return;
+  }
+  xfree(tokens->types);
+  xfree(tokens->offsets);
+  xfree(tokens->lens);
+  xfree(tokens->payloads);
+  xfree(tokens->literals);
+  xfree(tokens->literal_flags);
+  xfree(tokens);
+}
 
-    case '{':
-      next(1);
-      return vtoken_new(TOKEN_LBRACE, -1, 0);
+static void *grow_array(void *array, int count, int cap, size_t size) {
+  void *grown = xalloc(cap * size);
+  memcpy(grown, array, count * size);
+  xfree(array);
+  return grown;
+}
 
-    case '}':
-      next(1);
-      return vtoken_new(TOKEN_RBRACE, -1, 0);
+/* appends a copy of `token`
+ */
+void vcc_tokbuf_push(vcc_tokbuf_t *tokens, vtoken_t *token) {
+  int n = tokens->count;
+  if (n == tokens->cap) {
+    tokens->cap *= 2;
+    tokens->types = grow_array(tokens->types, n, tokens->cap, sizeof(uint8_t));
+    tokens->offsets =
+        grow_array(tokens->offsets, n, tokens->cap, sizeof(uint32_t));
+    tokens->lens = grow_array(tokens->lens, n, tokens->cap, sizeof(uint32_t));
+    tokens->payloads =
+        grow_array(tokens->payloads, n, tokens->cap, sizeof(uint32_t));
+  }
+  tokens->types[n] = token->type;
+  tokens->offsets[n] = token->offset;
+  tokens->lens[n] = token->len;
+  if (token->type == TOKEN_INT || token->type == TOKEN_FLOAT) {
+    if (tokens->nliterals == tokens->literals_cap) {
+      tokens->literals_cap *= 2;
+      tokens->literals =
+          grow_array(tokens->literals, tokens->nliterals, tokens->literals_cap,
+                     sizeof(vtoken_value_t));
+      tokens->literal_flags =
+          grow_array(tokens->literal_flags, tokens->nliterals,
+                     tokens->literals_cap, sizeof(uint8_t));
+    }
+    tokens->payloads[n] = tokens->nliterals;
+    tokens->literal_flags[tokens->nliterals] = token->flags;
+    tokens->literals[tokens->nliterals++] = token->value;
+  } else {
+    tokens->payloads[n] = token->value.atom;
+  }
+  ++tokens->count;
+}
 
-    case '*':
-      if (peek(1) == '=') {
-        next(2);
-        return vtoken_new(TOKEN_MUL_ASSIGN, -1, 0);
-      }
-      next(1);
-      return vtoken_new(TOKEN_ASTERISK, -1, 0);
-
-    case ',':
-      next(1);
-      return vtoken_new(TOKEN_COMMA, -1, 0);
-    case '.':
-      if (is_digit(peek(1))) {
-        return scan_number();
-      }
-      next(1);
-      return vtoken_new(TOKEN_DOT, -1, 0);
+/* fills `token` with the token at `index`
+ */
+void vcc_tokbuf_get(vcc_tokbuf_t *tokens, int index, vtoken_t *token) {
+  int type = tokens->types[index];
+  *token = (vtoken_t){.type = type,
+                      .offset = tokens->offsets[index],
+                      .len = tokens->lens[index]};
+  if (type == TOKEN_INT || type == TOKEN_FLOAT) {
+    token->value = tokens->literals[tokens->payloads[index]];
+    token->flags = tokens->literal_flags[tokens->payloads[index]];
+  } else {
+    token->value.atom = tokens->payloads[index];
+  }
+}
 
-    case '!':
-      if (peek(1) == '=') {
-        next(2);
-        return vtoken_new(TOKEN_NOT_EQ, -1, 0);
-      }
-      next(1);
-      return vtoken_new(TOKEN_NOT, -1, 0);
-
-    case '>':
-      // to do shift & shift equal
-      if (peek(1) == '=') {
-        next(2);
-        return vtoken_new(TOKEN_GTEQ, -1, 0);
-      }
-      next(1);
-      return vtoken_new(TOKEN_GT, -1, 0);
-
-    case '<':
-      // to do shift & shift equal
-      if (peek(1) == '=') {
-        next(2);
-        return vtoken_new(TOKEN_LTEQ, -1, 0);
-      }
-      next(1);
-      return vtoken_new(TOKEN_LT, -1, 0);
+/* appends the tokens of `src` from `from` up to `to` to `dst`, offsets
+ * moved by `shift`, numbers keep their literals
+ */
+static void tokbuf_copy(vcc_tokbuf_t *dst, vcc_tokbuf_t *src, int from,
+                        int to, int shift) {
+  int n = dst->count + to - from;
+  if (n > dst->cap) {
+    while (dst->cap < n) {
+      dst->cap *= 2;
+    }
+    dst->types = grow_array(dst->types, dst->count, dst->cap, sizeof(uint8_t));
+    dst->offsets =
+        grow_array(dst->offsets, dst->count, dst->cap, sizeof(uint32_t));
+    dst->lens = grow_array(dst->lens, dst->count, dst->cap, sizeof(uint32_t));
+    dst->payloads =
+        grow_array(dst->payloads, dst->count, dst->cap, sizeof(uint32_t));
+  }
+  memcpy(dst->types + dst->count, src->types + from,
+         (to - from) * sizeof(uint8_t));
+  memcpy(dst->lens + dst->count, src->lens + from,
+         (to - from) * sizeof(uint32_t));
+  // numbers are pushed in order, so those of the range have a run of
+  // literals of their own
+  uint32_t first_literal = 0;
+  int nliterals = 0;
+  for (int i = from, j = dst->count; i < to; ++i, ++j) {
+    int type = src->types[i];
+    dst->offsets[j] = src->offsets[i] + shift;
+    if (type == TOKEN_INT || type == TOKEN_FLOAT) {
+      first_literal = nliterals ? first_literal : src->payloads[i];
+      dst->payloads[j] = dst->nliterals + nliterals++;
+    } else {
+      dst->payloads[j] = src->payloads[i];
+    }
+  }
+  if (dst->nliterals + nliterals > dst->literals_cap) {
+    while (dst->literals_cap < dst->nliterals + nliterals) {
+      dst->literals_cap *= 2;
+    }
+    dst->literals = grow_array(dst->literals, dst->nliterals,
+                               dst->literals_cap, sizeof(vtoken_value_t));
+    dst->literal_flags = grow_array(dst->literal_flags, dst->nliterals,
+                                    dst->literals_cap, sizeof(uint8_t));
+  }
+  memcpy(dst->literals + dst->nliterals, src->literals + first_literal,
+         nliterals * sizeof(vtoken_value_t));
+  memcpy(dst->literal_flags + dst->nliterals,
+         src->literal_flags + first_literal, nliterals * sizeof(uint8_t));
+  dst->count = n;
+  dst->nliterals += nliterals;
+}
 
-    case '=':
-      if (peek(1) == '=') {
-        next(2);
-        return vtoken_new(TOKEN_EQ, -1, 0);
-      }
-      next(1);
-      return vtoken_new(TOKEN_ASSIGN, -1, 0);
+/* lexes the whole source at once, the buffer ends with the EOF token, or
+ * with the last good token and `error` set
+ */
+vcc_tokbuf_t *vcc_lex_all(vcc_lexer_t *L) {
+  vcc_tokbuf_t *tokens = vcc_tokbuf_new();
+  while (1) {
+    vtoken_t *t = vcc_lex(L);
+    if (!t) {
+      tokens->error = 1;
+      break;
+    }
+    vcc_tokbuf_push(tokens, t);
+    int type = t->type;
+    vtoken_free(L, t);
+    if (type == TOKEN_EOF) {
+      break;
+    }
+  }
+  return tokens;
+}
 
-    case '|':
-      if (peek(1) == '=') {
-        next(2);
-        return vtoken_new(TOKEN_OR_ASSIGN, -1, 0);
-      }
-      if (peek(1) == '|') {
-        next(2);
-        return vtoken_new(TOKEN_OR_OR, -1, 0);
-      }
-      next(1);
-      return vtoken_new(TOKEN_OR, -1, 0);
+/* ================= PARALLEL LEXING ================== */
 
-    case '&':
-      if (peek(1) == '&') {
-        next(2);
-        return vtoken_new(TOKEN_AND_AND, -1, 0);
-      }
-      if (peek(1) == '=') {
-        next(2);
-        return vtoken_new(TOKEN_AND_ASSIGN, -1, 0);
-      }
-      next(1);
-      return vtoken_new(TOKEN_AND, -1, 0);
+/* a stretch of the source lexed on a thread of its own, on the guess that
+ * it starts outside any comment, string or directive
+ */
+typedef struct _lex_chunk_t {
+  vcc_lexer_t *lexer;   // the whole source, lexed from `from` only
+  vcc_tokbuf_t *tokens; // tokens starting before `end`
+  uint32_t from;        // just after a newline
+  uint32_t end;         // where the next chunk starts, 0 for the last one
+  uint32_t first;       // offset of the first token found
+  uint32_t next;        // offset of the first token at or past `end`
+  int next_state;       // in_directive when that token was lexed
+  int error;            // the lexer failed before `next`
+  pthread_t thread;
+} lex_chunk_t;
 
-    case '%':
-      if (peek(1) == '=') {
-        next(2);
-        return vtoken_new(TOKEN_MOD_ASSIGN, -1, 0);
-      }
-      next(1);
-      return vtoken_new(TOKEN_ASSIGN, -1, 0);
+/* moves the lexer to `offset` of a source held in memory
+ */
+static void seek(vcc_lexer_t *L, uint32_t offset, int in_directive) {
+  L->ptr = offset;
+  L->c = at(L, offset);
+  L->in_directive = in_directive;
+  L->error = 0;
+}
+
+/* lexes `chunk` with `L`, from `offset` with `in_directive`, into a fresh
+ * token buffer
+ */
+static void lex_range(vcc_lexer_t *L, lex_chunk_t *chunk, uint32_t offset,
+                      int in_directive) {
+  vcc_tokbuf_free(chunk->tokens);
+  chunk->tokens = vcc_tokbuf_new();
+  chunk->error = 0;
+  seek(L, offset, in_directive);
+  for (int n = 0;; ++n) {
+    int state = L->in_directive;
+    vtoken_t *t = vcc_lex(L);
+    if (!t) {
+      chunk->error = chunk->tokens->error = 1;
+      return;
+    }
+    if (n == 0) {
+      chunk->first = t->offset;
+    }
+    if (chunk->end && t->offset >= chunk->end) {
+      chunk->next = t->offset;
+      chunk->next_state = state;
+      vtoken_free(L, t);
+      return;
+    }
+    vcc_tokbuf_push(chunk->tokens, t);
+    int type = t->type;
+    vtoken_free(L, t);
+    if (type == TOKEN_EOF) {
+      return;
+    }
+  }
+}
 
-    case ':':
-      next(1);
-      return vtoken_new(TOKEN_COLON, -1, 0);
+static void *lex_chunk(void *arg) {
+  lex_chunk_t *chunk = arg;
+  lex_range(chunk->lexer, chunk, chunk->from, 0);
+  return NULL;
+}
 
-    case '+':
-      if (peek(1) == '=') {
-        next(2);
-        return vtoken_new(TOKEN_ADD_ASSIGN, -1, 0);
-      }
-      if (peek(1) == '+') {
-        next(2);
-        return vtoken_new(TOKEN_INC, -1, 0);
-      }
-      next(1);
-      return vtoken_new(TOKEN_ADD, -1, 0);
+/* lexes a source held in memory on `nchunks` threads and gives exactly
+ * what vcc_lex_all() would, 0 picks one chunk per core of at least
+ * VCC_LEX_CHUNK_MIN bytes, must be called before the first token
+ *
+ * the source is cut after newlines and every chunk but the first is lexed
+ * as if it started outside any comment, string or directive, quietly; a
+ * chunk whose first token is not where the one before ended, or that
+ * failed, is lexed again with `lexer` from there, `relexed` counts those
+ *
+ * atoms come from one table shared by the chunks, a private table of the
+ * lexer is made a shared one, they are not numbered as a single lexer
+ * would number them, and misguessed chunks may leave extra names in it
+ */
+vcc_tokbuf_t *vcc_lex_all_parallel(vcc_lexer_t *L, int nchunks,
+                                   int *relexed) {
+  if (relexed) {
+    *relexed = 0;
+  }
+  if (nchunks <= 0) {
+    long ncores = sysconf(_SC_NPROCESSORS_ONLN);
+    nchunks = L->len / VCC_LEX_CHUNK_MIN;
+    nchunks = nchunks < ncores ? nchunks : ncores;
+  }
+  if (nchunks > L->len) {
+    nchunks = L->len;
+  }
+  if (L->input == VCC_LEXER_INPUT_STREAM || nchunks <= 1 ||
+      (!L->symtbl->shared && !L->own_symtbl)) {
+    return vcc_lex_all(L);
+  }
+  if (!L->symtbl->shared) {
+    vcc_symtbl_free(L->symtbl);
+    L->symtbl = vcc_symtbl_new_shared(nchunks);
+  }
 
-    case '-':
-      if (peek(1) == '=') {
-        next(2);
-        return vtoken_new(TOKEN_SUB_ASSIGN, -1, 0);
-      }
-      if (peek(1) == '>') {
-        next(2);
-        return vtoken_new(TOKEN_POINTER, -1, 0);
+  // cut after the first newline past each even share of the source
+  lex_chunk_t *chunks = xalloc(nchunks * sizeof(lex_chunk_t));
+  int count = 1;
+  for (int i = 1; i < nchunks; ++i) {
+    uint32_t cut = (uint64_t)L->len * i / nchunks;
+    cut = cut > chunks[count - 1].from ? cut : chunks[count - 1].from;
+    const char *nl = memchr(L->src + cut, '\n', L->len - cut);
+    if (!nl || nl + 1 == L->src + L->len) {
+      break;
+    }
+    chunks[count - 1].end = nl + 1 - L->src;
+    chunks[count++].from = nl + 1 - L->src;
+  }
+  logf("lexing `%s` in %d chunks\n", L->fname, count);
+
+  for (int i = 1; i < count; ++i) {
+    vcc_lexer_t *lexer = vcc_lexer_new_from_mem(L->fname, L->src, L->len);
+    vcc_lexer_set_symtbl(lexer, L->symtbl);
+    lexer->directives = L->directives;
+    lexer->quiet = 1;
+    chunks[i].lexer = lexer;
+    if (pthread_create(&chunks[i].thread, NULL, lex_chunk, &chunks[i])) {
+      fatals("could not start a lexer thread\n");
+    }
+  }
+  lex_range(L, &chunks[0], 0, 0);
+  for (int i = 1; i < count; ++i) {
+    pthread_join(chunks[i].thread, NULL);
+  }
+
+  // stitch the chunks in order, relexing those that guessed wrong
+  vcc_tokbuf_t *tokens = chunks[0].tokens;
+  chunks[0].tokens = NULL;
+  int error = chunks[0].error;
+  for (int i = 1; i < count && !error; ++i) {
+    lex_chunk_t *prev = &chunks[i - 1], *chunk = &chunks[i];
+    if (chunk->error || chunk->first != prev->next || prev->next_state) {
+      logf("chunk %d of `%s` relexed from %u\n", i, L->fname, prev->next);
+      lex_range(L, chunk, prev->next, prev->next_state);
+      if (relexed) {
+        ++*relexed;
       }
-      if (peek(1) == '-') {
-        next(2);
-        return vtoken_new(TOKEN_DEC, -1, 0);
+    }
+    tokbuf_copy(tokens, chunk->tokens, 0, chunk->tokens->count, 0);
+    tokens->error = chunk->tokens->error;
+    error = chunk->error;
+  }
+
+  // leave the lexer where vcc_lex_all() would
+  if (error) {
+    L->error = 1;
+  } else {
+    seek(L, tokens->offsets[tokens->count - 1], 0);
+  }
+  for (int i = 0; i < count; ++i) {
+    vcc_tokbuf_free(chunks[i].tokens);
+    vcc_lexer_free(chunks[i].lexer);
+  }
+  xfree(chunks);
+  return tokens;
+}
+
+/* ================ INCREMENTAL LEXING ================= */
+
+/* whether a lexer is inside a directive after the first `count` tokens,
+ * the last # or newline token before says it
+ */
+static int state_after(vcc_lexer_t *L, vcc_tokbuf_t *tokens, int count) {
+  if (!L->directives) {
+    return 0;
+  }
+  for (int i = count - 1; i >= 0; --i) {
+    int type = tokens->types[i];
+    if (type == TOKEN_NEWLINE) {
+      return 0;
+    }
+    if (type == TOKEN_HASH || type == TOKEN_HASH_HASH) {
+      return 1;
+    }
+  }
+  return 0;
+}
+
+/* where the text of token `i` starts and ends, with the quotes of strings
+ * and chars, which their offsets leave out
+ */
+static uint32_t token_start(vcc_tokbuf_t *tokens, int i) {
+  int type = tokens->types[i];
+  return tokens->offsets[i] - (type == TOKEN_STR || type == TOKEN_CHAR);
+}
+
+static uint32_t token_end(vcc_tokbuf_t *tokens, int i) {
+  int type = tokens->types[i];
+  return tokens->offsets[i] + tokens->lens[i] +
+         (type == TOKEN_STR || type == TOKEN_CHAR);
+}
+
+/* lexes again the part of a source that `edit` changed: `old` are the
+ * tokens of the source before the edit, `lexer` reads it after the edit
+ * from memory
+ *
+ * tokens that end before the edit are kept, lexing starts right after the
+ * last of them and stops at the first token that begins past the inserted
+ * text where an old one began, in the same state, the old ones from there
+ * on are only moved, `diff` tells which tokens are new
+ */
+vcc_tokbuf_t *vcc_relex(vcc_lexer_t *L, vcc_tokbuf_t *old,
+                        const vcc_edit_t *edit, vcc_relex_t *diff) {
+  *diff = (vcc_relex_t){0};
+  if (L->input == VCC_LEXER_INPUT_STREAM) {
+    vcc_tokbuf_t *tokens = vcc_lex_all(L);
+    diff->old_resync = old->count;
+    diff->new_resync = diff->lexed = tokens->count;
+    return tokens;
+  }
+  // the lexer looks up to two chars past a token, as past the first . of
+  // .., they must not be in the edit
+  int lo = 0, hi = old->count;
+  while (lo < hi) {
+    int mid = (lo + hi) / 2;
+    if (token_end(old, mid) + 1 < edit->offset) {
+      lo = mid + 1;
+    } else {
+      hi = mid;
+    }
+  }
+  diff->kept = lo;
+  vcc_tokbuf_t *tokens = vcc_tokbuf_new();
+  tokbuf_copy(tokens, old, 0, lo, 0);
+  seek(L, lo ? token_end(old, lo - 1) : 0, state_after(L, old, lo));
+
+  int shift = (int)edit->len - (int)edit->removed;
+  uint32_t inserted_end = edit->offset + edit->len;
+  diff->old_resync = old->count;
+  for (int j = lo;;) {
+    int state = L->in_directive;
+    vtoken_t *t = vcc_lex(L);
+    if (!t) {
+      tokens->error = 1;
+      break;
+    }
+    uint32_t start =
+        t->offset - (t->type == TOKEN_STR || t->type == TOKEN_CHAR);
+    if (start >= inserted_end) {
+      uint32_t was = start - shift; // where it would have been
+      while (j < old->count && token_start(old, j) < was) {
+        ++j;
       }
-      if (is_digit(peek(1))) {
-        next(1);
-        return scan_number_neg();
+      if (j < old->count && token_start(old, j) == was &&
+          state_after(L, old, j) == state) {
+        vtoken_free(L, t);
+        diff->old_resync = j;
+        diff->new_resync = tokens->count;
+        tokbuf_copy(tokens, old, j, old->count, shift);
+        tokens->error = old->error;
+        return tokens;
       }
-      next(1);
-      return vtoken_new(TOKEN_SUB, -1, 0);
+    }
+    vcc_tokbuf_push(tokens, t);
+    ++diff->lexed;
+    int type = t->type;
+    vtoken_free(L, t);
+    if (type == TOKEN_EOF) {
+      break;
+    }
+  }
+  diff->new_resync = tokens->count;
+  return tokens;
+}
 
-    default:
-      // identifiers and keywords don't start with digit, only numbers
-      if (is_digit(c)) {
-        return scan_number();
+/* waits a little for the other side of a pipe, spinning first since it is
+ * usually a batch away, then giving the core up, right away if the other
+ * side needs this very core to make progress
+ */
+static void pipe_wait(vcc_lex_pipe_t *pipe, int *spins) {
+  if (++*spins < pipe->spins) {
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#endif
+  } else {
+    sched_yield();
+  }
+}
+
+static void *pipe_produce(void *arg) {
+  vcc_lex_pipe_t *pipe = arg;
+  uint32_t size = pipe->mask + 1;
+  uint32_t tail = 0, published = 0;
+  while (1) {
+    vtoken_t *t = vcc_lex(pipe->lexer);
+    if (!t) {
+      pipe->error = 1;
+      break;
+    }
+    for (int spins = 0; tail - pipe->head_seen == size;) { // full
+      if (published != tail) {
+        atomic_store_explicit(&pipe->tail, tail, memory_order_release);
+        published = tail;
       }
-      if (is_alpha(c)) {
-        return scan_identifier();
+      pipe->head_seen =
+          atomic_load_explicit(&pipe->head, memory_order_acquire);
+      if (tail - pipe->head_seen < size) {
+        break;
       }
-      errors("Unknown or unimplemented token!");
-      return NULL;
+      if (atomic_load_explicit(&pipe->stop, memory_order_relaxed)) {
+        vtoken_free(pipe->lexer, t);
+        goto done;
+      }
+      pipe_wait(pipe, &spins);
+    }
+    int type = t->type;
+    pipe->ring[tail++ & pipe->mask] = *t;
+    vtoken_free(pipe->lexer, t);
+    if (tail - published >= pipe->batch || type == TOKEN_EOF) {
+      atomic_store_explicit(&pipe->tail, tail, memory_order_release);
+      published = tail;
+    }
+    if (type == TOKEN_EOF) {
+      break;
     }
-  } else {
-    /* add the final token: the EOF
-     */
-    logs("Reached EOF\n");
-    return vtoken_new(TOKEN_EOF, -1, 0);
   }
+done:
+  atomic_store_explicit(&pipe->tail, tail, memory_order_release);
+  atomic_store_explicit(&pipe->done, 1, memory_order_release);
   return NULL;
 }
 
-/* this function is called by parser to
- * get the tokens from stream
+/* starts lexing on a new thread, into a ring of `size` tokens rounded up
+ * to a power of two, 0 for VCC_LEX_PIPE_SIZE
+ *
+ * the lexer belongs to the pipe until vcc_lex_pipe_free(), tokens must not
+ * be viewed in the source of a stream, which moves under the consumer, but
+ * atoms and values are always good
+ */
+vcc_lex_pipe_t *vcc_lex_pipe_start(vcc_lexer_t *L, int size) {
+  uint32_t cap = 2;
+  while (cap < (uint32_t)(size > 0 ? size : VCC_LEX_PIPE_SIZE)) {
+    cap *= 2;
+  }
+  vcc_lex_pipe_t *pipe = aligned_alloc(64, sizeof(vcc_lex_pipe_t));
+  if (!pipe) {
+    fatals("could not allocate memory\n");
+  }
+  bzero(pipe, sizeof(vcc_lex_pipe_t));
+  pipe->lexer = L;
+  pipe->ring = xalloc(cap * sizeof(vtoken_t));
+  pipe->mask = cap - 1;
+  pipe->batch = cap / 2 < VCC_LEX_PIPE_BATCH ? cap / 2 : VCC_LEX_PIPE_BATCH;
+  pipe->spins = sysconf(_SC_NPROCESSORS_ONLN) > 1 ? 128 : 0;
+  if (pthread_create(&pipe->thread, NULL, pipe_produce, pipe)) {
+    fatals("could not start the lexer thread\n");
+  }
+  return pipe;
+}
+
+/* takes the next token of the pipe into `token`, EOF again after the end,
+ * returns 0 if the lexer failed
  */
-vtoken_t *vcc_lex() { return next_token(); }
+int vcc_lex_pipe_next(vcc_lex_pipe_t *pipe, vtoken_t *token) {
+  for (int spins = 0; pipe->taken == pipe->tail_seen;) { // empty
+    atomic_store_explicit(&pipe->head, pipe->taken, memory_order_release);
+    int done = atomic_load_explicit(&pipe->done, memory_order_acquire);
+    pipe->tail_seen = atomic_load_explicit(&pipe->tail, memory_order_acquire);
+    if (pipe->taken != pipe->tail_seen) {
+      break;
+    }
+    if (done) {
+      *token = pipe->eof;
+      return !pipe->error;
+    }
+    pipe_wait(pipe, &spins);
+  }
+  *token = pipe->ring[pipe->taken++ & pipe->mask];
+  if (token->type == TOKEN_EOF) {
+    pipe->eof = *token;
+  }
+  if (pipe->taken % pipe->batch == 0) {
+    atomic_store_explicit(&pipe->head, pipe->taken, memory_order_release);
+  }
+  return 1;
+}
+
+/* stops the lexer thread if it is still running and waits for it, the
+ * lexer is left for the caller to free
+ */
+void vcc_lex_pipe_free(vcc_lex_pipe_t *pipe) {
+  if (!pipe) {
+    return;
+  }
+  atomic_store_explicit(&pipe->stop, 1, memory_order_relaxed);
+  pthread_join(pipe->thread, NULL);
+  xfree(pipe->ring);
+  free(pipe);
+}
@@ -3,15 +3,33 @@
 
 #include "error.h"
 #include "mem.h"
+#include "scan.h"
+#include "symtbl.h"
 #include "vcc.h"
 #include <ctype.h>
+#include <stdatomic.h>
 
 #define BUF_EOF '\0'
 #define BUF_MAX_SIZE 1024     // token content in buffer
 #define NESTING_MAX_LEVEL 128 // nesting comments
+#define TOKEN_ARENA_CHUNK_SIZE (64 * 1024)
+#define VCC_LEXER_WINDOW_SIZE (64 * 1024) // default window of a stream
+#define VCC_LEXER_LOOKAHEAD 1024 // bytes in the window ahead of a token
+#define VCC_LEX_PIPE_SIZE 4096    // tokens in the ring of a pipe
+#define VCC_LEX_PIPE_BATCH 64     // tokens published to the other side at once
+#define VCC_LEX_CHUNK_MIN (256 * 1024) // smallest chunk lexed on its own thread
 
 enum { LEX_ERR_NONE, LEX_ERR_IO, LEX_ERR_NOMEM, LEX_ERR_UNKNOWN };
 
+/* where the lexer source comes from
+ */
+enum {
+  VCC_LEXER_INPUT_BUF = 0, // file read into a private buffer
+  VCC_LEXER_INPUT_MMAP,    // file mapped read-only
+  VCC_LEXER_INPUT_MEM,     // memory owned by the caller
+  VCC_LEXER_INPUT_STREAM   // FILE read through a fixed-size window
+};
+
 /* token types
  */
 enum {
@@ -41,6 +59,7 @@ enum {
   TOKEN_XOR,    // ^
   TOKEN_OR,     // |
   TOKEN_AND,    // &
+  TOKEN_TILDE,  // ~
   TOKEN_LSHIFT, // <<
   TOKEN_RSHIFT, // >>
   /* math operators
@@ -79,50 +98,94 @@ enum {
 
   TOKEN_POINTER, // ->
 
+  /* preprocessing tokens, # lines only give them to a lexer that keeps
+   * directives
+   */
+  TOKEN_HASH,      // #
+  TOKEN_HASH_HASH, // ##
+  TOKEN_NEWLINE,   // end of a directive
+  TOKEN_ELLIPSIS,  // ...
+
   /* keyword tokens
    */
+  TOKEN_KWORD_AUTO,
   TOKEN_KWORD_BREAK,
   TOKEN_KWORD_CASE,
+  TOKEN_KWORD_CHAR,
   TOKEN_KWORD_CONST,
   TOKEN_KWORD_CONTINUE,
   TOKEN_KWORD_DEFAULT,
   TOKEN_KWORD_DO,
+  TOKEN_KWORD_DOUBLE,
   TOKEN_KWORD_ELSE,
   TOKEN_KWORD_ENUM,
+  TOKEN_KWORD_EXTERN,
+  TOKEN_KWORD_FLOAT,
   TOKEN_KWORD_FOR,
   TOKEN_KWORD_GOTO,
   TOKEN_KWORD_IF,
+  TOKEN_KWORD_INLINE,
+  TOKEN_KWORD_INT,
+  TOKEN_KWORD_LONG,
   TOKEN_KWORD_NULL,
+  TOKEN_KWORD_REGISTER,
+  TOKEN_KWORD_RESTRICT,
   TOKEN_KWORD_RETURN,
+  TOKEN_KWORD_SHORT,
+  TOKEN_KWORD_SIGNED,
   TOKEN_KWORD_SIZEOF,
   TOKEN_KWORD_STATIC,
   TOKEN_KWORD_STRUCT,
   TOKEN_KWORD_SWITCH,
   TOKEN_KWORD_TYPEDEF,
   TOKEN_KWORD_UNION,
+  TOKEN_KWORD_UNSIGNED,
+  TOKEN_KWORD_VOID,
+  TOKEN_KWORD_VOLATILE,
   TOKEN_KWORD_WHILE,
+  TOKEN_KWORD_ALIGNAS,
+  TOKEN_KWORD_ALIGNOF,
+  TOKEN_KWORD_ATOMIC,
+  TOKEN_KWORD_BOOL,
+  TOKEN_KWORD_COMPLEX,
+  TOKEN_KWORD_GENERIC,
+  TOKEN_KWORD_IMAGINARY,
+  TOKEN_KWORD_NORETURN,
+  TOKEN_KWORD_STATIC_ASSERT,
+  TOKEN_KWORD_THREAD_LOCAL,
   /* others
    */
   NUMBER_OF_TOKENS
 };
 
 extern const char *token_names[];
+extern const char *token_spellings[];
+
+/* suffixes of number tokens, in vtoken_t.flags
+ */
+enum {
+  VCC_LIT_UNSIGNED = 1 << 0,  // u
+  VCC_LIT_LONG = 1 << 1,      // l, on integers and floats
+  VCC_LIT_LONG_LONG = 1 << 2, // ll
+  VCC_LIT_FLOAT = 1 << 3,     // f
+};
+
+typedef union _vtoken_value_t {
+  int64_t i; // all 64 bits of the literal, above INT64_MAX too
+  double f;
+  vcc_atom_t atom; // identifiers, strings and chars
+} vtoken_value_t;
 
 typedef struct _vtoken_t {
   int type;
-  union {
-    int i;
-    float f;
-    buf_t *s;
-  } value;
+  int flags; // VCC_LIT_* of numbers
+  vtoken_value_t value;
 
-  int line;
-  int col;
+  uint32_t offset; // start of the token text in the source
+  uint32_t len;    // length of the token text
 } vtoken_t;
 
 // vtoken_t *vtoken_new(int, int, int);
-// vtoken_t *vtoken_new_from_buf(int);
-void vtoken_free(vtoken_t *);
 
 typedef struct _lex_error_t {
   int code;
@@ -130,20 +193,136 @@ typedef struct _lex_error_t {
   buf_t *s;
 } lex_error_t;
 
+/* where the lines of the source start, built only when a position is
+ * needed, for a stream it covers the current window
+ */
+typedef struct _vcc_lines_t {
+  uint32_t *starts;     // input offsets of line starts
+  int count;            // 0 until built
+  int cap;
+  int first;            // number of the line starting at starts[0]
+  uint32_t first_start; // input offset where line `first` starts
+} vcc_lines_t;
+
 typedef struct _vcc_lexer_t {
-  buf_t *filebuf;         // code buffer
-  int ptr;                // pointer to file buffer
-  char fname[256];        // name of lexed file
-  int line;               // current line
-  int col;                // current column
-  int c;                  // current char
-  char buf[BUF_MAX_SIZE]; // buffer to save temp stream
-  int buflen;             // len of buf for scanning
-  int error;              // return value of the last lex call
+  int input;                  // one of VCC_LEXER_INPUT_*
+  buf_t *filebuf;             // code buffer, for VCC_LEXER_INPUT_BUF
+  const char *src;            // source text, not NUL-terminated
+  int len;                    // length of the source
+  int ptr;                    // pointer to source
+  FILE *stream;               // input of VCC_LEXER_INPUT_STREAM
+  char *window;               // src of VCC_LEXER_INPUT_STREAM
+  int cap;                    // size of the window
+  uint32_t base;              // offset in the input of src[0]
+  int lookahead;              // bytes kept in the window ahead of a token
+  int eof;                    // the whole rest of the input is in src
+  int directives;             // give # lines to the preprocessor as tokens
+  int in_directive;           // inside a # line, newlines are tokens
+  int quiet;                  // lexing speculatively, errors are not printed
+  char fname[256];            // name of lexed file
+  vcc_lines_t lines;          // line index for diagnostics
+  int c;                      // current char
+  int error;                  // return value of the last lex call
+  arena_t *tokens;            // memory of all tokens
+  vtoken_t *free_tokens;      // released tokens ready for reuse
+  const vcc_scan_ops_t *scan; // byte scanning kernels
+  vcc_symtbl_t *symtbl;       // interned identifiers, strings and chars
+  int own_symtbl;             // symtbl is private to the lexer
 } vcc_lexer_t;
 
-int vcc_lexer_init(const char *fname);
-int vcc_lexer_finish();
-vtoken_t *vcc_lex();
+vcc_lexer_t *vcc_lexer_new(const char *fname);
+vcc_lexer_t *vcc_lexer_new_mmap(const char *fname);
+vcc_lexer_t *vcc_lexer_new_from_mem(const char *fname, const char *src,
+                                    int len);
+vcc_lexer_t *vcc_lexer_new_stream(const char *fname, FILE *fp, int window);
+void vcc_lexer_set_symtbl(vcc_lexer_t *lexer, vcc_symtbl_t *symtbl);
+void vcc_lexer_keep_directives(vcc_lexer_t *lexer);
+void vcc_lexer_free(vcc_lexer_t *lexer);
+vtoken_t *vcc_lex(vcc_lexer_t *lexer);
+void vtoken_free(vcc_lexer_t *lexer, vtoken_t *token);
+void vcc_lexer_locate(vcc_lexer_t *lexer, uint32_t offset, int *line,
+                      int *col);
+
+int vtoken_has_atom(vtoken_t *token);
+const char *vtoken_view(vcc_lexer_t *lexer, vtoken_t *token);
+buf_t *vtoken_text(vcc_lexer_t *lexer, vtoken_t *token);
+
+/* a whole token stream in parallel arrays, indexed by token number
+ */
+typedef struct _vcc_tokbuf_t {
+  uint8_t *types;
+  uint32_t *offsets;
+  uint32_t *lens;
+  uint32_t *payloads;       // atom, or index in literals for numbers
+  vtoken_value_t *literals; // values of number tokens
+  uint8_t *literal_flags;   // their VCC_LIT_* suffixes
+  int count;                // number of tokens, the last one is EOF
+  int cap;
+  int nliterals;
+  int literals_cap;
+  int error; // lexing stopped on an error before EOF
+} vcc_tokbuf_t;
+
+vcc_tokbuf_t *vcc_tokbuf_new();
+void vcc_tokbuf_free(vcc_tokbuf_t *tokens);
+void vcc_tokbuf_push(vcc_tokbuf_t *tokens, vtoken_t *token);
+void vcc_tokbuf_get(vcc_tokbuf_t *tokens, int index, vtoken_t *token);
+vcc_tokbuf_t *vcc_lex_all(vcc_lexer_t *lexer);
+vcc_tokbuf_t *vcc_lex_all_parallel(vcc_lexer_t *lexer, int nchunks,
+                                   int *relexed);
+
+/* an edit of a source: `removed` bytes at `offset` replaced by the `len`
+ * bytes of `text`
+ */
+typedef struct _vcc_edit_t {
+  uint32_t offset;
+  uint32_t removed;
+  const char *text;
+  uint32_t len;
+} vcc_edit_t;
+
+/* how relexing changed a token buffer: the first `kept` tokens are as they
+ * were, the old tokens from `old_resync` on are the new ones from
+ * `new_resync` on, only moved, the `lexed` ones in between are new
+ */
+typedef struct _vcc_relex_t {
+  int kept;
+  int old_resync;
+  int new_resync;
+  int lexed;
+} vcc_relex_t;
+
+vcc_tokbuf_t *vcc_relex(vcc_lexer_t *lexer, vcc_tokbuf_t *old,
+                        const vcc_edit_t *edit, vcc_relex_t *diff);
+
+/* a lexer running on a thread of its own, ahead of the consumer, tokens
+ * pass through a single-producer single-consumer ring, each side only
+ * writes its own index and publishes it every VCC_LEX_PIPE_BATCH tokens
+ */
+typedef struct _vcc_lex_pipe_t {
+  vcc_lexer_t *lexer;
+  vtoken_t *ring;
+  uint32_t mask; // ring size - 1
+  uint32_t batch;
+  int spins; // busy waits before yielding
+  pthread_t thread;
+
+  // written by the producer
+  _Alignas(64) atomic_uint tail; // tokens published
+  atomic_int done;               // nothing will be published any more
+  int error;                     // the lexer failed before EOF
+  uint32_t head_seen;            // head when last read
+
+  // written by the consumer
+  _Alignas(64) atomic_uint head; // tokens taken, published
+  atomic_int stop;               // the consumer quits early
+  uint32_t taken;                // tokens taken
+  uint32_t tail_seen;            // tail when last read
+  vtoken_t eof;                  // given again after the end
+} vcc_lex_pipe_t;
+
+vcc_lex_pipe_t *vcc_lex_pipe_start(vcc_lexer_t *lexer, int size);
+int vcc_lex_pipe_next(vcc_lex_pipe_t *pipe, vtoken_t *token);
+void vcc_lex_pipe_free(vcc_lex_pipe_t *pipe);
 
 #endif
@@ -1,4 +1,9 @@
 #include "mem.h"
+#include <fcntl.h>
+#include <stdatomic.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
 long file_len(FILE *fp) {
   fseek(fp, 0, SEEK_END);
@@ -7,7 +12,47 @@ long file_len(FILE *fp) {
   return result;
 }
 
+/* maps a whole file read-only, returns NULL on failure, an empty file maps
+ * to a non-NULL pointer with `len` 0
+ */
+void *file_map(const char *fname, size_t *len) {
+  static char empty[1];
+  int fd = open(fname, O_RDONLY);
+  if (fd < 0) {
+    return NULL;
+  }
+  struct stat st;
+  if (fstat(fd, &st) < 0) {
+    close(fd);
+    return NULL;
+  }
+  *len = st.st_size;
+  if (*len == 0) {
+    close(fd);
+    return empty;
+  }
+  void *map = mmap(NULL, *len, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (map == MAP_FAILED) {
+    return NULL;
+  }
+  return map;
+}
+
+void file_unmap(void *map, size_t len) {
+  if (map && len > 0) {
+    munmap(map, len);
+  }
+}
+
+#ifdef ENABLE_DEBUG
+int vcc_log_quiet;
+#endif
+
+static atomic_size_t nallocs; // number of xalloc calls, for statistics
+
 void *xalloc(size_t size) {
+  atomic_fetch_add_explicit(&nallocs, 1, memory_order_relaxed);
   void *ret = malloc(size);
   if (!ret) {
     fatals("could not allocate memory\n");
@@ -22,6 +67,63 @@ void xfree(void *ptr) {
   }
 }
 
+/* returns how many times xalloc has been called, by any thread
+ */
+size_t xalloc_count() {
+  return atomic_load_explicit(&nallocs, memory_order_relaxed);
+}
+
+static arena_chunk_t *arena_chunk_new(size_t size) {
+  arena_chunk_t *chunk = malloc(sizeof(arena_chunk_t) + size);
+  if (!chunk) {
+    fatals("could not allocate memory\n");
+  }
+  atomic_fetch_add_explicit(&nallocs, 1, memory_order_relaxed);
+  chunk->next = NULL;
+  chunk->size = size;
+  chunk->used = 0;
+  return chunk;
+}
+
+arena_t *arena_new(size_t chunk_size) {
+  arena_t *arena = xalloc(sizeof(arena_t));
+  arena->chunk_size = chunk_size;
+  arena->head = arena_chunk_new(chunk_size);
+  arena->nchunks = 1;
+  return arena;
+}
+
+/* returns `size` bytes of uninitialized memory aligned for any type
+ */
+void *arena_alloc(arena_t *arena, size_t size) {
+  size = (size + 15) & ~(size_t)15;
+  arena_chunk_t *chunk = arena->head;
+  if (chunk->used + size > chunk->size) {
+    size_t chunk_size = size > arena->chunk_size ? size : arena->chunk_size;
+    chunk = arena_chunk_new(chunk_size);
+    chunk->next = arena->head;
+    arena->head = chunk;
+    ++arena->nchunks;
+  }
+  void *ret = chunk->data + chunk->used;
+  chunk->used += size;
+  arena->used += size;
+  return ret;
+}
+
+void arena_free(arena_t *arena) {
+  if (!arena) {
+    return;
+  }
+  arena_chunk_t *chunk = arena->head;
+  while (chunk) {
+    arena_chunk_t *next = chunk->next;
+    free(chunk);
+    chunk = next;
+  }
+  xfree(arena);
+}
+
 buf_t *buf_new(int len) {
   buf_t *b = xalloc(sizeof(buf_t));
   b->s = xalloc(len + 1);
@@ -49,7 +151,8 @@ buf_t *buf_new_from_mem(char *mem, size_t size) {
 buf_t *buf_new_from_string(char *str) {
   int len = strlen(str);
   buf_t *b = buf_new(len);
-  strncpy(b->s, str, len);
+  memcpy(b->s, str, len);
+  b->s[len] = '\0';
   b->len = len;
   return b;
 }
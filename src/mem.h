@@ -7,10 +7,33 @@
 
 /* file io functions */
 long file_len(FILE *);
+void *file_map(const char *fname, size_t *len);
+void file_unmap(void *map, size_t len);
 
 /* memory allocation functions */
 void *xalloc(size_t size);
 void xfree(void *ptr);
+size_t xalloc_count();
+
+/* bump-pointer arena, everything in it is released at once by arena_free()
+ */
+typedef struct _arena_chunk_t {
+  struct _arena_chunk_t *next;
+  size_t size;
+  size_t used;
+  _Alignas(16) char data[];
+} arena_chunk_t;
+
+typedef struct _arena_t {
+  arena_chunk_t *head; // chunk being filled
+  size_t chunk_size;   // default size of new chunks
+  int nchunks;         // number of chunks allocated so far
+  size_t used;         // bytes handed out in all chunks
+} arena_t;
+
+arena_t *arena_new(size_t chunk_size);
+void *arena_alloc(arena_t *arena, size_t size);
+void arena_free(arena_t *arena);
 
 /* common types */
 typedef struct _buf_t {
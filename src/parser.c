@@ -1,12 +1,16 @@
 #include "parser.h"
 #include "lexer.h"
 #include "mem.h"
-#include <stdarg.h>
+#include "trace.h"
+#include <limits.h>
+#include <pthread.h>
 #include <strings.h>
+#include <unistd.h>
 
 #define PHASE "parsing"
 
-static vcc_parser_t P;
+// one parser for each thread
+static _Thread_local vcc_parser_t P;
 
 const char *node_types[] = {
     [VCC_NODE_FUNC] = "function", [VCC_NODE_STMT] = "statement"};
@@ -19,38 +23,134 @@ const char *stmt_types[] = {[STMT_TYPE_IF] = "if",
 #define CURRENT P.current
 #define NEXT P.next
 #define PREVIOUS P.previous
+#define TRACED(t) ((t) ? (uint32_t)(t)->type : TRACE_NO_TOKEN)
 
-void vcc_parser_init() {
+void vcc_parser_init(vcc_lexer_t *lexer) {
   bzero(&P, sizeof(vcc_parser_t));
+  P.lexer = lexer;
   P.err.code = VCC_PARSER_ERR_NONE;
+  P.err.expected = TRACE_NO_TOKEN;
+  P.err.received = TRACE_NO_TOKEN;
+}
+
+/* makes the nodes parsed from now on come from `arena`, which is the
+ * caller's, so they live as long as it does
+ */
+void vcc_parser_set_arena(arena_t *arena) {
+  P.arena = arena;
+  P.own_arena = 0;
+}
+
+/* zeroed memory for the AST, from the parser arena, never freed on its own
+ */
+static void *ast_alloc(size_t size) {
+  if (!P.arena) {
+    P.arena = arena_new(AST_ARENA_CHUNK_SIZE);
+    P.own_arena = 1;
+  }
+  void *ptr = arena_alloc(P.arena, size);
+  bzero(ptr, size);
+  return ptr;
+}
+
+static void *grow(void *array, int count, int cap, size_t size) {
+  void *grown = xalloc(cap * size);
+  if (count) {
+    memcpy(grown, array, count * size);
+  }
+  xfree(array);
+  return grown;
+}
+
+/* parses a stream lexed beforehand by vcc_lex_all(), the parser walks it by
+ * index and never allocates or frees a token, `lexer` may be NULL
+ */
+void vcc_parser_init_tokens(vcc_lexer_t *lexer, vcc_tokbuf_t *tokens) {
+  vcc_parser_init(lexer);
+  P.tokens = tokens;
+  P.pos = -1;
+}
+
+/* parses tokens as a lexer thread hands them over through `pipe`, so
+ * lexing and parsing overlap, the parser only reads the pipe
+ */
+void vcc_parser_init_pipe(vcc_lexer_t *lexer, vcc_lex_pipe_t *pipe) {
+  vcc_parser_init(lexer);
+  P.pipe = pipe;
+  P.pos = -1;
+}
+
+/* takes the next token of the pipe into the window slot of `index`
+ */
+static vtoken_t *pull(int index) {
+  vtoken_t *t = &P.window[index % 3];
+  return vcc_lex_pipe_next(P.pipe, t) ? t : NULL;
+}
+
+/* gets the token at `index` of the token buffer into its window slot,
+ * reading past the end gives EOF again like the lexer does
+ */
+static vtoken_t *fetch(int index) {
+  int count = P.tokens->count;
+  if (index >= count) {
+    if (count == 0 || P.tokens->types[count - 1] != TOKEN_EOF) {
+      return NULL;
+    }
+    index = count - 1;
+  }
+  vtoken_t *t = &P.window[index % 3];
+  vcc_tokbuf_get(P.tokens, index, t);
+  return t;
+}
+
+/* looks at the type of the token `n` places after the current one, any
+ * distance is fine on a token buffer, only 0 and 1 on a lexer or a pipe
+ */
+int vcc_parser_peek(int n) {
+  vtoken_t *t;
+  if (P.tokens) {
+    int index = P.pos + n;
+    if (index >= P.tokens->count) {
+      index = P.tokens->count - 1;
+    }
+    return index < 0 ? TOKEN_EOF : P.tokens->types[index];
+  }
+  assert(n >= 0 && n <= 1);
+  t = n ? NEXT : CURRENT;
+  return t ? t->type : TOKEN_EOF;
 }
 
 static void advance() {
-  if (!CURRENT) {
-    CURRENT = vcc_lex();
-    NEXT = vcc_lex();
+  if (P.tokens) {
+    // PREVIOUS keeps its slot, only the next two are refilled
+    PREVIOUS = CURRENT;
+    ++P.pos;
+    CURRENT = fetch(P.pos);
+    NEXT = fetch(P.pos + 1);
+  } else if (P.pipe) {
+    PREVIOUS = CURRENT;
+    ++P.pos;
+    CURRENT = P.pos ? NEXT : pull(P.pos);
+    NEXT = CURRENT ? pull(P.pos + 1) : NULL;
+  } else if (!CURRENT) {
+    CURRENT = vcc_lex(P.lexer);
+    NEXT = vcc_lex(P.lexer);
   } else {
-    vtoken_free(PREVIOUS);
+    vtoken_free(P.lexer, PREVIOUS);
     // preload a token
     PREVIOUS = CURRENT;
     CURRENT = NEXT;
-    NEXT = vcc_lex();
+    NEXT = vcc_lex(P.lexer);
   }
   if (!CURRENT) {
     P.err.code = VCC_PARSER_ERR_LEXER;
+  } else if (CURRENT->type == TOKEN_LBRACE) {
+    ++P.depth;
+  } else if (CURRENT->type == TOKEN_RBRACE) {
+    --P.depth;
   }
-
-  logs("current at:");
-  if (PREVIOUS) {
-    printf(" %s", token_names[PREVIOUS->type]);
-  }
-  if (CURRENT) {
-    printf(" [%s]", token_names[CURRENT->type]);
-  }
-  if (NEXT) {
-    printf(" %s", token_names[NEXT->type]);
-  }
-  printf("\n");
+  vtrace(PARSER, TRACE_TOKEN, TRACE_EV_ADVANCE, TRACED(PREVIOUS),
+         TRACED(CURRENT), TRACED(NEXT));
 }
 
 void vcc_parser_advance() { advance(); }
@@ -59,12 +159,10 @@ void vcc_parser_advance() { advance(); }
 static void consume(int type) {
   logf("consuming %s\n", token_names[type]);
   advance();
+  vtrace(PARSER, TRACE_DEBUG, TRACE_EV_CONSUME, type, TRACED(NEXT), 0);
   if (NEXT->type == type) {
     advance();
-    return;
   }
-  printf("expect %s, received %s\n", token_names[type],
-         token_names[NEXT->type]);
 }
 
 static int reached_eof() {
@@ -78,6 +176,11 @@ static int reached_eof() {
   return 0;
 }
 
+/* the first error met, with the token expected and the one found, which
+ * is TRACE_NO_TOKEN past the end
+ */
+vcc_parser_err_t vcc_parser_error() { return P.err; }
+
 int vcc_parser_continuable() {
   if (P.err.code != VCC_PARSER_ERR_NONE) {
     logf("parser error: %d\n", P.err.code);
@@ -86,223 +189,1043 @@ int vcc_parser_continuable() {
   return !reached_eof();
 }
 
-vcc_node_t *vcc_node_new() {
-  vcc_node_t *node = malloc(sizeof(vcc_node_t));
-  bzero(node, sizeof(vcc_node_t));
-  return node;
+vcc_node_t *vcc_node_new() { return ast_alloc(sizeof(vcc_node_t)); }
+
+/* ================ EXPRESSIONS ================= */
+/* how a token continues an expression once its left operand is parsed
+ */
+enum {
+  OP_NONE = 0,
+  OP_BINARY,  // left associative
+  OP_RIGHT,   // right associative, the assignments
+  OP_TERNARY, // ? then : else
+  OP_CALL,    // ( arguments )
+  OP_INDEX,   // [ index ]
+  OP_MEMBER,  // . or -> and a name
+  OP_POSTFIX, // ++ or --
+};
+
+typedef struct _vcc_op_t {
+  uint8_t prec;
+  uint8_t kind;
+} vcc_op_t;
+
+/* every C operator after an operand, by token, one lookup per operator
+ */
+static const vcc_op_t infix[NUMBER_OF_TOKENS] = {
+    [TOKEN_COMMA] = {PREC_COMMA, OP_BINARY},
+    [TOKEN_ASSIGN] = {PREC_ASSIGN, OP_RIGHT},
+    [TOKEN_ADD_ASSIGN] = {PREC_ASSIGN, OP_RIGHT},
+    [TOKEN_SUB_ASSIGN] = {PREC_ASSIGN, OP_RIGHT},
+    [TOKEN_MUL_ASSIGN] = {PREC_ASSIGN, OP_RIGHT},
+    [TOKEN_DIV_ASSIGN] = {PREC_ASSIGN, OP_RIGHT},
+    [TOKEN_MOD_ASSIGN] = {PREC_ASSIGN, OP_RIGHT},
+    [TOKEN_LSHIFT_ASSIGN] = {PREC_ASSIGN, OP_RIGHT},
+    [TOKEN_RSHIFT_ASSIGN] = {PREC_ASSIGN, OP_RIGHT},
+    [TOKEN_AND_ASSIGN] = {PREC_ASSIGN, OP_RIGHT},
+    [TOKEN_XOR_ASSIGN] = {PREC_ASSIGN, OP_RIGHT},
+    [TOKEN_OR_ASSIGN] = {PREC_ASSIGN, OP_RIGHT},
+    [TOKEN_QUESTION] = {PREC_TERNARY, OP_TERNARY},
+    [TOKEN_OR_OR] = {PREC_OR_OR, OP_BINARY},
+    [TOKEN_AND_AND] = {PREC_AND_AND, OP_BINARY},
+    [TOKEN_OR] = {PREC_OR, OP_BINARY},
+    [TOKEN_XOR] = {PREC_XOR, OP_BINARY},
+    [TOKEN_AND] = {PREC_AND, OP_BINARY},
+    [TOKEN_EQ] = {PREC_EQUALITY, OP_BINARY},
+    [TOKEN_NOT_EQ] = {PREC_EQUALITY, OP_BINARY},
+    [TOKEN_LT] = {PREC_COMPARISON, OP_BINARY},
+    [TOKEN_GT] = {PREC_COMPARISON, OP_BINARY},
+    [TOKEN_LTEQ] = {PREC_COMPARISON, OP_BINARY},
+    [TOKEN_GTEQ] = {PREC_COMPARISON, OP_BINARY},
+    [TOKEN_LSHIFT] = {PREC_SHIFT, OP_BINARY},
+    [TOKEN_RSHIFT] = {PREC_SHIFT, OP_BINARY},
+    [TOKEN_ADD] = {PREC_TERM, OP_BINARY},
+    [TOKEN_SUB] = {PREC_TERM, OP_BINARY},
+    [TOKEN_ASTERISK] = {PREC_FACTOR, OP_BINARY},
+    [TOKEN_DIV] = {PREC_FACTOR, OP_BINARY},
+    [TOKEN_MOD] = {PREC_FACTOR, OP_BINARY},
+    [TOKEN_LPAREN] = {PREC_POSTFIX, OP_CALL},
+    [TOKEN_LBRACKET] = {PREC_POSTFIX, OP_INDEX},
+    [TOKEN_DOT] = {PREC_POSTFIX, OP_MEMBER},
+    [TOKEN_POINTER] = {PREC_POSTFIX, OP_MEMBER},
+    [TOKEN_INC] = {PREC_POSTFIX, OP_POSTFIX},
+    [TOKEN_DEC] = {PREC_POSTFIX, OP_POSTFIX},
+};
+
+/* the operators before an operand
+ */
+static const uint8_t prefix[NUMBER_OF_TOKENS] = {
+    [TOKEN_NOT] = 1,      [TOKEN_TILDE] = 1, [TOKEN_SUB] = 1,
+    [TOKEN_ADD] = 1,      [TOKEN_INC] = 1,   [TOKEN_DEC] = 1,
+    [TOKEN_ASTERISK] = 1, [TOKEN_AND] = 1,   [TOKEN_KWORD_SIZEOF] = 1,
+};
+
+static int current_type() { return CURRENT ? CURRENT->type : TOKEN_EOF; }
+
+/* the literal of a leaf, read through the member it was written as, so
+ * the bytes an atom leaves in the union do not count
+ */
+static uint64_t literal_bits(const vcc_expr_t *expr) {
+  return expr->arity == 0 && expr->opr != TOKEN_INT
+             ? expr->literal.atom
+             : (uint64_t)expr->literal.number;
 }
 
-void vcc_node_free(vcc_node_t *node) {
-  if (!node)
-    return;
+/* a stack for walking a tree without recursing, on the C stack until it
+ * holds more than WALK_INIT_CAP entries
+ */
+#define WALK_INIT_CAP 64
+
+typedef struct _walk_t {
+  void *items;
+  int count;
+  int cap;
+  size_t size;
+  void *init;
+} walk_t;
+
+static void walk_init(walk_t *w, void *init, size_t size) {
+  w->items = w->init = init;
+  w->count = 0;
+  w->cap = WALK_INIT_CAP;
+  w->size = size;
+}
 
-  switch (node->type) {
-  case VCC_NODE_STMT:
-    vcc_stmt_free(node->value.stmt);
-    break;
+static void *walk_push(walk_t *w) {
+  if (w->count == w->cap) {
+    void *grown = xalloc(2 * w->cap * w->size);
+    memcpy(grown, w->items, w->count * w->size);
+    if (w->items != w->init) {
+      xfree(w->items);
+    }
+    w->items = grown;
+    w->cap *= 2;
   }
+  return (char *)w->items + w->count++ * w->size;
 }
 
-/* ================ EXPRESSIONS ================= */
-static int match(int num, ...) {
-  va_list args;
-  va_start(args, num);
+static void *walk_top(walk_t *w) {
+  return (char *)w->items + (w->count - 1) * w->size;
+}
 
-  for (int i = 0; i < num; ++i) {
-    if (CURRENT->type == va_arg(args, int)) {
-      va_end(args);
-      return 1;
-    }
+static void walk_free(walk_t *w) {
+  if (w->items != w->init) {
+    xfree(w->items);
   }
-  return 0;
 }
 
+typedef struct _print_item_t {
+  vcc_expr_t *expr;
+  int depth;
+} print_item_t;
+
 void vcc_expr_print(vcc_expr_t *root, int depth) {
-  if (!root)
-    return;
-  printf("%*s\t%d\n", depth, token_names[root->opr], root->literal.number);
-  if (root->lhs) {
-    vcc_expr_print(root->lhs, depth + 8);
-  }
-  if (root->rhs) {
-    vcc_expr_print(root->rhs, depth + 8);
+  print_item_t init[WALK_INIT_CAP];
+  walk_t w;
+  walk_init(&w, init, sizeof(print_item_t));
+  *(print_item_t *)walk_push(&w) = (print_item_t){root, depth};
+  while (w.count) {
+    print_item_t it = *(print_item_t *)walk_top(&w);
+    w.count--;
+    if (!it.expr) {
+      continue;
+    }
+    printf("%*s\t%lld\n", it.depth, token_names[it.expr->opr],
+           (long long)literal_bits(it.expr));
+    // pushed in reverse, so operands come before the rest of the list
+    *(print_item_t *)walk_push(&w) = (print_item_t){it.expr->next, it.depth};
+    *(print_item_t *)walk_push(&w) =
+        (print_item_t){it.expr->rhs, it.depth + 8};
+    *(print_item_t *)walk_push(&w) =
+        (print_item_t){it.expr->lhs, it.depth + 8};
   }
+  walk_free(&w);
 }
 
 vcc_expr_t *vcc_expr_parse() {
   logs("parsing an expression\n");
-  return vcc_expr_parse_equality();
+  return vcc_expr_parse_prec(PREC_COMMA);
 }
 
-vcc_expr_t *vcc_expr_parse_equality() {
-  vcc_expr_t *lhs = vcc_expr_parse_comparison();
+static vcc_expr_t *unshare(vcc_expr_t *expr);
+
+/* what a frame waits for
+ */
+enum {
+  FRAME_UNARY,  // the operand of a prefix operator
+  FRAME_BINARY, // the right operand
+  FRAME_GROUP,  // what is in parentheses
+  FRAME_THEN,   // the branch after ?
+  FRAME_ELSE,   // the branch after :
+  FRAME_INDEX,  // what is in brackets
+  FRAME_ARG,    // an argument of a call
+};
+
+static void push_frame(int kind, int prec, int opr, vcc_expr_t *lhs) {
+  if (!P.frames) {
+    P.frames = P.frames_init;
+    P.frames_cap = EXPR_FRAMES_INIT_CAP;
+  }
+  if (P.nframes == P.frames_cap) {
+    vcc_expr_frame_t *grown =
+        xalloc(2 * P.frames_cap * sizeof(vcc_expr_frame_t));
+    memcpy(grown, P.frames, P.nframes * sizeof(vcc_expr_frame_t));
+    if (P.frames != P.frames_init) {
+      xfree(P.frames);
+    }
+    P.frames = grown;
+    P.frames_cap *= 2;
+  }
+  P.frames[P.nframes++] =
+      (vcc_expr_frame_t){.kind = kind, .prec = prec, .opr = opr, .lhs = lhs};
+}
 
-  while (match(2, TOKEN_NOT_EQ, TOKEN_EQ)) {
-    int opr = CURRENT->type;
-    logf("catched opr: %s\n", token_names[opr]);
+/* gives back the frames grown past the ones in the parser
+ */
+static void free_frames() {
+  if (P.frames != P.frames_init) {
+    xfree(P.frames);
+  }
+  P.frames = NULL;
+  P.nframes = 0;
+}
+
+/* parses an operand without its prefix operators, NULL if the current
+ * token does not start one
+ */
+static vcc_expr_t *parse_primary() {
+  int type = current_type();
+  switch (type) {
+  case TOKEN_INT:
+    logs("primary is an integer\n");
+    advance();
+    return vcc_expr_new_atomic_number(PREVIOUS->value.i, PREVIOUS->flags);
+  case TOKEN_KWORD_NULL:
+    logs("primary is a null\n");
     advance();
-    vcc_expr_t *rhs = vcc_expr_parse_comparison();
+    return vcc_expr_new_atomic_null();
+  case TOKEN_IDENTIFIER:
+  case TOKEN_STR:
+  case TOKEN_CHAR:
+    logf("primary is a %s\n", token_names[type]);
+    advance();
+    return vcc_expr_new_atomic_name(type, PREVIOUS->value.atom);
+  }
+  return NULL;
+}
 
-    lhs = vcc_expr_new_binary(lhs, opr, rhs);
+/* parses an expression of operators that bind at least as tight as `prec`
+ * by precedence climbing over the infix table, without recursing: an
+ * operator that needs an operand parsed first pushes a frame, and the
+ * frame is popped once the operand is complete, so a long chain of left
+ * associative operators takes one frame and nesting is bound by memory
+ */
+vcc_expr_t *vcc_expr_parse_prec(int prec) {
+  int base = P.nframes;
+  int err = P.err.code; // an error from before does not stop it
+  vcc_expr_t *lhs;
+  for (;;) {
+    // prefix operators and parentheses, up to an operand
+    int type = current_type();
+    if (prefix[type] || type == TOKEN_LPAREN) {
+      logf("catched opr: %s\n", token_names[type]);
+      advance();
+      push_frame(prefix[type] ? FRAME_UNARY : FRAME_GROUP, prec, type, NULL);
+      prec = prefix[type] ? PREC_UNARY : PREC_COMMA;
+      continue;
+    }
+    lhs = parse_primary();
+
+    // operators after it, then the frames it completes
+    int operand = 0;
+    while (!operand) {
+      int opr = current_type();
+      vcc_op_t op = infix[opr];
+      if (op.kind != OP_NONE && op.prec >= prec) {
+        logf("catched opr: %s\n", token_names[opr]);
+        advance();
+        switch (op.kind) {
+        case OP_BINARY:
+        case OP_RIGHT:
+          push_frame(FRAME_BINARY, prec, opr, lhs);
+          prec = op.kind == OP_BINARY ? op.prec + 1 : op.prec;
+          operand = 1;
+          break;
+        case OP_TERNARY:
+          push_frame(FRAME_THEN, prec, opr, lhs);
+          prec = PREC_COMMA;
+          operand = 1;
+          break;
+        case OP_CALL:
+          if (current_type() == TOKEN_RPAREN) {
+            advance();
+            lhs = vcc_expr_new_binary(lhs, opr, NULL);
+            break;
+          }
+          push_frame(FRAME_ARG, prec, opr, lhs);
+          prec = PREC_ASSIGN;
+          operand = 1;
+          break;
+        case OP_INDEX:
+          push_frame(FRAME_INDEX, prec, opr, lhs);
+          prec = PREC_COMMA;
+          operand = 1;
+          break;
+        case OP_MEMBER:
+          if (current_type() != TOKEN_IDENTIFIER) {
+            P.err.code = VCC_PARSER_ERR_EXPR;
+            break;
+          }
+          advance();
+          lhs = vcc_expr_new_binary(
+              lhs, opr,
+              vcc_expr_new_atomic_name(TOKEN_IDENTIFIER, PREVIOUS->value.atom));
+          break;
+        case OP_POSTFIX:
+          lhs = vcc_expr_new_postfix(lhs, opr);
+          break;
+        }
+      } else if (P.nframes == base || P.err.code != err) {
+        // done, or what is left of an error
+        P.nframes = base;
+        return lhs;
+      } else {
+        vcc_expr_frame_t f = P.frames[--P.nframes];
+        prec = f.prec;
+        switch (f.kind) {
+        case FRAME_UNARY:
+          lhs = vcc_expr_new_unary(f.opr, lhs);
+          break;
+        case FRAME_BINARY:
+          lhs = vcc_expr_new_binary(f.lhs, f.opr, lhs);
+          break;
+        case FRAME_GROUP:
+          if (current_type() == TOKEN_RPAREN) {
+            advance();
+          } else {
+            P.err.code = VCC_PARSER_ERR_EXPR;
+          }
+          break;
+        case FRAME_THEN:
+          if (current_type() != TOKEN_COLON) {
+            P.err.code = VCC_PARSER_ERR_EXPR;
+            lhs = f.lhs;
+            break;
+          }
+          advance();
+          push_frame(FRAME_ELSE, prec, f.opr, f.lhs);
+          P.frames[P.nframes - 1].then = lhs;
+          prec = PREC_TERNARY;
+          operand = 1;
+          break;
+        case FRAME_ELSE:
+          // the condition, then a : node of both branches
+          lhs = vcc_expr_new_binary(
+              f.lhs, f.opr, vcc_expr_new_binary(f.then, TOKEN_COLON, lhs));
+          break;
+        case FRAME_INDEX:
+          lhs = vcc_expr_new_binary(f.lhs, f.opr, lhs);
+          if (current_type() == TOKEN_RBRACKET) {
+            advance();
+          } else {
+            P.err.code = VCC_PARSER_ERR_EXPR;
+          }
+          break;
+        case FRAME_ARG:
+          // arguments are linked by their next, so none is shared
+          if ((lhs = unshare(lhs))) {
+            f.then = f.then ? f.then : lhs;
+            if (f.last) {
+              f.last->next = lhs;
+            }
+            f.last = lhs;
+          }
+          if (current_type() == TOKEN_COMMA) {
+            advance();
+            P.frames[P.nframes++] = f;
+            prec = PREC_ASSIGN;
+            operand = 1;
+            break;
+          }
+          if (current_type() == TOKEN_RPAREN) {
+            advance();
+          } else {
+            P.err.code = VCC_PARSER_ERR_EXPR;
+          }
+          lhs = vcc_expr_new_binary(f.lhs, f.opr, f.then);
+          break;
+        }
+      }
+    }
   }
+}
 
-  return lhs;
+/* ======== CONSTANT FOLDING ======== */
+static int is_const(vcc_expr_t *expr) {
+  return expr && expr->arity == 0 && expr->opr == TOKEN_INT &&
+         expr->type != EXPR_TYPE_NONE;
 }
 
-vcc_expr_t *vcc_expr_parse_comparison() {
-  vcc_expr_t *lhs = vcc_expr_parse_term();
+/* the value of a constant operand as its type reads it
+ */
+static int64_t const_value(vcc_expr_t *expr) {
+  return expr->type == EXPR_TYPE_UINT ? (int64_t)(uint32_t)expr->literal.number
+                                      : expr->literal.number;
+}
 
-  while (match(4, TOKEN_LT, TOKEN_GT, TOKEN_LTEQ, TOKEN_GTEQ)) {
-    int opr = CURRENT->type;
-    logf("catched opr: %s\n", token_names[opr]);
-    advance();
-    vcc_expr_t *rhs = vcc_expr_parse_term();
+/* stores `value` of `type` in the constant `expr`, returns 0 if an int
+ * cannot hold it, an unsigned int wraps around
+ */
+static int const_store(vcc_expr_t *expr, int type, int64_t value) {
+  if (type == EXPR_TYPE_INT && (value < INT_MIN || value > INT_MAX)) {
+    return 0;
+  }
+  expr->type = type;
+  expr->literal.number = type == EXPR_TYPE_UINT ? (uint32_t)value : value;
+  return 1;
+}
 
-    lhs = vcc_expr_new_binary(lhs, opr, rhs);
+/* folds `lhs opr rhs` of two constants into the constant `out` the way C
+ * computes it after the usual arithmetic conversions, returns 0 if `opr` is
+ * no arithmetic or C leaves the result undefined
+ */
+static int fold_binary(vcc_expr_t *lhs, int opr, vcc_expr_t *rhs,
+                       vcc_expr_t *out) {
+  int type = lhs->type == EXPR_TYPE_UINT || rhs->type == EXPR_TYPE_UINT
+                 ? EXPR_TYPE_UINT
+                 : EXPR_TYPE_INT;
+  int64_t a = const_value(lhs), b = const_value(rhs);
+  if (type == EXPR_TYPE_UINT) {
+    a = (uint32_t)a;
+    b = (uint32_t)b;
   }
+  switch (opr) {
+  case TOKEN_ADD:
+    return const_store(out, type, a + b);
+  case TOKEN_SUB:
+    return const_store(out, type, a - b);
+  case TOKEN_ASTERISK:
+    // two unsigned ints may not fit in 63 bits, only the low 32 are kept
+    return const_store(out, type,
+                       type == EXPR_TYPE_UINT
+                           ? (int64_t)((uint64_t)a * (uint64_t)b)
+                           : a * b);
+  case TOKEN_DIV:
+    return b != 0 && const_store(out, type, a / b);
+  case TOKEN_MOD:
+    // undefined where the quotient is, INT_MIN / -1 does not fit
+    return b != 0 && !(type == EXPR_TYPE_INT && a == INT_MIN && b == -1) &&
+           const_store(out, type, a % b);
+  case TOKEN_LSHIFT:
+  case TOKEN_RSHIFT:
+    // only the left operand gives the type
+    a = const_value(lhs);
+    b = const_value(rhs);
+    if (b < 0 || b > 31 || (lhs->type == EXPR_TYPE_INT && a < 0)) {
+      return 0;
+    }
+    return const_store(out, lhs->type, opr == TOKEN_LSHIFT ? a << b : a >> b);
+  case TOKEN_AND:
+    return const_store(out, type, a & b);
+  case TOKEN_OR:
+    return const_store(out, type, a | b);
+  case TOKEN_XOR:
+    return const_store(out, type, a ^ b);
+  case TOKEN_EQ:
+    return const_store(out, EXPR_TYPE_INT, a == b);
+  case TOKEN_NOT_EQ:
+    return const_store(out, EXPR_TYPE_INT, a != b);
+  case TOKEN_LT:
+    return const_store(out, EXPR_TYPE_INT, a < b);
+  case TOKEN_GT:
+    return const_store(out, EXPR_TYPE_INT, a > b);
+  case TOKEN_LTEQ:
+    return const_store(out, EXPR_TYPE_INT, a <= b);
+  case TOKEN_GTEQ:
+    return const_store(out, EXPR_TYPE_INT, a >= b);
+  case TOKEN_AND_AND:
+    return const_store(out, EXPR_TYPE_INT, a && b);
+  case TOKEN_OR_OR:
+    return const_store(out, EXPR_TYPE_INT, a || b);
+  }
+  return 0;
+}
+
+/* folds the prefix `opr` of the constant `rhs` into `out`, like
+ * fold_binary()
+ */
+static int fold_unary(int opr, vcc_expr_t *rhs, vcc_expr_t *out) {
+  int64_t a = const_value(rhs);
+  switch (opr) {
+  case TOKEN_ADD:
+    return const_store(out, rhs->type, a);
+  case TOKEN_SUB:
+    return const_store(out, rhs->type,
+                       rhs->type == EXPR_TYPE_UINT ? (uint32_t)-a : -a);
+  case TOKEN_TILDE:
+    return const_store(out, rhs->type,
+                       rhs->type == EXPR_TYPE_UINT ? (uint32_t)~a : ~a);
+  case TOKEN_NOT:
+    return const_store(out, EXPR_TYPE_INT, !a);
+  }
+  return 0;
+}
 
-  return lhs;
+/* folds `cond ? branches->lhs : branches->rhs` of three constants into
+ * `out`, the branch taken converted to the type of both
+ */
+static int fold_ternary(vcc_expr_t *cond, vcc_expr_t *branches,
+                        vcc_expr_t *out) {
+  if (!is_const(cond) || !branches || branches->opr != TOKEN_COLON ||
+      !is_const(branches->lhs) || !is_const(branches->rhs)) {
+    return 0;
+  }
+  vcc_expr_t *taken = cond->literal.number ? branches->lhs : branches->rhs;
+  int type = branches->lhs->type == EXPR_TYPE_UINT ||
+                     branches->rhs->type == EXPR_TYPE_UINT
+                 ? EXPR_TYPE_UINT
+                 : EXPR_TYPE_INT;
+  return const_store(out, type, const_value(taken));
 }
 
-vcc_expr_t *vcc_expr_parse_term() {
-  vcc_expr_t *lhs = vcc_expr_parse_factor();
+/* ======== HASH-CONSING ======== */
+/* turns sharing of expressions on or off for the rest of the parse: an
+ * expression without side effects built again is the node built first,
+ * whose operands are shared too, so equal subtrees are the same pointer
+ */
+void vcc_parser_share_exprs(int on) {
+  if (!on) {
+    xfree(P.shared);
+    P.shared = NULL;
+    P.shared_cap = 0;
+    P.shared_count = 0;
+    return;
+  }
+  if (!P.shared) {
+    P.shared_cap = EXPR_SHARED_INIT_CAP;
+    P.shared = xalloc(P.shared_cap * sizeof(vcc_expr_t *));
+  }
+}
 
-  while (match(2, TOKEN_ADD, TOKEN_SUB)) {
-    int opr = CURRENT->type;
-    logf("catched opr: %s\n", token_names[opr]);
-    advance();
-    vcc_expr_t *rhs = vcc_expr_parse_factor();
+vcc_share_stats_t vcc_parser_share_stats() { return P.share_stats; }
 
-    lhs = vcc_expr_new_binary(lhs, opr, rhs);
+/* only these are safe to evaluate once for every copy
+ */
+static int shareable(const vcc_expr_t *key) {
+  if (key->next || (key->lhs && !key->lhs->shared) ||
+      (key->rhs && !key->rhs->shared)) {
+    return 0;
   }
+  switch (key->opr) {
+  case TOKEN_INC:
+  case TOKEN_DEC:
+  case TOKEN_LPAREN: // a call
+    return 0;
+  }
+  return key->arity < 2 || infix[key->opr].prec != PREC_ASSIGN;
+}
 
-  return lhs;
+static uint32_t expr_hash(const vcc_expr_t *key) {
+  uint64_t h = (uint64_t)key->opr << 40 ^ (uint64_t)key->arity << 32 ^
+               (uint64_t)key->type << 36 ^ literal_bits(key);
+  h = (h ^ (uintptr_t)key->lhs) * 0x9e3779b97f4a7c15ULL;
+  h = (h ^ (uintptr_t)key->rhs) * 0x9e3779b97f4a7c15ULL;
+  return h >> 32;
 }
 
-vcc_expr_t *vcc_expr_parse_factor() {
-  vcc_expr_t *lhs = vcc_expr_parse_unary();
+static int expr_equal(const vcc_expr_t *a, const vcc_expr_t *b) {
+  return a->arity == b->arity && a->opr == b->opr && a->type == b->type &&
+         literal_bits(a) == literal_bits(b) && a->lhs == b->lhs &&
+         a->rhs == b->rhs;
+}
 
-  while (match(2, TOKEN_DIV, TOKEN_ASTERISK)) {
-    int opr = CURRENT->type;
-    logf("catched opr: %s\n", token_names[opr]);
-    advance();
-    vcc_expr_t *rhs = vcc_expr_parse_unary();
+static void shared_grow() {
+  vcc_expr_t **old = P.shared;
+  int old_cap = P.shared_cap;
+  P.shared_cap *= 2;
+  P.shared = xalloc(P.shared_cap * sizeof(vcc_expr_t *));
+  for (int i = 0; i < old_cap; ++i) {
+    if (old[i]) {
+      uint32_t slot = expr_hash(old[i]) & (P.shared_cap - 1);
+      while (P.shared[slot]) {
+        slot = (slot + 1) & (P.shared_cap - 1);
+      }
+      P.shared[slot] = old[i];
+    }
+  }
+  xfree(old);
+}
+
+vcc_expr_t *vcc_expr_new() {
+  vcc_expr_t *expr = ast_alloc(sizeof(vcc_expr_t));
+  return expr;
+}
+
+/* an expression like `key`, the one already built if it is shared
+ */
+static vcc_expr_t *make(const vcc_expr_t *key) {
+  uint32_t slot = 0;
+  int share = P.shared && shareable(key);
+  if (share) {
+    ++P.share_stats.built;
+    slot = expr_hash(key) & (P.shared_cap - 1);
+    for (; P.shared[slot]; slot = (slot + 1) & (P.shared_cap - 1)) {
+      if (expr_equal(P.shared[slot], key)) {
+        return P.shared[slot];
+      }
+    }
+  }
+  vcc_expr_t *expr = vcc_expr_new();
+  *expr = *key;
+  if (share) {
+    ++P.share_stats.allocated;
+    expr->shared = 1;
+    P.shared[slot] = expr;
+    if (++P.shared_count * 2 > P.shared_cap) {
+      shared_grow();
+    }
+  }
+  return expr;
+}
 
-    lhs = vcc_expr_new_binary(lhs, opr, rhs);
+/* `expr` if it may be changed, else a copy of it that is not shared
+ */
+static vcc_expr_t *unshare(vcc_expr_t *expr) {
+  if (!expr || !expr->shared) {
+    return expr;
   }
+  vcc_expr_t *copy = vcc_expr_new();
+  *copy = *expr;
+  copy->shared = 0;
+  return copy;
+}
 
-  return lhs;
+/* a constant folded from `operand`, written over it unless it is shared
+ */
+static vcc_expr_t *folded(vcc_expr_t *operand, const vcc_expr_t *key) {
+  if (operand->shared) {
+    return make(key);
+  }
+  *operand = *key;
+  return operand;
 }
 
-vcc_expr_t *vcc_expr_parse_unary() {
-  if (match(1, TOKEN_NOT)) {
-    int opr = CURRENT->type;
-    logf("catched opr: %s\n", token_names[opr]);
-    advance();
-    vcc_expr_t *rhs = vcc_expr_parse_unary();
+/* `lhs opr rhs`, or the constant it folds to if both operands are constant
+ */
+vcc_expr_t *vcc_expr_new_binary(vcc_expr_t *lhs, int opr, vcc_expr_t *rhs) {
+  vcc_expr_t key = {.prec = PREC_PRIMARY, .opr = TOKEN_INT};
+  if (opr == TOKEN_QUESTION ? fold_ternary(lhs, rhs, &key)
+                            : is_const(lhs) && is_const(rhs) &&
+                                  fold_binary(lhs, opr, rhs, &key)) {
+    return folded(lhs, &key);
+  }
+  key = (vcc_expr_t){.arity = 2,
+                     .prec = infix[opr].prec,
+                     .opr = opr,
+                     .lhs = lhs,
+                     .rhs = rhs};
+  return make(&key);
+}
 
-    return vcc_expr_new_unary(opr, rhs);
+/* `opr rhs`, or the constant it folds to if `rhs` is constant
+ */
+vcc_expr_t *vcc_expr_new_unary(int opr, vcc_expr_t *rhs) {
+  vcc_expr_t key = {.prec = PREC_PRIMARY, .opr = TOKEN_INT};
+  if (is_const(rhs) && fold_unary(opr, rhs, &key)) {
+    return folded(rhs, &key);
   }
+  key = (vcc_expr_t){
+      .arity = 1, .prec = PREC_UNARY, .opr = opr, .rhs = rhs};
+  return make(&key);
+}
 
-  return vcc_expr_parse_primary();
+/* a postfix ++ or --, the operand is on the left
+ */
+vcc_expr_t *vcc_expr_new_postfix(vcc_expr_t *lhs, int opr) {
+  vcc_expr_t key = {
+      .arity = 1, .prec = PREC_POSTFIX, .opr = opr, .lhs = lhs};
+  return make(&key);
 }
 
-vcc_expr_t *vcc_expr_parse_primary() {
-  if (match(1, TOKEN_INT)) {
-    logs("primary is an integer\n");
-    advance();
-    return vcc_expr_new_atomic_int(PREVIOUS->value.i);
+vcc_expr_t *vcc_expr_new_atomic_int(int val) {
+  vcc_expr_t key = {.prec = PREC_PRIMARY,
+                    .opr = TOKEN_INT,
+                    .type = EXPR_TYPE_INT,
+                    .literal.number = val};
+  return make(&key);
+}
+
+/* an integer literal with the VCC_LIT_* suffixes in `flags`, only an int or
+ * an unsigned int is ever folded, a literal of another type is kept as it
+ * is written
+ */
+vcc_expr_t *vcc_expr_new_atomic_number(int64_t value, int flags) {
+  vcc_expr_t key = {.prec = PREC_PRIMARY,
+                    .opr = TOKEN_INT,
+                    .type = EXPR_TYPE_INT,
+                    .literal.number = value};
+  if (flags & (VCC_LIT_LONG | VCC_LIT_LONG_LONG)) {
+    key.type = EXPR_TYPE_NONE;
+  } else if (flags & VCC_LIT_UNSIGNED) {
+    key.type = (uint64_t)value <= UINT_MAX ? EXPR_TYPE_UINT : EXPR_TYPE_NONE;
+  } else if (value < INT_MIN || value > INT_MAX) {
+    // a long, or an unsigned int if it was not written in decimal
+    key.type = EXPR_TYPE_NONE;
   }
+  return make(&key);
+}
 
-  if (match(1, TOKEN_KWORD_NULL)) {
-    logs("primary is a null\n");
-    advance();
-    return vcc_expr_new_atomic_null();
+vcc_expr_t *vcc_expr_new_atomic_null() { return vcc_expr_new_atomic_int(0); }
+
+/* an identifier, string or character by its atom
+ */
+vcc_expr_t *vcc_expr_new_atomic_name(int type, vcc_atom_t atom) {
+  vcc_expr_t key = {.prec = PREC_PRIMARY, .opr = type};
+  key.literal.atom = atom; // after the zeroed number, so the union is whole
+  return make(&key);
+}
+
+/* ======== COMPACT EXPRESSIONS ======== */
+/* applies the binary `opr` to the values of its operands, without objects
+ * an assignment gives the value it would store, calls, subscripts and
+ * members give 0, and so does what C leaves undefined, like a division by
+ * zero or a shift out of range
+ */
+static int apply(int opr, int lhs, int rhs) {
+  switch (opr) {
+  case TOKEN_COMMA:
+  case TOKEN_ASSIGN:
+    return rhs;
+  case TOKEN_ADD:
+  case TOKEN_ADD_ASSIGN:
+    return (unsigned)lhs + rhs;
+  case TOKEN_SUB:
+  case TOKEN_SUB_ASSIGN:
+    return (unsigned)lhs - rhs;
+  case TOKEN_ASTERISK:
+  case TOKEN_MUL_ASSIGN:
+    return (unsigned)lhs * rhs;
+  case TOKEN_DIV:
+  case TOKEN_DIV_ASSIGN:
+    return rhs == 0 || (lhs == INT_MIN && rhs == -1) ? 0 : lhs / rhs;
+  case TOKEN_MOD:
+  case TOKEN_MOD_ASSIGN:
+    return rhs == 0 || (lhs == INT_MIN && rhs == -1) ? 0 : lhs % rhs;
+  case TOKEN_LSHIFT:
+  case TOKEN_LSHIFT_ASSIGN:
+    return rhs < 0 || rhs > 31 ? 0 : (int)((unsigned)lhs << rhs);
+  case TOKEN_RSHIFT:
+  case TOKEN_RSHIFT_ASSIGN:
+    return rhs < 0 || rhs > 31 ? 0 : lhs >> rhs;
+  case TOKEN_AND:
+  case TOKEN_AND_ASSIGN:
+    return lhs & rhs;
+  case TOKEN_OR:
+  case TOKEN_OR_ASSIGN:
+    return lhs | rhs;
+  case TOKEN_XOR:
+  case TOKEN_XOR_ASSIGN:
+    return lhs ^ rhs;
+  case TOKEN_AND_AND:
+    return lhs && rhs;
+  case TOKEN_OR_OR:
+    return lhs || rhs;
+  case TOKEN_EQ:
+    return lhs == rhs;
+  case TOKEN_NOT_EQ:
+    return lhs != rhs;
+  case TOKEN_LT:
+    return lhs < rhs;
+  case TOKEN_GT:
+    return lhs > rhs;
+  case TOKEN_LTEQ:
+    return lhs <= rhs;
+  case TOKEN_GTEQ:
+    return lhs >= rhs;
   }
+  return 0;
+}
 
-  if (match(1, TOKEN_LPAREN)) {
-    logs("primary is a grouping\n");
-    advance();
-    vcc_expr_t *expr = vcc_expr_parse();
+/* applies the prefix `opr` to the value of its operand, dereferences,
+ * addresses and sizes give 0
+ */
+static int apply_unary(int opr, int rhs) {
+  switch (opr) {
+  case TOKEN_NOT:
+    return !rhs;
+  case TOKEN_TILDE:
+    return ~rhs;
+  case TOKEN_SUB:
+    return -(unsigned)rhs;
+  case TOKEN_ADD:
+    return rhs;
+  case TOKEN_INC:
+    return (unsigned)rhs + 1;
+  case TOKEN_DEC:
+    return (unsigned)rhs - 1;
+  }
+  return 0;
+}
 
-    logf("ended at %s\n", token_names[CURRENT->type]);
-    // TODO: expect the RPAREN here
-    if (CURRENT->type == TOKEN_RPAREN) {
-      advance();
+/* the value of an expression tree, names and missing operands count as 0,
+ * a postfix ++ or -- gives its operand
+ */
+typedef struct _eval_item_t {
+  vcc_expr_t *expr;
+  int state; // operands valued so far
+  int lhs;   // value of the first
+} eval_item_t;
+
+int vcc_expr_eval(vcc_expr_t *expr) {
+  eval_item_t init[WALK_INIT_CAP];
+  walk_t w;
+  walk_init(&w, init, sizeof(eval_item_t));
+  *(eval_item_t *)walk_push(&w) = (eval_item_t){expr, 0, 0};
+  int value = 0; // of the last item popped
+  while (w.count) {
+    eval_item_t *it = walk_top(&w);
+    vcc_expr_t *e = it->expr;
+    int want = 1; // whether `operand` is valued next
+    vcc_expr_t *operand = NULL;
+    if (!e) {
+      value = 0;
+      want = 0;
+    } else if (e->arity == 0) {
+      value = e->opr == TOKEN_INT ? (int)e->literal.number : 0;
+      want = 0;
+    } else if (e->arity == 1) {
+      if (it->state++ == 0) {
+        operand = e->lhs ? e->lhs : e->rhs;
+      } else {
+        value = e->lhs ? value : apply_unary(e->opr, value);
+        want = 0;
+      }
+    } else if (e->opr == TOKEN_QUESTION && !e->rhs) {
+      value = 0;
+      want = 0;
+    } else if (e->opr == TOKEN_QUESTION) {
+      // the condition, then only the branch it takes
+      switch (it->state++) {
+      case 0:
+        operand = e->lhs;
+        break;
+      case 1:
+        operand = value ? e->rhs->lhs : e->rhs->rhs;
+        break;
+      default:
+        want = 0;
+      }
     } else {
-      P.err.code = VCC_PARSER_ERR_EXPR;
+      switch (it->state++) {
+      case 0:
+        operand = e->lhs;
+        break;
+      case 1:
+        it->lhs = value;
+        operand = e->rhs;
+        break;
+      default:
+        value = apply(e->opr, it->lhs, value);
+        want = 0;
+      }
+    }
+    if (want) {
+      *(eval_item_t *)walk_push(&w) = (eval_item_t){operand, 0, 0};
+    } else {
+      w.count--;
     }
-    return expr;
   }
-  return NULL;
+  walk_free(&w);
+  return value;
 }
 
-vcc_expr_t *vcc_expr_new() {
-  vcc_expr_t *expr = xalloc(sizeof(vcc_expr_t));
-  return expr;
+vcc_expr_pool_t *vcc_expr_pool_new() {
+  vcc_expr_pool_t *pool = xalloc(sizeof(vcc_expr_pool_t));
+  pool->cap = EXPR_POOL_INIT_CAP;
+  pool->nodes = xalloc(pool->cap * sizeof(vcc_xnode_t));
+  pool->count = 1; // index 0 is no expression
+  pool->literals_cap = EXPR_POOL_INIT_CAP;
+  pool->literals = xalloc(pool->literals_cap * sizeof(int64_t));
+  return pool;
 }
 
-vcc_expr_t *vcc_expr_new_binary(vcc_expr_t *lhs, int opr, vcc_expr_t *rhs) {
-  vcc_expr_t *expr = vcc_expr_new();
-  expr->arity = 2;
-  expr->opr = opr;
-  expr->lhs = lhs;
-  expr->rhs = rhs;
+void vcc_expr_pool_free(vcc_expr_pool_t *pool) {
+  if (!pool) {
+    return;
+  }
+  xfree(pool->nodes);
+  xfree(pool->literals);
+  xfree(pool);
+}
 
-  return expr;
+static uint32_t pool_push(vcc_expr_pool_t *pool, int arity, int prec,
+                          int opr, uint32_t lhs, uint32_t rhs) {
+  if (pool->count == pool->cap) {
+    pool->cap *= 2;
+    pool->nodes =
+        grow(pool->nodes, pool->count, pool->cap, sizeof(vcc_xnode_t));
+  }
+  vcc_xnode_t *x = &pool->nodes[pool->count];
+  x->arity = arity;
+  x->prec = prec;
+  x->opr = opr;
+  x->lhs = lhs;
+  x->rhs = rhs;
+  x->next = 0;
+  return pool->count++;
 }
 
-vcc_expr_t *vcc_expr_new_unary(int opr, vcc_expr_t *rhs) {
-  vcc_expr_t *expr = vcc_expr_new();
-  expr->arity = 1;
-  expr->opr = opr;
-  expr->rhs = rhs;
+/* an atom of token `type`, an integer or the atom of a name, string or
+ * character
+ */
+uint32_t vcc_expr_pool_atom(vcc_expr_pool_t *pool, int type, int64_t val) {
+  if (pool->nliterals == pool->literals_cap) {
+    pool->literals_cap *= 2;
+    pool->literals = grow(pool->literals, pool->nliterals,
+                          pool->literals_cap, sizeof(int64_t));
+  }
+  pool->literals[pool->nliterals] = val;
+  return pool_push(pool, 0, PREC_PRIMARY, type, pool->nliterals++, 0);
+}
 
-  return expr;
+uint32_t vcc_expr_pool_int(vcc_expr_pool_t *pool, int val) {
+  return vcc_expr_pool_atom(pool, TOKEN_INT, val);
 }
 
-vcc_expr_t *vcc_expr_new_atomic_int(int val) {
-  vcc_expr_t *expr = vcc_expr_new();
-  expr->arity = 0;
-  expr->opr = TOKEN_INT;
-  expr->literal.number = val;
+uint32_t vcc_expr_pool_unary(vcc_expr_pool_t *pool, int opr, uint32_t rhs) {
+  return pool_push(pool, 1, PREC_UNARY, opr, 0, rhs);
+}
 
-  return expr;
+uint32_t vcc_expr_pool_binary(vcc_expr_pool_t *pool, uint32_t lhs, int opr,
+                              uint32_t rhs) {
+  return pool_push(pool, 2, infix[opr].prec, opr, lhs, rhs);
 }
 
-vcc_expr_t *vcc_expr_new_atomic_null() { return vcc_expr_new_atomic_int(0); }
+/* copies the tree at `expr` to the end of the pool, operands and the rest
+ * of its list before it, so the copy is one run of records ending at the
+ * index returned, 0 if `expr` is NULL
+ */
+typedef struct _add_item_t {
+  vcc_expr_t *expr;
+  int state;     // parts copied so far: the rest of the list, then operands
+  uint32_t next; // their indexes
+  uint32_t lhs;
+} add_item_t;
+
+uint32_t vcc_expr_pool_add(vcc_expr_pool_t *pool, vcc_expr_t *expr) {
+  add_item_t init[WALK_INIT_CAP];
+  walk_t w;
+  walk_init(&w, init, sizeof(add_item_t));
+  *(add_item_t *)walk_push(&w) = (add_item_t){expr, 0, 0, 0};
+  uint32_t index = 0; // of the last item popped
+  while (w.count) {
+    add_item_t *it = walk_top(&w);
+    vcc_expr_t *e = it->expr;
+    if (!e) {
+      index = 0;
+      w.count--;
+      continue;
+    }
+    vcc_expr_t *part = NULL;
+    switch (it->state++) {
+    case 0:
+      part = e->next;
+      break;
+    case 1:
+      it->next = index;
+      if (e->arity) {
+        part = e->lhs;
+        break;
+      }
+      index = vcc_expr_pool_atom(pool, e->opr, literal_bits(e));
+      pool->nodes[index].next = it->next;
+      w.count--;
+      continue;
+    case 2:
+      it->lhs = index;
+      part = e->rhs;
+      break;
+    default:
+      index = pool_push(pool, e->arity, e->prec, e->opr, it->lhs, index);
+      pool->nodes[index].next = it->next;
+      w.count--;
+      continue;
+    }
+    *(add_item_t *)walk_push(&w) = (add_item_t){part, 0, 0, 0};
+  }
+  walk_free(&w);
+  return index;
+}
 
-void vcc_expr_free(vcc_expr_t *expr) {
-  if (expr) {
-    vcc_expr_free(expr->lhs);
-    vcc_expr_free(expr->rhs);
-    vcc_expr_free(expr->next);
-    free(expr);
+/* the values of every expression in the pool in one pass from the start,
+ * into `values`, which has room for pool->count of them
+ */
+void vcc_expr_pool_eval(vcc_expr_pool_t *pool, int *values) {
+  values[0] = 0;
+  const vcc_xnode_t *x = pool->nodes;
+  for (int i = 1; i < pool->count; ++i) {
+    if (x[i].arity == 0) {
+      values[i] = x[i].opr == TOKEN_INT ? (int)pool->literals[x[i].lhs] : 0;
+    } else if (x[i].arity == 1) {
+      values[i] = x[i].lhs ? values[x[i].lhs]
+                           : apply_unary(x[i].opr, values[x[i].rhs]);
+    } else if (x[i].opr == TOKEN_QUESTION) {
+      const vcc_xnode_t *branches = &x[x[i].rhs];
+      values[i] = x[i].rhs ? values[values[x[i].lhs] ? branches->lhs
+                                                     : branches->rhs]
+                           : 0;
+    } else {
+      values[i] = apply(x[i].opr, values[x[i].lhs], values[x[i].rhs]);
+    }
   }
 }
 
+typedef struct _pool_print_item_t {
+  uint32_t root;
+  int depth;
+} pool_print_item_t;
+
+void vcc_expr_pool_print(vcc_expr_pool_t *pool, uint32_t root, int depth) {
+  pool_print_item_t init[WALK_INIT_CAP];
+  walk_t w;
+  walk_init(&w, init, sizeof(pool_print_item_t));
+  *(pool_print_item_t *)walk_push(&w) = (pool_print_item_t){root, depth};
+  while (w.count) {
+    pool_print_item_t it = *(pool_print_item_t *)walk_top(&w);
+    w.count--;
+    if (!it.root) {
+      continue;
+    }
+    vcc_xnode_t *x = &pool->nodes[it.root];
+    printf("%*s\t%lld\n", it.depth, token_names[x->opr],
+           x->arity == 0 ? (long long)pool->literals[x->lhs] : 0);
+    *(pool_print_item_t *)walk_push(&w) = (pool_print_item_t){x->next, it.depth};
+    *(pool_print_item_t *)walk_push(&w) =
+        (pool_print_item_t){x->rhs, it.depth + 8};
+    if (x->arity) {
+      *(pool_print_item_t *)walk_push(&w) =
+          (pool_print_item_t){x->lhs, it.depth + 8};
+    }
+  }
+  walk_free(&w);
+}
+
 /* ======== STATEMENTS ======== */
 vcc_stmt_t *vcc_stmt_new() {
-  vcc_stmt_t *stmt = xalloc(sizeof(vcc_stmt_t));
+  vcc_stmt_t *stmt = ast_alloc(sizeof(vcc_stmt_t));
   return stmt;
 }
 
-void vcc_stmt_free(vcc_stmt_t *stmt) {
-  if (stmt) {
-    vcc_expr_free(stmt->condition);
-    vcc_expr_free(stmt->expr);
-  }
-}
-
 #define expect(expectation, error)                                             \
   do {                                                                         \
-    if (CURRENT->type != expectation) {                                        \
-      logs("did not meet expectation: ");                                      \
-      printf("expect %s, received %s\n", token_names[expectation],             \
-             token_names[CURRENT->type]);                                      \
+    int met = CURRENT && CURRENT->type == expectation;                         \
+    vtrace(PARSER, TRACE_DEBUG, TRACE_EV_EXPECT, expectation, TRACED(CURRENT), \
+           met);                                                               \
+    if (!met && P.err.code == VCC_PARSER_ERR_NONE) {                           \
+      vtrace(PARSER, TRACE_ERROR, TRACE_EV_PARSE_ERROR, error, P.pos, 0);      \
       P.err.code = error;                                                      \
-    } else {                                                                   \
-      logf("met expectation: %s\n", token_names[CURRENT->type]);               \
+      P.err.expected = expectation;                                            \
+      P.err.received = TRACED(CURRENT);                                        \
     }                                                                          \
   } while (0)
 
@@ -340,6 +1263,171 @@ vcc_node_t *vcc_parser_stmt_return() {
   return node;
 }
 
+/* makes function bodies parsed from now on only skimmed for their closing
+ * brace, vcc_func_body() parses one when it is needed, this needs a token
+ * buffer, other sources are parsed in full
+ *
+ * a skipped body is parsed later into the arena of its function, so only
+ * bodies going to an arena of the caller's, given with
+ * vcc_parser_set_arena(), are skipped, the parser's own is gone after
+ * vcc_parser_finish()
+ */
+void vcc_parser_lazy_bodies(int on) { P.lazy = on; }
+
+/* parses statements up to the brace closing the one at CURRENT
+ */
+static vcc_block_t *parse_body() {
+  int depth = P.depth - 1;
+  vcc_block_t *block = ast_alloc(sizeof(vcc_block_t));
+  vcc_node_t **tail = &block->nodes;
+  while (vcc_parser_continuable() && P.depth > depth) {
+    vcc_node_t *node = vcc_parse();
+    if (node) {
+      *tail = node;
+      tail = &node->next;
+      ++block->count;
+    }
+  }
+  return block;
+}
+
+/* moves to the brace closing the one at CURRENT without parsing what is in
+ * between, returns 0 if it is not in the token buffer
+ */
+static int skip_body() {
+  uint8_t *types = P.tokens->types;
+  int depth = 0;
+  for (int i = P.pos; i < P.tokens->count; ++i) {
+    depth += (types[i] == TOKEN_LBRACE) - (types[i] == TOKEN_RBRACE);
+    if (depth == 0) {
+      vtrace(PARSER, TRACE_DEBUG, TRACE_EV_SKIP_BODY, P.pos, i, 0);
+      P.pos = i;
+      PREVIOUS = fetch(i - 1);
+      CURRENT = fetch(i);
+      NEXT = fetch(i + 1);
+      --P.depth;
+      return 1;
+    }
+  }
+  return 0;
+}
+
+static int is_decl_specifier(int type) {
+  switch (type) {
+  case TOKEN_KWORD_STATIC:
+  case TOKEN_KWORD_EXTERN:
+  case TOKEN_KWORD_INLINE:
+  case TOKEN_KWORD_CONST:
+  case TOKEN_KWORD_VOLATILE:
+  case TOKEN_KWORD_VOID:
+  case TOKEN_KWORD_CHAR:
+  case TOKEN_KWORD_SHORT:
+  case TOKEN_KWORD_INT:
+  case TOKEN_KWORD_LONG:
+  case TOKEN_KWORD_FLOAT:
+  case TOKEN_KWORD_DOUBLE:
+  case TOKEN_KWORD_SIGNED:
+  case TOKEN_KWORD_UNSIGNED:
+  case TOKEN_KWORD_BOOL:
+    return 1;
+  }
+  return 0;
+}
+
+/* a function definition of basic types, anything else declared is passed
+ * over up to where the declaration stops looking like a function
+ */
+vcc_node_t *vcc_parser_func() {
+  logs("parsing a function\n");
+  while (is_decl_specifier(vcc_parser_peek(1)) ||
+         vcc_parser_peek(1) == TOKEN_ASTERISK) {
+    advance();
+  }
+  if (vcc_parser_peek(1) != TOKEN_IDENTIFIER) {
+    return NULL;
+  }
+  advance();
+  vcc_atom_t name = CURRENT->value.atom;
+  if (vcc_parser_peek(1) != TOKEN_LPAREN) {
+    return NULL;
+  }
+  advance();
+
+  // only the parameters are counted for now
+  int arity = 0, parens = 1;
+  while (parens > 0) {
+    advance();
+    if (!vcc_parser_continuable()) {
+      return NULL;
+    }
+    int type = CURRENT->type;
+    parens += (type == TOKEN_LPAREN) - (type == TOKEN_RPAREN);
+    if (arity == 0 && parens == 1 && type != TOKEN_KWORD_VOID) {
+      arity = 1;
+    } else if (parens == 1 && type == TOKEN_COMMA) {
+      ++arity;
+    }
+  }
+  if (vcc_parser_peek(1) != TOKEN_LBRACE) {
+    // a prototype
+    return NULL;
+  }
+  advance();
+
+  vcc_func_t *func = ast_alloc(sizeof(vcc_func_t));
+  func->arity = arity;
+  func->name = name;
+  func->arena = P.arena;
+  func->first = P.pos;
+  // bodies skipped are parsed later, into an arena outliving the parser
+  if (P.lazy && P.tokens && !P.own_arena && skip_body()) {
+    func->tokens = P.tokens;
+  } else {
+    func->body = parse_body();
+  }
+  func->last = P.pos;
+  vcc_node_t *node = vcc_node_new();
+  node->type = VCC_NODE_FUNC;
+  node->value.func = func;
+  return node;
+}
+
+/* the body of `func`, parsed now if it was skipped, with a parser of its
+ * own so the one of the caller may be in the middle of a file, NULL if
+ * the body does not parse, the arena and token buffer the function was
+ * parsed with must still be there
+ */
+vcc_block_t *vcc_func_body(vcc_func_t *func) {
+  if (func->body || !func->tokens) {
+    return func->body;
+  }
+  vcc_parser_t saved = P;
+  vcc_parser_init_tokens(NULL, func->tokens);
+  vcc_parser_set_arena(func->arena);
+  if (saved.arena == func->arena) {
+    // expressions hash-consed so far live as long as this body
+    P.shared = saved.shared;
+    P.shared_cap = saved.shared_cap;
+    P.shared_count = saved.shared_count;
+    P.share_stats = saved.share_stats;
+  }
+  P.pos = func->first - 1;
+  advance();
+  vcc_block_t *body = parse_body();
+  if (P.err.code == VCC_PARSER_ERR_NONE) {
+    func->body = body;
+  }
+  if (P.shared) {
+    saved.shared = P.shared;
+    saved.shared_cap = P.shared_cap;
+    saved.shared_count = P.shared_count;
+    saved.share_stats = P.share_stats;
+  }
+  free_frames();
+  P = saved;
+  return func->body;
+}
+
 #undef expect
 
 vcc_node_t *vcc_parse() {
@@ -359,9 +1447,392 @@ vcc_node_t *vcc_parse() {
   case TOKEN_KWORD_RETURN:
     return vcc_parser_stmt_return();
     break;
+
+  default:
+    if (is_decl_specifier(CURRENT->type)) {
+      return vcc_parser_func();
+    }
+    break;
   }
   // TODO:
   return NULL;
 }
 
-void vcc_parser_finish() { logs("Parsing done, freeing resources\n"); }
+/* frees every node parsed, at once, unless they came from the caller's
+ * arena
+ */
+void vcc_parser_finish() {
+  logs("Parsing done, freeing resources\n");
+  vcc_parser_share_exprs(0);
+  free_frames();
+  if (P.own_arena) {
+    arena_free(P.arena);
+  }
+  P.arena = NULL;
+  P.own_arena = 0;
+}
+
+/* ============ TRANSLATION UNITS ============= */
+static void unit_push(vcc_unit_t *unit, vcc_node_t *node, int first,
+                      int last, uint32_t bytes) {
+  if (unit->count == unit->cap) {
+    int n = unit->count;
+    unit->cap = unit->cap ? unit->cap * 2 : 64;
+    unit->nodes = grow(unit->nodes, n, unit->cap, sizeof(vcc_node_t *));
+    unit->first = grow(unit->first, n, unit->cap, sizeof(int));
+    unit->last = grow(unit->last, n, unit->cap, sizeof(int));
+    unit->bytes = grow(unit->bytes, n, unit->cap, sizeof(uint32_t));
+  }
+  unit->nodes[unit->count] = node;
+  unit->first[unit->count] = first;
+  unit->last[unit->count] = last;
+  unit->bytes[unit->count++] = bytes;
+}
+
+/* nodes of a unit set aside while the edited part is parsed again, their
+ * tokens start at `first` in the old token buffer
+ */
+typedef struct _unit_tail_t {
+  vcc_node_t **nodes;
+  int *first;
+  int *last;
+  uint32_t *bytes;
+  int count;
+  int error;      // the old parse stopped in the last of them
+  int old_resync; // tokens from here on were only moved
+  int shift;      // by this many places
+} unit_tail_t;
+
+/* parses the unit from token `pos` on, until the end, an error, or a node
+ * boundary where a node of `tail` began in tokens that were only moved,
+ * from there on the tail is taken as it is, the nodes of the tail left
+ * out are garbage in the arena
+ */
+static void unit_parse(vcc_unit_t *unit, int pos, unit_tail_t *tail,
+                       vcc_reuse_t *reuse) {
+  vcc_parser_init_tokens(unit->lexer, unit->tokens);
+  vcc_parser_set_arena(unit->arena);
+  P.pos = pos - 1;
+  CURRENT = pos ? fetch(P.pos) : NULL; // as if parsing went up to here
+  int t = 0;
+  while (vcc_parser_continuable()) {
+    int next = P.pos + 1;
+    while (t < tail->count &&
+           (tail->first[t] < tail->old_resync ||
+            tail->first[t] + tail->shift < next)) {
+      unit->garbage += tail->bytes[t++];
+    }
+    if (t < tail->count && tail->first[t] + tail->shift == next) {
+      for (; t < tail->count; ++t) {
+        unit_push(unit, tail->nodes[t], tail->first[t] + tail->shift,
+                  tail->last[t] + tail->shift, tail->bytes[t]);
+        ++reuse->nodes_reused;
+      }
+      unit->error = tail->error;
+      return;
+    }
+    size_t used = unit->arena->used;
+    vcc_node_t *node = vcc_parse();
+    unit_push(unit, node, next, P.pos, unit->arena->used - used);
+    ++reuse->nodes_parsed;
+  }
+  unit->error = P.err.code != VCC_PARSER_ERR_NONE;
+  while (t < tail->count) {
+    unit->garbage += tail->bytes[t++];
+  }
+}
+
+/* parses the whole unit into a new arena, dropping the old one at once
+ */
+static void unit_parse_all(vcc_unit_t *unit, vcc_reuse_t *reuse) {
+  arena_free(unit->arena);
+  unit->arena = arena_new(AST_ARENA_CHUNK_SIZE);
+  unit->garbage = 0;
+  unit->count = 0;
+  unit_tail_t none = {0};
+  unit_parse(unit, 0, &none, reuse);
+}
+
+/* lexes and parses a copy of `len` bytes at `src`
+ */
+vcc_unit_t *vcc_unit_new(const char *fname, const char *src, int len) {
+  vcc_unit_t *unit = xalloc(sizeof(vcc_unit_t));
+  unit->src = buf_new(len);
+  memcpy(unit->src->s, src, len);
+  unit->src->len = len;
+  unit->symtbl = vcc_symtbl_new();
+  unit->lexer = vcc_lexer_new_from_mem(fname, unit->src->s, len);
+  vcc_lexer_set_symtbl(unit->lexer, unit->symtbl);
+  unit->tokens = vcc_lex_all(unit->lexer);
+  vcc_reuse_t reuse;
+  unit_parse_all(unit, &reuse);
+  return unit;
+}
+
+/* applies `edit` to the text of the unit, lexes again from the last token
+ * before it until the tokens are the old ones again, and parses again the
+ * nodes that saw a new token, until a node starts where an old one did,
+ * returns 0 if the unit now has an error
+ *
+ * nodes dropped by edits stay in the arena until they take more of it than
+ * the live ones, then the whole unit is parsed again into a new one
+ *
+ * `reuse`, if not NULL, tells how much was done again
+ */
+int vcc_unit_edit(vcc_unit_t *unit, const vcc_edit_t *edit,
+                  vcc_reuse_t *reuse) {
+  vcc_reuse_t ignored;
+  reuse = reuse ? reuse : &ignored;
+  *reuse = (vcc_reuse_t){0};
+  buf_t *old_src = unit->src;
+  uint32_t after = edit->offset + edit->removed;
+  assert(after <= (uint32_t)old_src->len);
+  buf_t *src = buf_new(old_src->len - edit->removed + edit->len);
+  memcpy(src->s, old_src->s, edit->offset);
+  if (edit->len) {
+    memcpy(src->s + edit->offset, edit->text, edit->len);
+  }
+  memcpy(src->s + edit->offset + edit->len, old_src->s + after,
+         old_src->len - after);
+  src->len = old_src->len - edit->removed + edit->len;
+
+  vcc_lexer_t *lexer =
+      vcc_lexer_new_from_mem(unit->lexer->fname, src->s, src->len);
+  vcc_lexer_set_symtbl(lexer, unit->symtbl);
+  vcc_relex_t diff;
+  vcc_tokbuf_t *tokens = vcc_relex(lexer, unit->tokens, edit, &diff);
+  reuse->tokens_lexed = diff.lexed;
+  reuse->tokens_reused = tokens->count - diff.lexed;
+  vcc_tokbuf_free(unit->tokens);
+  vcc_lexer_free(unit->lexer);
+  buf_free(old_src);
+  unit->src = src;
+  unit->lexer = lexer;
+  unit->tokens = tokens;
+
+  // nodes that saw only kept tokens, and the one after them, stay, but
+  // the one that failed is always parsed again
+  int lo = 0, hi = unit->error ? unit->count - 1 : unit->count;
+  while (lo < hi) {
+    int mid = (lo + hi) / 2;
+    if (unit->last[mid] + 1 < diff.kept) {
+      lo = mid + 1;
+    } else {
+      hi = mid;
+    }
+  }
+  reuse->nodes_reused = lo;
+  int n = unit->count - lo;
+  unit_tail_t tail = {.nodes = xalloc(n * sizeof(vcc_node_t *)),
+                      .first = xalloc(n * sizeof(int)),
+                      .last = xalloc(n * sizeof(int)),
+                      .bytes = xalloc(n * sizeof(uint32_t)),
+                      .count = n,
+                      .error = unit->error,
+                      .old_resync = diff.old_resync,
+                      .shift = diff.new_resync - diff.old_resync};
+  if (n) {
+    memcpy(tail.nodes, unit->nodes + lo, n * sizeof(vcc_node_t *));
+    memcpy(tail.first, unit->first + lo, n * sizeof(int));
+    memcpy(tail.last, unit->last + lo, n * sizeof(int));
+    memcpy(tail.bytes, unit->bytes + lo, n * sizeof(uint32_t));
+  }
+  unit->count = lo;
+  unit_parse(unit, lo ? unit->last[lo - 1] + 1 : 0, &tail, reuse);
+  xfree(tail.nodes);
+  xfree(tail.first);
+  xfree(tail.last);
+  xfree(tail.bytes);
+  if (unit->garbage > AST_ARENA_CHUNK_SIZE &&
+      unit->garbage > unit->arena->used - unit->garbage) {
+    unit_parse_all(unit, reuse);
+  }
+  return !unit->error;
+}
+
+void vcc_unit_free(vcc_unit_t *unit) {
+  if (!unit) {
+    return;
+  }
+  arena_free(unit->arena);
+  xfree(unit->nodes);
+  xfree(unit->first);
+  xfree(unit->last);
+  xfree(unit->bytes);
+  vcc_tokbuf_free(unit->tokens);
+  vcc_lexer_free(unit->lexer);
+  vcc_symtbl_free(unit->symtbl);
+  buf_free(unit->src);
+  xfree(unit);
+}
+
+/* ============ PARALLEL PARSING ============= */
+/* top-level bodies parsed by one thread: tokens `from` to `end` included,
+ * or to the end of the buffer if `end` is -1
+ */
+typedef struct _parse_task_t {
+  int from;
+  int end;
+  vcc_node_t **nodes;
+  int count;
+  int cap;
+  int error;
+} parse_task_t;
+
+typedef struct _parse_pool_t {
+  vcc_lexer_t *lexer;
+  vcc_tokbuf_t *tokens;
+  parse_task_t *tasks;
+  int ntasks;
+  atomic_int next;       // task to take next
+  atomic_int first_error; // no task after it is needed
+} parse_pool_t;
+
+typedef struct _parse_worker_t {
+  parse_pool_t *pool;
+  arena_t *arena;
+  pthread_t thread;
+} parse_worker_t;
+
+/* cuts the tokens after the closing brace of a top-level body, once a task
+ * holds at least `min` tokens, returns the number of tasks
+ */
+static int skim(vcc_tokbuf_t *tokens, int min, parse_task_t **tasks) {
+  int cap = 16, count = 0, depth = 0, from = 0;
+  *tasks = xalloc(cap * sizeof(parse_task_t));
+  for (int i = 0; i < tokens->count; ++i) {
+    uint8_t type = tokens->types[i];
+    if (type == TOKEN_LBRACE) {
+      ++depth;
+    } else if (type == TOKEN_RBRACE && depth > 0 && --depth == 0 &&
+               i + 1 - from >= min) {
+      if (count + 1 == cap) {
+        cap *= 2;
+        *tasks = grow(*tasks, count, cap, sizeof(parse_task_t));
+      }
+      (*tasks)[count++] = (parse_task_t){.from = from, .end = i};
+      from = i + 1;
+    }
+  }
+  (*tasks)[count++] = (parse_task_t){.from = from, .end = -1};
+  return count;
+}
+
+/* parses a task like the loop of vcc_parse() over the whole buffer would:
+ * the state at the start of a top-level body is the same wherever parsing
+ * began, and no statement reads past the brace that closes it
+ */
+static void parse_task(parse_pool_t *pool, arena_t *arena,
+                       parse_task_t *task) {
+  vcc_parser_init_tokens(pool->lexer, pool->tokens);
+  vcc_parser_set_arena(arena);
+  P.pos = task->from - 1;
+  CURRENT = task->from ? fetch(P.pos) : NULL; // as if parsing went up to here
+  while (vcc_parser_continuable() && (task->end < 0 || P.pos < task->end)) {
+    if (task->count == task->cap) {
+      task->cap = task->cap ? task->cap * 2 : 64;
+      task->nodes =
+          grow(task->nodes, task->count, task->cap, sizeof(vcc_node_t *));
+    }
+    task->nodes[task->count++] = vcc_parse();
+  }
+  task->error = P.err.code != VCC_PARSER_ERR_NONE;
+  vcc_parser_finish();
+}
+
+static void *parse_worker(void *arg) {
+  parse_worker_t *worker = arg;
+  parse_pool_t *pool = worker->pool;
+  int i;
+  while ((i = atomic_fetch_add(&pool->next, 1)) < pool->ntasks) {
+    if (i > atomic_load(&pool->first_error)) {
+      continue;
+    }
+    parse_task(pool, worker->arena, &pool->tasks[i]);
+    if (pool->tasks[i].error) {
+      // tasks after an error are dropped, so stop taking them
+      int first = atomic_load(&pool->first_error);
+      while (i < first &&
+             !atomic_compare_exchange_weak(&pool->first_error, &first, i)) {
+      }
+    }
+  }
+  return NULL;
+}
+
+/* parses every top-level node of `tokens` on `nthreads` threads, 0 for one
+ * per core: a skim over the tokens cuts them after top-level bodies, the
+ * threads take the pieces with parsers of their own, and the nodes are
+ * joined in source order, the same nodes a loop of vcc_parse() gives
+ *
+ * the parser of the calling thread is left finished
+ */
+vcc_forest_t *vcc_parse_all(vcc_lexer_t *lexer, vcc_tokbuf_t *tokens,
+                            int nthreads) {
+  parse_pool_t pool = {.lexer = lexer, .tokens = tokens};
+  pool.ntasks = skim(tokens, PARSE_TASK_MIN, &pool.tasks);
+  atomic_init(&pool.next, 0);
+  atomic_init(&pool.first_error, pool.ntasks);
+  if (nthreads <= 0) {
+    nthreads = sysconf(_SC_NPROCESSORS_ONLN);
+  }
+  nthreads = nthreads < pool.ntasks ? nthreads : pool.ntasks;
+  logf("parsing %d tasks on %d threads\n", pool.ntasks, nthreads);
+
+  vcc_forest_t *forest = xalloc(sizeof(vcc_forest_t));
+  forest->narenas = nthreads;
+  forest->arenas = xalloc(nthreads * sizeof(arena_t *));
+  parse_worker_t *workers = xalloc(nthreads * sizeof(parse_worker_t));
+  for (int i = 0; i < nthreads; ++i) {
+    forest->arenas[i] = arena_new(AST_ARENA_CHUNK_SIZE);
+    workers[i].pool = &pool;
+    workers[i].arena = forest->arenas[i];
+  }
+  for (int i = 1; i < nthreads; ++i) {
+    if (pthread_create(&workers[i].thread, NULL, parse_worker, &workers[i])) {
+      fatals("could not start a parser thread\n");
+    }
+  }
+  parse_worker(&workers[0]);
+  for (int i = 1; i < nthreads; ++i) {
+    pthread_join(workers[i].thread, NULL);
+  }
+
+  // join the nodes up to the first error
+  int count = 0, last = pool.ntasks - 1;
+  for (int i = 0; i < pool.ntasks; ++i) {
+    count += pool.tasks[i].count;
+    if (pool.tasks[i].error) {
+      last = i;
+      break;
+    }
+  }
+  forest->nodes = xalloc(count * sizeof(vcc_node_t *));
+  for (int i = 0; i <= last; ++i) {
+    parse_task_t *task = &pool.tasks[i];
+    if (task->count) {
+      memcpy(forest->nodes + forest->count, task->nodes,
+             task->count * sizeof(vcc_node_t *));
+    }
+    forest->count += task->count;
+    forest->error = task->error;
+  }
+  for (int i = 0; i < pool.ntasks; ++i) {
+    xfree(pool.tasks[i].nodes);
+  }
+  xfree(pool.tasks);
+  xfree(workers);
+  return forest;
+}
+
+void vcc_forest_free(vcc_forest_t *forest) {
+  if (!forest) {
+    return;
+  }
+  for (int i = 0; i < forest->narenas; ++i) {
+    arena_free(forest->arenas[i]);
+  }
+  xfree(forest->arenas);
+  xfree(forest->nodes);
+  xfree(forest);
+}
@@ -5,18 +5,35 @@
 #include "lexer.h"
 #include "mem.h"
 
+#define AST_ARENA_CHUNK_SIZE (64 * 1024)
+#define EXPR_SHARED_INIT_CAP 1024
+#define EXPR_FRAMES_INIT_CAP 64 // pending operators kept in the parser
+#define PARSE_TASK_MIN 4096 // tokens of top-level bodies parsed as one task
+
 enum {
   VCC_NODE_FUNC = 0,
   VCC_NODE_STMT,
 };
 
+/* C precedence levels, from the loosest binding up
+ */
 enum {
-  PREC_EXPR = 0,
-  PREC_EQUALITY,
-  PREC_COMPARISON,
-  PREC_TERM,
-  PREC_FACTOR,
-  PREC_UNARY,
+  PREC_NONE = 0,
+  PREC_COMMA,      // ,
+  PREC_ASSIGN,     // = += -= *= /= %= <<= >>= &= ^= |=
+  PREC_TERNARY,    // ?:
+  PREC_OR_OR,      // ||
+  PREC_AND_AND,    // &&
+  PREC_OR,         // |
+  PREC_XOR,        // ^
+  PREC_AND,        // &
+  PREC_EQUALITY,   // == !=
+  PREC_COMPARISON, // < > <= >=
+  PREC_SHIFT,      // << >>
+  PREC_TERM,       // + -
+  PREC_FACTOR,     // * / %
+  PREC_UNARY,      // ! ~ - + ++ -- * & sizeof
+  PREC_POSTFIX,    // () [] . -> ++ --
   PREC_PRIMARY
 };
 
@@ -24,6 +41,10 @@ enum { STMT_TYPE_IF, STMT_TYPE_WHILE, STMT_TYPE_RETURN, STMT_TYPE_DECL };
 
 enum { EXPR_OP_MUL = 0, EXPR_OP_DIV, EXPR_OP_ADD, EXPR_OP_SUB };
 
+/* types of integer constants, the ones folded as they are parsed
+ */
+enum { EXPR_TYPE_NONE = 0, EXPR_TYPE_INT, EXPR_TYPE_UINT };
+
 enum {
   VCC_PARSER_ERR_NONE = 0,
   VCC_PARSER_ERR_STMT,
@@ -39,11 +60,15 @@ typedef struct _vcc_expr_t {
   int arity; // numbers of argument
   int prec;  // precedence
   int opr;   // operator
+  int type;  // EXPR_TYPE_* of an integer constant
+  int shared; // hash-consed, so never changed
   struct _vcc_expr_t *lhs;
   struct _vcc_expr_t *rhs;
   // atomic expression e.g. number, function call
   union {
-    int number;
+    int64_t number;  // the literal as written, only an int or an
+                     // unsigned int constant is folded
+    vcc_atom_t atom; // identifier, string or character
     void *func_call;
   } literal;
   struct _vcc_expr_t *next;
@@ -56,28 +81,77 @@ typedef struct _vcc_expr_t {
 vcc_expr_t *vcc_expr_new();
 vcc_expr_t *vcc_expr_new_binary(vcc_expr_t *lhs, int opr, vcc_expr_t *rhs);
 vcc_expr_t *vcc_expr_new_unary(int opr, vcc_expr_t *rhs);
+vcc_expr_t *vcc_expr_new_postfix(vcc_expr_t *lhs, int opr);
 vcc_expr_t *vcc_expr_new_atomic_int(int val);
 vcc_expr_t *vcc_expr_new_atomic_null();
+vcc_expr_t *vcc_expr_new_atomic_number(int64_t value, int flags);
+vcc_expr_t *vcc_expr_new_atomic_name(int type, vcc_atom_t atom);
 
 vcc_expr_t *vcc_expr_parse();
-vcc_expr_t *vcc_expr_parse_equality();
-vcc_expr_t *vcc_expr_parse_comparison();
-vcc_expr_t *vcc_expr_parse_term();
-vcc_expr_t *vcc_expr_parse_factor();
-vcc_expr_t *vcc_expr_parse_unary();
-vcc_expr_t *vcc_expr_parse_primary();
+vcc_expr_t *vcc_expr_parse_prec(int prec);
 
 void vcc_expr_print(vcc_expr_t *root, int depth);
+int vcc_expr_eval(vcc_expr_t *expr);
+
+/* ========= COMPACT EXPRESSIONS ========== */
+#define EXPR_POOL_INIT_CAP 1024
+
+/* an expression as a record of a vcc_expr_pool_t, operands are indices in
+ * the same pool, 0 for none, an atom keeps the index of its literal in lhs
+ */
+typedef struct _vcc_xnode_t {
+  uint8_t arity;
+  uint8_t prec;
+  uint16_t opr;
+  uint32_t lhs;
+  uint32_t rhs;
+  uint32_t next; // rest of a list
+} vcc_xnode_t;
+
+_Static_assert(sizeof(vcc_xnode_t) == 16, "pool records are 16 bytes");
+
+/* expressions in one array, operands always before their operator, so a
+ * pass in index order sees the operands of each first
+ */
+typedef struct _vcc_expr_pool_t {
+  vcc_xnode_t *nodes; // nodes[0] is no expression
+  int count;
+  int cap;
+  int64_t *literals;
+  int nliterals;
+  int literals_cap;
+} vcc_expr_pool_t;
+
+vcc_expr_pool_t *vcc_expr_pool_new();
+void vcc_expr_pool_free(vcc_expr_pool_t *pool);
+uint32_t vcc_expr_pool_atom(vcc_expr_pool_t *pool, int type, int64_t val);
+uint32_t vcc_expr_pool_int(vcc_expr_pool_t *pool, int val);
+uint32_t vcc_expr_pool_unary(vcc_expr_pool_t *pool, int opr, uint32_t rhs);
+uint32_t vcc_expr_pool_binary(vcc_expr_pool_t *pool, uint32_t lhs, int opr,
+                              uint32_t rhs);
+uint32_t vcc_expr_pool_add(vcc_expr_pool_t *pool, vcc_expr_t *expr);
+void vcc_expr_pool_eval(vcc_expr_pool_t *pool, int *values);
+void vcc_expr_pool_print(vcc_expr_pool_t *pool, uint32_t root, int depth);
 
 /* ========= STATEMENTS ========== */
 typedef struct _vcc_block_t {
   struct _vcc_stmt_t *stmt;
+  struct _vcc_node_t *nodes; // statements in order, linked by next
+  int count;
 } vcc_block_t;
 
+/* a function definition, its body parsed with it or, with lazy bodies on,
+ * only kept as a range of tokens until vcc_func_body() asks for it, which
+ * works as long as `tokens` and `arena`, both the caller's, are alive
+ */
 typedef struct _vcc_func_t {
   int arity;
-  char *name;
-  vcc_block_t *body;
+  vcc_atom_t name;
+  vcc_block_t *body;    // NULL while not parsed
+  vcc_tokbuf_t *tokens; // where a body not parsed yet is
+  int first;            // index of its opening brace
+  int last;             // index of its closing brace
+  arena_t *arena;       // where its nodes go
 } vcc_func_t;
 
 typedef struct _vcc_stmt_t {
@@ -89,21 +163,63 @@ typedef struct _vcc_stmt_t {
 } vcc_stmt_t;
 
 vcc_stmt_t *vcc_stmt_new();
-void vcc_stmt_free(vcc_stmt_t *stmt);
+vcc_block_t *vcc_func_body(vcc_func_t *func);
 
 /* ========= PARSER ========== */
 typedef struct _vcc_parser_err_t {
   int code;
   buf_t *msg;
+  uint32_t expected; // token types of an expectation not met
+  uint32_t received; //
 } vcc_parser_err_t;
 
+/* counters of hash-consing, built over allocated is the sharing ratio
+ */
+typedef struct _vcc_share_stats_t {
+  long built;     // side-effect-free expressions built
+  long allocated; // of them, the ones not seen before
+} vcc_share_stats_t;
+
+/* an operator whose operand is being parsed, the expression parser keeps
+ * them on a stack of its own instead of recursing
+ */
+typedef struct _vcc_expr_frame_t {
+  uint8_t kind;     // what waits for the operand
+  uint8_t prec;     // precedence to go back to once it is done
+  uint16_t opr;     //
+  vcc_expr_t *lhs;  // left operand, condition or callee
+  vcc_expr_t *then; // branch of a ternary, or first argument of a call
+  vcc_expr_t *last; // last argument of a call
+} vcc_expr_frame_t;
+
 typedef struct _vcc_parser_t {
+  vcc_lexer_t *lexer;   // token source
+  vcc_tokbuf_t *tokens; // token source lexed beforehand, walked by index
+  int pos;              // index of the current token in tokens
+  vcc_lex_pipe_t *pipe; // token source lexed on another thread
+  vtoken_t window[3];   // previous, current and next read from tokens
+
   vtoken_t *previous;
   vtoken_t *current;
   vtoken_t *next;
 
   int stacks; // parenthesis stacks
+  int depth;  // braces opened so far less the ones closed
+  int lazy;   // function bodies are skipped and parsed on demand
   vcc_parser_err_t err;
+
+  arena_t *arena; // every node, statement and expression parsed
+  int own_arena;  // made on the first node, freed by vcc_parser_finish()
+
+  vcc_expr_t **shared; // open-addressing set of hash-consed expressions
+  int shared_cap;      // power of two
+  int shared_count;
+  vcc_share_stats_t share_stats;
+
+  vcc_expr_frame_t *frames; // frames_init until more are needed
+  int nframes;
+  int frames_cap;
+  vcc_expr_frame_t frames_init[EXPR_FRAMES_INIT_CAP];
 } vcc_parser_t;
 
 typedef struct _vcc_node_t {
@@ -116,15 +232,74 @@ typedef struct _vcc_node_t {
   struct _vcc_node_t *next;
 } vcc_node_t;
 
-void vcc_parser_init();
+void vcc_parser_init(vcc_lexer_t *lexer);
+void vcc_parser_init_tokens(vcc_lexer_t *lexer, vcc_tokbuf_t *tokens);
+void vcc_parser_init_pipe(vcc_lexer_t *lexer, vcc_lex_pipe_t *pipe);
+void vcc_parser_set_arena(arena_t *arena);
+void vcc_parser_share_exprs(int on);
+vcc_share_stats_t vcc_parser_share_stats();
+void vcc_parser_lazy_bodies(int on);
+int vcc_parser_peek(int n);
 void vcc_parser_finish();
 int vcc_parser_continuable();
+vcc_parser_err_t vcc_parser_error();
 
 vcc_node_t *vcc_node_new();
-void vcc_node_free(vcc_node_t *node);
 
 void vcc_parser_advance();
 
 vcc_node_t *vcc_parse();
 
+/* ========= TRANSLATION UNITS ========== */
+
+/* a source kept with its tokens and top-level nodes, each node with the
+ * tokens it was parsed from, so an edit lexes and parses again only what
+ * it touched
+ */
+typedef struct _vcc_unit_t {
+  buf_t *src;           // text, a copy edits are applied to
+  vcc_symtbl_t *symtbl; // atoms of every version of the text
+  vcc_lexer_t *lexer;   // reads src
+  vcc_tokbuf_t *tokens; //
+  arena_t *arena;       // every node of the unit
+  vcc_node_t **nodes;   // what vcc_parse() gave, NULL included
+  int *first;           // index of the first token of each node
+  int *last;            // index of its last token
+  uint32_t *bytes;      // arena bytes of each node
+  int count;            // number of nodes
+  int cap;              //
+  int error;            // lexing or parsing stopped early
+  size_t garbage;       // arena bytes of nodes an edit dropped
+} vcc_unit_t;
+
+/* work done by an edit, against work saved
+ */
+typedef struct _vcc_reuse_t {
+  int tokens_lexed;
+  int tokens_reused;
+  int nodes_parsed;
+  int nodes_reused;
+} vcc_reuse_t;
+
+vcc_unit_t *vcc_unit_new(const char *fname, const char *src, int len);
+int vcc_unit_edit(vcc_unit_t *unit, const vcc_edit_t *edit,
+                  vcc_reuse_t *reuse);
+void vcc_unit_free(vcc_unit_t *unit);
+
+/* ========= PARALLEL PARSING ========== */
+
+/* the top-level nodes of a token buffer, in source order
+ */
+typedef struct _vcc_forest_t {
+  vcc_node_t **nodes; // what vcc_parse() gave, NULL included
+  int count;          //
+  int error;          // parsing stopped at an error in the last node
+  arena_t **arenas;   // where the nodes live, one per thread
+  int narenas;        //
+} vcc_forest_t;
+
+vcc_forest_t *vcc_parse_all(vcc_lexer_t *lexer, vcc_tokbuf_t *tokens,
+                            int nthreads);
+void vcc_forest_free(vcc_forest_t *forest);
+
 #endif
\ No newline at end of file
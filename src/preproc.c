@@ -0,0 +1,1543 @@
+#include "preproc.h"
+#include <limits.h>
+
+/* for error emitting
+ */
+#define PHASE "preprocessing"
+
+/* the preprocessor sits between the lexer and the parser: it reads the raw
+ * tokens of a file, directives included, runs the directives and expands
+ * macros, and gives the parser a token buffer with none of them left
+ *
+ * tokens are read from a stack of contexts, a file or the expansion of a
+ * macro, and a macro is disabled while its expansion is on the stack
+ */
+
+/* the include cache: headers are keyed by their resolved path and never
+ * leave it, their raw tokens are replayed by every preprocessor of the
+ * process, on any thread, without lexing them again
+ */
+static struct {
+  pthread_mutex_t lock;
+  vcc_pp_map_t files; // path atom to vcc_pp_file_t
+  vcc_pp_stats_t stats;
+} cache = {.lock = PTHREAD_MUTEX_INITIALIZER};
+
+/* atoms of directive names and other words the preprocessor looks for,
+ * keywords get an atom too because they may be macro names
+ */
+static struct {
+  vcc_atom_t define, undef, include, ifdef, ifndef, elif, endif, error,
+      warning, pragma, once, line, defined, va_args;
+  vcc_atom_t keywords[NUMBER_OF_TOKENS];
+} A;
+
+static pthread_once_t atoms_once = PTHREAD_ONCE_INIT;
+
+static void init_atoms() {
+  vcc_symtbl_t *tbl = vcc_symtbl_global();
+#define ATOM(name, s) A.name = vcc_symtbl_intern(tbl, s, strlen(s))
+  ATOM(define, "define");
+  ATOM(undef, "undef");
+  ATOM(include, "include");
+  ATOM(ifdef, "ifdef");
+  ATOM(ifndef, "ifndef");
+  ATOM(elif, "elif");
+  ATOM(endif, "endif");
+  ATOM(error, "error");
+  ATOM(warning, "warning");
+  ATOM(pragma, "pragma");
+  ATOM(once, "once");
+  ATOM(line, "line");
+  ATOM(defined, "defined");
+  ATOM(va_args, "__VA_ARGS__");
+#undef ATOM
+  for (int type = TOKEN_KWORD_AUTO; type < NUMBER_OF_TOKENS; ++type) {
+    const char *s = token_spellings[type];
+    A.keywords[type] = vcc_symtbl_intern(tbl, s, strlen(s));
+  }
+}
+
+/* ==================== HELPERS ==================== */
+
+static uint32_t map_slot(vcc_pp_map_t *m, vcc_atom_t key) {
+  uint32_t h = key * 0x9e3779b1u;
+  uint32_t mask = m->cap - 1;
+  for (h = (h ^ h >> 15) & mask; m->values[h] && m->keys[h] != key;
+       h = (h + 1) & mask)
+    ;
+  return h;
+}
+
+static void *map_get(vcc_pp_map_t *m, vcc_atom_t key) {
+  return m->cap ? m->values[map_slot(m, key)] : NULL;
+}
+
+static void map_put(vcc_pp_map_t *m, vcc_atom_t key, void *value) {
+  if (2 * (m->count + 1) > m->cap) { // keep it at most half full
+    vcc_pp_map_t old = *m;
+    m->cap = old.cap ? 2 * old.cap : 64;
+    m->keys = xalloc(m->cap * sizeof(vcc_atom_t));
+    m->values = xalloc(m->cap * sizeof(void *));
+    for (int i = 0; i < old.cap; ++i) {
+      if (old.values[i]) {
+        uint32_t slot = map_slot(m, old.keys[i]);
+        m->keys[slot] = old.keys[i];
+        m->values[slot] = old.values[i];
+      }
+    }
+    xfree(old.keys);
+    xfree(old.values);
+  }
+  uint32_t slot = map_slot(m, key);
+  m->count += !m->values[slot];
+  m->keys[slot] = key;
+  m->values[slot] = value;
+}
+
+static void map_free(vcc_pp_map_t *m) {
+  xfree(m->keys);
+  xfree(m->values);
+}
+
+static void vec_push(vcc_pp_vec_t *vec, const vcc_pp_token_t *tok) {
+  if (vec->count == vec->cap) {
+    vec->cap = vec->cap ? 2 * vec->cap : 16;
+    vcc_pp_token_t *v = xalloc(vec->cap * sizeof(vcc_pp_token_t));
+    if (vec->count) {
+      memcpy(v, vec->v, vec->count * sizeof(vcc_pp_token_t));
+    }
+    xfree(vec->v);
+    vec->v = v;
+  }
+  vec->v[vec->count++] = *tok;
+}
+
+static void vec_append(vcc_pp_vec_t *vec, const vcc_pp_token_t *v, int n) {
+  for (int i = 0; i < n; ++i) {
+    vec_push(vec, &v[i]);
+  }
+}
+
+/* a growing string, for spellings
+ */
+typedef struct {
+  char *s;
+  int len;
+  int cap;
+} text_t;
+
+static void text_put(text_t *t, const char *s, int len) {
+  if (t->len + len + 1 > t->cap) {
+    t->cap = 2 * (t->len + len + 1) > 64 ? 2 * (t->len + len + 1) : 64;
+    char *grown = xalloc(t->cap);
+    if (t->len) {
+      memcpy(grown, t->s, t->len);
+    }
+    xfree(t->s);
+    t->s = grown;
+  }
+  memcpy(t->s + t->len, s, len);
+  t->len += len;
+  t->s[t->len] = '\0';
+}
+
+static void text_putc(text_t *t, char c) { text_put(t, &c, 1); }
+
+/* gets the atom `tok` names if it is an identifier or a keyword, which
+ * may be macro names too
+ */
+static int name_of(const vcc_pp_token_t *tok, vcc_atom_t *atom) {
+  if (tok->t.type == TOKEN_IDENTIFIER) {
+    *atom = tok->t.value.atom;
+    return 1;
+  }
+  if (tok->t.type >= TOKEN_KWORD_AUTO && tok->t.type < NUMBER_OF_TOKENS) {
+    *atom = A.keywords[tok->t.type];
+    return 1;
+  }
+  return 0;
+}
+
+static int is_name(const vcc_pp_token_t *tok, vcc_atom_t atom) {
+  vcc_atom_t name;
+  return name_of(tok, &name) && name == atom;
+}
+
+static vcc_pp_macro_t *macro_of(vcc_pp_t *pp, const vcc_pp_token_t *tok) {
+  vcc_atom_t name;
+  if (!name_of(tok, &name)) {
+    return NULL;
+  }
+  vcc_pp_macro_t *m = map_get(&pp->macros, name);
+  return m && m->defined ? m : NULL;
+}
+
+/* appends how `tok` is written, numbers that are not read from a source
+ * text get a spelling of the same value
+ */
+static void spell(vcc_pp_t *pp, text_t *t, const vcc_pp_token_t *tok) {
+  const vtoken_t *v = &tok->t;
+  int len;
+  const char *s;
+  char number[64];
+  switch (v->type) {
+  case TOKEN_IDENTIFIER:
+    s = vcc_symtbl_name(pp->symtbl, v->value.atom, &len);
+    text_put(t, s, len);
+    break;
+  case TOKEN_STR:
+  case TOKEN_CHAR:
+    s = vcc_symtbl_name(pp->symtbl, v->value.atom, &len);
+    text_putc(t, v->type == TOKEN_STR ? '"' : '\'');
+    text_put(t, s, len);
+    text_putc(t, v->type == TOKEN_STR ? '"' : '\'');
+    break;
+  case TOKEN_INT:
+  case TOKEN_FLOAT:
+    if (tok->file && tok->file->src) {
+      text_put(t, tok->file->src + v->offset, v->len);
+      break;
+    }
+    if (v->type == TOKEN_INT) {
+      len = snprintf(number, sizeof(number), "%llu%s%s",
+                     (unsigned long long)v->value.i,
+                     v->flags & VCC_LIT_UNSIGNED ? "u" : "",
+                     v->flags & VCC_LIT_LONG_LONG ? "ll"
+                     : v->flags & VCC_LIT_LONG    ? "l"
+                                                  : "");
+    } else {
+      len = snprintf(number, sizeof(number), "%.17g", v->value.f);
+      if (!strpbrk(number, ".en")) {
+        number[len++] = '.';
+      }
+      if (v->flags & (VCC_LIT_FLOAT | VCC_LIT_LONG)) {
+        number[len++] = v->flags & VCC_LIT_FLOAT ? 'f' : 'l';
+      }
+    }
+    text_put(t, number, len);
+    break;
+  case TOKEN_EOF:
+  case TOKEN_NEWLINE:
+    break;
+  default:
+    text_put(t, token_spellings[v->type], strlen(token_spellings[v->type]));
+    break;
+  }
+}
+
+/* where a token starts and ends in its source, strings and chars include
+ * their quotes
+ */
+static uint32_t span_start(const vcc_pp_token_t *tok) {
+  int quoted = tok->t.type == TOKEN_STR || tok->t.type == TOKEN_CHAR;
+  return tok->t.offset - quoted;
+}
+
+static uint32_t span_end(const vcc_pp_token_t *tok) {
+  int quoted = tok->t.type == TOKEN_STR || tok->t.type == TOKEN_CHAR;
+  return tok->t.offset + tok->t.len + quoted;
+}
+
+/* tells if there was white space between two tokens in their source
+ */
+static int spaced(const vcc_pp_token_t *a, const vcc_pp_token_t *b) {
+  return !a->file || a->file != b->file || span_end(a) != span_start(b);
+}
+
+/* finds the file and position of `tok`, made-up tokens are blamed on the
+ * last token read from a file
+ */
+static vcc_pp_file_t *locate(vcc_pp_t *pp, const vcc_pp_token_t *tok,
+                             int *line, int *col) {
+  vcc_pp_file_t *f = tok ? tok->file : NULL;
+  uint32_t offset = tok ? tok->t.offset : 0;
+  for (int i = pp->nctx - 1; !f && i >= 0; --i) {
+    if (pp->ctx[i].file) {
+      f = pp->ctx[i].file;
+      int pos = pp->ctx[i].pos - 1;
+      offset = pos >= 0 && pos < f->tokens->count ? f->tokens->offsets[pos] : 0;
+    }
+  }
+  *line = *col = 1;
+  if (f == &pp->main) {
+    vcc_lexer_locate(pp->lexer, offset, line, col);
+  } else if (f && f->src) {
+    for (uint32_t i = 0; i < offset && i < f->len; ++i) {
+      if (f->src[i] == '\n') {
+        ++*line;
+        *col = 1;
+      } else {
+        ++*col;
+      }
+    }
+  }
+  return f;
+}
+
+/* reports an error at `tok`, and stops the preprocessor
+ */
+#define pp_errorf(pp, tok, fmt, ...)                                           \
+  do {                                                                         \
+    int _line, _col;                                                           \
+    vcc_pp_file_t *_f = locate((pp), (tok), &_line, &_col);                    \
+    fprintf(stderr, "[error while " PHASE "]@%s:%d:%d " fmt,                   \
+            _f ? _f->path : "<none>", _line, _col, __VA_ARGS__);               \
+    (pp)->error = 1;                                                           \
+  } while (0)
+
+#define pp_errors(pp, tok, str) pp_errorf(pp, tok, "%s\n", str)
+
+/* =================== INCLUDE CACHE ==================== */
+
+/* finds the include guard of a file: it starts with `#ifndef X` or
+ * `#if !defined(X)`, and the #endif matching it is the last thing in the
+ * file with no #else or #elif hanging off the same #if
+ */
+static void detect_guard(vcc_pp_file_t *f) {
+  const uint8_t *type = f->tokens->types;
+  const uint32_t *atom = f->tokens->payloads;
+  int n = f->tokens->count;
+  int i;
+  vcc_atom_t guard;
+  if (n < 5 || type[0] != TOKEN_HASH) {
+    return;
+  }
+  if (type[1] == TOKEN_IDENTIFIER && atom[1] == A.ifndef &&
+      type[2] == TOKEN_IDENTIFIER && type[3] == TOKEN_NEWLINE) {
+    guard = atom[2];
+    i = 4;
+  } else if (type[1] == TOKEN_KWORD_IF && type[2] == TOKEN_NOT &&
+             type[3] == TOKEN_IDENTIFIER && atom[3] == A.defined) {
+    i = 4;
+    int paren = type[i] == TOKEN_LPAREN;
+    i += paren;
+    if (i + 2 >= n || type[i] != TOKEN_IDENTIFIER) {
+      return;
+    }
+    guard = atom[i++];
+    if (paren && type[i++] != TOKEN_RPAREN) {
+      return;
+    }
+    if (type[i++] != TOKEN_NEWLINE) {
+      return;
+    }
+  } else {
+    return;
+  }
+  int depth = 1, in_directive = 0;
+  for (; i + 1 < n; ++i) {
+    if (type[i] == TOKEN_NEWLINE) {
+      in_directive = 0;
+    }
+    if (type[i] != TOKEN_HASH || in_directive) {
+      continue;
+    }
+    in_directive = 1;
+    int kind = type[i + 1];
+    vcc_atom_t name = atom[i + 1];
+    if (kind == TOKEN_KWORD_IF ||
+        (kind == TOKEN_IDENTIFIER && (name == A.ifdef || name == A.ifndef))) {
+      ++depth;
+    } else if (kind == TOKEN_IDENTIFIER && name == A.endif && !--depth) {
+      while (type[i] != TOKEN_NEWLINE) {
+        ++i;
+      }
+      if (i + 1 < n && type[i + 1] == TOKEN_EOF) {
+        f->has_guard = 1;
+        f->guard = guard;
+      }
+      return;
+    } else if (depth == 1 && (kind == TOKEN_KWORD_ELSE ||
+                              (kind == TOKEN_IDENTIFIER && name == A.elif))) {
+      return;
+    }
+  }
+}
+
+/* gets the file at the resolved `path` from the cache, lexing it on first
+ * sight, `fresh` tells which of both happened
+ */
+static vcc_pp_file_t *load(vcc_pp_t *pp, const char *path, int *fresh) {
+  vcc_atom_t atom = vcc_symtbl_intern(pp->symtbl, path, strlen(path));
+  pthread_mutex_lock(&cache.lock);
+  vcc_pp_file_t *f = map_get(&cache.files, atom);
+  pthread_mutex_unlock(&cache.lock);
+  *fresh = 0;
+  if (f) {
+    return f;
+  }
+
+  // lex it without the lock, another thread may be doing the same
+  size_t len;
+  char *src = file_map(path, &len);
+  if (!src) {
+    return NULL;
+  }
+  vcc_lexer_t *lexer = vcc_lexer_new_from_mem(path, src, len);
+  vcc_lexer_set_symtbl(lexer, pp->symtbl);
+  vcc_lexer_keep_directives(lexer);
+  vcc_tokbuf_t *tokens = vcc_lex_all(lexer);
+  vcc_lexer_free(lexer);
+  if (tokens->error) {
+    vcc_tokbuf_free(tokens);
+    file_unmap(src, len);
+    return NULL;
+  }
+  f = xalloc(sizeof(vcc_pp_file_t));
+  f->path = xalloc(strlen(path) + 1);
+  strcpy(f->path, path);
+  f->atom = atom;
+  f->src = src;
+  f->len = len;
+  f->tokens = tokens;
+  detect_guard(f);
+
+  pthread_mutex_lock(&cache.lock);
+  vcc_pp_file_t *other = map_get(&cache.files, atom);
+  if (!other) {
+    map_put(&cache.files, atom, f);
+    ++cache.stats.lexed;
+    *fresh = 1;
+  }
+  pthread_mutex_unlock(&cache.lock);
+  if (other) { // lost the race, keep the first one
+    vcc_tokbuf_free(f->tokens);
+    file_unmap((void *)f->src, f->len);
+    xfree(f->path);
+    xfree(f);
+    return other;
+  }
+  return f;
+}
+
+/* returns the counters of the include cache so far
+ */
+vcc_pp_stats_t vcc_pp_stats() {
+  pthread_mutex_lock(&cache.lock);
+  vcc_pp_stats_t stats = cache.stats;
+  pthread_mutex_unlock(&cache.lock);
+  return stats;
+}
+
+static void count_include(long *counter) {
+  pthread_mutex_lock(&cache.lock);
+  ++*counter;
+  pthread_mutex_unlock(&cache.lock);
+}
+
+/* finds the file `name` is about: next to the including file first if it
+ * was written in quotes, then in the include directories
+ */
+static int resolve(vcc_pp_t *pp, const char *name, int quoted,
+                   vcc_pp_file_t *from, char *resolved) {
+  char path[PATH_MAX];
+  if (name[0] == '/') {
+    return realpath(name, resolved) != NULL;
+  }
+  if (quoted) {
+    const char *slash = from ? strrchr(from->path, '/') : NULL;
+    if (slash) {
+      snprintf(path, sizeof(path), "%.*s/%s", (int)(slash - from->path),
+               from->path, name);
+    } else {
+      snprintf(path, sizeof(path), "%s", name);
+    }
+    if (realpath(path, resolved)) {
+      return 1;
+    }
+  }
+  for (int i = 0; i < pp->ndirs; ++i) {
+    snprintf(path, sizeof(path), "%s/%s", pp->dirs[i], name);
+    if (realpath(path, resolved)) {
+      return 1;
+    }
+  }
+  return 0;
+}
+
+/* ==================== CONTEXTS ==================== */
+
+static vcc_pp_ctx_t *push_ctx(vcc_pp_t *pp) {
+  if (pp->nctx == pp->ctx_cap) {
+    pp->ctx_cap = pp->ctx_cap ? 2 * pp->ctx_cap : 16;
+    vcc_pp_ctx_t *grown = xalloc(pp->ctx_cap * sizeof(vcc_pp_ctx_t));
+    if (pp->nctx) {
+      memcpy(grown, pp->ctx, pp->nctx * sizeof(vcc_pp_ctx_t));
+    }
+    xfree(pp->ctx);
+    pp->ctx = grown;
+  }
+  vcc_pp_ctx_t *ctx = &pp->ctx[pp->nctx++];
+  *ctx = (vcc_pp_ctx_t){.nconds = pp->nconds};
+  return ctx;
+}
+
+static void push_file(vcc_pp_t *pp, vcc_pp_file_t *f) {
+  push_ctx(pp)->file = f;
+}
+
+/* reads `count` tokens at `list` next, they must live until they are read,
+ * `macro` is disabled until then
+ */
+static void push_list(vcc_pp_t *pp, const vcc_pp_token_t *list, int count,
+                      vcc_pp_macro_t *macro) {
+  vcc_pp_ctx_t *ctx = push_ctx(pp);
+  ctx->list = list;
+  ctx->count = count;
+  ctx->macro = macro;
+  if (macro) {
+    macro->disabled = 1;
+  }
+}
+
+/* like push_list(), and the context frees the tokens in `owned`
+ */
+static void push_owned(vcc_pp_t *pp, vcc_pp_vec_t *owned,
+                       vcc_pp_macro_t *macro) {
+  push_list(pp, owned->v, owned->count, macro);
+  pp->ctx[pp->nctx - 1].owned = *owned;
+}
+
+static void pop_ctx(vcc_pp_t *pp) {
+  vcc_pp_ctx_t *ctx = &pp->ctx[--pp->nctx];
+  if (ctx->macro) {
+    ctx->macro->disabled = 0;
+  }
+  xfree(ctx->owned.v);
+}
+
+/* takes the next token of the innermost context, the contexts that run out
+ * on the way are left, except the barrier, which gives EOF forever,
+ * returns 1 for a token read from a file
+ */
+static int next_raw(vcc_pp_t *pp, vcc_pp_token_t *tok) {
+  if (pp->has_ahead) {
+    pp->has_ahead = 0;
+    *tok = pp->ahead;
+    return pp->ahead_file;
+  }
+  while (1) {
+    vcc_pp_ctx_t *ctx = &pp->ctx[pp->nctx - 1];
+    if (ctx->file) {
+      vcc_tokbuf_t *tokens = ctx->file->tokens;
+      if (ctx->pos < tokens->count &&
+          tokens->types[ctx->pos] != TOKEN_EOF) {
+        vcc_tokbuf_get(tokens, ctx->pos++, &tok->t);
+        tok->file = ctx->file;
+        tok->noexpand = 0;
+        return 1;
+      }
+      if (pp->nctx - 1 > pp->barrier && pp->nconds > ctx->nconds) {
+        pp_errors(pp, NULL, "unterminated conditional directive");
+        pp->nconds = ctx->nconds;
+      }
+    } else if (ctx->pos < ctx->count) {
+      *tok = ctx->list[ctx->pos++];
+      return 0;
+    }
+    if (pp->nctx - 1 <= pp->barrier) {
+      *tok = (vcc_pp_token_t){.t = {.type = TOKEN_EOF}, .file = ctx->file};
+      if (ctx->file) {
+        tok->t.offset = ctx->file->len;
+      }
+      return 0;
+    }
+    pop_ctx(pp);
+  }
+}
+
+/* gives back the token next_raw() just read
+ */
+static void unread(vcc_pp_t *pp, const vcc_pp_token_t *tok, int from_file) {
+  pp->ahead = *tok;
+  pp->ahead_file = from_file;
+  pp->has_ahead = 1;
+}
+
+/* ==================== EXPANSION ==================== */
+
+static void expand(vcc_pp_t *pp, vcc_pp_vec_t *out);
+
+/* fully expands `count` tokens on their own, as if nothing came after
+ * them, into `out`
+ */
+static void expand_list(vcc_pp_t *pp, const vcc_pp_token_t *list, int count,
+                        vcc_pp_vec_t *out) {
+  int barrier = pp->barrier;
+  push_list(pp, list, count, NULL);
+  pp->barrier = pp->nctx - 1;
+  expand(pp, out);
+  while (pp->nctx > pp->barrier) {
+    pop_ctx(pp);
+  }
+  pp->barrier = barrier;
+}
+
+static int param_of(vcc_pp_macro_t *m, const vcc_pp_token_t *tok) {
+  vcc_atom_t name;
+  if (!m->function || !name_of(tok, &name)) {
+    return -1;
+  }
+  for (int i = 0; i < m->nparams; ++i) {
+    if (m->params[i] == name) {
+      return i;
+    }
+  }
+  return -1;
+}
+
+/* turns an argument into a string literal, as # does
+ */
+static vcc_pp_token_t stringify(vcc_pp_t *pp, const vcc_pp_vec_t *arg,
+                                const vcc_pp_token_t *at) {
+  text_t t = {0};
+  text_t quoted = {0};
+  for (int i = 0; i < arg->count; ++i) {
+    const vcc_pp_token_t *tok = &arg->v[i];
+    if (i && spaced(&arg->v[i - 1], tok)) {
+      text_putc(&t, ' ');
+    }
+    if (tok->t.type != TOKEN_STR && tok->t.type != TOKEN_CHAR) {
+      spell(pp, &t, tok);
+      continue;
+    }
+    quoted.len = 0;
+    spell(pp, &quoted, tok);
+    for (int j = 0; j < quoted.len; ++j) {
+      if (quoted.s[j] == '"' || quoted.s[j] == '\\') {
+        text_putc(&t, '\\');
+      }
+      text_putc(&t, quoted.s[j]);
+    }
+  }
+  vcc_pp_token_t s = *at;
+  s.t.type = TOKEN_STR;
+  s.t.len = t.len;
+  s.t.value.atom = vcc_symtbl_intern(pp->symtbl, t.s ? t.s : "", t.len);
+  s.file = NULL;
+  s.noexpand = 0;
+  xfree(t.s);
+  xfree(quoted.s);
+  return s;
+}
+
+/* glues `rhs` to the end of `lhs`, as ## does, the spelling of both must
+ * lex as exactly one token
+ */
+static void paste(vcc_pp_t *pp, vcc_pp_token_t *lhs,
+                  const vcc_pp_token_t *rhs) {
+  text_t t = {0};
+  spell(pp, &t, lhs);
+  spell(pp, &t, rhs);
+  vcc_lexer_t *lexer = vcc_lexer_new_from_mem("<paste>", t.s, t.len);
+  vcc_lexer_set_symtbl(lexer, pp->symtbl);
+  vtoken_t *a = vcc_lex(lexer);
+  vtoken_t *b = a && a->type != TOKEN_EOF ? vcc_lex(lexer) : NULL;
+  if (b && b->type == TOKEN_EOF) {
+    uint32_t offset = lhs->t.offset;
+    lhs->t = *a;
+    lhs->t.offset = offset;
+    lhs->file = NULL;
+    lhs->noexpand = 0;
+  } else {
+    pp_errorf(pp, lhs, "pasting gives `%s`, which is not one token\n", t.s);
+  }
+  vtoken_free(lexer, a);
+  vtoken_free(lexer, b);
+  vcc_lexer_free(lexer);
+  xfree(t.s);
+}
+
+/* replaces the parameters in the body of `m`, the arguments are expanded
+ * first unless # or ## take them as they are
+ */
+static void substitute(vcc_pp_t *pp, vcc_pp_macro_t *m, vcc_pp_vec_t *args,
+                       vcc_pp_vec_t *out) {
+  const vcc_pp_token_t *body = m->body.v;
+  int n = m->body.count;
+  vcc_pp_vec_t *expanded = NULL;
+  char *ready = NULL;
+  if (m->nparams) {
+    expanded = xalloc(m->nparams * sizeof(vcc_pp_vec_t));
+    ready = xalloc(m->nparams);
+  }
+  int last_empty = 0; // the last operand was an empty argument
+  for (int i = 0; i < n && !pp->error; ++i) {
+    const vcc_pp_token_t *tok = &body[i];
+    int p;
+    if (tok->t.type == TOKEN_HASH && i + 1 < n &&
+        (p = param_of(m, &body[i + 1])) >= 0) {
+      vcc_pp_token_t s = stringify(pp, &args[p], tok);
+      vec_push(out, &s);
+      last_empty = 0;
+      ++i;
+      continue;
+    }
+    if (tok->t.type == TOKEN_HASH_HASH && i + 1 < n) {
+      const vcc_pp_token_t *rhs = &body[++i];
+      const vcc_pp_token_t *ops = rhs;
+      int nops = 1;
+      if ((p = param_of(m, rhs)) >= 0) {
+        ops = args[p].v;
+        nops = args[p].count;
+      }
+      // `, ## __VA_ARGS__` keeps the comma only if there are extra arguments
+      int comma = m->variadic && p == m->nparams - 1 && !last_empty &&
+                  out->count && out->v[out->count - 1].t.type == TOKEN_COMMA;
+      if (!nops) {
+        out->count -= comma;
+        continue;
+      }
+      if (!last_empty && !comma && out->count) {
+        paste(pp, &out->v[out->count - 1], &ops[0]);
+        ++ops;
+        --nops;
+      }
+      vec_append(out, ops, nops);
+      last_empty = 0;
+      continue;
+    }
+    if ((p = param_of(m, tok)) >= 0) {
+      const vcc_pp_vec_t *arg = &args[p];
+      if (i + 1 >= n || body[i + 1].t.type != TOKEN_HASH_HASH) {
+        if (!ready[p]) {
+          expand_list(pp, args[p].v, args[p].count, &expanded[p]);
+          ready[p] = 1;
+        }
+        arg = &expanded[p];
+      }
+      vec_append(out, arg->v, arg->count);
+      last_empty = !args[p].count;
+      continue;
+    }
+    vec_push(out, tok);
+    last_empty = 0;
+  }
+  for (int i = 0; i < m->nparams; ++i) {
+    xfree(expanded[i].v);
+  }
+  xfree(expanded);
+  xfree(ready);
+}
+
+/* reads the arguments of a call of `m` up to its closing parenthesis,
+ * returns the number of arguments, -1 on error
+ */
+static int collect_args(vcc_pp_t *pp, vcc_pp_macro_t *m, vcc_pp_vec_t **args) {
+  int nargs = 1, cap = m->nparams > 1 ? m->nparams : 1;
+  int depth = 0;
+  *args = xalloc(cap * sizeof(vcc_pp_vec_t));
+  while (1) {
+    vcc_pp_token_t tok;
+    int from_file = next_raw(pp, &tok);
+    int type = tok.t.type;
+    if (type == TOKEN_EOF) {
+      pp_errors(pp, &tok, "unterminated call of a macro");
+      return nargs;
+    }
+    if (from_file && type == TOKEN_HASH) {
+      pp_errors(pp, &tok, "directive inside the arguments of a macro");
+      return nargs;
+    }
+    if (type == TOKEN_LPAREN) {
+      ++depth;
+    } else if (type == TOKEN_RPAREN && !depth--) {
+      break;
+    } else if (type == TOKEN_COMMA && !depth &&
+               !(m->variadic && nargs == m->nparams)) {
+      if (nargs == cap) {
+        vcc_pp_vec_t *grown = xalloc(2 * cap * sizeof(vcc_pp_vec_t));
+        memcpy(grown, *args, cap * sizeof(vcc_pp_vec_t));
+        xfree(*args);
+        *args = grown;
+        cap *= 2;
+      }
+      ++nargs;
+      continue;
+    }
+    vec_push(&(*args)[nargs - 1], &tok);
+  }
+  return nargs;
+}
+
+static void free_args(vcc_pp_vec_t *args, int nargs) {
+  for (int i = 0; i < nargs; ++i) {
+    xfree(args[i].v);
+  }
+  xfree(args);
+}
+
+/* starts the expansion of `m`, whose name `name` was just read, returns 0
+ * if it is a function-like macro that is not called
+ */
+static int expand_macro(vcc_pp_t *pp, vcc_pp_macro_t *m,
+                        const vcc_pp_token_t *name) {
+  vcc_pp_vec_t body = {0};
+  if (!m->function) {
+    if (!m->paste) { // read right out of the definition
+      push_list(pp, m->body.v, m->body.count, m);
+      return 1;
+    }
+    substitute(pp, m, NULL, &body);
+    push_owned(pp, &body, m);
+    return 1;
+  }
+
+  vcc_pp_token_t next;
+  int from_file = next_raw(pp, &next);
+  if (next.t.type != TOKEN_LPAREN) {
+    unread(pp, &next, from_file);
+    return 0;
+  }
+  vcc_pp_vec_t *args;
+  int nargs = collect_args(pp, m, &args);
+  if (pp->error) {
+    free_args(args, nargs);
+    return 1;
+  }
+  if (nargs == 1 && !args[0].count && m->nparams == 0) {
+    nargs = 0; // f() of a macro without parameters
+  } else if (nargs == m->nparams - 1 && m->variadic) {
+    ++nargs; // nothing for the variadic part, it is empty
+  }
+  if (nargs != m->nparams) {
+    pp_errorf(pp, name, "macro takes %d arguments, %d given\n", m->nparams,
+              nargs);
+    free_args(args, nargs > m->nparams ? nargs : m->nparams);
+    return 1;
+  }
+  substitute(pp, m, args, &body);
+  free_args(args, nargs ? nargs : 1);
+  push_owned(pp, &body, m);
+  return 1;
+}
+
+static int skipping(vcc_pp_t *pp) {
+  return pp->nconds && !pp->conds[pp->nconds - 1].active;
+}
+
+static void directive(vcc_pp_t *pp);
+
+/* expands tokens until the barrier runs out, into `out`, or into the
+ * output buffer if it is NULL, directives are run as they come
+ */
+static void expand(vcc_pp_t *pp, vcc_pp_vec_t *out) {
+  vcc_pp_token_t tok;
+  while (!pp->error) {
+    int from_file = next_raw(pp, &tok);
+    if (tok.t.type == TOKEN_EOF) {
+      break;
+    }
+    if (from_file && tok.t.type == TOKEN_HASH) {
+      directive(pp);
+      continue;
+    }
+    if (from_file && skipping(pp)) {
+      continue;
+    }
+    vcc_pp_macro_t *m = tok.noexpand ? NULL : macro_of(pp, &tok);
+    if (m && m->disabled) {
+      tok.noexpand = 1; // never again, even once m is enabled
+    } else if (m && expand_macro(pp, m, &tok)) {
+      continue;
+    }
+    if (out) {
+      vec_push(out, &tok);
+    } else {
+      vcc_tokbuf_push(pp->out, &tok.t);
+    }
+  }
+}
+
+/* ================ #if EXPRESSIONS ================= */
+
+typedef struct {
+  vcc_pp_t *pp;
+  const vcc_pp_token_t *v;
+  int n;
+  int pos;
+  int dead; // inside an operand that is not evaluated
+} cond_expr_t;
+
+static const int binary_precedence[NUMBER_OF_TOKENS] = {
+    [TOKEN_ASTERISK] = 10, [TOKEN_DIV] = 10,    [TOKEN_MOD] = 10,
+    [TOKEN_ADD] = 9,       [TOKEN_SUB] = 9,     [TOKEN_LSHIFT] = 8,
+    [TOKEN_RSHIFT] = 8,    [TOKEN_LT] = 7,      [TOKEN_GT] = 7,
+    [TOKEN_LTEQ] = 7,      [TOKEN_GTEQ] = 7,    [TOKEN_EQ] = 6,
+    [TOKEN_NOT_EQ] = 6,    [TOKEN_AND] = 5,     [TOKEN_XOR] = 4,
+    [TOKEN_OR] = 3,        [TOKEN_AND_AND] = 2, [TOKEN_OR_OR] = 1,
+};
+
+static int cond_peek(cond_expr_t *e) {
+  return e->pos < e->n ? e->v[e->pos].t.type : TOKEN_EOF;
+}
+
+static const vcc_pp_token_t *cond_at(cond_expr_t *e) {
+  return e->pos < e->n ? &e->v[e->pos] : e->n ? &e->v[e->n - 1] : NULL;
+}
+
+static int64_t char_value(const char *s) {
+  if (s[0] != '\\') {
+    return (unsigned char)s[0];
+  }
+  switch (s[1]) {
+  case 'n':
+    return '\n';
+  case 't':
+    return '\t';
+  case 'r':
+    return '\r';
+  case '0':
+    return '\0';
+  case 'a':
+    return '\a';
+  case 'b':
+    return '\b';
+  case 'f':
+    return '\f';
+  case 'v':
+    return '\v';
+  default:
+    return (unsigned char)s[1];
+  }
+}
+
+static int64_t cond_ternary(cond_expr_t *e);
+
+static int64_t cond_unary(cond_expr_t *e) {
+  if (e->pp->error) {
+    return 0;
+  }
+  const vcc_pp_token_t *tok = cond_at(e);
+  int type = cond_peek(e);
+  ++e->pos;
+  switch (type) {
+  case TOKEN_INT:
+    return tok->t.value.i;
+  case TOKEN_CHAR:
+    return char_value(vcc_symtbl_name(e->pp->symtbl, tok->t.value.atom, NULL));
+  case TOKEN_ADD:
+    return cond_unary(e);
+  case TOKEN_SUB:
+    return -(uint64_t)cond_unary(e);
+  case TOKEN_NOT:
+    return !cond_unary(e);
+  case TOKEN_TILDE:
+    return ~cond_unary(e);
+  case TOKEN_LPAREN: {
+    int64_t value = cond_ternary(e);
+    if (cond_peek(e) != TOKEN_RPAREN) {
+      pp_errors(e->pp, cond_at(e), "missing `)` in #if");
+    }
+    ++e->pos;
+    return value;
+  }
+  default:
+    if (type == TOKEN_IDENTIFIER || type >= TOKEN_KWORD_AUTO) {
+      return 0; // names that are no macros
+    }
+    pp_errors(e->pp, tok, "bad expression in #if");
+    return 0;
+  }
+}
+
+static int64_t cond_binary(cond_expr_t *e, int min_precedence) {
+  int64_t lhs = cond_unary(e);
+  while (!e->pp->error) {
+    int type = cond_peek(e);
+    int precedence = binary_precedence[type];
+    if (!precedence || precedence < min_precedence) {
+      break;
+    }
+    const vcc_pp_token_t *op = cond_at(e);
+    ++e->pos;
+    int dead = (type == TOKEN_AND_AND && !lhs) || (type == TOKEN_OR_OR && lhs);
+    e->dead += dead;
+    int64_t rhs = cond_binary(e, precedence + 1);
+    e->dead -= dead;
+    uint64_t l = lhs, r = rhs;
+    switch (type) {
+    case TOKEN_ASTERISK:
+      lhs = l * r;
+      break;
+    case TOKEN_DIV:
+    case TOKEN_MOD:
+      if (!rhs || (lhs == INT64_MIN && rhs == -1)) {
+        if (!e->dead) {
+          pp_errors(e->pp, op, "division by zero in #if");
+        }
+        lhs = 0;
+      } else {
+        lhs = type == TOKEN_DIV ? lhs / rhs : lhs % rhs;
+      }
+      break;
+    case TOKEN_ADD:
+      lhs = l + r;
+      break;
+    case TOKEN_SUB:
+      lhs = l - r;
+      break;
+    case TOKEN_LSHIFT:
+      lhs = r < 64 ? l << r : 0;
+      break;
+    case TOKEN_RSHIFT:
+      lhs = r < 64 ? lhs >> r : lhs < 0 ? -1 : 0;
+      break;
+    case TOKEN_LT:
+      lhs = lhs < rhs;
+      break;
+    case TOKEN_GT:
+      lhs = lhs > rhs;
+      break;
+    case TOKEN_LTEQ:
+      lhs = lhs <= rhs;
+      break;
+    case TOKEN_GTEQ:
+      lhs = lhs >= rhs;
+      break;
+    case TOKEN_EQ:
+      lhs = lhs == rhs;
+      break;
+    case TOKEN_NOT_EQ:
+      lhs = lhs != rhs;
+      break;
+    case TOKEN_AND:
+      lhs = l & r;
+      break;
+    case TOKEN_XOR:
+      lhs = l ^ r;
+      break;
+    case TOKEN_OR:
+      lhs = l | r;
+      break;
+    case TOKEN_AND_AND:
+      lhs = lhs && rhs;
+      break;
+    case TOKEN_OR_OR:
+      lhs = lhs || rhs;
+      break;
+    }
+  }
+  return lhs;
+}
+
+static int64_t cond_ternary(cond_expr_t *e) {
+  int64_t value = cond_binary(e, 1);
+  if (cond_peek(e) != TOKEN_QUESTION) {
+    return value;
+  }
+  ++e->pos;
+  e->dead += !value;
+  int64_t then = cond_ternary(e);
+  e->dead -= !value;
+  if (cond_peek(e) != TOKEN_COLON) {
+    pp_errors(e->pp, cond_at(e), "missing `:` in #if");
+    return 0;
+  }
+  ++e->pos;
+  e->dead += !!value;
+  int64_t otherwise = cond_ternary(e);
+  e->dead -= !!value;
+  return value ? then : otherwise;
+}
+
+/* evaluates the tokens of an #if or #elif: `defined` goes first, then
+ * macros are expanded, and any name left is 0
+ */
+static int64_t eval_cond(vcc_pp_t *pp, const vcc_pp_token_t *v, int n) {
+  vcc_pp_vec_t line = {0}, expanded = {0};
+  for (int i = 0; i < n; ++i) {
+    if (!is_name(&v[i], A.defined)) {
+      vec_push(&line, &v[i]);
+      continue;
+    }
+    int paren = i + 1 < n && v[i + 1].t.type == TOKEN_LPAREN;
+    int at = i + 1 + paren;
+    vcc_atom_t name;
+    if (at >= n || !name_of(&v[at], &name) ||
+        (paren && (at + 1 >= n || v[at + 1].t.type != TOKEN_RPAREN))) {
+      pp_errors(pp, &v[i], "`defined` needs a macro name");
+      break;
+    }
+    vcc_pp_token_t one = v[i];
+    one.t = (vtoken_t){.type = TOKEN_INT,
+                       .value.i = macro_of(pp, &v[at]) != NULL,
+                       .offset = v[i].t.offset,
+                       .len = v[i].t.len};
+    one.file = NULL;
+    vec_push(&line, &one);
+    i = at + paren;
+  }
+  int64_t value = 0;
+  if (!pp->error) {
+    expand_list(pp, line.v, line.count, &expanded);
+  }
+  if (!pp->error) {
+    cond_expr_t e = {.pp = pp, .v = expanded.v, .n = expanded.count};
+    if (!e.n) {
+      pp_errors(pp, n ? &v[0] : NULL, "#if without an expression");
+    }
+    value = cond_ternary(&e);
+    if (!pp->error && e.pos < e.n) {
+      pp_errors(pp, &e.v[e.pos], "garbage at the end of #if");
+    }
+  }
+  xfree(line.v);
+  xfree(expanded.v);
+  return value;
+}
+
+/* ================== DIRECTIVES ==================== */
+
+static void free_macro(vcc_pp_macro_t *m) {
+  xfree(m->params);
+  xfree(m->body.v);
+  m->params = NULL;
+  m->body = (vcc_pp_vec_t){0};
+}
+
+/* #define, `v` are the tokens after its name
+ */
+static void do_define(vcc_pp_t *pp, const vcc_pp_token_t *v, int n) {
+  vcc_atom_t name;
+  if (!n || !name_of(&v[0], &name)) {
+    pp_errors(pp, n ? &v[0] : NULL, "#define needs a macro name");
+    return;
+  }
+  vcc_pp_macro_t m = {.defined = 1};
+  int i = 1;
+  if (n > 1 && v[1].t.type == TOKEN_LPAREN && v[1].file == v[0].file &&
+      v[1].t.offset == v[0].t.offset + v[0].t.len) { // no space before (
+    m.function = 1;
+    m.params = xalloc(n * sizeof(vcc_atom_t));
+    int ok = 0;
+    for (i = 2; i < n; ++i) {
+      vcc_atom_t param;
+      if (v[i].t.type == TOKEN_RPAREN && !m.nparams) {
+        ok = 1;
+        break;
+      }
+      if (v[i].t.type == TOKEN_ELLIPSIS) {
+        m.params[m.nparams++] = A.va_args;
+        m.variadic = 1;
+      } else if (name_of(&v[i], &param)) {
+        m.params[m.nparams++] = param;
+        if (i + 1 < n && v[i + 1].t.type == TOKEN_ELLIPSIS) {
+          m.variadic = 1; // args...
+          ++i;
+        }
+      } else {
+        break;
+      }
+      if (++i >= n) {
+        break;
+      }
+      if (v[i].t.type == TOKEN_RPAREN) {
+        ok = 1;
+        break;
+      }
+      if (v[i].t.type != TOKEN_COMMA || m.variadic) {
+        break;
+      }
+    }
+    if (!ok) {
+      pp_errors(pp, i < n ? &v[i] : &v[0], "bad macro parameter list");
+      free_macro(&m);
+      return;
+    }
+    ++i;
+  }
+  for (int j = i; j < n; ++j) {
+    int type = v[j].t.type;
+    if (type == TOKEN_HASH_HASH && (j == i || j == n - 1)) {
+      pp_errors(pp, &v[j], "`##` cannot be at either end of a macro");
+      free_macro(&m);
+      return;
+    }
+    if (type == TOKEN_HASH && m.function &&
+        (j + 1 == n || param_of(&m, &v[j + 1]) < 0)) {
+      pp_errors(pp, &v[j], "`#` is not followed by a macro parameter");
+      free_macro(&m);
+      return;
+    }
+    m.paste |= type == TOKEN_HASH_HASH || (type == TOKEN_HASH && m.function);
+  }
+  vec_append(&m.body, v + i, n - i);
+
+  vcc_pp_macro_t *old = map_get(&pp->macros, name);
+  if (!old) {
+    old = xalloc(sizeof(vcc_pp_macro_t));
+    map_put(&pp->macros, name, old);
+  }
+  free_macro(old);
+  *old = m;
+}
+
+static void do_include(vcc_pp_t *pp, const vcc_pp_token_t *v, int n,
+                       const vcc_pp_token_t *at) {
+  vcc_pp_vec_t expanded = {0};
+  if (n && v[0].t.type == TOKEN_IDENTIFIER) { // #include MACRO
+    expand_list(pp, v, n, &expanded);
+    v = expanded.v;
+    n = expanded.count;
+  }
+  text_t name = {0};
+  int quoted = 0;
+  if (n == 1 && v[0].t.type == TOKEN_STR) {
+    int len;
+    const char *s = vcc_symtbl_name(pp->symtbl, v[0].t.value.atom, &len);
+    text_put(&name, s, len);
+    quoted = 1;
+  } else if (n >= 2 && v[0].t.type == TOKEN_LT &&
+             v[n - 1].t.type == TOKEN_GT) {
+    if (v[0].file && v[0].file == v[n - 1].file && v[0].file->src) {
+      // as it is written, <sys/types.h> is not made of tokens
+      uint32_t start = v[0].t.offset + 1;
+      text_put(&name, v[0].file->src + start, v[n - 1].t.offset - start);
+    } else {
+      for (int i = 1; i < n - 1; ++i) {
+        spell(pp, &name, &v[i]);
+      }
+    }
+  } else {
+    pp_errors(pp, at, "#include expects \"file\" or <file>");
+  }
+  vcc_pp_file_t *from = pp->ctx[pp->nctx - 1].file;
+  char path[PATH_MAX];
+  vcc_pp_file_t *f = NULL;
+  int fresh = 0;
+  if (!pp->error && name.len) {
+    if (!resolve(pp, name.s, quoted, from, path)) {
+      pp_errorf(pp, at, "cannot find include file `%s`\n", name.s);
+    } else if (!(f = load(pp, path, &fresh))) {
+      pp_errorf(pp, at, "cannot read include file `%s`\n", path);
+    }
+  }
+  xfree(name.s);
+  xfree(expanded.v);
+  if (!f) {
+    return;
+  }
+  vcc_pp_macro_t *guard = f->has_guard ? map_get(&pp->macros, f->guard) : NULL;
+  if (map_get(&pp->once, f->atom) || (guard && guard->defined)) {
+    count_include(&cache.stats.skipped);
+    return;
+  }
+  int depth = 0;
+  for (int i = 0; i < pp->nctx; ++i) {
+    depth += pp->ctx[i].file != NULL;
+  }
+  if (depth > PP_MAX_INCLUDE_DEPTH) {
+    pp_errors(pp, at, "#include nested too deeply");
+    return;
+  }
+  if (!fresh) {
+    count_include(&cache.stats.replayed);
+  }
+  push_file(pp, f);
+}
+
+static vcc_pp_cond_t *push_cond(vcc_pp_t *pp) {
+  if (pp->nconds == pp->conds_cap) {
+    pp->conds_cap = pp->conds_cap ? 2 * pp->conds_cap : 16;
+    vcc_pp_cond_t *grown = xalloc(pp->conds_cap * sizeof(vcc_pp_cond_t));
+    if (pp->nconds) {
+      memcpy(grown, pp->conds, pp->nconds * sizeof(vcc_pp_cond_t));
+    }
+    xfree(pp->conds);
+    pp->conds = grown;
+  }
+  int parent_active = !skipping(pp);
+  vcc_pp_cond_t *cond = &pp->conds[pp->nconds++];
+  *cond = (vcc_pp_cond_t){.parent_active = parent_active};
+  return cond;
+}
+
+enum {
+  D_UNKNOWN,
+  D_IF,
+  D_IFDEF,
+  D_IFNDEF,
+  D_ELIF,
+  D_ELSE,
+  D_ENDIF,
+  D_DEFINE,
+  D_UNDEF,
+  D_INCLUDE,
+  D_ERROR,
+  D_WARNING,
+  D_PRAGMA,
+  D_LINE,
+};
+
+static int directive_kind(const vcc_pp_token_t *tok) {
+  if (tok->t.type == TOKEN_KWORD_IF) {
+    return D_IF;
+  }
+  if (tok->t.type == TOKEN_KWORD_ELSE) {
+    return D_ELSE;
+  }
+  if (tok->t.type != TOKEN_IDENTIFIER) {
+    return D_UNKNOWN;
+  }
+  vcc_atom_t name = tok->t.value.atom;
+  return name == A.ifdef     ? D_IFDEF
+         : name == A.ifndef  ? D_IFNDEF
+         : name == A.elif    ? D_ELIF
+         : name == A.endif   ? D_ENDIF
+         : name == A.define  ? D_DEFINE
+         : name == A.undef   ? D_UNDEF
+         : name == A.include ? D_INCLUDE
+         : name == A.error   ? D_ERROR
+         : name == A.warning ? D_WARNING
+         : name == A.pragma  ? D_PRAGMA
+         : name == A.line    ? D_LINE
+                             : D_UNKNOWN;
+}
+
+/* runs the directive whose # was just read
+ */
+static void directive(vcc_pp_t *pp) {
+  vcc_pp_vec_t *line = &pp->line;
+  vcc_pp_token_t tok;
+  line->count = 0;
+  while (1) {
+    next_raw(pp, &tok);
+    if (tok.t.type == TOKEN_NEWLINE || tok.t.type == TOKEN_EOF) {
+      break;
+    }
+    vec_push(line, &tok);
+  }
+  if (!line->count) { // the null directive
+    return;
+  }
+  const vcc_pp_token_t *v = line->v;
+  int n = line->count;
+  int kind = directive_kind(&v[0]);
+  vcc_pp_ctx_t *ctx = &pp->ctx[pp->nctx - 1];
+  vcc_pp_cond_t *cond = pp->nconds > ctx->nconds ? &pp->conds[pp->nconds - 1]
+                                                  : NULL;
+  vcc_pp_macro_t *m;
+  text_t msg = {0};
+  if (skipping(pp) && kind != D_IF && kind != D_IFDEF && kind != D_IFNDEF &&
+      kind != D_ELIF && kind != D_ELSE && kind != D_ENDIF) {
+    return;
+  }
+  switch (kind) {
+  case D_IF:
+    cond = push_cond(pp);
+    cond->active = cond->parent_active && eval_cond(pp, v + 1, n - 1);
+    cond->taken = cond->active;
+    break;
+  case D_IFDEF:
+  case D_IFNDEF:
+    if (n < 2 || !name_of(&v[1], &(vcc_atom_t){0})) {
+      pp_errors(pp, &v[0], "#ifdef needs a macro name");
+      break;
+    }
+    cond = push_cond(pp);
+    cond->active = cond->parent_active &&
+                   (macro_of(pp, &v[1]) != NULL) == (kind == D_IFDEF);
+    cond->taken = cond->active;
+    break;
+  case D_ELIF:
+  case D_ELSE:
+    if (!cond || cond->seen_else) {
+      pp_errorf(pp, &v[0], "#%s without #if\n",
+                kind == D_ELSE ? "else" : "elif");
+      break;
+    }
+    if (cond->taken || !cond->parent_active) {
+      cond->active = 0;
+    } else {
+      cond->active = kind == D_ELSE || eval_cond(pp, v + 1, n - 1);
+    }
+    cond->taken |= cond->active;
+    cond->seen_else = kind == D_ELSE;
+    break;
+  case D_ENDIF:
+    if (!cond) {
+      pp_errors(pp, &v[0], "#endif without #if");
+      break;
+    }
+    --pp->nconds;
+    break;
+  case D_DEFINE:
+    do_define(pp, v + 1, n - 1);
+    break;
+  case D_UNDEF:
+    if (n < 2 || !macro_of(pp, &v[1])) {
+      break;
+    }
+    m = macro_of(pp, &v[1]);
+    free_macro(m);
+    m->defined = 0;
+    break;
+  case D_INCLUDE:
+    do_include(pp, v + 1, n - 1, &v[0]);
+    break;
+  case D_ERROR:
+  case D_WARNING:
+    for (int i = 1; i < n; ++i) {
+      if (i > 1 && spaced(&v[i - 1], &v[i])) {
+        text_putc(&msg, ' ');
+      }
+      spell(pp, &msg, &v[i]);
+    }
+    if (kind == D_ERROR) {
+      pp_errorf(pp, &v[0], "#error %s\n", msg.s ? msg.s : "");
+    } else {
+      int line, col;
+      vcc_pp_file_t *f = locate(pp, &v[0], &line, &col);
+      fprintf(stderr, "[warning while " PHASE "]@%s:%d:%d #warning %s\n",
+              f->path, line, col, msg.s ? msg.s : "");
+    }
+    xfree(msg.s);
+    break;
+  case D_PRAGMA:
+    if (n == 2 && is_name(&v[1], A.once) && ctx->file) {
+      map_put(&pp->once, ctx->file->atom, ctx->file);
+    }
+    break; // other pragmas mean nothing to us
+  case D_LINE:
+    break;
+  default:
+    if (v[0].t.type == TOKEN_INT) {
+      break; // # 12 "file", as written by other preprocessors
+    }
+    pp_errors(pp, &v[0], "unknown directive");
+    break;
+  }
+}
+
+/* ===================== API ======================== */
+
+vcc_pp_t *vcc_pp_new() {
+  pthread_once(&atoms_once, init_atoms);
+  vcc_pp_t *pp = xalloc(sizeof(vcc_pp_t));
+  pp->symtbl = vcc_symtbl_global();
+  vcc_pp_define(pp, "__STDC__", "1");
+  vcc_pp_define(pp, "__STDC_VERSION__", "201112L");
+  vcc_pp_define(pp, "__STDC_HOSTED__", "1");
+  vcc_pp_define(pp, "__vcc__", "1");
+  return pp;
+}
+
+void vcc_pp_free(vcc_pp_t *pp) {
+  while (pp->nctx) { // left by an error, before their macros go
+    pop_ctx(pp);
+  }
+  for (int i = 0; i < pp->macros.cap; ++i) {
+    if (pp->macros.values[i]) {
+      free_macro(pp->macros.values[i]);
+      xfree(pp->macros.values[i]);
+    }
+  }
+  map_free(&pp->macros);
+  map_free(&pp->once);
+  xfree(pp->ctx);
+  xfree(pp->conds);
+  xfree(pp->line.v);
+  for (int i = 0; i < pp->ndirs; ++i) {
+    xfree(pp->dirs[i]);
+  }
+  for (int i = 0; i < pp->ndefines; ++i) {
+    vcc_tokbuf_free(pp->defines[i]->tokens);
+    xfree((char *)pp->defines[i]->src);
+    xfree(pp->defines[i]);
+  }
+  xfree(pp->defines);
+  vcc_tokbuf_free(pp->main.tokens);
+  xfree(pp);
+}
+
+/* adds a directory to look for <files> and "files" in, in order
+ */
+void vcc_pp_add_include_dir(vcc_pp_t *pp, const char *dir) {
+  if (pp->ndirs == PP_MAX_INCLUDE_DIRS) {
+    fatals("too many include directories\n");
+  }
+  char *copy = xalloc(strlen(dir) + 1);
+  strcpy(copy, dir);
+  pp->dirs[pp->ndirs++] = copy;
+}
+
+/* defines `name` as `body` like `#define name body` would, a name with a
+ * parameter list is a function-like macro, returns 0 on error
+ */
+int vcc_pp_define(vcc_pp_t *pp, const char *name, const char *body) {
+  vcc_pp_file_t *f = xalloc(sizeof(vcc_pp_file_t));
+  int len = strlen(name) + strlen(body) + 10;
+  char *src = xalloc(len);
+  f->path = "<command line>";
+  f->len = snprintf(src, len, "#define %s %s\n", name, body);
+  f->src = src;
+  vcc_lexer_t *lexer = vcc_lexer_new_from_mem(f->path, f->src, f->len);
+  vcc_lexer_set_symtbl(lexer, pp->symtbl);
+  vcc_lexer_keep_directives(lexer);
+  f->tokens = vcc_lex_all(lexer);
+  vcc_lexer_free(lexer);
+
+  // the definition must outlive the macro, its spellings are used
+  vcc_pp_file_t **defines = xalloc((pp->ndefines + 1) * sizeof(void *));
+  if (pp->ndefines) {
+    memcpy(defines, pp->defines, pp->ndefines * sizeof(void *));
+  }
+  xfree(pp->defines);
+  pp->defines = defines;
+  pp->defines[pp->ndefines++] = f;
+
+  if (f->tokens->error) {
+    return 0;
+  }
+  int barrier = pp->barrier;
+  push_file(pp, f);
+  pp->barrier = pp->nctx - 1;
+  vcc_pp_vec_t out = {0};
+  expand(pp, &out);
+  pop_ctx(pp);
+  pp->barrier = barrier;
+  xfree(out.v);
+  int ok = !pp->error;
+  pp->error = 0;
+  return ok;
+}
+
+/* preprocesses the translation unit `lexer` reads, the tokens given back
+ * are the caller's and have no directives left, each token has its offset
+ * in the file it came from, `error` is set if something went wrong
+ *
+ * a preprocessor runs a single translation unit, `lexer` must not be freed
+ * before the preprocessor, a large one is lexed in chunks on every core
+ */
+vcc_tokbuf_t *vcc_pp_run(vcc_pp_t *pp, vcc_lexer_t *lexer) {
+  vcc_lexer_set_symtbl(lexer, pp->symtbl);
+  vcc_lexer_keep_directives(lexer);
+  pp->lexer = lexer;
+  pp->main.path = lexer->fname;
+  pp->main.atom = vcc_symtbl_intern(pp->symtbl, lexer->fname,
+                                    strlen(lexer->fname));
+  if (lexer->input != VCC_LEXER_INPUT_STREAM) {
+    pp->main.src = lexer->src;
+    pp->main.len = lexer->len;
+  }
+  pp->main.tokens = vcc_lex_all_parallel(lexer, 0, NULL);
+  pp->out = vcc_tokbuf_new();
+
+  push_file(pp, &pp->main);
+  pp->barrier = 0;
+  expand(pp, NULL);
+  if (!pp->error && pp->nconds) {
+    pp_errors(pp, NULL, "unterminated conditional directive");
+  }
+  pp->out->error = pp->error || pp->main.tokens->error;
+  if (!pp->out->error) {
+    vtoken_t eof = {.type = TOKEN_EOF, .offset = pp->main.len};
+    vcc_tokbuf_push(pp->out, &eof);
+  }
+
+  vcc_tokbuf_t *out = pp->out;
+  pp->out = NULL;
+  return out;
+}
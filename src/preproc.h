@@ -0,0 +1,119 @@
+#ifndef _PREPROC_H_
+#define _PREPROC_H_
+
+#include "error.h"
+#include "lexer.h"
+#include "mem.h"
+#include "symtbl.h"
+
+#define PP_MAX_INCLUDE_DEPTH 200
+#define PP_MAX_INCLUDE_DIRS 64
+
+/* open-addressing map from atoms to pointers, NULL values are empty slots
+ */
+typedef struct _vcc_pp_map_t {
+  vcc_atom_t *keys;
+  void **values;
+  int cap; // power of two
+  int count;
+} vcc_pp_map_t;
+
+/* a file as the preprocessor has seen it, headers live in the process-wide
+ * include cache and are lexed only once, whoever includes them
+ */
+typedef struct _vcc_pp_file_t {
+  char *path;           // resolved path, the cache key
+  vcc_atom_t atom;      // path interned in the global table
+  const char *src;      // source text for spellings, NULL for a stream
+  size_t len;           // length of src
+  vcc_tokbuf_t *tokens; // raw tokens, directives included
+  int has_guard;        // the whole file is inside #ifndef `guard`
+  vcc_atom_t guard;
+} vcc_pp_file_t;
+
+/* counters of the include cache, for every preprocessor of the process
+ */
+typedef struct _vcc_pp_stats_t {
+  long lexed;    // headers lexed, each at most once
+  long replayed; // includes served from cached tokens
+  long skipped;  // includes dropped by a guard or #pragma once
+} vcc_pp_stats_t;
+
+/* a token on its way through the preprocessor
+ */
+typedef struct _vcc_pp_token_t {
+  vtoken_t t;
+  vcc_pp_file_t *file; // where it was read, NULL if it was made up
+  int noexpand;        // names a macro that must never expand again
+} vcc_pp_token_t;
+
+typedef struct _vcc_pp_vec_t {
+  vcc_pp_token_t *v;
+  int count;
+  int cap;
+} vcc_pp_vec_t;
+
+typedef struct _vcc_pp_macro_t {
+  int defined;        // 0 after #undef
+  int function;       // takes arguments
+  int variadic;       // the last parameter takes the rest
+  int nparams;        //
+  vcc_atom_t *params; //
+  vcc_pp_vec_t body;  //
+  int paste;          // body has # or ##, so it is always substituted
+  int disabled;       // being expanded, so not again
+} vcc_pp_macro_t;
+
+/* where tokens are read from: the raw tokens of a file or the result of
+ * an expansion
+ */
+typedef struct _vcc_pp_ctx_t {
+  vcc_pp_file_t *file;        // reading a file, else a list
+  int pos;                    // next token
+  const vcc_pp_token_t *list; // expansion
+  int count;                  // length of list
+  vcc_pp_vec_t owned;         // list, unless it is a macro body
+  vcc_pp_macro_t *macro;      // disabled while this context lives
+  int nconds;                 // conditionals open when it was entered
+} vcc_pp_ctx_t;
+
+typedef struct _vcc_pp_cond_t {
+  int active;        // tokens are kept
+  int parent_active; // the enclosing group is kept
+  int taken;         // some branch was kept
+  int seen_else;
+} vcc_pp_cond_t;
+
+typedef struct _vcc_pp_t {
+  vcc_symtbl_t *symtbl; // always the global table
+  char *dirs[PP_MAX_INCLUDE_DIRS];
+  int ndirs;
+  vcc_pp_map_t macros; // atom to vcc_pp_macro_t
+  vcc_pp_map_t once;   // files with #pragma once already included
+  vcc_pp_ctx_t *ctx;   // context stack, the main file at the bottom
+  int nctx;
+  int ctx_cap;
+  int barrier;         // context that ends the current expansion
+  vcc_pp_cond_t *conds;
+  int nconds;
+  int conds_cap;
+  vcc_pp_token_t ahead; // a token read too far
+  int has_ahead;
+  int ahead_file;  // ahead came from a file, so it may start a directive
+  vcc_pp_vec_t line; // tokens of the directive being run
+  vcc_pp_file_t main;  // the translation unit
+  vcc_lexer_t *lexer;  // its lexer, for positions in it
+  vcc_pp_file_t **defines; // command line macros
+  int ndefines;
+  vcc_tokbuf_t *out;
+  int error;
+} vcc_pp_t;
+
+vcc_pp_t *vcc_pp_new();
+void vcc_pp_free(vcc_pp_t *pp);
+void vcc_pp_add_include_dir(vcc_pp_t *pp, const char *dir);
+int vcc_pp_define(vcc_pp_t *pp, const char *name, const char *body);
+vcc_tokbuf_t *vcc_pp_run(vcc_pp_t *pp, vcc_lexer_t *lexer);
+vcc_pp_stats_t vcc_pp_stats();
+
+#endif
@@ -0,0 +1,147 @@
+#include "scan.h"
+
+/* =================== SCALAR ==================== */
+static const char *find2_scalar(const char *p, const char *end, char a,
+                                char b) {
+  while (p < end && *p != a && *p != b) {
+    ++p;
+  }
+  return p;
+}
+
+/* spaces are ' ' and '\t', '\n', '\v', '\f', '\r', which are 9 to 13
+ */
+static const char *skip_space_scalar(const char *p, const char *end) {
+  while (p < end && (*p == ' ' || (uint8_t)(*p - '\t') <= '\r' - '\t')) {
+    ++p;
+  }
+  return p;
+}
+
+static int count_scalar(const char *p, const char *end, char ch) {
+  int n = 0;
+  for (; p < end; ++p) {
+    n += *p == ch;
+  }
+  return n;
+}
+
+const vcc_scan_ops_t vcc_scan_scalar = {"scalar", find2_scalar,
+                                        skip_space_scalar, count_scalar};
+
+#ifdef VCC_SCAN_X86
+#include <immintrin.h>
+
+/* =================== SSE2 ==================== */
+__attribute__((target("sse2"))) static const char *
+find2_sse2(const char *p, const char *end, char a, char b) {
+  __m128i va = _mm_set1_epi8(a);
+  __m128i vb = _mm_set1_epi8(b);
+  for (; end - p >= 16; p += 16) {
+    __m128i x = _mm_loadu_si128((const __m128i *)p);
+    int m = _mm_movemask_epi8(
+        _mm_or_si128(_mm_cmpeq_epi8(x, va), _mm_cmpeq_epi8(x, vb)));
+    if (m) {
+      return p + __builtin_ctz(m);
+    }
+  }
+  return find2_scalar(p, end, a, b);
+}
+
+__attribute__((target("sse2"))) static const char *
+skip_space_sse2(const char *p, const char *end) {
+  __m128i sp = _mm_set1_epi8(' ');
+  __m128i tab = _mm_set1_epi8('\t');
+  __m128i range = _mm_set1_epi8('\r' - '\t');
+  for (; end - p >= 16; p += 16) {
+    __m128i x = _mm_loadu_si128((const __m128i *)p);
+    // x - '\t' <= '\r' - '\t' as unsigned bytes
+    __m128i d = _mm_sub_epi8(x, tab);
+    __m128i ctl = _mm_cmpeq_epi8(_mm_min_epu8(d, range), d);
+    int m = _mm_movemask_epi8(_mm_or_si128(_mm_cmpeq_epi8(x, sp), ctl));
+    if (m != 0xffff) {
+      return p + __builtin_ctz(~m);
+    }
+  }
+  return skip_space_scalar(p, end);
+}
+
+__attribute__((target("sse2"))) static int count_sse2(const char *p,
+                                                      const char *end,
+                                                      char ch) {
+  __m128i vc = _mm_set1_epi8(ch);
+  int n = 0;
+  for (; end - p >= 16; p += 16) {
+    __m128i x = _mm_loadu_si128((const __m128i *)p);
+    n += __builtin_popcount(_mm_movemask_epi8(_mm_cmpeq_epi8(x, vc)));
+  }
+  return n + count_scalar(p, end, ch);
+}
+
+const vcc_scan_ops_t vcc_scan_sse2 = {"sse2", find2_sse2, skip_space_sse2,
+                                      count_sse2};
+
+/* =================== AVX2 ==================== */
+__attribute__((target("avx2"))) static const char *
+find2_avx2(const char *p, const char *end, char a, char b) {
+  __m256i va = _mm256_set1_epi8(a);
+  __m256i vb = _mm256_set1_epi8(b);
+  for (; end - p >= 32; p += 32) {
+    __m256i x = _mm256_loadu_si256((const __m256i *)p);
+    unsigned m = _mm256_movemask_epi8(
+        _mm256_or_si256(_mm256_cmpeq_epi8(x, va), _mm256_cmpeq_epi8(x, vb)));
+    if (m) {
+      return p + __builtin_ctz(m);
+    }
+  }
+  return find2_sse2(p, end, a, b);
+}
+
+__attribute__((target("avx2"))) static const char *
+skip_space_avx2(const char *p, const char *end) {
+  __m256i sp = _mm256_set1_epi8(' ');
+  __m256i tab = _mm256_set1_epi8('\t');
+  __m256i range = _mm256_set1_epi8('\r' - '\t');
+  for (; end - p >= 32; p += 32) {
+    __m256i x = _mm256_loadu_si256((const __m256i *)p);
+    __m256i d = _mm256_sub_epi8(x, tab);
+    __m256i ctl = _mm256_cmpeq_epi8(_mm256_min_epu8(d, range), d);
+    unsigned m =
+        _mm256_movemask_epi8(_mm256_or_si256(_mm256_cmpeq_epi8(x, sp), ctl));
+    if (m != 0xffffffff) {
+      return p + __builtin_ctz(~m);
+    }
+  }
+  return skip_space_sse2(p, end);
+}
+
+__attribute__((target("avx2"))) static int count_avx2(const char *p,
+                                                      const char *end,
+                                                      char ch) {
+  __m256i vc = _mm256_set1_epi8(ch);
+  int n = 0;
+  for (; end - p >= 32; p += 32) {
+    __m256i x = _mm256_loadu_si256((const __m256i *)p);
+    n += __builtin_popcount(_mm256_movemask_epi8(_mm256_cmpeq_epi8(x, vc)));
+  }
+  return n + count_sse2(p, end, ch);
+}
+
+const vcc_scan_ops_t vcc_scan_avx2 = {"avx2", find2_avx2, skip_space_avx2,
+                                      count_avx2};
+#endif
+
+/* picks the widest kernels the running cpu supports
+ */
+const vcc_scan_ops_t *vcc_scan_best() {
+#ifdef VCC_SCAN_X86
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx2")) {
+    return &vcc_scan_avx2;
+  }
+  if (__builtin_cpu_supports("sse2")) {
+    return &vcc_scan_sse2;
+  }
+#endif
+  return &vcc_scan_scalar;
+}
@@ -0,0 +1,29 @@
+#ifndef _SCAN_H_
+#define _SCAN_H_
+
+#include "vcc.h"
+
+/* byte scanning kernels used by the lexer to skip whitespace, comments,
+ * strings and preprocessor lines many bytes at a time, every kernel works
+ * on [p, end) and returns `end` when nothing is found
+ */
+typedef struct _vcc_scan_ops_t {
+  const char *name;
+  // first byte equal to `a` or `b`
+  const char *(*find2)(const char *p, const char *end, char a, char b);
+  // first byte that is not a space
+  const char *(*skip_space)(const char *p, const char *end);
+  // number of bytes equal to `ch`
+  int (*count)(const char *p, const char *end, char ch);
+} vcc_scan_ops_t;
+
+extern const vcc_scan_ops_t vcc_scan_scalar;
+#if defined(__x86_64__) || defined(__i386__)
+#define VCC_SCAN_X86
+extern const vcc_scan_ops_t vcc_scan_sse2;
+extern const vcc_scan_ops_t vcc_scan_avx2;
+#endif
+
+const vcc_scan_ops_t *vcc_scan_best();
+
+#endif
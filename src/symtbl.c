@@ -0,0 +1,187 @@
+#include "symtbl.h"
+
+#define PHASE "interning"
+
+#define SYMTBL_INIT_CAP 256
+#define SYMTBL_STRINGS_CHUNK (64 * 1024)
+#define SYMTBL_PAGE_SIZE (1 << SYMTBL_PAGE_BITS)
+
+static vcc_symtbl_t *symtbl_new(int shared, int shard_bits) {
+  vcc_symtbl_t *tbl = xalloc(sizeof(vcc_symtbl_t));
+  tbl->shared = shared;
+  tbl->shard_bits = shard_bits;
+  tbl->shards = xalloc(sizeof(vcc_symtbl_shard_t) << shard_bits);
+  for (int i = 0; i < 1 << shard_bits; ++i) {
+    vcc_symtbl_shard_t *shard = &tbl->shards[i];
+    pthread_mutex_init(&shard->lock, NULL);
+    shard->cap = SYMTBL_INIT_CAP;
+    shard->slots = xalloc(shard->cap * sizeof(uint32_t));
+    shard->strings = arena_new(SYMTBL_STRINGS_CHUNK);
+  }
+  return tbl;
+}
+
+/* a table for one thread, no locking at all
+ */
+vcc_symtbl_t *vcc_symtbl_new() { return symtbl_new(0, 0); }
+
+/* a table any number of threads can intern into at the same time,
+ * `nshards` is rounded up to a power of two
+ */
+vcc_symtbl_t *vcc_symtbl_new_shared(int nshards) {
+  int bits = 0;
+  while ((1 << bits) < nshards && (1 << bits) < SYMTBL_MAX_SHARDS) {
+    ++bits;
+  }
+  return symtbl_new(1, bits);
+}
+
+static vcc_symtbl_t *global;
+static pthread_once_t global_once = PTHREAD_ONCE_INIT;
+
+static void global_init() { global = vcc_symtbl_new_shared(16); }
+
+/* the process-wide shared table, for atoms that must agree across
+ * translation units compiled in parallel, it is never freed
+ */
+vcc_symtbl_t *vcc_symtbl_global() {
+  pthread_once(&global_once, global_init);
+  return global;
+}
+
+void vcc_symtbl_free(vcc_symtbl_t *tbl) {
+  if (!tbl || tbl == global) {
+    return;
+  }
+  for (int i = 0; i < 1 << tbl->shard_bits; ++i) {
+    vcc_symtbl_shard_t *shard = &tbl->shards[i];
+    for (int p = 0; p < SYMTBL_MAX_PAGES && shard->pages[p]; ++p) {
+      xfree(shard->pages[p]);
+    }
+    arena_free(shard->strings);
+    xfree(shard->slots);
+    pthread_mutex_destroy(&shard->lock);
+  }
+  xfree(tbl->shards);
+  xfree(tbl);
+}
+
+/* hashes 8 bytes at a time
+ */
+static uint32_t hash(const char *s, int len) {
+  uint64_t h = 0x9e3779b97f4a7c15ull ^ (uint64_t)len;
+  for (; len >= 8; s += 8, len -= 8) {
+    uint64_t w;
+    memcpy(&w, s, 8);
+    h = (h ^ w) * 0x100000001b3ull;
+    h ^= h >> 29;
+  }
+  uint64_t w = 0;
+  memcpy(&w, s, len);
+  h = (h ^ w) * 0x100000001b3ull;
+  h ^= h >> 32;
+  return (uint32_t)h;
+}
+
+static vcc_symbol_t *entry(vcc_symtbl_shard_t *shard, uint32_t index) {
+  return &shard->pages[index >> SYMTBL_PAGE_BITS]
+                      [index & (SYMTBL_PAGE_SIZE - 1)];
+}
+
+static void grow(vcc_symtbl_shard_t *shard) {
+  uint32_t cap = shard->cap * 2;
+  uint32_t *slots = xalloc(cap * sizeof(uint32_t));
+  for (uint32_t i = 0; i < shard->count; ++i) {
+    uint32_t s = entry(shard, i)->hash & (cap - 1);
+    while (slots[s]) {
+      s = (s + 1) & (cap - 1);
+    }
+    slots[s] = i + 1;
+  }
+  xfree(shard->slots);
+  shard->slots = slots;
+  shard->cap = cap;
+}
+
+static uint32_t shard_intern(vcc_symtbl_shard_t *shard, const char *s,
+                             int len, uint32_t h) {
+  uint32_t slot = h & (shard->cap - 1);
+  while (shard->slots[slot]) {
+    uint32_t index = shard->slots[slot] - 1;
+    vcc_symbol_t *sym = entry(shard, index);
+    if (sym->hash == h && sym->len == (uint32_t)len &&
+        !memcmp(sym->s, s, len)) {
+      return index;
+    }
+    slot = (slot + 1) & (shard->cap - 1);
+  }
+
+  // new spelling
+  uint32_t index = shard->count;
+  int page = index >> SYMTBL_PAGE_BITS;
+  if (page >= SYMTBL_MAX_PAGES) {
+    fatals("too many names to intern\n");
+  }
+  if (!shard->pages[page]) {
+    shard->pages[page] = xalloc(sizeof(vcc_symbol_t) * SYMTBL_PAGE_SIZE);
+  }
+  char *copy = arena_alloc(shard->strings, len + 1);
+  memcpy(copy, s, len);
+  copy[len] = '\0';
+  *entry(shard, index) = (vcc_symbol_t){copy, len, h};
+  shard->slots[slot] = index + 1;
+  ++shard->count;
+  // keep the load under 1/2 so probe chains stay short
+  if (shard->count * 2 > shard->cap) {
+    grow(shard);
+  }
+  return index;
+}
+
+/* returns the atom of `len` bytes at `s`, interning them on first sight
+ */
+vcc_atom_t vcc_symtbl_intern(vcc_symtbl_t *tbl, const char *s, int len) {
+  uint32_t h = hash(s, len);
+  // slots are picked by the low bits, shards by the high ones
+  uint32_t which =
+      (h >> (32 - SYMTBL_MAX_SHARD_BITS)) & ((1u << tbl->shard_bits) - 1);
+  vcc_symtbl_shard_t *shard = &tbl->shards[which];
+  if (tbl->shared) {
+    pthread_mutex_lock(&shard->lock);
+  }
+  uint32_t index = shard_intern(shard, s, len, h);
+  if (tbl->shared) {
+    pthread_mutex_unlock(&shard->lock);
+  }
+  return index << tbl->shard_bits | which;
+}
+
+/* returns the NUL-terminated spelling of `atom`, and its length in `len`
+ * when not NULL, spellings live as long as the table
+ */
+const char *vcc_symtbl_name(vcc_symtbl_t *tbl, vcc_atom_t atom, int *len) {
+  vcc_symtbl_shard_t *shard =
+      &tbl->shards[atom & ((1u << tbl->shard_bits) - 1)];
+  vcc_symbol_t *sym = entry(shard, atom >> tbl->shard_bits);
+  if (len) {
+    *len = sym->len;
+  }
+  return sym->s;
+}
+
+/* returns the number of distinct spellings
+ */
+int vcc_symtbl_count(vcc_symtbl_t *tbl) {
+  int count = 0;
+  for (int i = 0; i < 1 << tbl->shard_bits; ++i) {
+    vcc_symtbl_shard_t *shard = &tbl->shards[i];
+    if (tbl->shared) {
+      pthread_mutex_lock(&shard->lock);
+    }
+    count += shard->count;
+    if (tbl->shared) {
+      pthread_mutex_unlock(&shard->lock);
+    }
+  }
+  return count;
+}
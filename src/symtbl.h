@@ -1,4 +1,53 @@
 #ifndef _SYMTBL_H_
 #define _SYMTBL_H_
 
-#endif
\ No newline at end of file
+#include "mem.h"
+#include "vcc.h"
+#include <pthread.h>
+
+/* string interner: every distinct spelling is stored once and named by a
+ * stable 32-bit atom, so comparing names is comparing atoms
+ */
+typedef uint32_t vcc_atom_t;
+
+#define SYMTBL_PAGE_BITS 10 // entries per page: 1024
+#define SYMTBL_MAX_PAGES 4096
+#define SYMTBL_MAX_SHARD_BITS 6
+#define SYMTBL_MAX_SHARDS (1 << SYMTBL_MAX_SHARD_BITS)
+
+typedef struct _vcc_symbol_t {
+  const char *s; // NUL-terminated spelling
+  uint32_t len;
+  uint32_t hash;
+} vcc_symbol_t;
+
+/* a shard is an open-addressing table of its own, a shared table has one
+ * lock per shard so threads interning different names rarely wait
+ */
+typedef struct _vcc_symtbl_shard_t {
+  pthread_mutex_t lock;
+  uint32_t *slots;  // 0 for empty, else entry index + 1
+  uint32_t cap;     // number of slots, power of two
+  uint32_t count;   // number of entries
+  arena_t *strings; // spellings
+  // entries live in fixed pages that never move, so names can be read
+  // without taking the lock
+  vcc_symbol_t *pages[SYMTBL_MAX_PAGES];
+} vcc_symtbl_shard_t;
+
+typedef struct _vcc_symtbl_t {
+  int shared;     // lock the shards
+  int shard_bits; // atom = entry index << shard_bits | shard
+  vcc_symtbl_shard_t *shards;
+} vcc_symtbl_t;
+
+vcc_symtbl_t *vcc_symtbl_new();
+vcc_symtbl_t *vcc_symtbl_new_shared(int nshards);
+vcc_symtbl_t *vcc_symtbl_global();
+void vcc_symtbl_free(vcc_symtbl_t *tbl);
+
+vcc_atom_t vcc_symtbl_intern(vcc_symtbl_t *tbl, const char *s, int len);
+const char *vcc_symtbl_name(vcc_symtbl_t *tbl, vcc_atom_t atom, int *len);
+int vcc_symtbl_count(vcc_symtbl_t *tbl);
+
+#endif
@@ -0,0 +1,214 @@
+#include "trace.h"
+#include "lexer.h"
+#include "mem.h"
+#include <stdatomic.h>
+#include <time.h>
+
+#define PHASE "tracing"
+
+const char *trace_phases[] = {[TRACE_LEXER] = "lexer",
+                              [TRACE_PREPROC] = "preproc",
+                              [TRACE_PARSER] = "parser",
+                              [TRACE_GENERATOR] = "generator"};
+
+const char *trace_events[] = {[TRACE_EV_NONE] = "none",
+                              [TRACE_EV_ADVANCE] = "advance",
+                              [TRACE_EV_CONSUME] = "consume",
+                              [TRACE_EV_EXPECT] = "expect",
+                              [TRACE_EV_SKIP_BODY] = "skip-body",
+                              [TRACE_EV_PARSE_ERROR] = "parse-error"};
+
+static const char *levels[] = {[TRACE_OFF] = "off",
+                               [TRACE_ERROR] = "error",
+                               [TRACE_INFO] = "info",
+                               [TRACE_DEBUG] = "debug",
+                               [TRACE_TOKEN] = "token"};
+
+/* how the arguments of each event are printed: t for a token, d for a
+ * number, nothing past the last
+ */
+static const char *event_args[] = {[TRACE_EV_NONE] = "",
+                                   [TRACE_EV_ADVANCE] = "ttt",
+                                   [TRACE_EV_CONSUME] = "tt",
+                                   [TRACE_EV_EXPECT] = "ttd",
+                                   [TRACE_EV_SKIP_BODY] = "dd",
+                                   [TRACE_EV_PARSE_ERROR] = "dd"};
+
+uint8_t vcc_trace_levels[TRACE_NPHASES];
+
+static _Atomic(vcc_trace_ring_t *) rings; // every ring, the newest first
+static atomic_uint nrings;
+static _Thread_local vcc_trace_ring_t *ring;
+
+/* the ring of this thread, made on its first event and never freed, so it
+ * can be dumped after the thread is gone
+ */
+static vcc_trace_ring_t *own_ring() {
+  if (!ring) {
+    ring = xalloc(sizeof(vcc_trace_ring_t));
+    ring->count = 0;
+    ring->thread = atomic_fetch_add(&nrings, 1);
+    ring->next = atomic_load(&rings);
+    while (!atomic_compare_exchange_weak(&rings, &ring->next, ring)) {
+    }
+  }
+  return ring;
+}
+
+void vcc_trace_emit(int phase, int event, uint32_t a, uint32_t b, uint32_t c) {
+  vcc_trace_ring_t *r = own_ring();
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  vcc_trace_record_t *rec = &r->records[r->count++ & (TRACE_RING_SIZE - 1)];
+  rec->time = ts.tv_sec * 1000000000ull + ts.tv_nsec;
+  rec->phase = phase;
+  rec->event = event;
+  rec->args[0] = a;
+  rec->args[1] = b;
+  rec->args[2] = c;
+}
+
+void vcc_trace_set_level(int phase, int level) {
+  assert(phase >= 0 && phase < TRACE_NPHASES);
+  vcc_trace_levels[phase] = level;
+}
+
+static int lookup(const char **names, int count, const char *s, int len) {
+  for (int i = 0; i < count; ++i) {
+    if ((int)strlen(names[i]) == len && !strncmp(names[i], s, len)) {
+      return i;
+    }
+  }
+  return -1;
+}
+
+/* a level by name or number, a number above the last level is the last,
+ * -1 if `s` up to `end` is neither
+ */
+static int parse_level(const char *s, const char *end) {
+  int level = lookup(levels, TRACE_TOKEN + 1, s, end - s);
+  if (level >= 0) {
+    return level;
+  }
+  if (s == end || *s < '0' || *s > '9') {
+    return -1;
+  }
+  char *stop;
+  long n = strtol(s, &stop, 10);
+  if (stop != end) {
+    return -1;
+  }
+  return n > TRACE_TOKEN ? TRACE_TOKEN : n;
+}
+
+/* sets levels from a list like `parser=token,lexer=1`, where `all` names
+ * every phase, returns 0 and sets nothing if a part of it is not
+ * understood, NULL is fine
+ */
+int vcc_trace_configure(const char *spec) {
+  // checked whole before any level is set
+  for (int apply = 0; apply <= 1; ++apply) {
+    for (const char *s = spec; s && *s;) {
+      const char *end = s + strcspn(s, ",");
+      const char *eq = memchr(s, '=', end - s);
+      if (!eq) {
+        return 0;
+      }
+      int phase = lookup(trace_phases, TRACE_NPHASES, s, eq - s);
+      int level = parse_level(eq + 1, end);
+      int all = eq - s == 3 && !strncmp(s, "all", 3);
+      if ((phase < 0 && !all) || level < 0) {
+        return 0;
+      }
+      for (int i = 0; apply && i < TRACE_NPHASES; ++i) {
+        if (all || i == phase) {
+          vcc_trace_set_level(i, level);
+        }
+      }
+      s = *end ? end + 1 : end;
+    }
+  }
+  return 1;
+}
+
+typedef struct _trace_header_t {
+  char magic[8];
+  uint32_t version;
+  uint32_t record_size;
+  uint32_t nrings;
+} trace_header_t;
+
+typedef struct _trace_ring_header_t {
+  uint32_t thread;
+  uint32_t count; // records that follow, the oldest first
+} trace_ring_header_t;
+
+/* writes the records of every ring, to be called once the threads that
+ * trace are done, returns 0 if writing failed
+ */
+int vcc_trace_dump(FILE *fp) {
+  trace_header_t h = {.magic = TRACE_MAGIC,
+                      .version = TRACE_VERSION,
+                      .record_size = sizeof(vcc_trace_record_t),
+                      .nrings = atomic_load(&nrings)};
+  int ok = fwrite(&h, sizeof(h), 1, fp) == 1;
+  for (vcc_trace_ring_t *r = atomic_load(&rings); ok && r; r = r->next) {
+    uint64_t first = r->count > TRACE_RING_SIZE ? r->count - TRACE_RING_SIZE
+                                                : 0;
+    trace_ring_header_t rh = {r->thread, r->count - first};
+    ok = fwrite(&rh, sizeof(rh), 1, fp) == 1;
+    for (uint64_t i = first; ok && i < r->count; ++i) {
+      ok = fwrite(&r->records[i & (TRACE_RING_SIZE - 1)],
+                  sizeof(vcc_trace_record_t), 1, fp) == 1;
+    }
+  }
+  return ok;
+}
+
+static void decode_record(FILE *out, uint32_t thread, uint64_t start,
+                          const vcc_trace_record_t *rec) {
+  fprintf(out, "%12.3f %3u %-9s %-11s", (rec->time - start) / 1e3, thread,
+          rec->phase < TRACE_NPHASES ? trace_phases[rec->phase] : "?",
+          rec->event < TRACE_NEVENTS ? trace_events[rec->event] : "?");
+  const char *args = rec->event < TRACE_NEVENTS ? event_args[rec->event] : "";
+  for (int i = 0; args[i]; ++i) {
+    uint32_t arg = rec->args[i];
+    if (args[i] == 'd') {
+      fprintf(out, " %u", arg);
+    } else if (arg < NUMBER_OF_TOKENS) {
+      fprintf(out, " %s", token_names[arg]);
+    } else {
+      fprintf(out, " -");
+    }
+  }
+  fprintf(out, "\n");
+}
+
+/* prints a dump made by vcc_trace_dump(), a line for each record with its
+ * time in microseconds from the first record of its thread, returns 0 if
+ * `in` is not such a dump
+ */
+int vcc_trace_decode(FILE *in, FILE *out) {
+  trace_header_t h;
+  if (fread(&h, sizeof(h), 1, in) != 1 || memcmp(h.magic, TRACE_MAGIC, 8) ||
+      h.version != TRACE_VERSION ||
+      h.record_size != sizeof(vcc_trace_record_t)) {
+    return 0;
+  }
+  for (uint32_t i = 0; i < h.nrings; ++i) {
+    trace_ring_header_t rh;
+    if (fread(&rh, sizeof(rh), 1, in) != 1) {
+      return 0;
+    }
+    vcc_trace_record_t rec;
+    uint64_t start = 0;
+    for (uint32_t j = 0; j < rh.count; ++j) {
+      if (fread(&rec, sizeof(rec), 1, in) != 1) {
+        return 0;
+      }
+      start = j ? start : rec.time;
+      decode_record(out, rh.thread, start, &rec);
+    }
+  }
+  return 1;
+}
@@ -0,0 +1,105 @@
+#ifndef _TRACE_H_
+#define _TRACE_H_
+
+#include "vcc.h"
+
+/* trace points: an event of a phase is recorded when its level is within
+ * both the ceiling the file was compiled with and the level of the phase
+ * set at run time, a point above the ceiling compiles to nothing
+ *
+ * events are not formatted where they happen: each thread appends fixed
+ * records to a ring of its own, vcc_trace_dump() writes the rings out and
+ * vcc_trace_decode() prints them later
+ */
+enum {
+  TRACE_LEXER = 0,
+  TRACE_PREPROC,
+  TRACE_PARSER,
+  TRACE_GENERATOR,
+  TRACE_NPHASES
+};
+
+enum {
+  TRACE_OFF = 0,
+  TRACE_ERROR, // what stops a phase
+  TRACE_INFO,  // a few events for each file
+  TRACE_DEBUG, // events for each node
+  TRACE_TOKEN, // events for each token
+};
+
+#ifndef TRACE_CEILING
+#ifdef ENABLE_TRACE
+#define TRACE_CEILING TRACE_TOKEN
+#else
+#define TRACE_CEILING TRACE_OFF
+#endif
+#endif
+
+/* the ceiling of each phase, a build lowers one with, e.g.,
+ * -DTRACE_CEILING_PARSER=TRACE_INFO
+ */
+#ifndef TRACE_CEILING_LEXER
+#define TRACE_CEILING_LEXER TRACE_CEILING
+#endif
+#ifndef TRACE_CEILING_PREPROC
+#define TRACE_CEILING_PREPROC TRACE_CEILING
+#endif
+#ifndef TRACE_CEILING_PARSER
+#define TRACE_CEILING_PARSER TRACE_CEILING
+#endif
+#ifndef TRACE_CEILING_GENERATOR
+#define TRACE_CEILING_GENERATOR TRACE_CEILING
+#endif
+
+/* events, with what their three arguments are
+ */
+enum {
+  TRACE_EV_NONE = 0,
+  TRACE_EV_ADVANCE,     // previous, current and next token
+  TRACE_EV_CONSUME,     // token expected, token found
+  TRACE_EV_EXPECT,      // token expected, token found, met
+  TRACE_EV_SKIP_BODY,   // first and last token index of a function body
+  TRACE_EV_PARSE_ERROR, // error code, token index
+  TRACE_NEVENTS
+};
+
+#define TRACE_NO_TOKEN 0xffffffffu // a token argument that is missing
+#define TRACE_RING_SIZE 4096       // records kept for each thread
+#define TRACE_MAGIC "VCCTRACE"
+#define TRACE_VERSION 1
+
+typedef struct _vcc_trace_record_t {
+  uint64_t time; // nanoseconds on a monotonic clock
+  uint16_t phase;
+  uint16_t event;
+  uint32_t args[3];
+} vcc_trace_record_t;
+
+/* the records of one thread, the oldest are written over once it is full
+ */
+typedef struct _vcc_trace_ring_t {
+  vcc_trace_record_t records[TRACE_RING_SIZE];
+  uint64_t count;                 // records ever appended
+  uint32_t thread;                // rings are numbered as threads trace
+  struct _vcc_trace_ring_t *next; // every ring of the process
+} vcc_trace_ring_t;
+
+extern const char *trace_phases[];
+extern const char *trace_events[];
+extern uint8_t vcc_trace_levels[TRACE_NPHASES];
+
+#define vtrace(phase, level, event, a, b, c)                                   \
+  do {                                                                         \
+    if ((level) <= TRACE_CEILING_##phase &&                                    \
+        (level) <= vcc_trace_levels[TRACE_##phase]) {                          \
+      vcc_trace_emit(TRACE_##phase, (event), (a), (b), (c));                   \
+    }                                                                          \
+  } while (0)
+
+void vcc_trace_emit(int phase, int event, uint32_t a, uint32_t b, uint32_t c);
+void vcc_trace_set_level(int phase, int level);
+int vcc_trace_configure(const char *spec);
+int vcc_trace_dump(FILE *fp);
+int vcc_trace_decode(FILE *in, FILE *out);
+
+#endif
@@ -12,11 +12,15 @@
 #define VCC_PHASE_PARSING "parsing"
 
 #ifdef ENABLE_DEBUG
+extern int vcc_log_quiet; // set to keep debug logs off at run time
+
 #define logf(fmt, ...)                                                         \
   do {                                                                         \
-    fprintf(stderr, "[%s][\033[0;32m%s\033[0m:%d:\033[0;34m%s()\033[0m] " fmt, \
-            PHASE, __FILE__, __LINE__, __func__, __VA_ARGS__);                 \
-                                                                               \
+    if (!vcc_log_quiet) {                                                      \
+      fprintf(stderr,                                                          \
+              "[%s][\033[0;32m%s\033[0m:%d:\033[0;34m%s()\033[0m] " fmt,       \
+              PHASE, __FILE__, __LINE__, __func__, __VA_ARGS__);               \
+    }                                                                          \
   } while (0)
 
 #define logs(str) logf("%s", str)
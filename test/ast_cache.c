@@ -0,0 +1,174 @@
+/* an AST written to the cache must read back as the same nodes, with
+ * names in the symbol table it is read with and shared expressions still
+ * shared, loading must not allocate for each node, and a file of another
+ * source or a damaged one, even with pointers and tables still in it, must
+ * be turned down
+ */
+#include "../src/astcache.h"
+#include <unistd.h>
+
+#define FUNCS 500
+
+static const char *func = "static int helper%d(int a, char *s) {\n"
+                          "  if ((a & 255) == %d) {\n"
+                          "    return puts(\"helper %d\") + (a & 255);\n"
+                          "  }\n"
+                          "  return s[a + 1] == 'x' ? a * %d : -1;\n"
+                          "}\n"
+                          "if (x%d) {\n"
+                          "return y ? %d : z;\n"
+                          "}\n";
+
+static int same_expr(vcc_symtbl_t *ta, vcc_expr_t *a, vcc_symtbl_t *tb,
+                     vcc_expr_t *b) {
+  if (!a || !b) {
+    return !a && !b;
+  }
+  if (a->arity != b->arity || a->opr != b->opr || a->type != b->type ||
+      a->shared != b->shared) {
+    return 0;
+  }
+  if (a->arity == 0 && a->opr != TOKEN_INT) {
+    if (strcmp(vcc_symtbl_name(ta, a->literal.atom, NULL),
+               vcc_symtbl_name(tb, b->literal.atom, NULL))) {
+      return 0;
+    }
+  } else if (a->literal.number != b->literal.number) {
+    return 0;
+  }
+  return same_expr(ta, a->lhs, tb, b->lhs) &&
+         same_expr(ta, a->rhs, tb, b->rhs) &&
+         same_expr(ta, a->next, tb, b->next);
+}
+
+static int same_node(vcc_symtbl_t *ta, vcc_node_t *a, vcc_symtbl_t *tb,
+                     vcc_node_t *b) {
+  if (!a || !b) {
+    return !a && !b;
+  }
+  if (a->type != b->type) {
+    return 0;
+  }
+  if (a->type == VCC_NODE_FUNC) {
+    vcc_func_t *fa = a->value.func, *fb = b->value.func;
+    vcc_block_t *ba = vcc_func_body(fa), *bb = vcc_func_body(fb);
+    if (strcmp(vcc_symtbl_name(ta, fa->name, NULL),
+               vcc_symtbl_name(tb, fb->name, NULL)) ||
+        fa->arity != fb->arity || !ba || !bb || ba->count != bb->count) {
+      return 0;
+    }
+    vcc_node_t *na = ba->nodes, *nb = bb->nodes;
+    for (; na && nb; na = na->next, nb = nb->next) {
+      if (!same_node(ta, na, tb, nb)) {
+        return 0;
+      }
+    }
+    return !na && !nb;
+  }
+  vcc_stmt_t *sa = a->value.stmt, *sb = b->value.stmt;
+  return sa->type == sb->type &&
+         same_expr(ta, sa->condition, tb, sb->condition) &&
+         same_expr(ta, sa->expr, tb, sb->expr);
+}
+
+/* writes `n` bytes over the file at `off`
+ */
+static int patch(const char *path, uint64_t off, const void *bytes, size_t n) {
+  FILE *fp = fopen(path, "r+b");
+  int ok = fp && !fseek(fp, off, SEEK_SET) && fwrite(bytes, n, 1, fp) == 1;
+  return fp && !fclose(fp) && ok;
+}
+
+int main() {
+  char dir[] = "/tmp/vcc_ast_cache_XXXXXX";
+  if (!mkdtemp(dir)) {
+    fprintf(stderr, "could not make a cache directory\n");
+    return 1;
+  }
+  buf_t *src = buf_new(FUNCS * 256);
+  for (int i = 0; i < FUNCS; ++i) {
+    src->len += sprintf(src->s + src->len, func, i, i, i, i, i % 7, i);
+  }
+  uint64_t hash = vcc_ast_hash(0, src->s, src->len);
+  vcc_lexer_t *lexer = vcc_lexer_new_from_mem("cache", src->s, src->len);
+  vcc_tokbuf_t *tokens = vcc_lex_all(lexer);
+  vcc_node_t **nodes = xalloc(tokens->count * sizeof(vcc_node_t *));
+  int count = 0, failed = 0;
+  arena_t *arena = arena_new(AST_ARENA_CHUNK_SIZE);
+  vcc_parser_init_tokens(lexer, tokens);
+  vcc_parser_set_arena(arena);
+  vcc_parser_lazy_bodies(1);
+  vcc_parser_share_exprs(1);
+  while (vcc_parser_continuable()) {
+    nodes[count++] = vcc_parse();
+  }
+  failed |= !vcc_ast_cache_store(dir, hash, lexer->symtbl, nodes, count);
+
+  vcc_symtbl_t *symtbl = vcc_symtbl_new();
+  vcc_symtbl_intern(symtbl, "atoms differ from the lexer's", 29);
+  size_t before = xalloc_count();
+  vcc_cached_ast_t *ast = vcc_ast_cache_load(dir, hash, symtbl);
+  size_t mallocs = xalloc_count() - before;
+  if (!ast || ast->count != count) {
+    fprintf(stderr, "read back %d nodes of %d\n", ast ? ast->count : -1,
+            count);
+    failed = 1;
+  }
+  for (int i = 0; !failed && i < count; ++i) {
+    if (!same_node(lexer->symtbl, nodes[i], symtbl, ast->nodes[i])) {
+      fprintf(stderr, "node %d was not read back right\n", i);
+      failed = 1;
+    }
+  }
+  // `(a & 255)` is one expression in the first function, and in the file
+  vcc_block_t *body = ast ? vcc_func_body(ast->nodes[0]->value.func) : NULL;
+  if (!body || body->nodes->value.stmt->condition->lhs !=
+                   body->nodes->next->value.stmt->expr->rhs) {
+    fprintf(stderr, "shared expressions were copied apart\n");
+    failed = 1;
+  }
+  // the names are interned, that is the only allocation of the symbol table
+  fprintf(stderr, "%d nodes read back, %zu mallocs, %zu bytes\n", count,
+          mallocs, ast ? ast->size : 0);
+  failed |= mallocs > 16;
+
+  // another source, then the file cut short
+  failed |= vcc_ast_cache_load(dir, hash + 1, symtbl) != NULL;
+  char path[256];
+  snprintf(path, sizeof(path), "%s/%016llx.ast", dir,
+           (unsigned long long)hash);
+  // a pointer to an object running past the end of the file
+  vcc_ast_cache_header_t h = {0};
+  uint32_t reloc = 0;
+  FILE *fp = fopen(path, "rb");
+  failed |= !fp || fread(&h, sizeof(h), 1, fp) != 1 || !h.nrelocs ||
+            fseek(fp, h.relocs, SEEK_SET) ||
+            fread(&reloc, sizeof(reloc), 1, fp) != 1;
+  if (fp) {
+    fclose(fp);
+  }
+  uint64_t last = (h.size - 8) & ~(uint64_t)7;
+  failed |= !patch(path, reloc & ~7u, &last, sizeof(last));
+  failed |= vcc_ast_cache_load(dir, hash, symtbl) != NULL;
+  // a table out of line
+  failed |= !vcc_ast_cache_store(dir, hash, lexer->symtbl, nodes, count);
+  h.relocs += 2;
+  failed |= !patch(path, 0, &h, sizeof(h));
+  failed |= vcc_ast_cache_load(dir, hash, symtbl) != NULL;
+  failed |= !vcc_ast_cache_store(dir, hash, lexer->symtbl, nodes, count);
+  failed |= truncate(path, ast ? ast->size / 2 : 0) != 0;
+  failed |= vcc_ast_cache_load(dir, hash, symtbl) != NULL;
+  unlink(path);
+  rmdir(dir);
+
+  vcc_cached_ast_free(ast);
+  vcc_symtbl_free(symtbl);
+  vcc_parser_finish();
+  arena_free(arena);
+  xfree(nodes);
+  vcc_tokbuf_free(tokens);
+  vcc_lexer_free(lexer);
+  buf_free(src);
+  fprintf(stderr, "%s\n", failed ? "failed" : "ok");
+  return failed;
+}
@@ -0,0 +1,133 @@
+/* expressions far deeper than the C stack would take if parsing or walking
+ * them recursed: a million terms of one chain, and long runs of nesting of
+ * each kind, parsed, valued, copied to a pool and generated on a thread
+ * with a small stack
+ */
+#include "../src/generator.h"
+#include "../src/parser.h"
+#include <pthread.h>
+
+#define TERMS 1000000
+#define NESTING 100000
+#define STACK_SIZE (256 << 10)
+
+typedef struct {
+  const char *name;
+  const char *head;  // once at the start
+  const char *open;  // NESTING times, or TERMS / 2 - 1 for the sum
+  const char *leaf;  // once in the middle
+  const char *close; // as many times after it
+  const char *tail;  // once at the end
+  int value;         // of the expression, names are 0
+} case_t;
+
+static const case_t cases[] = {
+    {"sum", "", "x + 1 + ", "x + 1", "", "", TERMS / 2},
+    {"parentheses", "", "(", "x + 3", ")", "", 3},
+    {"prefix", "", "- ~", "x", "", "", NESTING},
+    {"assignment", "", "a = ", "5", "", "", 5},
+    {"ternary", "", "a ? b : ", "7", "", "", 7},
+    {"calls", "", "f(", "x", ")", "", 0},
+    {"indexes", "", "a[", "x", "]", "", 0},
+    {"comma", "", "x, ", "2", "", "", 2},
+    {"arguments", "f(", "x, ", "x", "", ")", 0},
+};
+
+static char *build(const case_t *c, int *len) {
+  int n = strcmp(c->name, "sum") ? NESTING : TERMS / 2 - 1;
+  size_t cap = 16 + n * (strlen(c->open) + strlen(c->close)) +
+               strlen(c->head) + strlen(c->leaf) + strlen(c->tail);
+  char *src = xalloc(cap);
+  *len = sprintf(src, "return %s", c->head);
+  for (int i = 0; i < n; ++i) {
+    *len += sprintf(src + *len, "%s", c->open);
+  }
+  *len += sprintf(src + *len, "%s", c->leaf);
+  for (int i = 0; i < n; ++i) {
+    *len += sprintf(src + *len, "%s", c->close);
+  }
+  *len += sprintf(src + *len, "%s;", c->tail);
+  return src;
+}
+
+static int lines(const char *s) {
+  int n = 0;
+  for (; *s; ++s) {
+    n += *s == '\n';
+  }
+  return n;
+}
+
+static int check(const case_t *c) {
+  int len;
+  char *src = build(c, &len);
+  vcc_lexer_t *lexer = vcc_lexer_new_from_mem(c->name, src, len);
+  vcc_tokbuf_t *tokens = vcc_lex_all(lexer);
+  vcc_parser_init_tokens(lexer, tokens);
+  vcc_node_t *node = vcc_parse();
+  int failed = !node || !vcc_parser_continuable();
+  vcc_expr_t *expr = failed ? NULL : node->value.stmt->expr;
+  failed |= !expr;
+  if (!failed) {
+    int value = vcc_expr_eval(expr);
+    vcc_expr_pool_t *pool = vcc_expr_pool_new();
+    uint32_t root = vcc_expr_pool_add(pool, expr);
+    int *values = xalloc(pool->count * sizeof(int));
+    vcc_expr_pool_eval(pool, values);
+    failed |= value != c->value || values[root] != c->value;
+    if (failed) {
+      fprintf(stderr, "%s: valued %d and %d in a pool, not %d\n", c->name,
+              value, values[root], c->value);
+    }
+    xfree(values);
+    vcc_expr_pool_free(pool);
+
+    vcc_generator_init();
+    char *code = vcc_generate(node);
+    // a push for each constant, names are not generated, then two pops,
+    // the add and a push for each operator
+    if (!strcmp(c->name, "sum") &&
+        (lines(code) != TERMS / 2 + 4 * (TERMS - 1) ||
+         !strstr(code, "pop r9\npop r8\nadd r8, r9\npush r8\n"))) {
+      fprintf(stderr, "sum: %d lines generated\n", lines(code));
+      failed = 1;
+    }
+    failed |= !code;
+    vcc_generator_finish();
+  } else {
+    fprintf(stderr, "%s: did not parse\n", c->name);
+  }
+  vcc_parser_finish();
+  vcc_tokbuf_free(tokens);
+  vcc_lexer_free(lexer);
+  xfree(src);
+  return failed;
+}
+
+static void *run(void *arg) {
+  int *failed = arg;
+  for (size_t i = 0; i < sizeof(cases) / sizeof(*cases); ++i) {
+    *failed |= check(&cases[i]);
+  }
+  return NULL;
+}
+
+int main() {
+  int failed = 0;
+#ifdef ENABLE_DEBUG
+  // a debug build logs every token, hundreds of megabytes for these
+  vcc_log_quiet = 1;
+#endif
+  pthread_attr_t attr;
+  pthread_t thread;
+  pthread_attr_init(&attr);
+  pthread_attr_setstacksize(&attr, STACK_SIZE);
+  if (pthread_create(&thread, &attr, run, &failed)) {
+    fprintf(stderr, "could not start a thread\n");
+    return 1;
+  }
+  pthread_join(thread, NULL);
+  pthread_attr_destroy(&attr);
+  fprintf(stderr, "%s\n", failed ? "failed" : "ok");
+  return failed;
+}
@@ -0,0 +1,151 @@
+/* expressions copied to a pool must keep their shape and value: random
+ * expressions are parsed, copied, compared node by node with their trees,
+ * and evaluated both ways
+ */
+#include "../src/parser.h"
+
+#define EXPRS 2000
+#define MAX_DEPTH 6
+
+static const char *binary[] = {
+    " + ",  " - ", " * ",  " / ",  " % ",  " << ", " >> ", " == ", " != ",
+    " < ",  " > ", " <= ", " >= ", " & ",  " | ",  " ^ ",  " && ", " || ",
+};
+
+static const char *unary[] = {"- ", "!", "~"};
+
+static void generate(buf_t *out, int depth) {
+  int pick = depth >= MAX_DEPTH ? 0 : rand() % 6;
+  switch (pick) {
+  case 0:
+    // names keep the constants around them from being folded
+    if (rand() % 2) {
+      out->len += sprintf(out->s + out->len, "x");
+    } else {
+      out->len += sprintf(out->s + out->len, "%d", rand() % 100);
+    }
+    break;
+  case 1:
+    out->len += sprintf(out->s + out->len, "%s", unary[rand() % 3]);
+    generate(out, depth + 1);
+    break;
+  case 2:
+    out->len += sprintf(out->s + out->len, "(");
+    generate(out, depth + 1);
+    out->len += sprintf(out->s + out->len, ")");
+    break;
+  case 3:
+    generate(out, depth + 1);
+    out->len += sprintf(out->s + out->len, " ? ");
+    generate(out, depth + 1);
+    out->len += sprintf(out->s + out->len, " : ");
+    generate(out, depth + 1);
+    break;
+  default:
+    generate(out, depth + 1);
+    out->len += sprintf(out->s + out->len, "%s", binary[rand() % 18]);
+    generate(out, depth + 1);
+    break;
+  }
+}
+
+/* compares a tree with the pool records at `root`, returns the number of
+ * records it takes or -1 if they differ
+ */
+static int compare(vcc_expr_t *expr, vcc_expr_pool_t *pool, uint32_t root) {
+  if (!expr || !root) {
+    return !expr && !root ? 0 : -1;
+  }
+  vcc_xnode_t *x = &pool->nodes[root];
+  if (x->arity != expr->arity || x->opr != expr->opr) {
+    return -1;
+  }
+  int next = compare(expr->next, pool, x->next);
+  if (expr->arity == 0) {
+    return next >= 0 && pool->literals[x->lhs] == expr->literal.number
+               ? next + 1
+               : -1;
+  }
+  int lhs = compare(expr->lhs, pool, x->lhs);
+  int rhs = compare(expr->rhs, pool, x->rhs);
+  return lhs < 0 || rhs < 0 || next < 0 ? -1 : lhs + rhs + next + 1;
+}
+
+static int check_parsed() {
+  buf_t *src = buf_new(EXPRS * 4096);
+  srand(1);
+  for (int i = 0; i < EXPRS; ++i) {
+    src->len += sprintf(src->s + src->len, "return ");
+    generate(src, 0);
+    src->len += sprintf(src->s + src->len, ";\n");
+  }
+  vcc_lexer_t *lexer = vcc_lexer_new_from_mem("pool", src->s, src->len);
+  vcc_tokbuf_t *tokens = vcc_lex_all(lexer);
+  vcc_parser_init_tokens(lexer, tokens);
+  vcc_expr_pool_t *pool = vcc_expr_pool_new();
+  vcc_expr_t **trees = xalloc(EXPRS * sizeof(vcc_expr_t *));
+  uint32_t *roots = xalloc(EXPRS * sizeof(uint32_t));
+  int n = 0, failed = 0;
+  while (vcc_parser_continuable() && n < EXPRS) {
+    vcc_node_t *node = vcc_parse();
+    if (!node) {
+      continue;
+    }
+    int first = pool->count;
+    trees[n] = node->value.stmt->expr;
+    roots[n] = vcc_expr_pool_add(pool, trees[n]);
+    // the copy is one run ending at its root
+    if (compare(trees[n], pool, roots[n]) != (int)roots[n] - first + 1) {
+      fprintf(stderr, "expression %d was not copied right\n", n);
+      failed = 1;
+    }
+    ++n;
+  }
+  if (n != EXPRS) {
+    fprintf(stderr, "parsed %d expressions of %d\n", n, EXPRS);
+    failed = 1;
+  }
+  int *values = xalloc(pool->count * sizeof(int));
+  vcc_expr_pool_eval(pool, values);
+  for (int i = 0; i < n; ++i) {
+    if (values[roots[i]] != vcc_expr_eval(trees[i])) {
+      fprintf(stderr, "expression %d: %d in the pool, %d in the tree\n", i,
+              values[roots[i]], vcc_expr_eval(trees[i]));
+      failed = 1;
+    }
+  }
+  xfree(values);
+  xfree(roots);
+  xfree(trees);
+  vcc_expr_pool_free(pool);
+  vcc_parser_finish();
+  vcc_tokbuf_free(tokens);
+  vcc_lexer_free(lexer);
+  buf_free(src);
+  return failed;
+}
+
+/* -(2 - 10) * 3 == 24, built straight into a pool
+ */
+static int check_built() {
+  vcc_expr_pool_t *pool = vcc_expr_pool_new();
+  uint32_t diff = vcc_expr_pool_binary(pool, vcc_expr_pool_int(pool, 2),
+                                       TOKEN_SUB, vcc_expr_pool_int(pool, 10));
+  uint32_t prod =
+      vcc_expr_pool_binary(pool, vcc_expr_pool_unary(pool, TOKEN_SUB, diff),
+                           TOKEN_ASTERISK, vcc_expr_pool_int(pool, 3));
+  uint32_t root = vcc_expr_pool_binary(pool, prod, TOKEN_EQ,
+                                       vcc_expr_pool_int(pool, 24));
+  int values[16];
+  vcc_expr_pool_eval(pool, values);
+  int failed = values[prod] != 24 || values[root] != 1;
+  vcc_expr_pool_free(pool);
+  return failed;
+}
+
+int main() {
+  int failed = check_parsed();
+  failed |= check_built();
+  fprintf(stderr, "%s\n", failed ? "failed" : "ok");
+  return failed;
+}
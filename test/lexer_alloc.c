@@ -0,0 +1,53 @@
+/* checks that lexing fixed-spelling tokens never calls malloc: tokens come
+ * from the lexer arena and are recycled once released
+ */
+#include "../src/lexer.h"
+
+#define REPEAT 20000
+
+static const char punct[] =
+    "; ( ) { } [ ] , . : == != <= >= && || += -> ++ -- ";
+
+int main() {
+  int plen = strlen(punct);
+  int len = plen * REPEAT;
+  char *src = xalloc(len);
+  for (int i = 0; i < REPEAT; ++i) {
+    memcpy(src + i * plen, punct, plen);
+  }
+
+  int failed = 0;
+
+  /* tokens released as they are consumed, like the parser does
+   */
+  vcc_lexer_t *lexer = vcc_lexer_new_from_mem("punct", src, len);
+  size_t before = xalloc_count();
+  long ntokens = 0;
+  vtoken_t *t;
+  while ((t = vcc_lex(lexer)) && t->type != TOKEN_EOF) {
+    ++ntokens;
+    vtoken_free(lexer, t);
+  }
+  size_t mallocs = xalloc_count() - before;
+  printf("released: %ld tokens, %zu mallocs\n", ntokens, mallocs);
+  failed |= mallocs != 0;
+  vcc_lexer_free(lexer);
+
+  /* tokens kept alive, only arena chunks may be allocated
+   */
+  lexer = vcc_lexer_new_from_mem("punct", src, len);
+  before = xalloc_count();
+  int nchunks = lexer->tokens->nchunks;
+  ntokens = 0;
+  while ((t = vcc_lex(lexer)) && t->type != TOKEN_EOF) {
+    ++ntokens;
+  }
+  mallocs = xalloc_count() - before;
+  printf("kept: %ld tokens, %zu mallocs, %d arena chunks\n", ntokens, mallocs,
+         lexer->tokens->nchunks - nchunks);
+  failed |= mallocs != (size_t)(lexer->tokens->nchunks - nchunks);
+  vcc_lexer_free(lexer);
+
+  xfree(src);
+  return failed;
+}
@@ -0,0 +1,137 @@
+/* number literals: every base, suffix and exponent form gives the right
+ * type, flags and value, bad literals are errors, and random floats are
+ * rounded exactly like strtod() and strtof() do
+ */
+#include "../src/lexer.h"
+
+typedef struct {
+  const char *src;
+  int type; // TOKEN_EOF for an error
+  int flags;
+  int64_t i;
+  double f;
+} case_t;
+
+#define INT(s, fl, v) {s, TOKEN_INT, fl, v, 0}
+#define FLT(s, fl, v) {s, TOKEN_FLOAT, fl, 0, v}
+#define BAD(s) {s, TOKEN_EOF, 0, 0, 0}
+
+static const case_t cases[] = {
+    INT("0", 0, 0),
+    INT("42", 0, 42),
+    INT("2147483648", 0, 2147483648ll),
+    INT("9223372036854775807", 0, INT64_MAX),
+    INT("18446744073709551615u", VCC_LIT_UNSIGNED, -1),
+    INT("0x7f", 0, 127),
+    INT("0XdeadBEEF", 0, 0xdeadbeefll),
+    INT("0xffffffffffffffff", 0, -1),
+    INT("017", 0, 15),
+    INT("0b1011", 0, 11),
+    INT("10u", VCC_LIT_UNSIGNED, 10),
+    INT("10L", VCC_LIT_LONG, 10),
+    INT("10ul", VCC_LIT_UNSIGNED | VCC_LIT_LONG, 10),
+    INT("10LU", VCC_LIT_UNSIGNED | VCC_LIT_LONG, 10),
+    INT("10ll", VCC_LIT_LONG_LONG, 10),
+    INT("10ULL", VCC_LIT_UNSIGNED | VCC_LIT_LONG_LONG, 10),
+    INT("10llu", VCC_LIT_UNSIGNED | VCC_LIT_LONG_LONG, 10),
+    FLT("0.25", 0, 0.25),
+    FLT("1.", 0, 1.0),
+    FLT(".5", 0, 0.5),
+    FLT("1e3", 0, 1e3),
+    FLT("1.5E-3", 0, 1.5e-3),
+    FLT("2.5e+2", 0, 250.0),
+    FLT("09.5", 0, 9.5),
+    FLT("0.1f", VCC_LIT_FLOAT, 0.1f),
+    FLT("3.0L", VCC_LIT_LONG, 3.0),
+    FLT("0x1.8p1", 0, 3.0),
+    FLT("0x10P-2f", VCC_LIT_FLOAT, 4.0),
+    FLT("1e400", 0, __builtin_inf()),
+    FLT("123456789012345678901234567890.", 0, 123456789012345678901234567890.),
+    FLT("0.000000000000000000000000000001", 0, 1e-30),
+    FLT("2.2250738585072011e-308", 0, 2.2250738585072011e-308),
+    BAD("0x"),
+    BAD("0b"),
+    BAD("0b102"),
+    BAD("08"),
+    BAD("1e"),
+    BAD("1e+"),
+    BAD("0x1.8"),
+    BAD("12abc"),
+    BAD("1.5u"),
+    BAD("10lL"),
+    BAD("10uu"),
+    BAD("18446744073709551616"),
+    BAD("1.5.2"),
+};
+
+static int check(const case_t *c) {
+  vcc_lexer_t *lexer = vcc_lexer_new_from_mem("case", c->src, strlen(c->src));
+  vtoken_t *t = vcc_lex(lexer);
+  int ok;
+  if (c->type == TOKEN_EOF) {
+    ok = t == NULL;
+  } else {
+    ok = t && t->type == c->type && t->flags == c->flags &&
+         t->len == strlen(c->src) &&
+         (c->type == TOKEN_INT ? t->value.i == c->i
+                               : !memcmp(&t->value.f, &c->f, sizeof(double)));
+  }
+  if (!ok) {
+    fprintf(stderr, "`%s` lexed wrong\n", c->src);
+  }
+  vtoken_free(lexer, t);
+  vcc_lexer_free(lexer);
+  return !ok;
+}
+
+/* random decimal floats of up to 25 digits and wide exponents
+ */
+static int check_random(int rounds) {
+  int failed = 0;
+  srand(1);
+  for (int r = 0; r < rounds; ++r) {
+    char src[64];
+    int n = 0;
+    int ndigits = 1 + rand() % 25;
+    int dot = rand() % (ndigits + 1);
+    for (int i = 0; i < ndigits; ++i) {
+      if (i == dot) {
+        src[n++] = '.';
+      }
+      src[n++] = '0' + rand() % 10;
+    }
+    if (dot == ndigits) {
+      src[n++] = '.';
+    }
+    if (rand() % 2) {
+      n += sprintf(src + n, "e%d", rand() % 700 - 350);
+    }
+    int is_float = rand() % 4 == 0;
+    src[n] = '\0';
+    double expected = is_float ? strtof(src, NULL) : strtod(src, NULL);
+    if (is_float) {
+      src[n++] = 'f';
+      src[n] = '\0';
+    }
+    vcc_lexer_t *lexer = vcc_lexer_new_from_mem("random", src, n);
+    vtoken_t *t = vcc_lex(lexer);
+    if (!t || t->type != TOKEN_FLOAT ||
+        memcmp(&t->value.f, &expected, sizeof(double))) {
+      fprintf(stderr, "`%s` rounded wrong\n", src);
+      failed = 1;
+    }
+    vtoken_free(lexer, t);
+    vcc_lexer_free(lexer);
+  }
+  return failed;
+}
+
+int main() {
+  int failed = 0;
+  for (size_t i = 0; i < sizeof(cases) / sizeof(*cases); ++i) {
+    failed |= check(&cases[i]);
+  }
+  failed |= check_random(100000);
+  printf("%s\n", failed ? "failed" : "ok");
+  return failed;
+}
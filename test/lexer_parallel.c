@@ -0,0 +1,171 @@
+/* lexing a file in speculative chunks on many threads must give exactly the
+ * tokens of vcc_lex_all(): every file given on the command line, and
+ * generated sources whose comments, strings and directives run over the
+ * cuts, are lexed in every number of chunks up to one per line
+ */
+#include "../src/lexer.h"
+
+#define LINES 2000
+
+/* compares two token buffers of the same source, atoms by spelling since
+ * the tables differ
+ */
+static int same_tokens(vcc_lexer_t *la, vcc_tokbuf_t *a, vcc_lexer_t *lb,
+                       vcc_tokbuf_t *b) {
+  if (a->count != b->count || a->error != b->error) {
+    return 0;
+  }
+  for (int i = 0; i < a->count; ++i) {
+    vtoken_t ta, tb;
+    vcc_tokbuf_get(a, i, &ta);
+    vcc_tokbuf_get(b, i, &tb);
+    if (ta.type != tb.type || ta.offset != tb.offset || ta.len != tb.len) {
+      return 0;
+    }
+    if (ta.type == TOKEN_INT || ta.type == TOKEN_FLOAT) {
+      if (ta.flags != tb.flags ||
+          memcmp(&ta.value, &tb.value, sizeof(ta.value))) {
+        return 0;
+      }
+    } else if (vtoken_has_atom(&ta) &&
+               strcmp(vtoken_view(la, &ta), vtoken_view(lb, &tb))) {
+      return 0;
+    }
+  }
+  return 1;
+}
+
+/* lexes `src` in `nchunks` chunks, returns the number of chunks relexed or
+ * -1 if the tokens differ
+ */
+static int check(const char *name, const char *src, int len, int nchunks,
+                 int directives) {
+  vcc_lexer_t *ref = vcc_lexer_new_from_mem(name, src, len);
+  vcc_lexer_t *lexer = vcc_lexer_new_from_mem(name, src, len);
+  if (directives) {
+    vcc_lexer_keep_directives(ref);
+    vcc_lexer_keep_directives(lexer);
+  }
+  vcc_tokbuf_t *a = vcc_lex_all(ref);
+  int relexed;
+  vcc_tokbuf_t *b = vcc_lex_all_parallel(lexer, nchunks, &relexed);
+  if (!same_tokens(ref, a, lexer, b)) {
+    fprintf(stderr, "%s in %d chunks%s: %d and %d tokens differ\n", name,
+            nchunks, directives ? " with directives" : "", a->count,
+            b->count);
+    relexed = -1;
+  }
+  vcc_tokbuf_free(a);
+  vcc_tokbuf_free(b);
+  vcc_lexer_free(ref);
+  vcc_lexer_free(lexer);
+  return relexed;
+}
+
+/* statements one per line, a chunk never guesses wrong
+ */
+static buf_t *generate_plain() {
+  buf_t *out = buf_new(LINES * 64);
+  char *p = out->s;
+  for (int i = 0; i < LINES; ++i) {
+    p += sprintf(p, "int a%d = %d + 0x%x * %d.5f;\n", i, i, i, i);
+  }
+  out->len = p - out->s;
+  return out;
+}
+
+/* lines that each start inside something else
+ */
+static buf_t *generate_tricky() {
+  static const char *lines[] = {
+      "/* a comment\n",
+      "   int in_comment = \"not a string;\n",
+      "   // nor a line comment */ int after;\n",
+      "char *s = \"a string with /* in it\";\n",
+      "int x = 1; /* two\n",
+      "  lines */ x = '\"';\n",
+      "#define LONG(a) \\\n",
+      "  a + \\\n",
+      "  1\n",
+      "/* # not a directive\n",
+      "# nor this */ int y = 0;\n",
+      "/*/ still a comment\n",
+      " /* nested */ */ float z = .5e3;\n",
+      "char c = '\\'';\n",
+      "#if 0 /* a comment\n",
+      "   in a directive */ + 1\n",
+      "#endif\n",
+      "\n",
+      "   \n",
+      "s = \"escaped \\\" quote\"; // line /* comment\n",
+  };
+  int nlines = sizeof(lines) / sizeof(*lines);
+  buf_t *out = buf_new(LINES * 64);
+  char *p = out->s;
+  for (int i = 0; i < LINES; ++i) {
+    p += sprintf(p, "%s", lines[i % nlines]);
+  }
+  out->len = p - out->s;
+  return out;
+}
+
+static int line_start(buf_t *src, int line) {
+  int offset = 0;
+  for (; line > 0; --line) {
+    offset = (char *)memchr(src->s + offset, '\n', src->len - offset) -
+             src->s + 1;
+  }
+  return offset;
+}
+
+int main(int argc, char *argv[]) {
+  static const int counts[] = {2, 3, 4, 7, 16, 61, 256, LINES};
+  int ncounts = sizeof(counts) / sizeof(*counts);
+  int failed = 0;
+  for (int i = 1; i < argc; ++i) {
+    size_t len;
+    char *src = file_map(argv[i], &len);
+    if (!src) {
+      fprintf(stderr, "could not map `%s`\n", argv[i]);
+      return 1;
+    }
+    for (int n = 1; n <= 32; ++n) {
+      failed |= check(argv[i], src, len, n, 0) < 0;
+      failed |= check(argv[i], src, len, n, 1) < 0;
+    }
+    file_unmap(src, len);
+  }
+
+  buf_t *plain = generate_plain();
+  for (int i = 0; i < ncounts; ++i) {
+    int relexed = check("plain", plain->s, plain->len, counts[i], 0);
+    if (relexed != 0) {
+      fprintf(stderr, "plain in %d chunks: %d relexed\n", counts[i], relexed);
+      failed = 1;
+    }
+  }
+  buf_free(plain);
+
+  buf_t *tricky = generate_tricky();
+  for (int i = 0; i < ncounts; ++i) {
+    for (int directives = 0; directives <= 1; ++directives) {
+      int relexed =
+          check("tricky", tricky->s, tricky->len, counts[i], directives);
+      if (relexed < 0 || (counts[i] == LINES && relexed == 0)) {
+        failed = 1;
+      }
+    }
+  }
+  // an error halfway, and a comment that never ends on the last line
+  tricky->s[line_start(tricky, LINES / 2)] = '@';
+  for (int i = 0; i < ncounts; ++i) {
+    failed |= check("error", tricky->s, tricky->len, counts[i], 1) < 0;
+  }
+  memcpy(tricky->s + line_start(tricky, LINES - 1), "/*", 2);
+  for (int i = 0; i < ncounts; ++i) {
+    failed |= check("no ending", tricky->s, tricky->len, counts[i], 0) < 0;
+  }
+  buf_free(tricky);
+  printf("%s\n", failed ? "failed" : "ok");
+  return failed;
+}
@@ -0,0 +1,153 @@
+/* differential test of the byte scanning kernels: every kernel set the cpu
+ * supports must give exactly the same answers as the scalar one, both on
+ * its own and when driving the lexer
+ */
+#include "../src/lexer.h"
+
+#define SIZE 4096
+#define ROUNDS 200
+
+static const vcc_scan_ops_t *kernels[] = {
+#ifdef VCC_SCAN_X86
+    &vcc_scan_sse2,
+    &vcc_scan_avx2,
+#endif
+    NULL};
+
+static int supported(const vcc_scan_ops_t *ops) {
+#ifdef VCC_SCAN_X86
+  __builtin_cpu_init();
+  if (ops == &vcc_scan_avx2) {
+    return __builtin_cpu_supports("avx2");
+  }
+#endif
+  return 1;
+}
+
+/* random text made mostly of the bytes the kernels look for
+ */
+static void fill(char *s, int len) {
+  static const char alphabet[] = "  \n\n\t/*\"\\#ab;";
+  for (int i = 0; i < len; ++i) {
+    s[i] = alphabet[rand() % (sizeof(alphabet) - 1)];
+  }
+}
+
+static int check_kernels(const vcc_scan_ops_t *ops) {
+  const vcc_scan_ops_t *ref = &vcc_scan_scalar;
+  static const char pairs[][2] = {{'\n', '\n'}, {'/', '*'}, {'"', '\\'}};
+  char s[SIZE];
+  for (int r = 0; r < ROUNDS; ++r) {
+    fill(s, SIZE);
+    // sparse input exercises the full-width loops
+    if (r & 1) {
+      for (int i = 0; i < SIZE; ++i) {
+        if (rand() % 64) {
+          s[i] = r & 2 ? ' ' : 'x';
+        }
+      }
+    }
+    for (int start = 0; start < 70; ++start) {
+      const char *end = s + SIZE - rand() % 70;
+      for (int k = 0; k < 3; ++k) {
+        if (ops->find2(s + start, end, pairs[k][0], pairs[k][1]) !=
+            ref->find2(s + start, end, pairs[k][0], pairs[k][1])) {
+          printf("%s: find2 '%c' '%c' differs\n", ops->name, pairs[k][0],
+                 pairs[k][1]);
+          return 1;
+        }
+      }
+      if (ops->skip_space(s + start, end) != ref->skip_space(s + start, end)) {
+        printf("%s: skip_space differs\n", ops->name);
+        return 1;
+      }
+      if (ops->count(s + start, end, '\n') != ref->count(s + start, end, '\n')) {
+        printf("%s: count differs\n", ops->name);
+        return 1;
+      }
+    }
+  }
+  return 0;
+}
+
+/* C-ish source full of long comments, strings and preprocessor lines
+ */
+static buf_t *corpus() {
+  buf_t *b = buf_new(1 << 20);
+  char *p = b->s;
+  for (int i = 0; i < 2000; ++i) {
+    switch (rand() % 6) {
+    case 0:
+      p += sprintf(p, "/* license header line %d\n * more text /* nested */\n"
+                      "   */\n",
+                   i);
+      break;
+    case 1:
+      p += sprintf(p, "#include \"header_%d.h\"\n", i);
+      break;
+    case 2:
+      p += sprintf(p, "s = \"a long string literal with \\\"escapes\\\" and "
+                      "\\\\ backslashes %d\";\n",
+                   i);
+      break;
+    case 3:
+      p += sprintf(p, "// a line comment %d\n", i);
+      break;
+    case 4:
+      p += sprintf(p, "%*sif (a%d <= %d) {\n\n}\n", rand() % 40, "", i, i);
+      break;
+    default:
+      p += sprintf(p, "return x;%*s\n", rand() % 40, "");
+      break;
+    }
+  }
+  b->len = p - b->s;
+  return b;
+}
+
+/* lexes `src` with `ops`, recording every token and the lexer position
+ */
+static buf_t *lex_with(const vcc_scan_ops_t *ops, buf_t *src) {
+  buf_t *out = buf_new(1 << 22);
+  vcc_lexer_t *lexer = vcc_lexer_new_from_mem("corpus", src->s, src->len);
+  lexer->scan = ops;
+  vtoken_t *t;
+  while ((t = vcc_lex(lexer))) {
+    int line, col;
+    vcc_lexer_locate(lexer, t->offset, &line, &col);
+    out->len += sprintf(out->s + out->len, "%d %u %u %d %d\n", t->type,
+                        t->offset, t->len, line, col);
+    int type = t->type;
+    vtoken_free(lexer, t);
+    if (type == TOKEN_EOF) {
+      break;
+    }
+  }
+  vcc_lexer_free(lexer);
+  return out;
+}
+
+int main() {
+  int failed = 0;
+  srand(42);
+  buf_t *src = corpus();
+  buf_t *expected = lex_with(&vcc_scan_scalar, src);
+  for (int i = 0; kernels[i]; ++i) {
+    if (!supported(kernels[i])) {
+      printf("%s: not supported, skipped\n", kernels[i]->name);
+      continue;
+    }
+    int bad = check_kernels(kernels[i]);
+    buf_t *got = lex_with(kernels[i], src);
+    if (got->len != expected->len || memcmp(got->s, expected->s, got->len)) {
+      printf("%s: token stream differs\n", kernels[i]->name);
+      bad = 1;
+    }
+    buf_free(got);
+    printf("%s: %s\n", kernels[i]->name, bad ? "FAILED" : "ok");
+    failed |= bad;
+  }
+  buf_free(expected);
+  buf_free(src);
+  return failed;
+}
@@ -0,0 +1,182 @@
+/* the streaming lexer must give the same tokens as the in-memory one: every
+ * file given on the command line, and a generated source full of long
+ * comments, strings and identifiers, is fed through a pipe in odd-sized
+ * writes and lexed with windows small enough that many tokens span a
+ * boundary
+ */
+#include "../src/lexer.h"
+#include <pthread.h>
+#include <unistd.h>
+
+#define LONG_TOKEN 10000
+
+typedef struct {
+  int fd;
+  const char *src;
+  int len;
+} writer_t;
+
+static void *write_pipe(void *arg) {
+  writer_t *w = arg;
+  for (int off = 0; off < w->len;) {
+    int n = w->len - off < 7 ? w->len - off : 7;
+    n = write(w->fd, w->src + off, n);
+    if (n <= 0) {
+      break;
+    }
+    off += n;
+  }
+  close(w->fd);
+  return NULL;
+}
+
+/* line and column of `offset`, the slow way, offsets only go forward
+ */
+typedef struct {
+  uint32_t offset;
+  int line;
+  int col;
+} cursor_t;
+
+static void locate(const char *src, cursor_t *at, uint32_t offset) {
+  for (; at->offset < offset; ++at->offset) {
+    if (src[at->offset] == '\n') {
+      ++at->line;
+      at->col = 1;
+    } else {
+      ++at->col;
+    }
+  }
+}
+
+/* compares one token and its position with the reference
+ */
+static int same_token(const char *src, cursor_t *at, vcc_lexer_t *la,
+                      vtoken_t *a, vcc_lexer_t *lb, vtoken_t *b) {
+  if (!a || !b) {
+    return !a && !b;
+  }
+  if (a->type != b->type || a->offset != b->offset || a->len != b->len) {
+    return 0;
+  }
+  int line_a, col_a, line_b, col_b;
+  locate(src, at, a->offset);
+  vcc_lexer_locate(la, a->offset, &line_a, &col_a);
+  vcc_lexer_locate(lb, b->offset, &line_b, &col_b);
+  if (at->line != line_a || at->col != col_a || at->line != line_b ||
+      at->col != col_b) {
+    return 0;
+  }
+  switch (a->type) {
+  case TOKEN_INT:
+    return a->value.i == b->value.i;
+  case TOKEN_FLOAT:
+    return a->value.f == b->value.f;
+  default:
+    return !memcmp(vtoken_view(la, a), vtoken_view(lb, b), a->len);
+  }
+}
+
+/* lexes `src` from memory and from a pipe with a `window` byte window
+ */
+static int check(const char *name, const char *src, int len, int window,
+                 int max_cap) {
+  int fds[2];
+  if (pipe(fds)) {
+    perror("pipe");
+    return 1;
+  }
+  writer_t w = {.fd = fds[1], .src = src, .len = len};
+  pthread_t writer;
+  pthread_create(&writer, NULL, write_pipe, &w);
+  FILE *fp = fdopen(fds[0], "rb");
+
+  vcc_lexer_t *ref = vcc_lexer_new_from_mem(name, src, len);
+  vcc_lexer_t *lexer = vcc_lexer_new_stream(name, fp, window);
+  int failed = 0, count = 0;
+  cursor_t at = {.line = 1, .col = 1};
+  while (1) {
+    vtoken_t *a = vcc_lex(ref);
+    vtoken_t *b = vcc_lex(lexer);
+    if (!same_token(src, &at, ref, a, lexer, b)) {
+      fprintf(stderr, "%s, window %d: token %d differs\n", name, window,
+              count);
+      failed = 1;
+    }
+    int done = !a || !b || a->type == TOKEN_EOF;
+    vtoken_free(ref, a);
+    vtoken_free(lexer, b);
+    ++count;
+    if (done || failed) {
+      break;
+    }
+  }
+  if (lexer->cap > max_cap) {
+    fprintf(stderr, "%s, window %d: grew to %d bytes\n", name, window,
+            lexer->cap);
+    failed = 1;
+  }
+  vcc_lexer_free(lexer);
+  vcc_lexer_free(ref);
+  pthread_join(writer, NULL);
+  fclose(fp);
+  return failed;
+}
+
+/* a source whose long tokens cross any window boundary
+ */
+static buf_t *generate() {
+  int cap = 8 * LONG_TOKEN + 64 * 1024;
+  buf_t *out = buf_new(cap);
+  char *p = out->s;
+  p += sprintf(p, "int a = 1;\n/* long\n");
+  for (int i = 0; i < LONG_TOKEN / 8; ++i) {
+    p += sprintf(p, "x/*\n */ *");
+  }
+  p += sprintf(p, "*/\nchar *s = \"");
+  for (int i = 0; i < LONG_TOKEN; ++i) {
+    *p++ = "y\\\""[i % 3]; // y\" over and over
+  }
+  p += sprintf(p, "\";\nint ");
+  for (int i = 0; i < LONG_TOKEN; ++i) {
+    *p++ = 'a' + i % 26;
+  }
+  p += sprintf(p, " = 2;\n// line comment\n# define X\n");
+  for (int i = 0; i < 500; ++i) {
+    p += sprintf(p, "if (b%d >= %d.5) {\n  c += \"s%d\" - '\\n';\n}\n", i, i,
+                 i);
+  }
+  for (int i = 0; i < 500; ++i) { // blank runs past the lookahead
+    p += sprintf(p, "d%*s\n%*s\n\n;", i % 97, "", i % 5, "");
+  }
+  out->len = p - out->s;
+  return out;
+}
+
+int main(int argc, char *argv[]) {
+  static const int windows[] = {32, 61, 256, 4096, 0};
+  int failed = 0;
+  for (int i = 1; i < argc; ++i) {
+    size_t len;
+    char *src = file_map(argv[i], &len);
+    if (!src) {
+      fprintf(stderr, "could not map `%s`\n", argv[i]);
+      return 1;
+    }
+    for (size_t w = 0; w < sizeof(windows) / sizeof(*windows); ++w) {
+      failed |= check(argv[i], src, len, windows[w], VCC_LEXER_WINDOW_SIZE);
+    }
+    file_unmap(src, len);
+  }
+  buf_t *src = generate();
+  for (size_t w = 0; w < sizeof(windows) / sizeof(*windows); ++w) {
+    // only the long string and identifier may grow the window
+    failed |= check("generated", src->s, src->len, windows[w],
+                    VCC_LEXER_WINDOW_SIZE > 4 * LONG_TOKEN
+                        ? VCC_LEXER_WINDOW_SIZE
+                        : 4 * LONG_TOKEN);
+  }
+  buf_free(src);
+  printf("%s\n", failed ? "failed" : "ok");
+  return failed;
+}
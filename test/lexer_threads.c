@@ -0,0 +1,110 @@
+/* stress test for the reentrant lexer: every file given on the command line
+ * is lexed once on the main thread, then lexed again by many threads at the
+ * same time, from both a read buffer and a mapping, and each stream must
+ * match the single-threaded one
+ */
+#include "../src/lexer.h"
+#include <pthread.h>
+
+#define THREADS 16
+#define ROUNDS 64
+
+typedef struct {
+  int nfiles;
+  char **fnames;
+  buf_t **expected;
+  int failed;
+} job_t;
+
+/* dumps the whole token stream of `fname` to a string
+ */
+static buf_t *lex_to_buf(const char *fname, int map) {
+  int cap = 4096;
+  buf_t *out = buf_new(cap);
+  vcc_lexer_t *lexer = map ? vcc_lexer_new_mmap(fname) : vcc_lexer_new(fname);
+  vtoken_t *t;
+  int type;
+  do {
+    char line[BUF_MAX_SIZE + 64];
+    t = vcc_lex(lexer);
+    if (!t) {
+      snprintf(line, sizeof(line), "(null)\n");
+      type = TOKEN_EOF;
+    } else {
+      type = t->type;
+      switch (type) {
+      case TOKEN_INT:
+        snprintf(line, sizeof(line), "%s %lld\n", token_names[type],
+                 (long long)t->value.i);
+        break;
+      case TOKEN_FLOAT:
+        snprintf(line, sizeof(line), "%s %f\n", token_names[type], t->value.f);
+        break;
+      default:
+        snprintf(line, sizeof(line), "%s %.*s\n", token_names[type], t->len,
+                 vtoken_view(lexer, t));
+        break;
+      }
+      vtoken_free(lexer, t);
+    }
+    int len = strlen(line);
+    if (out->len + len >= cap) {
+      cap = (cap + len) * 2;
+      char *s = xalloc(cap + 1);
+      memcpy(s, out->s, out->len);
+      xfree(out->s);
+      out->s = s;
+    }
+    memcpy(out->s + out->len, line, len);
+    out->len += len;
+  } while (type != TOKEN_EOF);
+  vcc_lexer_free(lexer);
+  return out;
+}
+
+static void *worker(void *arg) {
+  job_t *job = arg;
+  for (int r = 0; r < ROUNDS; ++r) {
+    for (int i = 0; i < job->nfiles; ++i) {
+      buf_t *got = lex_to_buf(job->fnames[i], (r + i) & 1);
+      if (got->len != job->expected[i]->len ||
+          memcmp(got->s, job->expected[i]->s, got->len)) {
+        fprintf(stderr, "token stream of `%s` differs\n", job->fnames[i]);
+        job->failed = 1;
+      }
+      buf_free(got);
+    }
+  }
+  return NULL;
+}
+
+int main(int argc, char *argv[]) {
+  if (argc < 2) {
+    printf("%s [filename...]\n", argv[0]);
+    return -1;
+  }
+  int nfiles = argc - 1;
+  buf_t *expected[nfiles];
+  for (int i = 0; i < nfiles; ++i) {
+    expected[i] = lex_to_buf(argv[i + 1], 0);
+  }
+
+  pthread_t threads[THREADS];
+  job_t jobs[THREADS];
+  for (int i = 0; i < THREADS; ++i) {
+    jobs[i] = (job_t){nfiles, argv + 1, expected, 0};
+    pthread_create(&threads[i], NULL, worker, &jobs[i]);
+  }
+  int failed = 0;
+  for (int i = 0; i < THREADS; ++i) {
+    pthread_join(threads[i], NULL);
+    failed |= jobs[i].failed;
+  }
+
+  for (int i = 0; i < nfiles; ++i) {
+    buf_free(expected[i]);
+  }
+  printf("%d threads x %d rounds x %d files: %s\n", THREADS, ROUNDS, nfiles,
+         failed ? "FAILED" : "ok");
+  return failed;
+}
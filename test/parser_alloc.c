@@ -0,0 +1,83 @@
+/* checks that the AST of a translation unit comes from its arena: parsing
+ * calls malloc only for arena chunks, and a unit edited over and over keeps
+ * its arena within a bound of the live nodes
+ */
+#include "../src/parser.h"
+
+#define REPEAT 20000
+#define EDITS 2000
+#define UNIT_LINES 400
+
+static const char *lines[] = {
+    "if (1 + 2 * (3 - 4)) {\n",
+    "return (5 / 6) == 7;\n",
+    "}\n",
+    "return -8 < 9 != !NULL;\n",
+};
+
+static buf_t *generate() {
+  buf_t *out = buf_new(REPEAT * 32);
+  for (int i = 0; i < REPEAT; ++i) {
+    out->len += sprintf(out->s + out->len, "%s", lines[i % 4]);
+  }
+  return out;
+}
+
+int main() {
+  buf_t *src = generate();
+  int failed = 0;
+
+  /* a whole file into an arena of the caller
+   */
+  vcc_lexer_t *lexer = vcc_lexer_new_from_mem("alloc", src->s, src->len);
+  vcc_tokbuf_t *tokens = vcc_lex_all(lexer);
+  arena_t *arena = arena_new(AST_ARENA_CHUNK_SIZE);
+  vcc_parser_init_tokens(lexer, tokens);
+  vcc_parser_set_arena(arena);
+  size_t before = xalloc_count();
+  long nodes = 0;
+  while (vcc_parser_continuable()) {
+    nodes += vcc_parse() != NULL;
+  }
+  size_t mallocs = xalloc_count() - before;
+  fprintf(stderr, "parsed: %ld nodes, %zu bytes, %zu mallocs, %d chunks\n",
+          nodes, arena->used, mallocs, arena->nchunks - 1);
+  failed |= mallocs != (size_t)(arena->nchunks - 1);
+  vcc_parser_finish();
+  arena_free(arena);
+  vcc_tokbuf_free(tokens);
+  vcc_lexer_free(lexer);
+
+  /* one digit written over again and again, the nodes it drops are taken back
+   * by parsing the unit again once they outweigh the live ones
+   */
+  const char *end = src->s;
+  for (int i = 0; i < UNIT_LINES; ++i) {
+    end = strchr(end, '\n') + 1;
+  }
+  vcc_unit_t *unit = vcc_unit_new("alloc", src->s, end - src->s);
+  size_t live = unit->arena->used;
+  long reparsed = 0;
+  srand(1);
+  for (int i = 0; i < EDITS; ++i) {
+    int len = unit->src->len, at = rand() % len;
+    const char *one = memchr(unit->src->s + at, '1', len - at);
+    one = one ? one : memchr(unit->src->s, '1', len);
+    vcc_edit_t edit = {.offset = one - unit->src->s, 1, "1", 1};
+    vcc_reuse_t reuse;
+    failed |= !vcc_unit_edit(unit, &edit, &reuse);
+    reparsed += reuse.nodes_parsed > unit->count;
+    if (unit->arena->used > 2 * live + 2 * AST_ARENA_CHUNK_SIZE) {
+      fprintf(stderr, "edit %d: %zu bytes in the arena for %zu live\n", i,
+              unit->arena->used, live);
+      failed = 1;
+      break;
+    }
+  }
+  fprintf(stderr, "edited: %d edits, %ld whole reparses\n", EDITS, reparsed);
+  vcc_unit_free(unit);
+
+  buf_free(src);
+  fprintf(stderr, "%s\n", failed ? "failed" : "ok");
+  return failed;
+}
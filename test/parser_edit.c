@@ -0,0 +1,171 @@
+/* editing a unit must leave it with the tokens and nodes of a unit made
+ * from the edited text: random edits of a generated source are checked
+ * against a fresh unit each, and a small edit of a large source must lex
+ * and parse only a few tokens and nodes again
+ */
+#include "../src/parser.h"
+
+#define LINES 100
+#define EDITS 3000
+#define LARGE_LINES 20000
+
+static const char *lines[] = {
+    "if (1 + 2 * (3 - 4)) {\n", "return (5 / 6) == 7;\n",
+    "x = y;\n",                 "/* a comment */\n",
+    "}\n",                      "return -8 < 9 != !NULL;\n",
+    "s = \"string\";\n",        "if ((10)) {\n",
+};
+
+static const char *snippets[] = {
+    "if (", "return ", "1", "23", " + ", " * ", "(", ")", ";", "{",
+    "}",    "/*",      "*/", "\"", "\n", " ",   "x", "..", ".", "#",
+};
+
+/* compares two expressions of two units, names by spelling since the
+ * tables differ
+ */
+static int same_expr(vcc_unit_t *ua, vcc_expr_t *a, vcc_unit_t *ub,
+                     vcc_expr_t *b) {
+  if (!a || !b) {
+    return !a && !b;
+  }
+  if (a->arity != b->arity || a->opr != b->opr) {
+    return 0;
+  }
+  if (a->arity == 0 && a->opr != TOKEN_INT) {
+    if (strcmp(vcc_symtbl_name(ua->symtbl, a->literal.atom, NULL),
+               vcc_symtbl_name(ub->symtbl, b->literal.atom, NULL))) {
+      return 0;
+    }
+  } else if (a->literal.number != b->literal.number) {
+    return 0;
+  }
+  return same_expr(ua, a->lhs, ub, b->lhs) &&
+         same_expr(ua, a->rhs, ub, b->rhs) &&
+         same_expr(ua, a->next, ub, b->next);
+}
+
+static int same_node(vcc_unit_t *ua, vcc_node_t *a, vcc_unit_t *ub,
+                     vcc_node_t *b) {
+  if (!a || !b) {
+    return !a && !b;
+  }
+  if (a->type != b->type) {
+    return 0;
+  }
+  if (a->type != VCC_NODE_STMT) {
+    return 1;
+  }
+  vcc_stmt_t *sa = a->value.stmt, *sb = b->value.stmt;
+  return sa->type == sb->type &&
+         same_expr(ua, sa->condition, ub, sb->condition) &&
+         same_expr(ua, sa->expr, ub, sb->expr);
+}
+
+/* compares an edited unit with one made from its text
+ */
+static int same_unit(vcc_unit_t *edited, vcc_unit_t *fresh) {
+  vcc_tokbuf_t *a = edited->tokens, *b = fresh->tokens;
+  if (a->count != b->count || a->error != b->error ||
+      edited->count != fresh->count || edited->error != fresh->error) {
+    return 0;
+  }
+  for (int i = 0; i < a->count; ++i) {
+    vtoken_t ta, tb;
+    vcc_tokbuf_get(a, i, &ta);
+    vcc_tokbuf_get(b, i, &tb);
+    if (ta.type != tb.type || ta.offset != tb.offset || ta.len != tb.len ||
+        (ta.type == TOKEN_INT && ta.value.i != tb.value.i) ||
+        (vtoken_has_atom(&ta) &&
+         strcmp(vtoken_view(edited->lexer, &ta),
+                vtoken_view(fresh->lexer, &tb)))) {
+      return 0;
+    }
+  }
+  for (int i = 0; i < edited->count; ++i) {
+    if (edited->first[i] != fresh->first[i] ||
+        edited->last[i] != fresh->last[i] ||
+        !same_node(edited, edited->nodes[i], fresh, fresh->nodes[i])) {
+      return 0;
+    }
+  }
+  return 1;
+}
+
+static buf_t *generate(int nlines) {
+  buf_t *out = buf_new(nlines * 32);
+  for (int i = 0; i < nlines; ++i) {
+    out->len += sprintf(out->s + out->len, "%s", lines[i % 8]);
+  }
+  return out;
+}
+
+static int check_random() {
+  buf_t *src = generate(LINES);
+  vcc_unit_t *unit = vcc_unit_new("random", src->s, src->len);
+  buf_free(src);
+  srand(1);
+  for (int i = 0; i < EDITS; ++i) {
+    int len = unit->src->len;
+    const char *text = snippets[rand() % 20];
+    vcc_edit_t edit = {.offset = rand() % (len + 1), .text = text};
+    int left = len - edit.offset;
+    edit.removed = rand() % 3 ? 0 : rand() % (left < 8 ? left + 1 : 8);
+    edit.len = rand() % 4 ? strlen(text) : 0;
+    vcc_unit_edit(unit, &edit, NULL);
+    vcc_unit_t *fresh = vcc_unit_new("random", unit->src->s, unit->src->len);
+    int ok = same_unit(unit, fresh);
+    vcc_unit_free(fresh);
+    if (!ok) {
+      fprintf(stderr, "edit %d: %u bytes at %u for `%.*s` went wrong\n", i,
+              edit.removed, edit.offset, edit.len, text);
+      vcc_unit_free(unit);
+      return 1;
+    }
+  }
+  vcc_unit_free(unit);
+  return 0;
+}
+
+/* one digit changed, a line added, and a comment added and taken away, in
+ * the middle of a large source
+ */
+static int check_reuse() {
+  buf_t *src = generate(LARGE_LINES);
+  vcc_unit_t *unit = vcc_unit_new("large", src->s, src->len);
+  buf_free(src);
+  int failed = 0;
+  const char *middle = strstr(unit->src->s + unit->src->len / 2, "(1 + 2");
+  const vcc_edit_t edits[] = {
+      {.offset = middle + 1 - unit->src->s, .removed = 1, "7", 1},
+      {.offset = middle - 3 - unit->src->s, .text = "return 1;\n", .len = 10},
+      {.offset = middle - 3 - unit->src->s, .text = "/* x */", .len = 7},
+      {.offset = middle - 3 - unit->src->s, .removed = 7},
+  };
+  for (size_t i = 0; i < sizeof(edits) / sizeof(*edits); ++i) {
+    vcc_reuse_t reuse;
+    vcc_unit_edit(unit, &edits[i], &reuse);
+    if (reuse.tokens_lexed > 16 || reuse.nodes_parsed > 16 ||
+        reuse.tokens_reused < unit->tokens->count - 16 ||
+        reuse.nodes_reused < unit->count - 16) {
+      fprintf(stderr,
+              "edit %zu: %d tokens lexed, %d reused, %d nodes parsed, %d "
+              "reused\n",
+              i, reuse.tokens_lexed, reuse.tokens_reused, reuse.nodes_parsed,
+              reuse.nodes_reused);
+      failed = 1;
+    }
+  }
+  vcc_unit_t *fresh = vcc_unit_new("large", unit->src->s, unit->src->len);
+  failed |= !same_unit(unit, fresh);
+  vcc_unit_free(fresh);
+  vcc_unit_free(unit);
+  return failed;
+}
+
+int main() {
+  int failed = check_random();
+  failed |= check_reuse();
+  fprintf(stderr, "%s\n", failed ? "failed" : "ok");
+  return failed;
+}
@@ -0,0 +1,190 @@
+/* expressions of every C operator parse with the precedence and
+ * associativity of C, malformed ones are caught, constants are folded
+ * unless C leaves their value undefined, and equal subtrees without side
+ * effects are shared when asked
+ */
+#include "../src/parser.h"
+
+typedef struct {
+  const char *src;      // an expression, parsed as `return src;`
+  const char *expected; // its tree, NULL for an error
+} case_t;
+
+static const case_t cases[] = {
+    {"a + b * c", "(+ a (* b c))"},
+    {"a - b - c", "(- (- a b) c)"},
+    {"a / b % c * d", "(* (% (/ a b) c) d)"},
+    {"a << b + c >> d", "(>> (<< a (+ b c)) d)"},
+    {"a < b == c >= d", "(== (< a b) (>= c d))"},
+    {"a & b ^ c | d && e || f", "(|| (&& (| (^ (& a b) c) d) e) f)"},
+    {"a = b = c", "(= a (= b c))"},
+    {"a += b -= c <<= 1", "(+= a (-= b (<<= c 1)))"},
+    {"a ? b : c ? d : e", "(? a (: b (? c (: d e))))"},
+    {"a ? b, c : d", "(? a (: (, b c) d))"},
+    {"a || b ? c : d", "(? (|| a b) (: c d))"},
+    {"a = b ? c : d", "(= a (? b (: c d)))"},
+    {"a, b = c, d", "(, (, a (= b c)) d)"},
+    {"-a * !b", "(* (- a) (! b))"},
+    {"~-+a", "(~ (- (+ a)))"},
+    {"*p++", "(* (++ p))"},
+    {"++*p", "(++ (* p))"},
+    {"&a[1]", "(& ([ a 1))"},
+    {"sizeof a + 1", "(+ (sizeof a) 1)"},
+    {"a.b->c", "(-> (. a b) c)"},
+    {"f(a, g(b), c + d)(e)", "(( (( f a (( g b) (+ c d)) e)"},
+    {"f()", "(( f)"},
+    {"a--", "(-- a)"},
+    {"(a + b) * c", "(* (+ a b) c)"},
+    {"s = \"str\"", "(= s str)"},
+    {"a ? b", NULL},
+    {"f(1, 2", NULL},
+    {"a[1", NULL},
+    {"a.1", NULL},
+    {"(1 + 2", NULL},
+    // constants are folded the way C computes them
+    {"16 / 2 - 1", "7"},
+    {"(1 + 2) * 3 << 2", "36"},
+    {"- 7 / 2", "-3"},
+    {"- 7 % 2", "-1"},
+    {"!5 + ~0", "-1"},
+    {"NULL == 0", "1"},
+    {"a * (2 + 3)", "(* a 5)"},
+    {"f(3 + 4)", "(( f 7)"},
+    {"1 ? 2 : 3", "2"},
+    {"0 ? 2 : 3u", "3u"},
+    {"1 ? - 1 : 2u", "4294967295u"},
+    {"(1 ? - 1 : 2u) == 4294967295u", "1"},
+    {"a ? 2 : 3", "(? a (: 2 3))"},
+    {"1 / 0", "(/ 1 0)"},
+    {"1 % 0", "(% 1 0)"},
+    {"2147483647 + 1", "(+ 2147483647 1)"},
+    {"- 2147483647 - 1", "-2147483648"},
+    {"-(- 2147483647 - 1)", "(- -2147483648)"},
+    {"(- 2147483647 - 1) / - 1", "(/ -2147483648 -1)"},
+    {"(- 2147483647 - 1) % - 1", "(% -2147483648 -1)"},
+    {"- 7 % - 1", "0"},
+    {"65536 * 65536", "(* 65536 65536)"},
+    {"65536u * 65536", "0u"},
+    {"4294967295u + 1", "0u"},
+    {"0u - 1", "4294967295u"},
+    {"0u - 1 > 0", "1"},
+    {"- 1 < 0u", "0"},
+    {"-(1u)", "4294967295u"},
+    {"1 << 30", "1073741824"},
+    {"1 << 31", "(<< 1 31)"},
+    {"1u << 31", "2147483648u"},
+    {"1 << 32", "(<< 1 32)"},
+    {"- 1 << 1", "(<< -1 1)"},
+    {"- 8 >> 1", "(>> -8 1)"},
+    {"8u >> 1u", "4u"},
+    {"1l + 1", "(+ 1 1)"},
+    {"3000000000 - 1", "(- 3000000000 1)"},
+    // literals no int holds are kept whole, not folded
+    {"4294967296 + 1", "(+ 4294967296 1)"},
+    {"0xFFFFFFFFFF", "1099511627775"},
+    {"0xFFFFFFFFFF & 255", "(& 1099511627775 255)"},
+};
+
+/* appends `expr` and the rest of its list, each after `sep`
+ */
+static void dump(buf_t *out, vcc_lexer_t *lexer, vcc_expr_t *expr,
+                 const char *sep) {
+  for (; expr; expr = expr->next, sep = " ") {
+    if (expr->arity == 0 && expr->type == EXPR_TYPE_UINT) {
+      out->len += sprintf(out->s + out->len, "%s%uu", sep,
+                          (unsigned)expr->literal.number);
+    } else if (expr->arity == 0 && expr->opr == TOKEN_INT) {
+      out->len += sprintf(out->s + out->len, "%s%lld", sep,
+                          (long long)expr->literal.number);
+    } else if (expr->arity == 0) {
+      out->len += sprintf(out->s + out->len, "%s%s", sep,
+                          vcc_symtbl_name(lexer->symtbl, expr->literal.atom,
+                                          NULL));
+    } else {
+      out->len += sprintf(out->s + out->len, "%s(%s", sep,
+                          token_spellings[expr->opr]);
+      dump(out, lexer, expr->lhs, " ");
+      dump(out, lexer, expr->rhs, " ");
+      out->len += sprintf(out->s + out->len, ")");
+    }
+  }
+}
+
+static int check(const case_t *c, int share) {
+  char src[256];
+  int len = snprintf(src, sizeof(src), "return %s;", c->src);
+  vcc_lexer_t *lexer = vcc_lexer_new_from_mem("case", src, len);
+  vcc_tokbuf_t *tokens = vcc_lex_all(lexer);
+  vcc_parser_init_tokens(lexer, tokens);
+  vcc_parser_share_exprs(share);
+  vcc_node_t *node = vcc_parse();
+  int error = !vcc_parser_continuable();
+  buf_t *got = buf_new(1024);
+  if (node) {
+    dump(got, lexer, node->value.stmt->expr, "");
+  }
+  got->s[got->len] = '\0';
+  int ok = c->expected ? !error && !strcmp(got->s, c->expected) : error;
+  if (!ok) {
+    fprintf(stderr, "`%s` gave `%s`%s%s\n", c->src, got->s,
+            error ? " and an error" : "", share ? " with sharing" : "");
+  }
+  buf_free(got);
+  vcc_parser_finish();
+  vcc_tokbuf_free(tokens);
+  vcc_lexer_free(lexer);
+  return !ok;
+}
+
+/* equal subtrees without side effects are one node once shared, the
+ * others stay apart
+ */
+static int check_sharing() {
+  static const char src[] = "return (a[i + 1] & 255) == (a[i + 1] & 255), "
+                            "f(x) + f(x), y++ - y++, (b = 1) + (b = 1), "
+                            "~c * ~c;";
+  vcc_lexer_t *lexer = vcc_lexer_new_from_mem("share", src, strlen(src));
+  vcc_tokbuf_t *tokens = vcc_lex_all(lexer);
+  vcc_parser_init_tokens(lexer, tokens);
+  vcc_parser_share_exprs(1);
+  vcc_node_t *node = vcc_parse();
+  int failed = !node || !vcc_parser_continuable();
+  vcc_expr_t *e[5] = {NULL};
+  vcc_expr_t *list = failed ? NULL : node->value.stmt->expr;
+  for (int i = 4; i >= 0 && list; --i) {
+    e[i] = i ? list->rhs : list;
+    list = list->lhs;
+  }
+  for (int i = 0; i < 5; ++i) {
+    failed |= !e[i] || !e[i]->lhs || !e[i]->rhs;
+  }
+  if (!failed) {
+    failed |= e[0]->lhs != e[0]->rhs || !e[0]->lhs->shared;
+    failed |= e[1]->lhs == e[1]->rhs || e[1]->lhs->lhs != e[1]->rhs->lhs;
+    failed |= e[2]->lhs == e[2]->rhs;
+    failed |= e[3]->lhs == e[3]->rhs;
+    failed |= e[4]->lhs != e[4]->rhs;
+  }
+  vcc_share_stats_t stats = vcc_parser_share_stats();
+  fprintf(stderr, "shared: %ld built, %ld allocated\n", stats.built,
+          stats.allocated);
+  failed |= stats.built <= stats.allocated;
+  if (failed) {
+    fprintf(stderr, "`%s` was not shared right\n", src);
+  }
+  vcc_parser_finish();
+  vcc_tokbuf_free(tokens);
+  vcc_lexer_free(lexer);
+  return failed;
+}
+
+int main() {
+  int failed = 0;
+  for (size_t i = 0; i < sizeof(cases) / sizeof(*cases); ++i) {
+    failed |= check(&cases[i], 0);
+    failed |= check(&cases[i], 1);
+  }
+  failed |= check_sharing();
+  fprintf(stderr, "%s\n", failed ? "failed" : "ok");
+  return failed;
+}
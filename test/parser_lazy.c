@@ -0,0 +1,165 @@
+/* function bodies skipped by a lazy parse must parse on demand to the
+ * statements a full parse gives, whether asked for after the parse or in
+ * the middle of it, a body that does not parse only fails when asked, and
+ * none is skipped when the parser's own arena would free it
+ */
+#include "../src/parser.h"
+
+#define FUNCS 2000
+
+static const char *func = "static inline unsigned long helper%d(int a, "
+                          "char *b) {\n"
+                          "  if (a < %d) {\n"
+                          "    return (a * 2 + %d) & 255;\n"
+                          "  }\n"
+                          "  int c = a;\n"
+                          "  return f(a, b[a - %d]) - 1;\n"
+                          "}\n"
+                          "static void helper%d_decl(void);\n";
+
+static int same_expr(vcc_expr_t *a, vcc_expr_t *b) {
+  if (!a || !b) {
+    return !a && !b;
+  }
+  if (a->arity != b->arity || a->opr != b->opr || a->type != b->type) {
+    return 0;
+  }
+  if (a->arity == 0 && a->literal.number != b->literal.number) {
+    return 0;
+  }
+  return same_expr(a->lhs, b->lhs) && same_expr(a->rhs, b->rhs) &&
+         same_expr(a->next, b->next);
+}
+
+static int same_block(vcc_block_t *a, vcc_block_t *b);
+
+static int same_node(vcc_node_t *a, vcc_node_t *b) {
+  if (!a || !b) {
+    return !a && !b;
+  }
+  if (a->type != b->type) {
+    return 0;
+  }
+  if (a->type == VCC_NODE_FUNC) {
+    vcc_func_t *fa = a->value.func, *fb = b->value.func;
+    return fa->name == fb->name && fa->arity == fb->arity &&
+           fa->first == fb->first && fa->last == fb->last &&
+           same_block(vcc_func_body(fa), vcc_func_body(fb));
+  }
+  vcc_stmt_t *sa = a->value.stmt, *sb = b->value.stmt;
+  return sa->type == sb->type && same_expr(sa->condition, sb->condition) &&
+         same_expr(sa->expr, sb->expr);
+}
+
+static int same_block(vcc_block_t *a, vcc_block_t *b) {
+  if (!a || !b || a->count != b->count) {
+    return 0;
+  }
+  vcc_node_t *na = a->nodes, *nb = b->nodes;
+  for (; na && nb; na = na->next, nb = nb->next) {
+    if (!same_node(na, nb)) {
+      return 0;
+    }
+  }
+  return !na && !nb;
+}
+
+/* parses all of `tokens`, lazily or not, with the bodies of every
+ * `asked`-th function parsed as soon as the function is
+ */
+static int parse(vcc_tokbuf_t *tokens, arena_t *arena, int lazy, int asked,
+                 vcc_node_t **nodes) {
+  int count = 0;
+  vcc_parser_init_tokens(NULL, tokens);
+  vcc_parser_set_arena(arena);
+  vcc_parser_lazy_bodies(lazy);
+  while (vcc_parser_continuable()) {
+    vcc_node_t *node = vcc_parse();
+    if (!node) {
+      continue;
+    }
+    if (asked && node->type == VCC_NODE_FUNC && count % asked == 0) {
+      vcc_func_body(node->value.func);
+    }
+    nodes[count++] = node;
+  }
+  vcc_parser_finish();
+  return count;
+}
+
+int main() {
+  buf_t *src = buf_new(FUNCS * 256);
+  for (int i = 0; i < FUNCS; ++i) {
+    src->len += sprintf(src->s + src->len, func, i, i, i, i % 7, i);
+  }
+  vcc_lexer_t *lexer = vcc_lexer_new_from_mem("lazy", src->s, src->len);
+  vcc_tokbuf_t *tokens = vcc_lex_all(lexer);
+  vcc_node_t **full = xalloc(FUNCS * 2 * sizeof(vcc_node_t *));
+  vcc_node_t **lazy = xalloc(FUNCS * 2 * sizeof(vcc_node_t *));
+  arena_t *full_arena = arena_new(AST_ARENA_CHUNK_SIZE);
+  int failed = 0;
+
+  int count = parse(tokens, full_arena, 0, 0, full);
+  failed |= count != FUNCS;
+  for (int asked = 0; asked <= 3; ++asked) {
+    arena_t *arena = arena_new(AST_ARENA_CHUNK_SIZE);
+    int n = parse(tokens, arena, 1, asked, lazy);
+    size_t skimmed = arena->used;
+    for (int i = 0; i < count && i < n; ++i) {
+      failed |= !same_node(full[i], lazy[i]);
+    }
+    if (n != count || failed) {
+      fprintf(stderr, "lazy parse with every %d asked: %d nodes of %d%s\n",
+              asked, n, count, failed ? ", not the same" : "");
+      failed = 1;
+    }
+    fprintf(stderr, "every %d asked: %zu bytes lazily, %zu in full\n", asked,
+            skimmed, full_arena->used);
+    failed |= asked == 0 && skimmed * 4 > full_arena->used;
+    arena_free(arena);
+  }
+
+  // without an arena of the caller's, bodies are parsed in full, the
+  // parser's own arena is gone after vcc_parser_finish()
+  vcc_parser_init_tokens(NULL, tokens);
+  vcc_parser_lazy_bodies(1);
+  int parsed = 0;
+  while (vcc_parser_continuable()) {
+    vcc_node_t *node = vcc_parse();
+    parsed += node && node->type == VCC_NODE_FUNC &&
+              node->value.func->body && !node->value.func->tokens;
+  }
+  vcc_parser_finish();
+  if (parsed != FUNCS) {
+    fprintf(stderr, "own arena: %d of %d bodies parsed\n", parsed, FUNCS);
+    failed = 1;
+  }
+
+  // an error in a body is only met when the body is asked for
+  char *bad = strstr(src->s + src->len / 2, "return (");
+  memcpy(bad, "return )", 8);
+  vcc_tokbuf_free(tokens);
+  vcc_lexer_free(lexer);
+  lexer = vcc_lexer_new_from_mem("lazy", src->s, src->len);
+  tokens = vcc_lex_all(lexer);
+  arena_t *arena = arena_new(AST_ARENA_CHUNK_SIZE);
+  int n = parse(tokens, arena, 1, 0, lazy);
+  int bodies = 0;
+  for (int i = 0; i < n; ++i) {
+    bodies += vcc_func_body(lazy[i]->value.func) != NULL;
+  }
+  if (n != FUNCS || bodies != FUNCS - 1) {
+    fprintf(stderr, "bad body: %d functions, %d bodies\n", n, bodies);
+    failed = 1;
+  }
+  arena_free(arena);
+
+  arena_free(full_arena);
+  xfree(lazy);
+  xfree(full);
+  vcc_tokbuf_free(tokens);
+  vcc_lexer_free(lexer);
+  buf_free(src);
+  fprintf(stderr, "%s\n", failed ? "failed" : "ok");
+  return failed;
+}
@@ -0,0 +1,108 @@
+/* parsing on threads must give the nodes of a serial parse in source
+ * order: a generated file of many top-level bodies is parsed once with
+ * vcc_parse() and again on several threads, with and without an error
+ */
+#include "../src/parser.h"
+
+#define BODIES 4000
+
+static const char *body = "if (a < %d) {\n"
+                          "return a * 2 + %d;\n"
+                          "if ((b)) {\n"
+                          "return f(a, %d) - 1;\n"
+                          "}\n"
+                          "}\n"
+                          "return (a - 1) / 3;\n";
+
+static int same_expr(vcc_expr_t *a, vcc_expr_t *b) {
+  if (!a || !b) {
+    return !a && !b;
+  }
+  if (a->arity != b->arity || a->opr != b->opr || a->type != b->type) {
+    return 0;
+  }
+  if (a->arity == 0 && a->literal.number != b->literal.number) {
+    return 0;
+  }
+  return same_expr(a->lhs, b->lhs) && same_expr(a->rhs, b->rhs) &&
+         same_expr(a->next, b->next);
+}
+
+static int same_node(vcc_node_t *a, vcc_node_t *b) {
+  if (!a || !b) {
+    return !a && !b;
+  }
+  if (a->type != b->type) {
+    return 0;
+  }
+  if (a->type != VCC_NODE_STMT) {
+    return 1;
+  }
+  vcc_stmt_t *sa = a->value.stmt, *sb = b->value.stmt;
+  return sa->type == sb->type && same_expr(sa->condition, sb->condition) &&
+         same_expr(sa->expr, sb->expr);
+}
+
+static int check(const char *name, buf_t *src, int error) {
+  vcc_lexer_t *lexer = vcc_lexer_new_from_mem(name, src->s, src->len);
+  vcc_tokbuf_t *tokens = vcc_lex_all(lexer);
+  arena_t *arena = arena_new(AST_ARENA_CHUNK_SIZE);
+  int cap = 1024, count = 0;
+  vcc_node_t **serial = xalloc(cap * sizeof(vcc_node_t *));
+  vcc_parser_init_tokens(lexer, tokens);
+  vcc_parser_set_arena(arena);
+  while (vcc_parser_continuable()) {
+    if (count == cap) {
+      vcc_node_t **grown = xalloc(2 * cap * sizeof(vcc_node_t *));
+      memcpy(grown, serial, cap * sizeof(vcc_node_t *));
+      xfree(serial);
+      serial = grown;
+      cap *= 2;
+    }
+    serial[count++] = vcc_parse();
+  }
+  vcc_parser_finish();
+
+  int failed = 0;
+  static const int threads[] = {1, 2, 4, 7, 0};
+  for (size_t t = 0; t < sizeof(threads) / sizeof(*threads); ++t) {
+    vcc_forest_t *forest = vcc_parse_all(lexer, tokens, threads[t]);
+    int same = forest->count == count && forest->error == error;
+    for (int i = 0; same && i < count; ++i) {
+      same = same_node(serial[i], forest->nodes[i]);
+    }
+    if (!same) {
+      fprintf(stderr, "%s on %d threads: %d nodes%s, %d nodes%s serially\n",
+              name, threads[t], forest->count,
+              forest->error ? " and an error" : "", count,
+              error ? " and an error" : "");
+      failed = 1;
+    }
+    vcc_forest_free(forest);
+  }
+  fprintf(stderr, "%s: %d tokens, %d nodes\n", name, tokens->count, count);
+  xfree(serial);
+  arena_free(arena);
+  vcc_tokbuf_free(tokens);
+  vcc_lexer_free(lexer);
+  return failed;
+}
+
+int main() {
+  buf_t *src = buf_new(BODIES * 128);
+  for (int i = 0; i < BODIES; ++i) {
+    src->len += sprintf(src->s + src->len, body, i, i, i);
+  }
+  int failed = check("bodies", src, 0);
+
+  // a stray brace at the top level and an error two thirds of the way
+  const char *at = strstr(src->s + src->len / 3, "if (");
+  memcpy(src->s + (at - src->s), "}}  ", 4);
+  at = strstr(src->s + 2 * src->len / 3, "return a");
+  memcpy(src->s + (at - src->s), "return )", 8);
+  failed |= check("error", src, 1);
+
+  buf_free(src);
+  fprintf(stderr, "%s\n", failed ? "failed" : "ok");
+  return failed;
+}
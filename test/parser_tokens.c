@@ -0,0 +1,69 @@
+/* parsing from a token buffer, or from a lexer thread through rings big
+ * and tiny, must give the same nodes as parsing straight from the lexer
+ */
+#include "../src/parser.h"
+
+static void dump_expr(buf_t *out, vcc_expr_t *expr) {
+  if (!expr) {
+    out->len += sprintf(out->s + out->len, "_");
+    return;
+  }
+  out->len += sprintf(out->s + out->len, "(%s %lld ", token_names[expr->opr],
+                      (long long)expr->literal.number);
+  dump_expr(out, expr->lhs);
+  dump_expr(out, expr->rhs);
+  out->len += sprintf(out->s + out->len, ")");
+}
+
+enum { STREAMED, BUFFERED, PIPED, PIPED_TINY, MODES };
+
+static const char *modes[] = {"streamed", "buffered", "piped", "piped tiny"};
+
+static buf_t *parse(const char *fname, int mode) {
+  buf_t *out = buf_new(1 << 16);
+  vcc_lexer_t *lexer = vcc_lexer_new(fname);
+  vcc_tokbuf_t *tokens = NULL;
+  vcc_lex_pipe_t *pipe = NULL;
+  if (mode == BUFFERED) {
+    tokens = vcc_lex_all(lexer);
+    vcc_parser_init_tokens(lexer, tokens);
+  } else if (mode == PIPED || mode == PIPED_TINY) {
+    pipe = vcc_lex_pipe_start(lexer, mode == PIPED ? 0 : 2);
+    vcc_parser_init_pipe(lexer, pipe);
+  } else {
+    vcc_parser_init(lexer);
+  }
+  while (vcc_parser_continuable()) {
+    vcc_node_t *node = vcc_parse();
+    if (node && node->type == VCC_NODE_STMT) {
+      out->len += sprintf(out->s + out->len, "%s ",
+                          stmt_types[node->value.stmt->type]);
+      dump_expr(out, node->value.stmt->condition);
+      dump_expr(out, node->value.stmt->expr);
+    }
+    out->len += sprintf(out->s + out->len, node ? "\n" : ".");
+  }
+  vcc_parser_finish();
+  vcc_lex_pipe_free(pipe);
+  vcc_tokbuf_free(tokens);
+  vcc_lexer_free(lexer);
+  return out;
+}
+
+int main(int argc, char *argv[]) {
+  int failed = 0;
+  for (int i = 1; i < argc; ++i) {
+    buf_t *streamed = parse(argv[i], STREAMED);
+    for (int mode = BUFFERED; mode < MODES; ++mode) {
+      buf_t *other = parse(argv[i], mode);
+      int bad = streamed->len != other->len ||
+                memcmp(streamed->s, other->s, streamed->len);
+      fprintf(stderr, "%s, %s: %s\n", argv[i], modes[mode],
+              bad ? "FAILED" : "ok");
+      failed |= bad;
+      buf_free(other);
+    }
+    buf_free(streamed);
+  }
+  return failed;
+}
@@ -0,0 +1,9 @@
+/* a classic include guard, only the first include counts
+ */
+#ifndef GUARDED_H
+#define GUARDED_H
+
+#define GUARDED_H_VALUE 42
+int guarded;
+
+#endif
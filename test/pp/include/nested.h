@@ -0,0 +1,5 @@
+#if !defined(NESTED_H)
+#define NESTED_H
+#include <guarded.h>
+int nested;
+#endif
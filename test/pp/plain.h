@@ -0,0 +1,3 @@
+/* no guard, each include gives a value of its own
+ */
+int plain = VALUE;
@@ -0,0 +1,207 @@
+/* the preprocessor: macros and conditionals give the tokens they should,
+ * errors are caught, and a translation unit with guarded, #pragma once and
+ * plain headers lexes each header only once, however many times and from
+ * however many threads it is preprocessed
+ */
+#include "../src/preproc.h"
+#include <libgen.h>
+#include <limits.h>
+
+#define THREADS 4
+
+typedef struct {
+  const char *src;
+  const char *expected; // tokens joined by spaces, NULL for an error
+} case_t;
+
+static const case_t cases[] = {
+    {"#define N 10\nint a = N;", "int a = 10 ;"},
+    {"#define SQ(x) ((x) * (x))\nSQ(1 + 2)", "( ( 1 + 2 ) * ( 1 + 2 ) )"},
+    {"#define F (x)\nF", "( x )"},
+    {"#define F(x) x\nF", "F"},
+    {"#define F() 1\nF()", "1"},
+    {"#define CAT(a, b) a ## b\nCAT(foo, 1) CAT(, x) CAT(y, )",
+     "foo1 x y"},
+    {"#define CAT(a, b) a ## b\nCAT(<, <=) CAT(-, >)", "<<= ->"},
+    {"#define STR(x) #x\nSTR(a  +  b) STR( \"q\\n\" ) STR()",
+     "\"a + b\" \"\\\"q\\\\n\\\"\" \"\""},
+    {"#define STR(x) #x\n#define XSTR(x) STR(x)\n#define V 4\nXSTR(V) STR(V)",
+     "\"4\" \"V\""},
+    {"#define LOG(f, ...) p(f, ## __VA_ARGS__)\nLOG(1) LOG(1, 2, 3)",
+     "p ( 1 ) p ( 1 , 2 , 3 )"},
+    {"#define V(...) [__VA_ARGS__]\nV() V(a, (b, c))", "[ ] [ a , ( b , c ) ]"},
+    {"#define G(args...) g(args)\nG(1, 2)", "g ( 1 , 2 )"},
+    {"#define foo foo bar\nfoo", "foo bar"},
+    {"#define a b\n#define b a\na b", "a b"},
+    {"#define f(x) x f\nf(1)(2)", "1 f ( 2 )"},
+    {"#define f(x) (x + 1)\nf(f(1))", "( ( 1 + 1 ) + 1 )"},
+    {"#define int long\nint x;", "long x ;"},
+    {"#define X 1\n#undef X\nX", "X"},
+    {"#define X 1\n#define X 2\nX", "2"},
+    {"#if 1\na\n#elif 1\nb\n#else\nc\n#endif", "a"},
+    {"#if 0\na\n#elif 2 > 1\nb\n#else\nc\n#endif", "b"},
+    {"#if 0\na\n#elif 0\nb\n#else\nc\n#endif", "c"},
+    {"#if 0\n#if 1\na\n#else\nb\n#endif\n#endif\nc", "c"},
+    {"#ifdef X\na\n#endif\n#ifndef X\nb\n#endif", "b"},
+    {"#define X\n#if defined X && defined(X) && !defined Y\na\n#endif", "a"},
+    {"#if (1 ? 2 : 3) == 2 && -1 < 0 && (7 % 4) << 1 == 6 && ~0 == -1\na\n"
+     "#endif",
+     "a"},
+    {"#if 0 && 1 / 0\na\n#else\nb\n#endif", "b"},
+    {"#if 'A' == 65 && '\\n' == 10 && UNDEFINED == 0\na\n#endif", "a"},
+    {"#define V 3\n#if V * V == 9\na\n#endif", "a"},
+    {"#if __STDC__ && __STDC_VERSION__ >= 201112L\na\n#endif", "a"},
+    {"#\n# pragma whatever\n#line 10\na", "a"},
+    {"a \\\nb", "a b"},
+    {"#define LONG \\\n  1 + \\\n  2\nLONG", "1 + 2"},
+    {"#if 1\na", NULL},
+    {"#endif", NULL},
+    {"#else", NULL},
+    {"#error stop here", NULL},
+    {"#if 1 / 0\n#endif", NULL},
+    {"#if (1\n#endif", NULL},
+    {"#define F(x) x\nF(1", NULL},
+    {"#define F(x, y) x\nF(1)", NULL},
+    {"#define C(a, b) a ## b\nC(+, /)", NULL},
+    {"#define S(x) #y", NULL},
+    {"#define B ## x", NULL},
+    {"#include \"no/such/file.h\"", NULL},
+    {"#bogus", NULL},
+};
+
+/* appends the tokens of `tokens` to `out`, joined by spaces
+ */
+static void spell_all(vcc_tokbuf_t *tokens, char *out, int cap) {
+  vcc_symtbl_t *symtbl = vcc_symtbl_global();
+  int n = 0;
+  out[0] = '\0';
+  for (int i = 0; i < tokens->count && n < cap; ++i) {
+    vtoken_t t;
+    vcc_tokbuf_get(tokens, i, &t);
+    const char *sep = i ? " " : "";
+    switch (t.type) {
+    case TOKEN_EOF:
+      break;
+    case TOKEN_INT:
+      n += snprintf(out + n, cap - n, "%s%lld", sep, (long long)t.value.i);
+      break;
+    case TOKEN_STR:
+      n += snprintf(out + n, cap - n, "%s\"%s\"", sep,
+                    vcc_symtbl_name(symtbl, t.value.atom, NULL));
+      break;
+    case TOKEN_IDENTIFIER:
+    case TOKEN_CHAR:
+      n += snprintf(out + n, cap - n, "%s%s", sep,
+                    vcc_symtbl_name(symtbl, t.value.atom, NULL));
+      break;
+    default:
+      n += snprintf(out + n, cap - n, "%s%s", sep, token_spellings[t.type]);
+      break;
+    }
+  }
+}
+
+static int check(const case_t *c) {
+  char got[1024];
+  vcc_lexer_t *lexer = vcc_lexer_new_from_mem("case", c->src, strlen(c->src));
+  vcc_pp_t *pp = vcc_pp_new();
+  vcc_tokbuf_t *tokens = vcc_pp_run(pp, lexer);
+  spell_all(tokens, got, sizeof(got));
+  int ok = c->expected ? !tokens->error && !strcmp(got, c->expected)
+                       : tokens->error;
+  if (!ok) {
+    fprintf(stderr, "`%s` gave `%s`%s\n", c->src, got,
+            tokens->error ? " and an error" : "");
+  }
+  vcc_tokbuf_free(tokens);
+  vcc_pp_free(pp);
+  vcc_lexer_free(lexer);
+  return !ok;
+}
+
+typedef struct {
+  const char *fname;
+  char dirs[2][PATH_MAX];
+  char out[4096];
+  int error;
+} run_t;
+
+static void *run(void *arg) {
+  run_t *r = arg;
+  vcc_lexer_t *lexer = vcc_lexer_new_mmap(r->fname);
+  vcc_pp_t *pp = vcc_pp_new();
+  vcc_pp_add_include_dir(pp, r->dirs[0]);
+  vcc_pp_add_include_dir(pp, r->dirs[1]);
+  vcc_tokbuf_t *tokens = vcc_pp_run(pp, lexer);
+  spell_all(tokens, r->out, sizeof(r->out));
+  r->error = tokens->error;
+  vcc_tokbuf_free(tokens);
+  vcc_pp_free(pp);
+  vcc_lexer_free(lexer);
+  return NULL;
+}
+
+/* the translation unit at `fname` includes four headers nine times, once
+ * they are cached nothing is lexed again
+ */
+static int check_includes(const char *fname) {
+  static const char *expected = "int guarded ; int once ; int nested ; "
+                                "int plain = 1 ; int plain = 2 ; "
+                                "int ok = 42 ;";
+  char copy[PATH_MAX];
+  snprintf(copy, sizeof(copy), "%s", fname);
+  const char *dir = dirname(copy);
+  run_t runs[THREADS + 1];
+  for (int i = 0; i <= THREADS; ++i) {
+    runs[i].fname = fname;
+    snprintf(runs[i].dirs[0], PATH_MAX, "%s/include", dir);
+    snprintf(runs[i].dirs[1], PATH_MAX, "%s", dir);
+  }
+  int failed = 0;
+
+  vcc_pp_stats_t before = vcc_pp_stats();
+  run(&runs[0]);
+  vcc_pp_stats_t first = vcc_pp_stats();
+  if (first.lexed - before.lexed != 4 ||
+      first.skipped - before.skipped != 4 ||
+      first.replayed - before.replayed != 1) {
+    fprintf(stderr, "first run: %ld lexed, %ld skipped, %ld replayed\n",
+            first.lexed - before.lexed, first.skipped - before.skipped,
+            first.replayed - before.replayed);
+    failed = 1;
+  }
+
+  pthread_t threads[THREADS];
+  for (int i = 1; i <= THREADS; ++i) {
+    pthread_create(&threads[i - 1], NULL, run, &runs[i]);
+  }
+  for (int i = 1; i <= THREADS; ++i) {
+    pthread_join(threads[i - 1], NULL);
+  }
+  vcc_pp_stats_t after = vcc_pp_stats();
+  if (after.lexed != first.lexed ||
+      after.replayed - first.replayed != THREADS * 5) {
+    fprintf(stderr, "cached runs: %ld lexed, %ld replayed\n",
+            after.lexed - first.lexed, after.replayed - first.replayed);
+    failed = 1;
+  }
+  for (int i = 0; i <= THREADS; ++i) {
+    if (runs[i].error || strcmp(runs[i].out, expected)) {
+      fprintf(stderr, "run %d gave `%s`\n", i, runs[i].out);
+      failed = 1;
+    }
+  }
+  return failed;
+}
+
+int main(int argc, char *argv[]) {
+  int failed = 0;
+  for (size_t i = 0; i < sizeof(cases) / sizeof(*cases); ++i) {
+    failed |= check(&cases[i]);
+  }
+  for (int i = 1; i < argc; ++i) {
+    failed |= check_includes(argv[i]);
+  }
+  printf("%s\n", failed ? "failed" : "ok");
+  return failed;
+}
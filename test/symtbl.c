@@ -0,0 +1,106 @@
+/* checks the string interner: one atom per spelling, stable names, and
+ * agreement between threads interning into a shared table at once
+ */
+#include "../src/lexer.h"
+#include "../src/symtbl.h"
+
+#define NAMES 50000
+#define THREADS 8
+
+static char names[NAMES][16];
+
+typedef struct {
+  vcc_symtbl_t *tbl;
+  int seed;
+  vcc_atom_t atoms[NAMES];
+} job_t;
+
+static void *worker(void *arg) {
+  job_t *job = arg;
+  // every thread walks the names in its own order
+  for (int i = 0; i < NAMES; ++i) {
+    int n = (int)(((long)i * 7919 + job->seed * 104729) % NAMES);
+    job->atoms[n] = vcc_symtbl_intern(job->tbl, names[n], strlen(names[n]));
+  }
+  return NULL;
+}
+
+static int check_table(vcc_symtbl_t *tbl, vcc_atom_t *atoms) {
+  for (int i = 0; i < NAMES; ++i) {
+    int len;
+    const char *s = vcc_symtbl_name(tbl, atoms[i], &len);
+    if (len != (int)strlen(names[i]) || strcmp(s, names[i])) {
+      printf("name of atom %u is `%s`, expected `%s`\n", atoms[i], s,
+             names[i]);
+      return 1;
+    }
+    if (vcc_symtbl_intern(tbl, names[i], len) != atoms[i]) {
+      printf("`%s` interned twice\n", names[i]);
+      return 1;
+    }
+  }
+  if (vcc_symtbl_count(tbl) != NAMES) {
+    printf("%d names stored, expected %d\n", vcc_symtbl_count(tbl), NAMES);
+    return 1;
+  }
+  return 0;
+}
+
+static int check_lexer() {
+  static const char src[] = "foo bar foo \"foo\" 'f' f";
+  vcc_atom_t atoms[2][6];
+  for (int l = 0; l < 2; ++l) {
+    vcc_lexer_t *lexer = vcc_lexer_new_from_mem("atoms", src, strlen(src));
+    vcc_lexer_set_symtbl(lexer, vcc_symtbl_global());
+    for (int i = 0; i < 6; ++i) {
+      vtoken_t *t = vcc_lex(lexer);
+      atoms[l][i] = t->value.atom;
+      vtoken_free(lexer, t);
+    }
+    vcc_lexer_free(lexer);
+  }
+  // foo, bar, foo, "foo", 'f', f
+  return atoms[0][0] != atoms[0][2] || atoms[0][0] != atoms[0][3] ||
+         atoms[0][0] == atoms[0][1] || atoms[0][4] != atoms[0][5] ||
+         memcmp(atoms[0], atoms[1], sizeof(atoms[0]));
+}
+
+int main() {
+  for (int i = 0; i < NAMES; ++i) {
+    snprintf(names[i], sizeof(names[i]), "%s_%d", i % 3 ? "name" : "n", i);
+  }
+  int failed = 0;
+
+  job_t *single = xalloc(sizeof(job_t));
+  single->tbl = vcc_symtbl_new();
+  worker(single);
+  failed |= check_table(single->tbl, single->atoms);
+  printf("single: %s\n", failed ? "FAILED" : "ok");
+  vcc_symtbl_free(single->tbl);
+  xfree(single);
+
+  vcc_symtbl_t *shared = vcc_symtbl_new_shared(8);
+  job_t *jobs = xalloc(sizeof(job_t) * THREADS);
+  pthread_t threads[THREADS];
+  for (int i = 0; i < THREADS; ++i) {
+    jobs[i].tbl = shared;
+    jobs[i].seed = i;
+    pthread_create(&threads[i], NULL, worker, &jobs[i]);
+  }
+  for (int i = 0; i < THREADS; ++i) {
+    pthread_join(threads[i], NULL);
+  }
+  int bad = check_table(shared, jobs[0].atoms);
+  for (int i = 1; i < THREADS; ++i) {
+    bad |= memcmp(jobs[0].atoms, jobs[i].atoms, sizeof(jobs[0].atoms)) != 0;
+  }
+  printf("shared: %s\n", bad ? "FAILED" : "ok");
+  failed |= bad;
+  vcc_symtbl_free(shared);
+  xfree(jobs);
+
+  bad = check_lexer();
+  printf("lexer: %s\n", bad ? "FAILED" : "ok");
+  failed |= bad;
+  return failed;
+}
@@ -0,0 +1,104 @@
+/* trace points record only within both their compiled ceiling and the
+ * level set at run time, each thread keeps the newest records in its own
+ * ring, and a dump decodes to a line for each record
+ */
+#define TRACE_CEILING TRACE_TOKEN
+#define TRACE_CEILING_GENERATOR TRACE_OFF
+#include "../src/parser.h"
+#include "../src/trace.h"
+#include <pthread.h>
+
+#define THREADS 4
+#define EXTRA 100
+
+/* lines of a decoded dump of every ring that are events named `name`
+ */
+static int count(const char *name) {
+  FILE *dump = tmpfile();
+  char *text = NULL;
+  size_t size = 0;
+  FILE *out = open_memstream(&text, &size);
+  int ok = vcc_trace_dump(dump);
+  rewind(dump);
+  ok = ok && vcc_trace_decode(dump, out);
+  fclose(out);
+  fclose(dump);
+  int n = 0;
+  char needle[64];
+  snprintf(needle, sizeof(needle), " %s ", name);
+  for (char *line = text; ok && line && *line;) {
+    char *end = strchr(line, '\n');
+    *end = '\0';
+    n += strstr(line, needle) != NULL;
+    line = end + 1;
+  }
+  free(text);
+  return ok ? n : -1;
+}
+
+static void *flood(void *arg) {
+  (void)arg;
+  for (int i = 0; i < TRACE_RING_SIZE + EXTRA; ++i) {
+    vtrace(PARSER, TRACE_INFO, TRACE_EV_EXPECT, TOKEN_LPAREN, i, 1);
+  }
+  return NULL;
+}
+
+int main() {
+  int failed = 0;
+  failed |= !vcc_trace_configure("parser=info,lexer=2");
+  // a spec with a bad part sets nothing
+  failed |= vcc_trace_configure("nothing=1") || vcc_trace_configure("parser");
+  failed |= vcc_trace_configure("parser=12abc") ||
+            vcc_trace_configure("lexer=debug,parser=") ||
+            vcc_trace_configure("lexer=1,parser=-1");
+  failed |= vcc_trace_levels[TRACE_PARSER] != TRACE_INFO ||
+            vcc_trace_levels[TRACE_LEXER] != TRACE_INFO;
+  // levels past the last are the last
+  failed |= !vcc_trace_configure("generator=99") ||
+            vcc_trace_levels[TRACE_GENERATOR] != TRACE_TOKEN;
+
+  // within the level, above it, and above the ceiling of the generator
+  vtrace(PARSER, TRACE_INFO, TRACE_EV_SKIP_BODY, 1, 2, 0);
+  vtrace(PARSER, TRACE_DEBUG, TRACE_EV_CONSUME, TOKEN_LPAREN, TOKEN_EOF, 0);
+  vcc_trace_set_level(TRACE_GENERATOR, TRACE_TOKEN);
+  vtrace(GENERATOR, TRACE_ERROR, TRACE_EV_PARSE_ERROR, 1, 2, 0);
+  if (count("skip-body") != 1 || count("consume") != 0 ||
+      count("parse-error") != 0) {
+    fprintf(stderr, "levels were not kept to\n");
+    failed = 1;
+  }
+
+  // every thread keeps its newest records
+  pthread_t threads[THREADS];
+  for (int i = 0; i < THREADS; ++i) {
+    pthread_create(&threads[i], NULL, flood, NULL);
+  }
+  for (int i = 0; i < THREADS; ++i) {
+    pthread_join(threads[i], NULL);
+  }
+  int n = count("expect");
+  fprintf(stderr, "threads: %d records kept\n", n);
+  failed |= n != THREADS * TRACE_RING_SIZE;
+
+#ifdef ENABLE_TRACE
+  // the parser traces each token it reads when it was built to
+  static const char src[] = "return (1 + a) * 2;";
+  vcc_lexer_t *lexer = vcc_lexer_new_from_mem("trace", src, strlen(src));
+  vcc_tokbuf_t *tokens = vcc_lex_all(lexer);
+  vcc_trace_set_level(TRACE_PARSER, TRACE_TOKEN);
+  vcc_parser_init_tokens(lexer, tokens);
+  while (vcc_parser_continuable()) {
+    vcc_parse();
+  }
+  vcc_parser_finish();
+  n = count("advance");
+  fprintf(stderr, "parser: %d tokens, %d advances\n", tokens->count, n);
+  failed |= n != tokens->count;
+  vcc_tokbuf_free(tokens);
+  vcc_lexer_free(lexer);
+#endif
+
+  fprintf(stderr, "%s\n", failed ? "failed" : "ok");
+  return failed;
+}
@@ -0,0 +1,76 @@
+#!/usr/bin/env python3
+"""Generates the keyword perfect hash used by identifier_type() in
+src/lexer.c.
+
+The hash is keyed on the length and the first, second and last chars of an
+identifier:
+
+    h = (len * A + id[0] * B + id[1] * C + id[len - 1] * D) & (SIZE - 1)
+
+This script searches for the smallest multipliers that give every C keyword
+its own slot and prints the tables to paste into src/lexer.c.
+"""
+
+import itertools
+
+# (spelling, token suffix), order does not matter
+KEYWORDS = [
+    ("auto", "AUTO"), ("break", "BREAK"), ("case", "CASE"),
+    ("char", "CHAR"), ("const", "CONST"), ("continue", "CONTINUE"),
+    ("default", "DEFAULT"), ("do", "DO"), ("double", "DOUBLE"),
+    ("else", "ELSE"), ("enum", "ENUM"), ("extern", "EXTERN"),
+    ("float", "FLOAT"), ("for", "FOR"), ("goto", "GOTO"), ("if", "IF"),
+    ("inline", "INLINE"), ("int", "INT"), ("long", "LONG"),
+    ("NULL", "NULL"), ("register", "REGISTER"), ("restrict", "RESTRICT"),
+    ("return", "RETURN"), ("short", "SHORT"), ("signed", "SIGNED"),
+    ("sizeof", "SIZEOF"), ("static", "STATIC"), ("struct", "STRUCT"),
+    ("switch", "SWITCH"), ("typedef", "TYPEDEF"), ("union", "UNION"),
+    ("unsigned", "UNSIGNED"), ("void", "VOID"), ("volatile", "VOLATILE"),
+    ("while", "WHILE"), ("_Alignas", "ALIGNAS"), ("_Alignof", "ALIGNOF"),
+    ("_Atomic", "ATOMIC"), ("_Bool", "BOOL"), ("_Complex", "COMPLEX"),
+    ("_Generic", "GENERIC"), ("_Imaginary", "IMAGINARY"),
+    ("_Noreturn", "NORETURN"), ("_Static_assert", "STATIC_ASSERT"),
+    ("_Thread_local", "THREAD_LOCAL"),
+]
+
+SIZE = 128
+
+
+def slot(kw, a, b, c, d):
+    return (len(kw) * a + ord(kw[0]) * b + ord(kw[1]) * c +
+            ord(kw[-1]) * d) & (SIZE - 1)
+
+
+def search():
+    for a, b, c, d in itertools.product(range(1, 32), repeat=4):
+        slots = {slot(kw, a, b, c, d) for kw, _ in KEYWORDS}
+        if len(slots) == len(KEYWORDS):
+            return a, b, c, d
+    raise SystemExit("no perfect hash found, grow SIZE")
+
+
+def main():
+    a, b, c, d = search()
+    print("#define KW_HASH_SIZE %d" % SIZE)
+    macro = [
+        "#define KW_HASH(id, len)",
+        "  (((len) * %d + (id)[0] * %d + (id)[1] * %d + (id)[(len)-1] * %d) &"
+        % (a, b, c, d),
+    ]
+    for line in macro:
+        print(line.ljust(79) + "\\")
+    print("   (KW_HASH_SIZE - 1))")
+    print()
+    print("static const struct {")
+    print("  char s[15];")
+    print("  uint8_t len;")
+    print("  uint8_t type;")
+    print("} kw_slots[KW_HASH_SIZE] = {")
+    for kw, tok in sorted(KEYWORDS, key=lambda k: slot(k[0], a, b, c, d)):
+        print("    [%d] = {\"%s\", %d, TOKEN_KWORD_%s},"
+              % (slot(kw, a, b, c, d), kw, len(kw), tok))
+    print("};")
+
+
+if __name__ == "__main__":
+    main()